@@ -0,0 +1,66 @@
+#ifndef MSA_BENCH_BENCH_HPP
+#define MSA_BENCH_BENCH_HPP
+
+// Common definitions for the benchmarks built by 'make bench'.
+
+#include "msa.hpp"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace msa { namespace bench {
+
+	typedef struct result_type
+	{
+		std::string name;
+		size_t ops;
+		size_t runs;
+		// the time per op of the median, fastest and slowest runs
+		double nanos_per_op;
+		double min_nanos_per_op;
+		double max_nanos_per_op;
+	} Result;
+
+	// benchmarks write what they compute here so the work cannot be optimized out
+	extern volatile long long sink;
+
+	// how many times each benchmark is repeated; the median run is reported so that
+	// one slow run does not move the result
+	extern size_t run_count;
+
+	/**
+	 * Calls func with each index in [0, ops) once per run and records the time per
+	 * call of the median run.
+	 */
+	template<class F> void measure(std::vector<Result> &results, const std::string &name, size_t ops, F func)
+	{
+		std::vector<double> per_op;
+		for (size_t r = 0; r < run_count; r++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < ops; i++)
+			{
+				func(i);
+			}
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			per_op.push_back(std::chrono::duration<double, std::nano>(end - start).count() / ops);
+		}
+		std::sort(per_op.begin(), per_op.end());
+		results.push_back(Result {name, ops, run_count, per_op[per_op.size() / 2], per_op.front(), per_op.back()});
+	}
+
+	// starts a full MSA instance that logs only errors to a file and has no input devices,
+	// for benchmarks of modules that need their threads running. extra_config is added
+	// to the end of its config. Returns NULL if it could not be started.
+	extern msa::Handle start_instance(const std::string &extra_config = "");
+	extern void stop_instance(msa::Handle hdl);
+
+	#define MSA_BENCHMARK(name)		extern void name(std::vector<Result> &results);
+	#include "benchmarks.hpp"
+	#undef MSA_BENCHMARK
+
+} }
+
+#endif
@@ -0,0 +1,19 @@
+// The benchmarks that are run by 'make bench'.
+
+// Define the MSA_BENCHMARK macro to arrange the benchmarks as needed, and then include this file.
+// MSA_BENCHMARK will declare benchmarks with the following arguments:
+// MSA_BENCHMARK(func-name) where func-name appends its results to the vector of Result it is given
+// This file should only be included from bench code.
+
+#ifndef MSA_BENCHMARK
+	#error "cannot include benchmark list before MSA_BENCHMARK macro is defined"
+#endif
+
+MSA_BENCHMARK(cfg_benchmarks)
+MSA_BENCHMARK(event_benchmarks)
+MSA_BENCHMARK(log_benchmarks)
+MSA_BENCHMARK(var_benchmarks)
+MSA_BENCHMARK(cmd_benchmarks)
+MSA_BENCHMARK(thread_benchmarks)
+MSA_BENCHMARK(trace_benchmarks)
+MSA_BENCHMARK(memory_benchmarks)
@@ -0,0 +1,185 @@
+/* Benchmarks for loading a large config file and looking up typed values in it. */
+
+#include "bench.hpp"
+#include "cfg/cfg.hpp"
+#include "util/string.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+namespace msa { namespace bench {
+
+	static const char *GENERATED_PATH = "msa-bench-generated.cfg";
+	static const int SECTION_COUNT = 400;
+	static const int KEYS_PER_SECTION = 50;
+
+	typedef struct lookup_type
+	{
+		const msa::cfg::Section *section;
+		std::string key;
+	} Lookup;
+
+	static const std::map<std::string, int> LEVEL_NAMES = {
+		{"TRACE", 0}, {"DEBUG", 1}, {"INFO", 2}, {"WARN", 3}, {"ERROR", 4}
+	};
+	static const char *LEVEL_VALUES[] = {"trace", "Debug", "INFO", "warn", "error"};
+
+	static void generate_config(const char *path);
+	static msa::cfg::Config *legacy_load(const char *path);
+	static int legacy_get_int(const msa::cfg::Section &sec, const std::string &key);
+	static int legacy_get_enum(const msa::cfg::Section &sec, const std::string &key);
+
+	extern void cfg_benchmarks(std::vector<Result> &results)
+	{
+		generate_config(GENERATED_PATH);
+
+		msa::cfg::Config *conf = NULL;
+		measure(results, "cfg.load (getline parser)", 10, [&](size_t)
+		{
+			delete conf;
+			conf = legacy_load(GENERATED_PATH);
+		});
+		measure(results, "cfg.load", 10, [&](size_t)
+		{
+			delete conf;
+			conf = msa::cfg::load(GENERATED_PATH);
+		});
+		std::remove(GENERATED_PATH);
+		if (conf == NULL)
+		{
+			fprintf(stderr, "could not load generated config\n");
+			return;
+		}
+
+		std::vector<Lookup> int_keys;
+		std::vector<Lookup> enum_keys;
+		for (msa::cfg::Config::const_iterator sec = conf->begin(); sec != conf->end(); sec++)
+		{
+			for (int k = 0; k < KEYS_PER_SECTION; k++)
+			{
+				std::vector<Lookup> &list = (k % 2 == 0) ? int_keys : enum_keys;
+				list.push_back(Lookup {&sec->second, "KEY_" + std::to_string(k)});
+			}
+		}
+
+		const size_t ops = 1000000;
+		measure(results, "cfg.get_as<int>", ops, [&](size_t i)
+		{
+			const Lookup &l = int_keys[i % int_keys.size()];
+			sink += l.section->get_as<int>(l.key);
+		});
+		measure(results, "cfg.get_as<int> (stream parse)", ops, [&](size_t i)
+		{
+			const Lookup &l = int_keys[i % int_keys.size()];
+			sink += legacy_get_int(*l.section, l.key);
+		});
+		measure(results, "cfg.check_range+get_or<int>", ops, [&](size_t i)
+		{
+			const Lookup &l = int_keys[i % int_keys.size()];
+			l.section->check_range(l.key, -1000000, 1000000, false);
+			sink += l.section->get_or(l.key, 0);
+		});
+		measure(results, "cfg.get_or<double>", ops, [&](size_t i)
+		{
+			const Lookup &l = int_keys[i % int_keys.size()];
+			sink += (long long) l.section->get_or(l.key, 0.0);
+		});
+		measure(results, "cfg.get_as_enum", ops, [&](size_t i)
+		{
+			const Lookup &l = enum_keys[i % enum_keys.size()];
+			sink += l.section->get_as_enum(l.key, LEVEL_NAMES);
+		});
+		measure(results, "cfg.get_as_enum (upper-case copy)", ops, [&](size_t i)
+		{
+			const Lookup &l = enum_keys[i % enum_keys.size()];
+			sink += legacy_get_enum(*l.section, l.key);
+		});
+		delete conf;
+	}
+
+	static void generate_config(const char *path)
+	{
+		std::ofstream out(path);
+		for (int s = 0; s < SECTION_COUNT; s++)
+		{
+			out << "[section_" << s << "]" << std::endl;
+			for (int k = 0; k < KEYS_PER_SECTION; k++)
+			{
+				if (k % 2 == 0)
+				{
+					out << "key_" << k << " = " << (s * 7919 + k * 104729) % 2000000 - 1000000 << std::endl;
+				}
+				else
+				{
+					out << "key_" << k << " = " << LEVEL_VALUES[(s + k) % 5] << "  # comment" << std::endl;
+				}
+			}
+			out << std::endl;
+		}
+	}
+
+	// how load() read config files before it mapped them; errors and explicit
+	// indexes are left out since the generated config has neither
+	static msa::cfg::Config *legacy_load(const char *path)
+	{
+		std::ifstream config_file(path);
+		msa::cfg::Config *config = new msa::cfg::Config;
+		std::string line;
+		std::string section_name = "";
+		while (!getline(config_file, line).eof())
+		{
+			size_t pos = line.find('#');
+			if (pos != std::string::npos)
+			{
+				line = line.substr(0, pos);
+			}
+			msa::string::trim(line);
+			if (line == "")
+			{
+				continue;
+			}
+			if (line.front() == '[' && line.back() == ']')
+			{
+				section_name = line.substr(1, line.size() - 2);
+				msa::string::to_upper(section_name);
+				(*config)[section_name] = msa::cfg::Section(section_name);
+				continue;
+			}
+			size_t split_at = line.find('=');
+			std::string key = line.substr(0, split_at);
+			std::string val = line.substr(split_at + 1);
+			msa::string::trim(key);
+			msa::string::trim(val);
+			key.find('[');
+			msa::string::to_upper(key);
+			if (val.front() == '"' && val.back() == '"')
+			{
+				val = val.substr(1, val.size() - 2);
+			}
+			msa::cfg::Section &sec = (*config)[section_name];
+			sec.create_key(key);
+			sec.push(key, val);
+		}
+		return config;
+	}
+
+	// how get_as<int>() parsed values before they were cached
+	static int legacy_get_int(const msa::cfg::Section &sec, const std::string &key)
+	{
+		std::istringstream ss(sec[key]);
+		int typed;
+		ss >> typed;
+		return typed;
+	}
+
+	// how get_as_enum() looked up values before they were cached
+	static int legacy_get_enum(const msa::cfg::Section &sec, const std::string &key)
+	{
+		std::string val = sec[key];
+		msa::string::to_upper(val);
+		return LEVEL_NAMES.at(val);
+	}
+
+} }
@@ -0,0 +1,32 @@
+/* Benchmarks for splitting command lines and parsing their parameters. */
+
+#include "bench.hpp"
+#include "cmd/cmd.hpp"
+
+namespace msa { namespace bench {
+
+	extern void cmd_benchmarks(std::vector<Result> &results)
+	{
+		const std::string simple = "ECHO hello there";
+		const std::string quoted = "TIMER -r 30000 \"echo it's \\\"time\\\"\" 'and more' -x";
+		std::vector<std::string> tokens;
+		measure(results, "cmd.shell_tokenize (simple)", 1000000, [&](size_t)
+		{
+			tokens.clear();
+			msa::cmd::shell_tokenize(simple, tokens);
+			sink += tokens.size();
+		});
+		measure(results, "cmd.shell_tokenize (quoted)", 1000000, [&](size_t)
+		{
+			tokens.clear();
+			msa::cmd::shell_tokenize(quoted, tokens);
+			sink += tokens.size();
+		});
+		measure(results, "cmd.ParamList", 1000000, [&](size_t)
+		{
+			msa::cmd::ParamList params(tokens, "rx");
+			sink += params.arg_count();
+		});
+	}
+
+} }
@@ -0,0 +1,92 @@
+/* Benchmarks for creating events, passing them through the EDT's queue, and checking timers. */
+
+#include "bench.hpp"
+#include "event/dispatch.hpp"
+#include "event/timer.hpp"
+
+#include "util/util.hpp"
+
+namespace msa { namespace bench {
+
+	static const int DRAIN_POLL_MILLIS = 1;
+
+	static void wait_for_drain(msa::Handle hdl);
+	static void time_timers(std::vector<Result> &results, msa::Handle hdl, const std::string &name, size_t timer_count, std::chrono::milliseconds period);
+
+	extern void event_benchmarks(std::vector<Result> &results)
+	{
+		const msa::event::Args<std::string> args = msa::event::wrap(std::string("echo benchmark text input"));
+		measure(results, "event.create+dispose", 1000000, [&](size_t)
+		{
+			const msa::event::Event *e = msa::event::create(msa::event::Topic::TEXT_INPUT, args);
+			sink += msa::event::get_priority(e);
+			delete e->args;
+			msa::event::dispose(e);
+		});
+
+		msa::Handle hdl = start_instance();
+		if (hdl == NULL)
+		{
+			return;
+		}
+		// nothing is subscribed to the topic, so the EDT frees each event as soon as
+		// it takes it off the queue
+		measure(results, "event.generate (push_event)", 10000, [&](size_t)
+		{
+			msa::event::generate(hdl, msa::event::Topic::EVENT_HANDLED, args);
+		});
+		wait_for_drain(hdl);
+		const size_t burst = 200;
+		measure(results, "event.generate+dispatch (burst)", 1, [&](size_t)
+		{
+			for (size_t i = 0; i < burst; i++)
+			{
+				msa::event::generate(hdl, msa::event::Topic::EVENT_HANDLED, args);
+			}
+			wait_for_drain(hdl);
+		});
+		results.back().name += " of " + std::to_string(burst);
+
+		time_timers(results, hdl, "event.check_timers (1000 idle timers)", 1000, std::chrono::hours(1));
+		// every check fires all of the timers; what they generate is dropped when
+		// the instance stops
+		time_timers(results, hdl, "event.check_timers (100 due timers)", 100, std::chrono::milliseconds(0));
+		stop_instance(hdl);
+	}
+
+	static void wait_for_drain(msa::Handle hdl)
+	{
+		while (msa::event::queue_depth(hdl) > 0)
+		{
+			msa::util::sleep_milli(DRAIN_POLL_MILLIS);
+		}
+	}
+
+	/**
+	 * Times checking timers in a context of their own, so that the EDT does not check
+	 * them at the same time. Fired events still go to the instance's queue.
+	 */
+	static void time_timers(std::vector<Result> &results, msa::Handle hdl, const std::string &name, size_t timer_count, std::chrono::milliseconds period)
+	{
+		// every module that is not set here is left NULL
+		msa::environment_type timer_env = {};
+		timer_env.status = msa::Status::RUNNING;
+		timer_env.lifecycle = hdl->lifecycle;
+		timer_env.event = hdl->event;
+		timer_env.log = hdl->log;
+		msa::event::create_timer_context(&timer_env.timer);
+		msa::event::set_tick_resolution(timer_env.timer, 0);
+		const msa::event::Args<std::string> args = msa::event::wrap(std::string("timer"));
+		for (size_t i = 0; i < timer_count; i++)
+		{
+			msa::event::sys_add_timer(&timer_env, period, msa::event::Topic::EVENT_HANDLED, args);
+		}
+		measure(results, name, 100, [&](size_t)
+		{
+			msa::event::check_timers(&timer_env);
+		});
+		msa::event::clear_timers(timer_env.timer);
+		msa::event::dispose_timer_context(timer_env.timer);
+	}
+
+} }
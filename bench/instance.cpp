@@ -0,0 +1,51 @@
+/* Starts and stops the MSA instances that benchmarks of running modules are timed against. */
+
+#include "bench.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+namespace msa { namespace bench {
+
+	static const char *INSTANCE_CONFIG_PATH = "msa-bench-instance.cfg";
+
+	extern msa::Handle start_instance(const std::string &extra_config)
+	{
+		std::ofstream out(INSTANCE_CONFIG_PATH);
+		out << "[log]" << std::endl;
+		out << "global_level = error" << std::endl;
+		out << "type = file" << std::endl;
+		out << "location = msa-bench.log" << std::endl;
+		out << "open_mode = overwrite" << std::endl;
+		out << "[event]" << std::endl;
+		out << "idle_sleep_time = 1" << std::endl;
+		out << "tick_resolution = 10" << std::endl;
+		// a blank startup command does nothing, and keeps the agent from writing to stdout
+		out << "[command]" << std::endl;
+		out << "startup = \"\"" << std::endl;
+		out << "[output]" << std::endl;
+		out << "type = TTY" << std::endl;
+		out << "id = STDOUT" << std::endl;
+		out << "handler = print_to_stdout" << std::endl;
+		out << extra_config;
+		out.close();
+
+		msa::Handle hdl = NULL;
+		int status = msa::start(&hdl, INSTANCE_CONFIG_PATH);
+		std::remove(INSTANCE_CONFIG_PATH);
+		if (status != MSA_SUCCESS)
+		{
+			fprintf(stderr, "could not start MSA instance (error %d); see msa-bench.log\n", status);
+			return NULL;
+		}
+		msa::wait_for_status(hdl, msa::Status::RUNNING, -1);
+		return hdl;
+	}
+
+	extern void stop_instance(msa::Handle hdl)
+	{
+		msa::stop(hdl);
+		msa::dispose(hdl);
+	}
+
+} }
@@ -0,0 +1,445 @@
+/* Drives commands through a full MSA instance and measures how long each takes to come
+ * back out of the output module, for 'make loadgen'. */
+
+#include "msa.hpp"
+#include "cfg/cfg.hpp"
+#include "input/input.hpp"
+#include "output/output.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+
+#include "platform/thread/thread.hpp"
+
+#if !defined(__WIN32)
+	#include <sys/resource.h>
+#endif
+
+namespace msa { namespace loadgen {
+
+	typedef std::chrono::steady_clock Clock;
+
+	static const char *INPUT_HANDLER_NAME = "loadgen_input";
+	static const char *OUTPUT_HANDLER_NAME = "loadgen_capture";
+	static const char *DEVICE_NAME = "LOADGEN";
+	static const char *GENERATED_CONFIG_PATH = "msa-loadgen.cfg";
+	// every command line ends with this followed by its sequence number, so that a reply
+	// can be matched to the command that caused it
+	static const char *MARKER = "loadgen-";
+
+	typedef struct options_type
+	{
+		std::string config_path;
+		std::string command;
+		size_t count;
+		size_t warmup;
+		// commands per second; 0 sends each command as soon as the last one is answered
+		double rate;
+		int timeout_millis;
+		double max_p99_millis;
+		bool json;
+	} Options;
+
+	typedef struct resources_type
+	{
+		double cpu_seconds;
+		long max_rss_kb;
+	} Resources;
+
+	// shared by the input handler, the output handler and the sending loop
+	typedef struct state_type
+	{
+		msa::thread::Mutex mutex;
+		msa::thread::Cond input_ready;
+		msa::thread::Cond replied;
+		std::deque<std::string> pending;
+		// when each command was meant to be sent, and when its reply was written
+		std::vector<Clock::time_point> sent;
+		std::vector<Clock::time_point> received;
+		std::vector<bool> answered;
+		size_t answer_count;
+	} State;
+
+	static State state;
+
+	static bool parse_options(int argc, char *argv[], Options *opts);
+	static bool write_config(const Options &opts);
+	static void put(msa::cfg::Section &section, const std::string &key, const std::string &value);
+	static msa::input::Chunk *get_input(msa::Handle hdl, msa::input::Device *dev);
+	static bool input_ready(msa::Handle hdl, msa::input::Device *dev);
+	static void capture_output(msa::Handle hdl, const msa::output::Chunk *chunk, msa::output::Device *dev);
+	static void send(size_t seq, const Options &opts);
+	static bool wait_for_answers(size_t count, int timeout_millis);
+	static void run(const Options &opts, size_t first, size_t count);
+	static double percentile(const std::vector<double> &sorted, double p);
+	static Resources get_resources();
+	static void usage(const char *prog);
+
+	static bool parse_options(int argc, char *argv[], Options *opts)
+	{
+		opts->command = "ECHO";
+		opts->count = 2000;
+		opts->warmup = 100;
+		opts->rate = 0;
+		opts->timeout_millis = 5000;
+		opts->max_p99_millis = 0;
+		opts->json = false;
+		for (int a = 1; a < argc; a++)
+		{
+			bool has_value = (a + 1 < argc);
+			if (strcmp(argv[a], "--json") == 0)
+			{
+				opts->json = true;
+			}
+			else if (strcmp(argv[a], "--config") == 0 && has_value)
+			{
+				opts->config_path = argv[++a];
+			}
+			else if (strcmp(argv[a], "--command") == 0 && has_value)
+			{
+				opts->command = argv[++a];
+			}
+			else if (strcmp(argv[a], "--count") == 0 && has_value)
+			{
+				opts->count = strtoul(argv[++a], NULL, 10);
+			}
+			else if (strcmp(argv[a], "--warmup") == 0 && has_value)
+			{
+				opts->warmup = strtoul(argv[++a], NULL, 10);
+			}
+			else if (strcmp(argv[a], "--rate") == 0 && has_value)
+			{
+				opts->rate = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--timeout") == 0 && has_value)
+			{
+				opts->timeout_millis = atoi(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-p99") == 0 && has_value)
+			{
+				opts->max_p99_millis = atof(argv[++a]);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return opts->count > 0 && opts->rate >= 0 && opts->timeout_millis > 0;
+	}
+
+	// the instance gets its input from the load generator no matter what the config says,
+	// and must not run a startup command whose output would be mistaken for a reply
+	static bool write_config(const Options &opts)
+	{
+		msa::cfg::Config *conf = NULL;
+		if (opts.config_path != "")
+		{
+			conf = msa::cfg::load(opts.config_path.c_str());
+			if (conf == NULL)
+			{
+				fprintf(stderr, "could not load config %s\n", opts.config_path.c_str());
+				return false;
+			}
+		}
+		else
+		{
+			conf = new msa::cfg::Config;
+			msa::cfg::Section log("LOG");
+			put(log, "GLOBAL_LEVEL", "error");
+			put(log, "TYPE", "file");
+			put(log, "LOCATION", "msa-loadgen.log");
+			put(log, "OPEN_MODE", "overwrite");
+			(*conf)["LOG"] = log;
+			msa::cfg::Section event("EVENT");
+			put(event, "IDLE_SLEEP_TIME", "1");
+			put(event, "TICK_RESOLUTION", "10");
+			(*conf)["EVENT"] = event;
+			// output needs a device to start with; the load generator switches away from it
+			msa::cfg::Section output("OUTPUT");
+			put(output, "TYPE", "TTY");
+			put(output, "ID", "STDOUT");
+			put(output, "HANDLER", "print_to_stdout");
+			(*conf)["OUTPUT"] = output;
+		}
+		msa::cfg::Section input("INPUT");
+		put(input, "TYPE", "TTY");
+		put(input, "ID", DEVICE_NAME);
+		put(input, "HANDLER", INPUT_HANDLER_NAME);
+		(*conf)["INPUT"] = input;
+		msa::cfg::Section &command = (*conf)["COMMAND"];
+		if (command.get_name() == "")
+		{
+			command = msa::cfg::Section("COMMAND");
+		}
+		put(command, "STARTUP", "");
+		int status = msa::cfg::save(GENERATED_CONFIG_PATH, conf);
+		delete conf;
+		if (status != 0)
+		{
+			fprintf(stderr, "could not write %s\n", GENERATED_CONFIG_PATH);
+			return false;
+		}
+		return true;
+	}
+
+	// sets the only value of the key
+	static void put(msa::cfg::Section &section, const std::string &key, const std::string &value)
+	{
+		section.create_key(key);
+		if (section.get_all(key).empty())
+		{
+			section.push(key, value);
+		}
+		else
+		{
+			section.set(key, 0, value);
+		}
+	}
+
+	static msa::input::Chunk *get_input(msa::Handle UNUSED(hdl), msa::input::Device *UNUSED(dev))
+	{
+		msa::input::Chunk *chunk = new msa::input::Chunk;
+		msa::thread::mutex_lock(&state.mutex);
+		chunk->text = state.pending.front();
+		state.pending.pop_front();
+		msa::thread::mutex_unlock(&state.mutex);
+		return chunk;
+	}
+
+	static bool input_ready(msa::Handle UNUSED(hdl), msa::input::Device *UNUSED(dev))
+	{
+		msa::thread::mutex_lock(&state.mutex);
+		if (state.pending.empty())
+		{
+			msa::thread::cond_timed_wait(&state.input_ready, &state.mutex, 10);
+		}
+		bool ready = !state.pending.empty();
+		msa::thread::mutex_unlock(&state.mutex);
+		return ready;
+	}
+
+	static void capture_output(msa::Handle UNUSED(hdl), const msa::output::Chunk *chunk, msa::output::Device *UNUSED(dev))
+	{
+		Clock::time_point now = Clock::now();
+		const std::string &text = msa::output::get_chunk_text(chunk);
+		size_t pos = text.rfind(MARKER);
+		if (pos == std::string::npos)
+		{
+			return;
+		}
+		size_t seq = strtoul(text.c_str() + pos + strlen(MARKER), NULL, 10);
+		msa::thread::mutex_lock(&state.mutex);
+		if (seq < state.answered.size() && !state.answered[seq])
+		{
+			state.answered[seq] = true;
+			state.received[seq] = now;
+			state.answer_count++;
+			msa::thread::cond_broadcast(&state.replied);
+		}
+		msa::thread::mutex_unlock(&state.mutex);
+	}
+
+	static void send(size_t seq, const Options &opts)
+	{
+		std::string line = opts.command + " " + MARKER + std::to_string(seq);
+		msa::thread::mutex_lock(&state.mutex);
+		state.pending.push_back(line);
+		msa::thread::cond_signal(&state.input_ready);
+		msa::thread::mutex_unlock(&state.mutex);
+	}
+
+	static bool wait_for_answers(size_t count, int timeout_millis)
+	{
+		Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_millis);
+		msa::thread::mutex_lock(&state.mutex);
+		while (state.answer_count < count)
+		{
+			int left = (int) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			if (left <= 0)
+			{
+				break;
+			}
+			msa::thread::cond_timed_wait(&state.replied, &state.mutex, left);
+		}
+		bool all = (state.answer_count >= count);
+		msa::thread::mutex_unlock(&state.mutex);
+		return all;
+	}
+
+	// sends commands [first, first + count). Latency is measured from when a command was
+	// due to be sent rather than from when it was, so a slow instance cannot hide its
+	// delays by holding up the sender.
+	static void run(const Options &opts, size_t first, size_t count)
+	{
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t seq = first + i;
+			Clock::time_point due = Clock::now();
+			if (opts.rate > 0)
+			{
+				due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i / opts.rate));
+				std::this_thread::sleep_until(due);
+			}
+			msa::thread::mutex_lock(&state.mutex);
+			state.sent[seq] = due;
+			msa::thread::mutex_unlock(&state.mutex);
+			send(seq, opts);
+			if (opts.rate == 0 && !wait_for_answers(seq + 1, opts.timeout_millis))
+			{
+				return;
+			}
+		}
+		wait_for_answers(first + count, opts.timeout_millis);
+	}
+
+	// nearest-rank
+	static double percentile(const std::vector<double> &sorted, double p)
+	{
+		if (sorted.empty())
+		{
+			return 0;
+		}
+		size_t rank = (size_t) (p / 100.0 * sorted.size() + 0.5);
+		rank = std::min(std::max(rank, (size_t) 1), sorted.size());
+		return sorted[rank - 1];
+	}
+
+	static Resources get_resources()
+	{
+		Resources res = {(double) clock() / CLOCKS_PER_SEC, 0};
+		#if !defined(__WIN32)
+			struct rusage usage;
+			if (getrusage(RUSAGE_SELF, &usage) == 0)
+			{
+				res.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+				res.max_rss_kb = usage.ru_maxrss;
+			}
+		#endif
+		return res;
+	}
+
+	static void usage(const char *prog)
+	{
+		fprintf(stderr, "usage: %s [--config file] [--command cmd] [--count n] [--warmup n] [--rate per-sec]\n", prog);
+		fprintf(stderr, "       [--timeout millis] [--max-p99 millis] [--json]\n");
+	}
+
+} }
+
+// exits with 1 if the instance could not be started or did not answer every command, and
+// with 2 if the 99th percentile latency is over --max-p99
+int main(int argc, char *argv[])
+{
+	using namespace msa::loadgen;
+	Options opts;
+	if (!parse_options(argc, argv, &opts))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	size_t total = opts.warmup + opts.count;
+	msa::thread::mutex_init(&state.mutex, NULL);
+	msa::thread::cond_init(&state.input_ready, NULL);
+	msa::thread::cond_init(&state.replied, NULL);
+	state.sent.resize(total);
+	state.received.resize(total);
+	state.answered.assign(total, false);
+	state.answer_count = 0;
+
+	msa::init();
+	msa::input::register_handler(INPUT_HANDLER_NAME, get_input, input_ready);
+	if (!write_config(opts))
+	{
+		msa::quit();
+		return 1;
+	}
+	msa::Handle hdl = NULL;
+	int status = msa::start(&hdl, GENERATED_CONFIG_PATH);
+	std::remove(GENERATED_CONFIG_PATH);
+	if (status != MSA_SUCCESS)
+	{
+		fprintf(stderr, "could not start MSA instance (error %d)\n", status);
+		msa::quit();
+		return 1;
+	}
+	msa::wait_for_status(hdl, msa::Status::RUNNING, -1);
+
+	msa::output::OutputHandler *capture;
+	msa::output::create_handler(&capture, OUTPUT_HANDLER_NAME, capture_output);
+	msa::output::register_handler(hdl, msa::output::OutputType::TTY, capture);
+	std::string device_name = DEVICE_NAME;
+	msa::output::add_device(hdl, msa::output::OutputType::TTY, OUTPUT_HANDLER_NAME, &device_name);
+	msa::output::switch_device(hdl, std::string("TTY:") + DEVICE_NAME);
+
+	run(opts, 0, opts.warmup);
+	Resources before = get_resources();
+	Clock::time_point start = Clock::now();
+	run(opts, opts.warmup, opts.count);
+	Clock::time_point end = Clock::now();
+	Resources after = get_resources();
+
+	msa::output::unregister_handler(hdl, msa::output::OutputType::TTY, capture);
+	msa::stop(hdl);
+	msa::dispose(hdl);
+	msa::output::dispose_handler(capture);
+	msa::quit();
+
+	std::vector<double> latencies;
+	for (size_t seq = opts.warmup; seq < total; seq++)
+	{
+		if (state.answered[seq])
+		{
+			latencies.push_back(std::chrono::duration<double, std::milli>(state.received[seq] - state.sent[seq]).count());
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+	size_t lost = opts.count - latencies.size();
+	double elapsed = std::chrono::duration<double>(end - start).count();
+	double throughput = latencies.size() / elapsed;
+	double p50 = percentile(latencies, 50);
+	double p90 = percentile(latencies, 90);
+	double p99 = percentile(latencies, 99);
+	double max = latencies.empty() ? 0 : latencies.back();
+	double cpu = after.cpu_seconds - before.cpu_seconds;
+
+	if (opts.json)
+	{
+		printf("{\"commands\": %zu, \"lost\": %zu, \"rate\": %.1f, \"throughput\": %.1f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+			"\"p99_ms\": %.3f, \"max_ms\": %.3f, \"cpu_s\": %.3f, \"max_rss_kb\": %ld}\n",
+			opts.count, lost, opts.rate, throughput, p50, p90, p99, max, cpu, after.max_rss_kb);
+	}
+	else
+	{
+		if (opts.rate > 0)
+		{
+			printf("%zu x '%s' at %g/s: ", opts.count, opts.command.c_str(), opts.rate);
+		}
+		else
+		{
+			printf("%zu x '%s' one at a time: ", opts.count, opts.command.c_str());
+		}
+		printf("%zu answered, %zu lost in %.2f s (%.1f/s)\n", latencies.size(), lost, elapsed, throughput);
+		printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n", p50, p90, p99, max);
+		printf("cpu %.3f s (%.1f%% of wall), max rss %ld kB\n", cpu, 100.0 * cpu / elapsed, after.max_rss_kb);
+	}
+
+	if (lost > 0)
+	{
+		return 1;
+	}
+	if (opts.max_p99_millis > 0 && p99 > opts.max_p99_millis)
+	{
+		fprintf(stderr, "p99 latency %.3f ms is over the limit of %.3f ms\n", p99, opts.max_p99_millis);
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+/* Benchmarks for the cost of log calls to the thread that calls them. */
+
+#include "bench.hpp"
+#include "log/log.hpp"
+
+namespace msa { namespace bench {
+
+	extern void log_benchmarks(std::vector<Result> &results)
+	{
+		msa::Handle hdl = start_instance();
+		if (hdl == NULL)
+		{
+			return;
+		}
+		const std::string text = "benchmark message with a typical length for a log line";
+		// below the instance's level, so only the level check is done
+		measure(results, "log.debug (filtered out)", 1000000, [&](size_t)
+		{
+			msa::log::debug(hdl, text);
+		});
+		// queued for the writer thread, which writes to the instance's log file
+		measure(results, "log.error (queued)", 100000, [&](size_t)
+		{
+			msa::log::error(hdl, text);
+		});
+		stop_instance(hdl);
+	}
+
+} }
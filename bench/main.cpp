@@ -0,0 +1,123 @@
+/* Runs all benchmarks and prints the time per operation of each one. */
+
+#include "bench.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+namespace msa { namespace bench {
+
+	volatile long long sink = 0;
+	size_t run_count = 5;
+
+	typedef void (*Benchmark)(std::vector<Result> &results);
+
+	typedef struct benchmark_entry_type
+	{
+		const char *name;
+		Benchmark func;
+	} BenchmarkEntry;
+
+	static const BenchmarkEntry BENCHMARKS[] = {
+		#define MSA_BENCHMARK(name)		{#name, name},
+		#include "benchmarks.hpp"
+		#undef MSA_BENCHMARK
+	};
+
+	static void print_table(const std::vector<Result> &results);
+	static void print_json(const std::vector<Result> &results);
+	static std::string json_escape(const std::string &str);
+
+	static void print_table(const std::vector<Result> &results)
+	{
+		for (size_t r = 0; r < results.size(); r++)
+		{
+			const Result &res = results[r];
+			printf("%-45s %10zu ops %14.1f ns/op (%.1f - %.1f)\n", res.name.c_str(), res.ops, res.nanos_per_op, res.min_nanos_per_op, res.max_nanos_per_op);
+		}
+	}
+
+	// one result per line, always with the same keys in the same order, so that two
+	// runs can be compared with diff or a script
+	static void print_json(const std::vector<Result> &results)
+	{
+		printf("{\n\t\"runs\": %zu,\n\t\"results\": [\n", run_count);
+		for (size_t r = 0; r < results.size(); r++)
+		{
+			const Result &res = results[r];
+			printf("\t\t{\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, \"max_ns_per_op\": %.1f}%s\n",
+				json_escape(res.name).c_str(), res.ops, res.nanos_per_op, res.min_nanos_per_op, res.max_nanos_per_op,
+				(r + 1 < results.size()) ? "," : "");
+		}
+		printf("\t]\n}\n");
+	}
+
+	static std::string json_escape(const std::string &str)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			if (str[i] == '"' || str[i] == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += str[i];
+		}
+		return escaped;
+	}
+
+} }
+
+// give names as arguments to run only the benchmarks that contain one of them. --json
+// prints the results as JSON, and --runs N sets how many times each one is repeated.
+int main(int argc, char *argv[])
+{
+	using namespace msa::bench;
+	bool json = false;
+	std::vector<const char *> filters;
+	for (int a = 1; a < argc; a++)
+	{
+		if (strcmp(argv[a], "--json") == 0)
+		{
+			json = true;
+		}
+		else if (strcmp(argv[a], "--runs") == 0 && a + 1 < argc)
+		{
+			int runs = atoi(argv[++a]);
+			run_count = (runs > 0) ? runs : 1;
+		}
+		else
+		{
+			filters.push_back(argv[a]);
+		}
+	}
+
+	msa::init();
+	std::vector<Result> results;
+	size_t count = sizeof(BENCHMARKS) / sizeof(BenchmarkEntry);
+	for (size_t i = 0; i < count; i++)
+	{
+		bool selected = filters.empty();
+		for (size_t f = 0; f < filters.size() && !selected; f++)
+		{
+			selected = (strstr(BENCHMARKS[i].name, filters[f]) != NULL);
+		}
+		if (!selected)
+		{
+			continue;
+		}
+		size_t first = results.size();
+		BENCHMARKS[i].func(results);
+		if (!json)
+		{
+			print_table(std::vector<Result>(results.begin() + first, results.end()));
+		}
+	}
+	if (json)
+	{
+		print_json(results);
+	}
+	msa::quit();
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* Benchmarks for the cost of tagging allocations. */
+
+#include "bench.hpp"
+#include "memory/memory.hpp"
+
+#include <cstdlib>
+
+namespace msa { namespace bench {
+
+	// the blocks are kept here so that the allocations cannot be optimized out
+	static void *volatile block;
+
+	extern void memory_benchmarks(std::vector<Result> &results)
+	{
+		measure(results, "malloc+free (untracked)", 1000000, [&](size_t i)
+		{
+			block = std::malloc(32 + (i & 31));
+			std::free(block);
+		});
+		measure(results, "memory.new+delete", 1000000, [&](size_t i)
+		{
+			block = ::operator new(32 + (i & 31));
+			::operator delete(block);
+		});
+		measure(results, "memory.new+delete (in scope)", 1000000, [&](size_t i)
+		{
+			msa::memory::Scope scope(msa::memory::Tag::EVENT);
+			block = ::operator new(32 + (i & 31));
+			::operator delete(block);
+		});
+		msa::memory::Stats stats = msa::memory::get_stats(msa::memory::Tag::EVENT);
+		sink += stats.allocations - stats.frees;
+	}
+
+} }
@@ -0,0 +1,667 @@
+/* Runs a full MSA instance under mixed load for a long time and checks that nothing it
+ * samples keeps growing, for 'make soak'. */
+
+#include "msa.hpp"
+#include "cfg/cfg.hpp"
+#include "input/input.hpp"
+#include "output/output.hpp"
+#include "event/dispatch.hpp"
+#include "event/timer.hpp"
+#include "metrics/metrics.hpp"
+#include "memory/memory.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "platform/thread/thread.hpp"
+
+#if !defined(__WIN32)
+	#include <sys/resource.h>
+	#include <unistd.h>
+#endif
+
+namespace msa { namespace soak {
+
+	typedef std::chrono::steady_clock Clock;
+
+	static const char *INPUT_HANDLER_NAME = "soak_input";
+	static const char *OUTPUT_HANDLER_NAME = "soak_capture";
+	static const char *DEVICE_NAME = "SOAK";
+	// added and removed every other cycle, as both an input and an output device
+	static const char *HOTPLUG_DEVICE_NAME = "SOAK-HOTPLUG";
+	static const char *GENERATED_CONFIG_PATH = "msa-soak.cfg";
+	// every command line ends with this followed by its sequence number, so that a reply
+	// can be matched to the command that caused it
+	static const char *MARKER = "soak-cmd-";
+	static const char *TIMER_TEXT = "ECHO soak-timer";
+	// a command that has not been answered in this long is counted as lost
+	static const int LOST_AFTER_MILLIS = 5000;
+	// handler contexts and the queue depth are read this many times a millisecond apart,
+	// and the smallest reading is kept, so that a handler that happens to be running or
+	// an event that happens to be queued is not mistaken for growth
+	static const int SETTLE_READS = 20;
+
+	typedef struct options_type
+	{
+		std::string config_path;
+		std::string plugin_dir;
+		std::string plugin;
+		// all in seconds
+		double duration;
+		double interval;
+		double warmup;
+		double cycle;
+		// commands per second
+		double rate;
+		// how fast each sampled value may grow, per hour
+		double max_rss_growth;
+		double max_live_growth;
+		double max_contexts_growth;
+		double max_queue_growth;
+		double max_p99_growth;
+		bool json;
+	} Options;
+
+	typedef struct sample_type
+	{
+		double seconds;
+		double rss_kb;
+		double live_kb;
+		double contexts;
+		double queue_depth;
+		double p50_ms;
+		double p99_ms;
+		size_t answered;
+		size_t lost;
+	} Sample;
+
+	// a sampled value that fails the run if its fitted slope is over the limit
+	typedef struct trend_type
+	{
+		const char *name;
+		const char *unit;
+		double Sample::*field;
+		double limit_per_hour;
+		double slope_per_hour;
+		bool failed;
+	} Trend;
+
+	// the things that are added on one cycle and removed on the next
+	typedef struct churn_type
+	{
+		bool on;
+		int16_t timer;
+		size_t errors;
+	} Churn;
+
+	// shared by the input handler, the output handler and the driving loop
+	typedef struct state_type
+	{
+		msa::thread::Mutex mutex;
+		msa::thread::Cond input_ready;
+		std::deque<std::string> pending;
+		// when each unanswered command was sent
+		std::map<size_t, Clock::time_point> outstanding;
+		// latencies of the commands answered since the last sample
+		std::vector<double> window;
+		size_t answered;
+		size_t lost;
+	} State;
+
+	static State state;
+	// set by input_ready for the get_input call that follows it on the same device thread,
+	// so that two devices never race for the last pending line
+	static thread_local std::string claimed;
+
+	static bool parse_options(int argc, char *argv[], Options *opts);
+	static bool write_config(const Options &opts);
+	static void put(msa::cfg::Section &section, const std::string &key, const std::string &value);
+	static msa::input::Chunk *get_input(msa::Handle hdl, msa::input::Device *dev);
+	static bool input_ready(msa::Handle hdl, msa::input::Device *dev);
+	static void capture_output(msa::Handle hdl, const msa::output::Chunk *chunk, msa::output::Device *dev);
+	static void send_line(const std::string &line);
+	static void send_command(size_t seq);
+	static void churn(msa::Handle hdl, const Options &opts, Churn *c);
+	static Sample take_sample(msa::Handle hdl, msa::metrics::Gauge *contexts, double seconds);
+	static double percentile(const std::vector<double> &sorted, double p);
+	static double current_rss_kb();
+	static double live_kb();
+	static void fit_trend(const std::vector<Sample> &samples, double warmup, Trend *trend);
+	static void print_sample(const Sample &s);
+	static void usage(const char *prog);
+
+	static bool parse_options(int argc, char *argv[], Options *opts)
+	{
+		opts->plugin_dir = "plugins/autoload";
+		opts->plugin = "example";
+		opts->duration = 3600;
+		opts->interval = 30;
+		opts->warmup = 300;
+		opts->cycle = 5;
+		opts->rate = 20;
+		opts->max_rss_growth = 8192;
+		opts->max_live_growth = 1024;
+		opts->max_contexts_growth = 10;
+		opts->max_queue_growth = 100;
+		opts->max_p99_growth = 20;
+		opts->json = false;
+		for (int a = 1; a < argc; a++)
+		{
+			bool has_value = (a + 1 < argc);
+			if (strcmp(argv[a], "--json") == 0)
+			{
+				opts->json = true;
+			}
+			else if (strcmp(argv[a], "--config") == 0 && has_value)
+			{
+				opts->config_path = argv[++a];
+			}
+			else if (strcmp(argv[a], "--plugin-dir") == 0 && has_value)
+			{
+				opts->plugin_dir = argv[++a];
+			}
+			else if (strcmp(argv[a], "--plugin") == 0 && has_value)
+			{
+				opts->plugin = argv[++a];
+			}
+			else if (strcmp(argv[a], "--duration") == 0 && has_value)
+			{
+				opts->duration = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--interval") == 0 && has_value)
+			{
+				opts->interval = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--warmup") == 0 && has_value)
+			{
+				opts->warmup = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--cycle") == 0 && has_value)
+			{
+				opts->cycle = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--rate") == 0 && has_value)
+			{
+				opts->rate = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-rss-growth") == 0 && has_value)
+			{
+				opts->max_rss_growth = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-live-growth") == 0 && has_value)
+			{
+				opts->max_live_growth = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-contexts-growth") == 0 && has_value)
+			{
+				opts->max_contexts_growth = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-queue-growth") == 0 && has_value)
+			{
+				opts->max_queue_growth = atof(argv[++a]);
+			}
+			else if (strcmp(argv[a], "--max-p99-growth") == 0 && has_value)
+			{
+				opts->max_p99_growth = atof(argv[++a]);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return opts->duration > 0 && opts->interval > 0 && opts->warmup >= 0 && opts->warmup < opts->duration && opts->cycle > 0 && opts->rate > 0;
+	}
+
+	// the instance gets its input from the soak driver no matter what the config says,
+	// and must not run a startup command whose output would be mistaken for a reply
+	static bool write_config(const Options &opts)
+	{
+		msa::cfg::Config *conf = NULL;
+		if (opts.config_path != "")
+		{
+			conf = msa::cfg::load(opts.config_path.c_str());
+			if (conf == NULL)
+			{
+				fprintf(stderr, "could not load config %s\n", opts.config_path.c_str());
+				return false;
+			}
+		}
+		else
+		{
+			conf = new msa::cfg::Config;
+			msa::cfg::Section log("LOG");
+			put(log, "GLOBAL_LEVEL", "error");
+			put(log, "TYPE", "file");
+			put(log, "LOCATION", "msa-soak.log");
+			put(log, "OPEN_MODE", "overwrite");
+			(*conf)["LOG"] = log;
+			msa::cfg::Section event("EVENT");
+			put(event, "IDLE_SLEEP_TIME", "1");
+			put(event, "TICK_RESOLUTION", "10");
+			(*conf)["EVENT"] = event;
+			// output needs a device to start with; the soak driver switches away from it
+			msa::cfg::Section output("OUTPUT");
+			put(output, "TYPE", "TTY");
+			put(output, "ID", "STDOUT");
+			put(output, "HANDLER", "print_to_stdout");
+			(*conf)["OUTPUT"] = output;
+			msa::cfg::Section plugin("PLUGIN");
+			put(plugin, "DIR", opts.plugin_dir);
+			(*conf)["PLUGIN"] = plugin;
+		}
+		msa::cfg::Section input("INPUT");
+		put(input, "TYPE", "TTY");
+		put(input, "ID", DEVICE_NAME);
+		put(input, "HANDLER", INPUT_HANDLER_NAME);
+		(*conf)["INPUT"] = input;
+		msa::cfg::Section &command = (*conf)["COMMAND"];
+		if (command.get_name() == "")
+		{
+			command = msa::cfg::Section("COMMAND");
+		}
+		put(command, "STARTUP", "");
+		int status = msa::cfg::save(GENERATED_CONFIG_PATH, conf);
+		delete conf;
+		if (status != 0)
+		{
+			fprintf(stderr, "could not write %s\n", GENERATED_CONFIG_PATH);
+			return false;
+		}
+		return true;
+	}
+
+	// sets the only value of the key
+	static void put(msa::cfg::Section &section, const std::string &key, const std::string &value)
+	{
+		section.create_key(key);
+		if (section.get_all(key).empty())
+		{
+			section.push(key, value);
+		}
+		else
+		{
+			section.set(key, 0, value);
+		}
+	}
+
+	static msa::input::Chunk *get_input(msa::Handle UNUSED(hdl), msa::input::Device *UNUSED(dev))
+	{
+		msa::input::Chunk *chunk = new msa::input::Chunk;
+		chunk->text = claimed;
+		return chunk;
+	}
+
+	static bool input_ready(msa::Handle UNUSED(hdl), msa::input::Device *UNUSED(dev))
+	{
+		msa::thread::mutex_lock(&state.mutex);
+		if (state.pending.empty())
+		{
+			msa::thread::cond_timed_wait(&state.input_ready, &state.mutex, 10);
+		}
+		bool ready = !state.pending.empty();
+		if (ready)
+		{
+			claimed = state.pending.front();
+			state.pending.pop_front();
+		}
+		msa::thread::mutex_unlock(&state.mutex);
+		return ready;
+	}
+
+	static void capture_output(msa::Handle UNUSED(hdl), const msa::output::Chunk *chunk, msa::output::Device *UNUSED(dev))
+	{
+		Clock::time_point now = Clock::now();
+		const std::string &text = msa::output::get_chunk_text(chunk);
+		size_t pos = text.rfind(MARKER);
+		if (pos == std::string::npos)
+		{
+			return;
+		}
+		size_t seq = strtoul(text.c_str() + pos + strlen(MARKER), NULL, 10);
+		msa::thread::mutex_lock(&state.mutex);
+		std::map<size_t, Clock::time_point>::iterator iter = state.outstanding.find(seq);
+		if (iter != state.outstanding.end())
+		{
+			state.window.push_back(std::chrono::duration<double, std::milli>(now - iter->second).count());
+			state.outstanding.erase(iter);
+			state.answered++;
+		}
+		msa::thread::mutex_unlock(&state.mutex);
+	}
+
+	static void send_line(const std::string &line)
+	{
+		msa::thread::mutex_lock(&state.mutex);
+		state.pending.push_back(line);
+		msa::thread::cond_signal(&state.input_ready);
+		msa::thread::mutex_unlock(&state.mutex);
+	}
+
+	static void send_command(size_t seq)
+	{
+		msa::thread::mutex_lock(&state.mutex);
+		state.outstanding[seq] = Clock::now();
+		msa::thread::mutex_unlock(&state.mutex);
+		send_line(std::string("ECHO ") + MARKER + std::to_string(seq));
+	}
+
+	// turns a recurring timer, the plugin and the hot-plugged devices on or off
+	static void churn(msa::Handle hdl, const Options &opts, Churn *c)
+	{
+		std::string name = HOTPLUG_DEVICE_NAME;
+		std::string id = std::string("TTY:") + HOTPLUG_DEVICE_NAME;
+		c->on = !c->on;
+		try
+		{
+			if (c->on)
+			{
+				c->timer = msa::event::add_timer(hdl, std::chrono::milliseconds(250), msa::event::Topic::TEXT_INPUT, msa::event::wrap(std::string(TIMER_TEXT)));
+				send_line("PLUGINENABLE " + opts.plugin);
+				msa::input::add_device(hdl, msa::input::InputType::TTY, &name);
+				msa::input::enable_device(hdl, id);
+				msa::output::add_device(hdl, msa::output::OutputType::TTY, OUTPUT_HANDLER_NAME, &name);
+				msa::output::switch_device(hdl, id);
+			}
+			else
+			{
+				msa::event::remove_timer(hdl, c->timer);
+				send_line("PLUGINDISABLE " + opts.plugin);
+				msa::input::remove_device(hdl, id);
+				msa::output::switch_device(hdl, std::string("TTY:") + DEVICE_NAME);
+				msa::output::remove_device(hdl, id);
+			}
+		}
+		catch (const std::exception &e)
+		{
+			fprintf(stderr, "could not turn %s the churned parts: %s\n", c->on ? "on" : "off", e.what());
+			c->errors++;
+		}
+	}
+
+	static Sample take_sample(msa::Handle hdl, msa::metrics::Gauge *contexts, double seconds)
+	{
+		Sample s;
+		s.seconds = seconds;
+		std::vector<double> latencies;
+		Clock::time_point lost_before = Clock::now() - std::chrono::milliseconds(LOST_AFTER_MILLIS);
+		msa::thread::mutex_lock(&state.mutex);
+		latencies.swap(state.window);
+		std::map<size_t, Clock::time_point>::iterator iter = state.outstanding.begin();
+		while (iter != state.outstanding.end())
+		{
+			if (iter->second < lost_before)
+			{
+				iter = state.outstanding.erase(iter);
+				state.lost++;
+			}
+			else
+			{
+				iter++;
+			}
+		}
+		s.answered = state.answered;
+		s.lost = state.lost;
+		msa::thread::mutex_unlock(&state.mutex);
+		std::sort(latencies.begin(), latencies.end());
+		s.p50_ms = percentile(latencies, 50);
+		s.p99_ms = percentile(latencies, 99);
+		s.rss_kb = current_rss_kb();
+		s.live_kb = live_kb();
+		s.contexts = (double) msa::metrics::get_value(contexts);
+		s.queue_depth = (double) msa::event::queue_depth(hdl);
+		for (int i = 1; i < SETTLE_READS; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			s.contexts = std::min(s.contexts, (double) msa::metrics::get_value(contexts));
+			s.queue_depth = std::min(s.queue_depth, (double) msa::event::queue_depth(hdl));
+		}
+		return s;
+	}
+
+	// nearest-rank
+	static double percentile(const std::vector<double> &sorted, double p)
+	{
+		if (sorted.empty())
+		{
+			return 0;
+		}
+		size_t rank = (size_t) (p / 100.0 * sorted.size() + 0.5);
+		rank = std::min(std::max(rank, (size_t) 1), sorted.size());
+		return sorted[rank - 1];
+	}
+
+	// falls back to the peak where the current size cannot be read
+	static double current_rss_kb()
+	{
+		double rss = 0;
+		#if !defined(__WIN32)
+			FILE *statm = fopen("/proc/self/statm", "r");
+			if (statm != NULL)
+			{
+				unsigned long size, resident;
+				if (fscanf(statm, "%lu %lu", &size, &resident) == 2)
+				{
+					rss = resident * (sysconf(_SC_PAGESIZE) / 1024.0);
+				}
+				fclose(statm);
+			}
+			struct rusage usage;
+			if (rss == 0 && getrusage(RUSAGE_SELF, &usage) == 0)
+			{
+				rss = usage.ru_maxrss;
+			}
+		#endif
+		return rss;
+	}
+
+	static double live_kb()
+	{
+		uint64_t live = 0;
+		#define MSA_MEMORY_TAG(enum_name, name) \
+		{ \
+			msa::memory::Stats stats = msa::memory::get_stats(msa::memory::Tag::enum_name); \
+			live += (stats.allocated_bytes > stats.freed_bytes) ? stats.allocated_bytes - stats.freed_bytes : 0; \
+		}
+		#include "memory/tags.hpp"
+		#undef MSA_MEMORY_TAG
+		return live / 1024.0;
+	}
+
+	// least squares over the samples taken after the warmup
+	static void fit_trend(const std::vector<Sample> &samples, double warmup, Trend *trend)
+	{
+		double n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			if (samples[i].seconds < warmup)
+			{
+				continue;
+			}
+			double x = samples[i].seconds / 3600.0;
+			double y = samples[i].*(trend->field);
+			n++;
+			sum_x += x;
+			sum_y += y;
+			sum_xx += x * x;
+			sum_xy += x * y;
+		}
+		double denominator = n * sum_xx - sum_x * sum_x;
+		trend->slope_per_hour = (n >= 3 && denominator > 0) ? (n * sum_xy - sum_x * sum_y) / denominator : 0;
+		trend->failed = trend->slope_per_hour > trend->limit_per_hour;
+	}
+
+	static void print_sample(const Sample &s)
+	{
+		printf("%7.0f s  rss %9.0f kB  live %9.1f kB  contexts %3.0f  queue %3.0f  p50 %7.3f ms  p99 %7.3f ms  answered %zu  lost %zu\n",
+			s.seconds, s.rss_kb, s.live_kb, s.contexts, s.queue_depth, s.p50_ms, s.p99_ms, s.answered, s.lost);
+		fflush(stdout);
+	}
+
+	static void usage(const char *prog)
+	{
+		fprintf(stderr, "usage: %s [--config file] [--plugin-dir dir] [--plugin id] [--duration secs] [--interval secs]\n", prog);
+		fprintf(stderr, "       [--warmup secs] [--cycle secs] [--rate per-sec] [--max-rss-growth kB/h] [--max-live-growth kB/h]\n");
+		fprintf(stderr, "       [--max-contexts-growth n/h] [--max-queue-growth n/h] [--max-p99-growth ms/h] [--json]\n");
+	}
+
+} }
+
+// exits with 1 if the instance could not be started, lost a command or could not churn,
+// and with 2 if a sampled value grew faster than its limit
+int main(int argc, char *argv[])
+{
+	using namespace msa::soak;
+	Options opts;
+	if (!parse_options(argc, argv, &opts))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	msa::thread::mutex_init(&state.mutex, NULL);
+	msa::thread::cond_init(&state.input_ready, NULL);
+	state.answered = 0;
+	state.lost = 0;
+
+	msa::init();
+	msa::input::register_handler(INPUT_HANDLER_NAME, get_input, input_ready);
+	if (!write_config(opts))
+	{
+		msa::quit();
+		return 1;
+	}
+	msa::Handle hdl = NULL;
+	int status = msa::start(&hdl, GENERATED_CONFIG_PATH);
+	std::remove(GENERATED_CONFIG_PATH);
+	if (status != MSA_SUCCESS)
+	{
+		fprintf(stderr, "could not start MSA instance (error %d)\n", status);
+		msa::quit();
+		return 1;
+	}
+	msa::wait_for_status(hdl, msa::Status::RUNNING, -1);
+
+	msa::output::OutputHandler *capture;
+	msa::output::create_handler(&capture, OUTPUT_HANDLER_NAME, capture_output);
+	msa::output::register_handler(hdl, msa::output::OutputType::TTY, capture);
+	std::string device_name = DEVICE_NAME;
+	msa::output::add_device(hdl, msa::output::OutputType::TTY, OUTPUT_HANDLER_NAME, &device_name);
+	msa::output::switch_device(hdl, std::string("TTY:") + DEVICE_NAME);
+	msa::metrics::Gauge *contexts = msa::metrics::get_gauge(hdl, "msa_event_handler_contexts", "Handler contexts that have not been freed yet");
+
+	if (!opts.json)
+	{
+		printf("soaking for %.0f s at %g commands/s, churning every %g s, sampling every %g s\n", opts.duration, opts.rate, opts.cycle, opts.interval);
+	}
+	std::vector<Sample> samples;
+	Churn churned = {false, -1, 0};
+	Clock::time_point start = Clock::now();
+	Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.duration));
+	Clock::time_point next_sample = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.interval));
+	Clock::time_point next_cycle = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.cycle));
+	size_t sent = 0;
+	while (true)
+	{
+		Clock::time_point next_send = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(sent / opts.rate));
+		Clock::time_point wake = std::min(std::min(next_send, next_sample), std::min(next_cycle, end));
+		std::this_thread::sleep_until(wake);
+		Clock::time_point now = Clock::now();
+		if (now >= end)
+		{
+			break;
+		}
+		if (now >= next_send)
+		{
+			send_command(sent++);
+		}
+		if (now >= next_cycle)
+		{
+			churn(hdl, opts, &churned);
+			next_cycle += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.cycle));
+		}
+		if (now >= next_sample)
+		{
+			samples.push_back(take_sample(hdl, contexts, std::chrono::duration<double>(now - start).count()));
+			if (!opts.json)
+			{
+				print_sample(samples.back());
+			}
+			next_sample += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opts.interval));
+		}
+	}
+	if (churned.on)
+	{
+		churn(hdl, opts, &churned);
+	}
+	// give the last commands the same time to be answered as the rest
+	std::this_thread::sleep_for(std::chrono::milliseconds(LOST_AFTER_MILLIS));
+	Sample last = take_sample(hdl, contexts, std::chrono::duration<double>(Clock::now() - start).count());
+
+	msa::output::unregister_handler(hdl, msa::output::OutputType::TTY, capture);
+	msa::stop(hdl);
+	msa::dispose(hdl);
+	msa::output::dispose_handler(capture);
+	msa::quit();
+
+	Trend trends[] = {
+		{"rss", "kB", &Sample::rss_kb, opts.max_rss_growth, 0, false},
+		{"live", "kB", &Sample::live_kb, opts.max_live_growth, 0, false},
+		{"contexts", "", &Sample::contexts, opts.max_contexts_growth, 0, false},
+		{"queue", "", &Sample::queue_depth, opts.max_queue_growth, 0, false},
+		{"p99", "ms", &Sample::p99_ms, opts.max_p99_growth, 0, false}
+	};
+	size_t trend_count = sizeof(trends) / sizeof(trends[0]);
+	bool grew = false;
+	for (size_t i = 0; i < trend_count; i++)
+	{
+		fit_trend(samples, opts.warmup, &trends[i]);
+		grew = grew || trends[i].failed;
+	}
+
+	if (opts.json)
+	{
+		printf("{\"seconds\": %.1f, \"sent\": %zu, \"answered\": %zu, \"lost\": %zu, \"churn_errors\": %zu, \"samples\": [",
+			opts.duration, sent, last.answered, last.lost, churned.errors);
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			const Sample &s = samples[i];
+			printf("%s{\"seconds\": %.1f, \"rss_kb\": %.0f, \"live_kb\": %.1f, \"contexts\": %.0f, \"queue_depth\": %.0f, \"p50_ms\": %.3f, \"p99_ms\": %.3f}",
+				(i > 0) ? ", " : "", s.seconds, s.rss_kb, s.live_kb, s.contexts, s.queue_depth, s.p50_ms, s.p99_ms);
+		}
+		printf("], \"trends\": {");
+		for (size_t i = 0; i < trend_count; i++)
+		{
+			printf("%s\"%s\": {\"per_hour\": %.3f, \"limit\": %.3f, \"ok\": %s}", (i > 0) ? ", " : "", trends[i].name,
+				trends[i].slope_per_hour, trends[i].limit_per_hour, trends[i].failed ? "false" : "true");
+		}
+		printf("}}\n");
+	}
+	else
+	{
+		printf("%zu commands sent, %zu answered, %zu lost; %zu churn errors\n", sent, last.answered, last.lost, churned.errors);
+		printf("growth per hour after the first %.0f s:\n", opts.warmup);
+		for (size_t i = 0; i < trend_count; i++)
+		{
+			const Trend &t = trends[i];
+			printf("  %-8s %12.3f %-2s (limit %g)  %s\n", t.name, t.slope_per_hour, t.unit, t.limit_per_hour, t.failed ? "FAIL" : "ok");
+		}
+	}
+
+	if (last.lost > 0 || churned.errors > 0)
+	{
+		return 1;
+	}
+	if (grew)
+	{
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+/* Benchmarks for starting and joining threads through the platform layer. */
+
+#include "bench.hpp"
+
+#include "platform/thread/thread.hpp"
+
+namespace msa { namespace bench {
+
+	static void *thread_start(void *args);
+
+	extern void thread_benchmarks(std::vector<Result> &results)
+	{
+		measure(results, "thread.create+join", 2000, [&](size_t i)
+		{
+			msa::thread::Thread t;
+			if (msa::thread::create(&t, NULL, thread_start, (void *) i, "bench") == 0)
+			{
+				msa::thread::join(t, NULL);
+			}
+		});
+	}
+
+	static void *thread_start(void *args)
+	{
+		sink += (long long) (size_t) args;
+		return NULL;
+	}
+
+} }
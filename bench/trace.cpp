@@ -0,0 +1,45 @@
+/* Benchmarks for recording trace events, with tracing turned off and on. */
+
+#include "bench.hpp"
+#include "trace/trace.hpp"
+
+#include <cstdio>
+
+namespace msa { namespace bench {
+
+	static const char *TRACE_PATH = "msa-bench-trace.json";
+
+	extern void trace_benchmarks(std::vector<Result> &results)
+	{
+		msa::Handle hdl = start_instance();
+		if (hdl == NULL)
+		{
+			return;
+		}
+		measure(results, "trace.begin+end (off)", 1000000, [&](size_t)
+		{
+			msa::trace::begin(hdl, "bench", "span", NULL);
+			msa::trace::end(hdl);
+		});
+		stop_instance(hdl);
+
+		// every run records into the same buffers, so max_events must cover all of them
+		hdl = start_instance("[trace]\nfile = " + std::string(TRACE_PATH) + "\nmax_events = 10000000\n");
+		if (hdl == NULL)
+		{
+			return;
+		}
+		measure(results, "trace.begin+end", 100000, [&](size_t)
+		{
+			msa::trace::begin(hdl, "bench", "span", NULL);
+			msa::trace::end(hdl);
+		});
+		measure(results, "trace.instant", 100000, [&](size_t)
+		{
+			msa::trace::instant(hdl, "bench", "instant", NULL);
+		});
+		stop_instance(hdl);
+		std::remove(TRACE_PATH);
+	}
+
+} }
@@ -0,0 +1,38 @@
+/* Benchmarks for expanding variables in agent text. */
+
+#include "bench.hpp"
+#include "util/var.hpp"
+
+namespace msa { namespace bench {
+
+	extern void var_benchmarks(std::vector<Result> &results)
+	{
+		msa::var::Expander *ex;
+		msa::var::create_expander(&ex);
+		std::string user_title = "Onee-chan";
+		std::string agent_name = "Masa-chan";
+		msa::var::register_external(ex, "USER_TITLE", &user_title);
+		msa::var::register_external(ex, "AGENT_NAME", &agent_name);
+		msa::var::register_internal(ex, "MOOD");
+		msa::var::set_value(ex, "MOOD", "happy");
+
+		const std::string plain = "Masa-chan: \"Okay, I will do that in 30000 milliseconds!\"\n";
+		const std::string vars = "$AGENT_NAME: \"Okay, $USER_TITLE, I am $MOOD to do that; it costs \\$0.\"\n";
+		measure(results, "var.expand (no variables)", 1000000, [&](size_t)
+		{
+			std::string text = plain;
+			msa::var::expand(ex, text);
+			sink += text.size();
+		});
+		measure(results, "var.expand (3 variables)", 1000000, [&](size_t)
+		{
+			std::string text = vars;
+			msa::var::expand(ex, text);
+			sink += text.size();
+		});
+		msa::var::unregister_external(ex, "USER_TITLE");
+		msa::var::unregister_external(ex, "AGENT_NAME");
+		msa::var::dispose_expander(ex);
+	}
+
+} }
@@ -26,4 +26,9 @@
 	#include "platform/unix.hpp"
 #endif
 
+
+// PROBES
+
+#include "probes.hpp"
+
 #endif
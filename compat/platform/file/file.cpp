@@ -36,5 +36,23 @@ namespace msa { namespace file {
 		}
 	}
 
+	extern void dirname(std::string &path)
+	{
+		const std::string sep = dir_separator();
+		size_t sep_pos = path.rfind(sep);
+		if (sep_pos == std::string::npos)
+		{
+			path = ".";
+		}
+		else if (sep_pos == 0)
+		{
+			path = sep;
+		}
+		else
+		{
+			path = path.substr(0, sep_pos);
+		}
+	}
+
 } }
 
@@ -8,10 +8,54 @@
 
 namespace msa { namespace file {
 
+	// a read-only view of the contents of a file
+	typedef struct mapping_type Mapping;
+
+	// notifications of changes to a single file
+	typedef struct watch_type Watch;
+
+	// a file that is only written by adding to its end
+	typedef struct append_file_type AppendFile;
+
 	extern void list(const std::string &dir_path, std::vector<std::string> &files);
 	extern const std::string &dir_separator();
 	extern void join(std::string &base, const std::string &next);
 	extern void basename(std::string &path, const std::string &suffix = "");
+	extern void dirname(std::string &path);
+	extern bool is_absolute(const std::string &path);
+
+	// expands a wildcard pattern to the paths that match it, in sorted order. A pattern
+	// that matches nothing gives no paths.
+	extern void glob(const std::string &pattern, std::vector<std::string> &paths);
+
+	// maps the entire file into memory. A file that may be truncated while it is being
+	// read should be copied instead, since touching a mapped page past its new end
+	// raises SIGBUS. Throws std::logic_error if it cannot be opened.
+	extern Mapping *map(const std::string &path, bool copy = false);
+	extern const char *mapping_data(const Mapping *mapping);
+	extern size_t mapping_size(const Mapping *mapping);
+	extern void unmap(Mapping *mapping);
+
+	// starts watching a file for changes. Throws std::logic_error if it cannot be watched.
+	extern Watch *watch(const std::string &path);
+	// blocks until the watched file has changed, the timeout expires, or wake() is
+	// called, and returns whether it changed. A negative timeout never expires.
+	extern bool wait_for_change(Watch *watch, int timeout_millis);
+	// makes a wait_for_change() that is blocked, or the next one, return at once
+	extern void wake(Watch *watch);
+	extern void unwatch(Watch *watch);
+
+	// opens a file for appending, creating it if needed and emptying it first if truncate
+	// is set. Throws std::logic_error if it cannot be opened.
+	extern AppendFile *open_append(const std::string &path, bool truncate);
+	// adds all of the data to the end of the file; returns false if it could not
+	extern bool append(AppendFile *file, const char *data, size_t size);
+	// blocks until everything appended so far is on disk; returns false if it could not
+	extern bool sync(AppendFile *file);
+	extern void close_append(AppendFile *file);
+	// blocks until the entries of the directory, such as a file just renamed into it, are
+	// on disk; returns false if it could not
+	extern bool sync_dir(const std::string &dir_path);
 
 } }
 
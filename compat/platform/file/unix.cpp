@@ -1,7 +1,18 @@
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+	#include <sys/inotify.h>
+#endif
 
 #include <string>
+#include <algorithm>
 #include <stdexcept>
 
 namespace msa { namespace file {
@@ -28,4 +39,408 @@ namespace msa { namespace file {
 		return DIR_SEPARATOR;
 	}
 
+	extern bool is_absolute(const std::string &path)
+	{
+		return !path.empty() && path.compare(0, DIR_SEPARATOR.size(), DIR_SEPARATOR) == 0;
+	}
+
+	extern void glob(const std::string &pattern, std::vector<std::string> &paths)
+	{
+		glob_t matches;
+		int status = ::glob(pattern.c_str(), 0, NULL, &matches);
+		if (status == GLOB_NOMATCH)
+		{
+			globfree(&matches);
+			return;
+		}
+		if (status != 0)
+		{
+			// glob() may have matched some paths before it failed
+			globfree(&matches);
+			throw std::logic_error("could not expand pattern (" + std::to_string(status) + "): " + pattern);
+		}
+		// glob() sorts the matches unless told not to
+		for (size_t i = 0; i < matches.gl_pathc; i++)
+		{
+			paths.push_back(std::string(matches.gl_pathv[i]));
+		}
+		globfree(&matches);
+	}
+
+	struct mapping_type
+	{
+		const char *data;
+		size_t size;
+		// read into memory rather than mapped
+		bool copied;
+	};
+
+	static void read_copy(int fd, Mapping *mapping, const std::string &path);
+
+	extern Mapping *map(const std::string &path, bool copy)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+		{
+			throw std::logic_error("could not open file (" + std::to_string(errno) + "): " + path);
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			int err = errno;
+			::close(fd);
+			throw std::logic_error("could not stat file (" + std::to_string(err) + "): " + path);
+		}
+		Mapping *mapping = new Mapping;
+		mapping->data = NULL;
+		mapping->size = (size_t) st.st_size;
+		mapping->copied = copy;
+		if (copy)
+		{
+			read_copy(fd, mapping, path);
+		}
+		// a zero-length mapping is an error, so an empty file simply has no data
+		else if (mapping->size > 0)
+		{
+			void *addr = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr == MAP_FAILED)
+			{
+				int err = errno;
+				::close(fd);
+				delete mapping;
+				throw std::logic_error("could not map file (" + std::to_string(err) + "): " + path);
+			}
+			madvise(addr, mapping->size, MADV_SEQUENTIAL);
+			mapping->data = (const char *) addr;
+		}
+		// the mapping stays valid after the descriptor is closed
+		::close(fd);
+		return mapping;
+	}
+
+	// the file may be cut short while it is read, in which case only what was there is kept
+	static void read_copy(int fd, Mapping *mapping, const std::string &path)
+	{
+		char *buf = new char[mapping->size];
+		size_t done = 0;
+		while (done < mapping->size)
+		{
+			ssize_t count = ::read(fd, buf + done, mapping->size - done);
+			if (count == 0)
+			{
+				break;
+			}
+			if (count == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				int err = errno;
+				delete[] buf;
+				::close(fd);
+				delete mapping;
+				throw std::logic_error("could not read file (" + std::to_string(err) + "): " + path);
+			}
+			done += (size_t) count;
+		}
+		mapping->data = buf;
+		mapping->size = done;
+	}
+
+	extern const char *mapping_data(const Mapping *mapping)
+	{
+		return mapping->data;
+	}
+
+	extern size_t mapping_size(const Mapping *mapping)
+	{
+		return mapping->size;
+	}
+
+	extern void unmap(Mapping *mapping)
+	{
+		if (mapping->copied)
+		{
+			delete[] mapping->data;
+		}
+		else if (mapping->data != NULL)
+		{
+			munmap((void *) mapping->data, mapping->size);
+		}
+		delete mapping;
+	}
+
+	struct append_file_type
+	{
+		int fd;
+	};
+
+	extern AppendFile *open_append(const std::string &path, bool truncate)
+	{
+		int flags = O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0);
+		int fd = ::open(path.c_str(), flags, 0644);
+		if (fd == -1)
+		{
+			throw std::logic_error("could not open file (" + std::to_string(errno) + "): " + path);
+		}
+		AppendFile *file = new AppendFile;
+		file->fd = fd;
+		return file;
+	}
+
+	extern bool append(AppendFile *file, const char *data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t written = ::write(file->fd, data, size);
+			if (written < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return false;
+			}
+			data += written;
+			size -= (size_t) written;
+		}
+		return true;
+	}
+
+	extern bool sync(AppendFile *file)
+	{
+		#if defined(__linux__)
+		return fdatasync(file->fd) == 0;
+#else
+		return fsync(file->fd) == 0;
+#endif
+	}
+
+	extern void close_append(AppendFile *file)
+	{
+		::close(file->fd);
+		delete file;
+	}
+
+	extern bool sync_dir(const std::string &dir_path)
+	{
+		int fd = ::open(dir_path.c_str(), O_RDONLY);
+		if (fd == -1)
+		{
+			return false;
+		}
+		bool synced = (fsync(fd) == 0);
+		::close(fd);
+		return synced;
+	}
+
+#if defined(__linux__)
+	struct watch_type
+	{
+		std::string name;
+		int fd;
+		int wd;
+		// written to by wake() so that a blocked wait_for_change() returns
+		int wake_fds[2];
+	};
+
+	static void split_watch_path(const std::string &path, std::string &dir, std::string &name)
+	{
+		size_t sep_pos = path.rfind(DIR_SEPARATOR);
+		if (sep_pos == std::string::npos)
+		{
+			dir = ".";
+			name = path;
+		}
+		else
+		{
+			dir = (sep_pos == 0) ? DIR_SEPARATOR : path.substr(0, sep_pos);
+			name = path.substr(sep_pos + 1);
+		}
+	}
+
+	extern Watch *watch(const std::string &path)
+	{
+		std::string dir;
+		Watch *w = new Watch;
+		split_watch_path(path, dir, w->name);
+		w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (w->fd == -1)
+		{
+			int err = errno;
+			delete w;
+			throw std::logic_error("could not start watching (" + std::to_string(err) + "): " + path);
+		}
+		// editors often save by replacing the file, which would end a watch on the file
+		// itself, so the directory that contains it is watched instead
+		w->wd = inotify_add_watch(w->fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (w->wd == -1)
+		{
+			int err = errno;
+			::close(w->fd);
+			delete w;
+			throw std::logic_error("could not watch dir (" + std::to_string(err) + "): " + dir);
+		}
+		if (pipe2(w->wake_fds, O_NONBLOCK | O_CLOEXEC) != 0)
+		{
+			int err = errno;
+			inotify_rm_watch(w->fd, w->wd);
+			::close(w->fd);
+			delete w;
+			throw std::logic_error("could not create wake pipe (" + std::to_string(err) + "): " + path);
+		}
+		return w;
+	}
+
+	extern bool wait_for_change(Watch *w, int timeout_millis)
+	{
+		struct pollfd pfds[2];
+		pfds[0].fd = w->fd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = w->wake_fds[0];
+		pfds[1].events = POLLIN;
+		if (poll(pfds, 2, timeout_millis) <= 0 || (pfds[1].revents & POLLIN))
+		{
+			return false;
+		}
+		bool changed = false;
+		char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+		ssize_t len;
+		while ((len = read(w->fd, buf, sizeof(buf))) > 0)
+		{
+			const struct inotify_event *ev;
+			for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ev->len)
+			{
+				ev = (const struct inotify_event *) ptr;
+				if (ev->len > 0 && w->name == ev->name)
+				{
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	extern void wake(Watch *w)
+	{
+		char b = 0;
+		ssize_t written = write(w->wake_fds[1], &b, 1);
+		(void) written;
+	}
+
+	extern void unwatch(Watch *w)
+	{
+		inotify_rm_watch(w->fd, w->wd);
+		::close(w->fd);
+		::close(w->wake_fds[0]);
+		::close(w->wake_fds[1]);
+		delete w;
+	}
+
+#else
+	struct watch_type
+	{
+		std::string path;
+		struct timespec mtime;
+		off_t size;
+		// written to by wake() so that a blocked wait_for_change() returns
+		int wake_fds[2];
+	};
+
+	// how often the file is checked, since there is no change notification to wait on
+	static const int STAT_INTERVAL_MILLIS = 200;
+
+	static void stat_watched(Watch *w, struct timespec *mtime, off_t *size)
+	{
+		struct stat st;
+		if (stat(w->path.c_str(), &st) != 0)
+		{
+			mtime->tv_sec = 0;
+			mtime->tv_nsec = 0;
+			*size = -1;
+			return;
+		}
+	#if defined(__APPLE__)
+		*mtime = st.st_mtimespec;
+	#else
+		*mtime = st.st_mtim;
+	#endif
+		*size = st.st_size;
+	}
+
+	extern Watch *watch(const std::string &path)
+	{
+		Watch *w = new Watch;
+		w->path = path;
+		stat_watched(w, &w->mtime, &w->size);
+		if (w->size == -1)
+		{
+			delete w;
+			throw std::logic_error("could not stat file (" + std::to_string(errno) + "): " + path);
+		}
+		if (pipe(w->wake_fds) != 0)
+		{
+			int err = errno;
+			delete w;
+			throw std::logic_error("could not create wake pipe (" + std::to_string(err) + "): " + path);
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			fcntl(w->wake_fds[i], F_SETFL, fcntl(w->wake_fds[i], F_GETFL) | O_NONBLOCK);
+			fcntl(w->wake_fds[i], F_SETFD, FD_CLOEXEC);
+		}
+		return w;
+	}
+
+	extern bool wait_for_change(Watch *w, int timeout_millis)
+	{
+		// there is no change notification available, so check the modification time
+		int waited = 0;
+		while (timeout_millis < 0 || waited < timeout_millis)
+		{
+			int interval = (timeout_millis < 0) ? STAT_INTERVAL_MILLIS : std::min(STAT_INTERVAL_MILLIS, timeout_millis - waited);
+			struct pollfd pfd;
+			pfd.fd = w->wake_fds[0];
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, interval) > 0)
+			{
+				return false;
+			}
+			waited += interval;
+			struct timespec mtime;
+			off_t size;
+			stat_watched(w, &mtime, &size);
+			if (size == -1)
+			{
+				// the file is being replaced; pick it up once it is back
+				continue;
+			}
+			bool changed = (mtime.tv_sec != w->mtime.tv_sec || mtime.tv_nsec != w->mtime.tv_nsec || size != w->size);
+			w->mtime = mtime;
+			w->size = size;
+			if (changed)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	extern void wake(Watch *w)
+	{
+		char b = 0;
+		ssize_t written = write(w->wake_fds[1], &b, 1);
+		(void) written;
+	}
+
+	extern void unwatch(Watch *w)
+	{
+		::close(w->wake_fds[0]);
+		::close(w->wake_fds[1]);
+		delete w;
+	}
+
+#endif
+
 } }
@@ -2,6 +2,7 @@
 
 #include <stdstring>
 #include <stdexcept>
+#include <algorithm>
 
 namespace msa { namespace file {
 
@@ -29,4 +30,252 @@ namespace msa { namespace file {
 		return DIR_SEPARATOR;
 	}
 
+	extern bool is_absolute(const std::string &path)
+	{
+		// either a drive letter or a UNC path
+		return (path.size() >= 2 && path[1] == ':') || path.compare(0, DIR_SEPARATOR.size(), DIR_SEPARATOR) == 0;
+	}
+
+	extern void glob(const std::string &pattern, std::vector<std::string> &paths)
+	{
+		// FindFirstFile only gives back file names, so the dir has to be put back on
+		std::string dir = pattern;
+		dirname(dir);
+		bool has_dir = pattern.rfind(DIR_SEPARATOR) != std::string::npos;
+		WIN32_FIND_DATA find_data;
+		HANDLE find_handle = FindFirstFile(pattern.c_str(), &find_data);
+		if (find_handle == INVALID_HANDLE_VALUE)
+		{
+			if (GetLastError() == ERROR_FILE_NOT_FOUND)
+			{
+				return;
+			}
+			throw std::logic_error("could not expand pattern: " + pattern);
+		}
+		size_t first = paths.size();
+		do
+		{
+			std::string path = find_data.cFileName;
+			if (has_dir)
+			{
+				path = dir;
+				join(path, find_data.cFileName);
+			}
+			paths.push_back(path);
+		} while (FindNextFile(find_handle, &find_data));
+		FindClose(find_handle);
+		std::sort(paths.begin() + first, paths.end());
+	}
+
+	struct mapping_type
+	{
+		const char *data;
+		size_t size;
+		HANDLE file;
+		HANDLE map;
+	};
+
+	// the file is opened without write sharing, so it cannot be cut short while it is
+	// mapped and does not need to be copied
+	extern Mapping *map(const std::string &path, bool UNUSED(copy))
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::logic_error("could not open file: " + path);
+		}
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size))
+		{
+			CloseHandle(file);
+			throw std::logic_error("could not get size of file: " + path);
+		}
+		Mapping *mapping = new Mapping;
+		mapping->data = NULL;
+		mapping->size = (size_t) file_size.QuadPart;
+		mapping->file = file;
+		mapping->map = NULL;
+		// an empty file cannot be mapped, so it simply has no data
+		if (mapping->size > 0)
+		{
+			mapping->map = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping->map == NULL)
+			{
+				CloseHandle(file);
+				delete mapping;
+				throw std::logic_error("could not map file: " + path);
+			}
+			mapping->data = (const char *) MapViewOfFile(mapping->map, FILE_MAP_READ, 0, 0, 0);
+			if (mapping->data == NULL)
+			{
+				CloseHandle(mapping->map);
+				CloseHandle(file);
+				delete mapping;
+				throw std::logic_error("could not map view of file: " + path);
+			}
+		}
+		return mapping;
+	}
+
+	extern const char *mapping_data(const Mapping *mapping)
+	{
+		return mapping->data;
+	}
+
+	extern size_t mapping_size(const Mapping *mapping)
+	{
+		return mapping->size;
+	}
+
+	extern void unmap(Mapping *mapping)
+	{
+		if (mapping->data != NULL)
+		{
+			UnmapViewOfFile(mapping->data);
+		}
+		if (mapping->map != NULL)
+		{
+			CloseHandle(mapping->map);
+		}
+		CloseHandle(mapping->file);
+		delete mapping;
+	}
+
+	struct append_file_type
+	{
+		HANDLE file;
+	};
+
+	extern AppendFile *open_append(const std::string &path, bool truncate)
+	{
+		HANDLE handle = CreateFile(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			throw std::logic_error("could not open file: " + path);
+		}
+		AppendFile *file = new AppendFile;
+		file->file = handle;
+		return file;
+	}
+
+	extern bool append(AppendFile *file, const char *data, size_t size)
+	{
+		while (size > 0)
+		{
+			DWORD chunk = (DWORD) std::min(size, (size_t) 0x40000000);
+			DWORD written = 0;
+			if (!WriteFile(file->file, data, chunk, &written, NULL))
+			{
+				return false;
+			}
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+
+	extern bool sync(AppendFile *file)
+	{
+		return FlushFileBuffers(file->file) != 0;
+	}
+
+	extern void close_append(AppendFile *file)
+	{
+		CloseHandle(file->file);
+		delete file;
+	}
+
+	// a directory cannot be flushed here; NTFS journals the rename itself
+	extern bool sync_dir(const std::string &UNUSED(dir_path))
+	{
+		return true;
+	}
+
+	struct watch_type
+	{
+		std::string path;
+		HANDLE notification;
+		// set by wake() so that a blocked wait_for_change() returns
+		HANDLE wake_event;
+		FILETIME last_write;
+	};
+
+	static void split_watch_path(const std::string &path, std::string &dir, std::string &name)
+	{
+		size_t sep_pos = path.rfind(DIR_SEPARATOR);
+		if (sep_pos == std::string::npos)
+		{
+			dir = ".";
+			name = path;
+		}
+		else
+		{
+			dir = (sep_pos == 0) ? DIR_SEPARATOR : path.substr(0, sep_pos);
+			name = path.substr(sep_pos + 1);
+		}
+	}
+
+	static FILETIME get_last_write(const std::string &path)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		FILETIME none = {0, 0};
+		if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+		{
+			return none;
+		}
+		return data.ftLastWriteTime;
+	}
+
+	extern Watch *watch(const std::string &path)
+	{
+		std::string dir;
+		std::string name;
+		split_watch_path(path, dir, name);
+		Watch *w = new Watch;
+		w->path = path;
+		w->last_write = get_last_write(path);
+		w->notification = FindFirstChangeNotification(dir.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (w->notification == INVALID_HANDLE_VALUE)
+		{
+			delete w;
+			throw std::logic_error("could not watch dir: " + dir);
+		}
+		w->wake_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (w->wake_event == NULL)
+		{
+			FindCloseChangeNotification(w->notification);
+			delete w;
+			throw std::logic_error("could not create wake event: " + path);
+		}
+		return w;
+	}
+
+	extern bool wait_for_change(Watch *w, int timeout_millis)
+	{
+		HANDLE handles[2] = {w->notification, w->wake_event};
+		DWORD timeout = (timeout_millis < 0) ? INFINITE : (DWORD) timeout_millis;
+		if (WaitForMultipleObjects(2, handles, FALSE, timeout) != WAIT_OBJECT_0)
+		{
+			return false;
+		}
+		FindNextChangeNotification(w->notification);
+		// notifications are for the entire directory, so check that it was this file
+		FILETIME last_write = get_last_write(w->path);
+		bool changed = (CompareFileTime(&last_write, &w->last_write) != 0);
+		w->last_write = last_write;
+		return changed;
+	}
+
+	extern void wake(Watch *w)
+	{
+		SetEvent(w->wake_event);
+	}
+
+	extern void unwatch(Watch *w)
+	{
+		FindCloseChangeNotification(w->notification);
+		CloseHandle(w->wake_event);
+		delete w;
+	}
+
 } }
@@ -0,0 +1,2 @@
+// android has the same socket API as other posix systems
+#include "unix.cpp"
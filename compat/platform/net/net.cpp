@@ -0,0 +1,9 @@
+#include "net.hpp"
+
+#if defined(__WIN32)
+	#include "win32.cpp"
+#elif defined(__ANDROID__)
+	#include "android.cpp"
+#else
+	#include "unix.cpp"
+#endif
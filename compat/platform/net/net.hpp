@@ -0,0 +1,42 @@
+#ifndef COMPAT_PLATFORM_NET_NET_HPP
+#define COMPAT_PLATFORM_NET_NET_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// functions for serving clients on the local machine in a cross-platform way
+
+namespace msa { namespace net {
+
+	typedef struct socket_type Socket;
+	// lets another thread end a wait in accept() early
+	typedef struct waker_type Waker;
+
+	// listens on a local (Unix domain) socket at the given path. A socket file left there
+	// by an earlier run is replaced. Throws std::logic_error if it cannot listen.
+	extern Socket *listen_local(const std::string &path);
+	// listens on the loopback address only, so the port cannot be reached from other
+	// hosts. Throws std::logic_error if it cannot listen.
+	extern Socket *listen_loopback(uint16_t port);
+	// waits for a client to connect to any of the listeners, and returns NULL if none did
+	// before the timeout or the waker was woken. A negative timeout never expires.
+	extern Socket *accept(const std::vector<Socket *> &listeners, Waker *waker, int timeout_millis);
+	// reads up to len bytes once some are available. Returns 0 if none came before the
+	// timeout or the client has closed its end.
+	extern size_t receive(Socket *sock, char *buf, size_t len, int timeout_millis);
+	// sends all of data and returns false if the client has gone away
+	extern bool send(Socket *sock, const std::string &data);
+	// closes the socket; the file of a local listener is removed
+	extern void close(Socket *sock);
+
+	// throws std::logic_error if the waker cannot be created
+	extern Waker *create_waker();
+	// makes an accept() that is waiting, and every one after it, return at once
+	extern void wake(Waker *waker);
+	extern void dispose_waker(Waker *waker);
+
+} }
+
+#endif
@@ -0,0 +1,212 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace msa { namespace net {
+
+	static const int BACKLOG = 8;
+
+	struct socket_type
+	{
+		int fd;
+		// the socket file of a local listener; empty otherwise
+		std::string path;
+	};
+
+	struct waker_type
+	{
+		// a byte is written to the second and never read, so the first stays readable
+		int fds[2];
+	};
+
+	static bool wait_readable(int fd, int timeout_millis);
+
+	extern Socket *listen_local(const std::string &path)
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path))
+		{
+			throw std::logic_error("socket path is too long: " + path);
+		}
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			throw std::logic_error("could not create socket (" + std::to_string(errno) + ")");
+		}
+		unlink(path.c_str());
+		if (::bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || ::listen(fd, BACKLOG) != 0)
+		{
+			int err = errno;
+			::close(fd);
+			throw std::logic_error("could not listen on " + path + " (" + std::to_string(err) + ")");
+		}
+		return new Socket {fd, path};
+	}
+
+	extern Socket *listen_loopback(uint16_t port)
+	{
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			throw std::logic_error("could not create socket (" + std::to_string(errno) + ")");
+		}
+		int reuse = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (::bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || ::listen(fd, BACKLOG) != 0)
+		{
+			int err = errno;
+			::close(fd);
+			throw std::logic_error("could not listen on port " + std::to_string(port) + " (" + std::to_string(err) + ")");
+		}
+		return new Socket {fd, ""};
+	}
+
+	extern Socket *accept(const std::vector<Socket *> &listeners, Waker *waker, int timeout_millis)
+	{
+		std::vector<struct pollfd> pfds(listeners.size() + 1);
+		pfds[0].fd = waker->fds[0];
+		for (size_t i = 0; i < listeners.size(); i++)
+		{
+			pfds[i + 1].fd = listeners[i]->fd;
+		}
+		for (size_t i = 0; i < pfds.size(); i++)
+		{
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+		int ready;
+		do
+		{
+			ready = poll(pfds.data(), pfds.size(), timeout_millis);
+		} while (ready < 0 && errno == EINTR);
+		if (ready <= 0 || (pfds[0].revents & POLLIN))
+		{
+			return NULL;
+		}
+		size_t index = 1;
+		while (index < pfds.size() && !(pfds[index].revents & POLLIN))
+		{
+			index++;
+		}
+		if (index == pfds.size())
+		{
+			return NULL;
+		}
+		int fd = ::accept(pfds[index].fd, NULL, NULL);
+		if (fd < 0)
+		{
+			return NULL;
+		}
+		#if defined(SO_NOSIGPIPE)
+			int on = 1;
+			setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+		#endif
+		return new Socket {fd, ""};
+	}
+
+	extern size_t receive(Socket *sock, char *buf, size_t len, int timeout_millis)
+	{
+		if (!wait_readable(sock->fd, timeout_millis))
+		{
+			return 0;
+		}
+		ssize_t got = ::recv(sock->fd, buf, len, 0);
+		return (got > 0) ? (size_t) got : 0;
+	}
+
+	extern bool send(Socket *sock, const std::string &data)
+	{
+		int flags = 0;
+		#if defined(MSG_NOSIGNAL)
+			// a client that hangs up early must not kill the whole process
+			flags = MSG_NOSIGNAL;
+		#endif
+		size_t sent = 0;
+		while (sent < data.size())
+		{
+			ssize_t count = ::send(sock->fd, data.data() + sent, data.size() - sent, flags);
+			if (count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (count <= 0)
+			{
+				return false;
+			}
+			sent += count;
+		}
+		return true;
+	}
+
+	extern void close(Socket *sock)
+	{
+		::close(sock->fd);
+		if (sock->path != "")
+		{
+			unlink(sock->path.c_str());
+		}
+		delete sock;
+	}
+
+	extern Waker *create_waker()
+	{
+		Waker *waker = new Waker;
+		if (pipe(waker->fds) != 0)
+		{
+			int err = errno;
+			delete waker;
+			throw std::logic_error("could not create wake pipe (" + std::to_string(err) + ")");
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			fcntl(waker->fds[i], F_SETFL, fcntl(waker->fds[i], F_GETFL) | O_NONBLOCK);
+			fcntl(waker->fds[i], F_SETFD, FD_CLOEXEC);
+		}
+		return waker;
+	}
+
+	extern void wake(Waker *waker)
+	{
+		char b = 0;
+		ssize_t written = ::write(waker->fds[1], &b, 1);
+		(void) written;
+	}
+
+	extern void dispose_waker(Waker *waker)
+	{
+		::close(waker->fds[0]);
+		::close(waker->fds[1]);
+		delete waker;
+	}
+
+	static bool wait_readable(int fd, int timeout_millis)
+	{
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ready;
+		do
+		{
+			ready = poll(&pfd, 1, timeout_millis);
+		} while (ready < 0 && errno == EINTR);
+		return ready > 0;
+	}
+
+} }
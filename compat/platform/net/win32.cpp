@@ -0,0 +1,76 @@
+#include <windows.h>
+
+#include <stdexcept>
+
+// serving over sockets is not supported on windows yet; listening fails, so callers
+// never get a socket to pass to the other functions
+
+namespace msa { namespace net {
+
+	struct socket_type
+	{
+		int unused;
+	};
+
+	struct waker_type
+	{
+		HANDLE event;
+	};
+
+	extern Socket *listen_local(const std::string &path)
+	{
+		throw std::logic_error("local sockets are not supported on this platform: " + path);
+	}
+
+	extern Socket *listen_loopback(uint16_t port)
+	{
+		throw std::logic_error("sockets are not supported on this platform: port " + std::to_string(port));
+	}
+
+	// there are never any listeners, so this only waits for the timeout or the waker
+	extern Socket *accept(const std::vector<Socket *> &UNUSED(listeners), Waker *waker, int timeout_millis)
+	{
+		WaitForSingleObject(waker->event, (timeout_millis < 0) ? INFINITE : (DWORD) timeout_millis);
+		return NULL;
+	}
+
+	extern size_t receive(Socket *UNUSED(sock), char *UNUSED(buf), size_t UNUSED(len), int UNUSED(timeout_millis))
+	{
+		return 0;
+	}
+
+	extern bool send(Socket *UNUSED(sock), const std::string &UNUSED(data))
+	{
+		return false;
+	}
+
+	extern void close(Socket *sock)
+	{
+		delete sock;
+	}
+
+	extern Waker *create_waker()
+	{
+		Waker *waker = new Waker;
+		// manual reset, so that it stays set for every wait after wake()
+		waker->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (waker->event == NULL)
+		{
+			delete waker;
+			throw std::logic_error("could not create wake event");
+		}
+		return waker;
+	}
+
+	extern void wake(Waker *waker)
+	{
+		SetEvent(waker->event);
+	}
+
+	extern void dispose_waker(Waker *waker)
+	{
+		CloseHandle(waker->event);
+		delete waker;
+	}
+
+} }
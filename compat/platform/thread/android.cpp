@@ -2,6 +2,7 @@
 // functions are missing
 
 #include <map>
+#include <ctime>
 
 namespace msa { namespace thread {
 
@@ -18,23 +19,40 @@ namespace msa { namespace thread {
 		Mutex *start_mutex;
 	} RunnerArgs;
 
+	// threads start and exit concurrently, so all access to __info goes through the lock
 	static std::map<Thread, Info *> __info;
+	static Mutex __info_mutex = PTHREAD_MUTEX_INITIALIZER;
+	// signalled whenever a thread removes its info on exit; set up by init(), since a
+	// statically-initialized cond waits on the wall clock
+	static Cond __info_cond;
+	static pthread_once_t __info_cond_once = PTHREAD_ONCE_INIT;
 	static Thread main_thread_id;
 	static bool inited = false;
 
+	// how long quit() waits for other threads to exit
+	static const int QUIT_WAIT_MILLIS = 1000;
+	static const int QUIT_POLL_MILLIS = 10;
+
 	static void __info_dispose(Info *info);
 	static void __info_create(Info **info);
+	static void __info_cond_init();
 	static void *__run(void *arg);
 
 	extern int init()
 	{		
 		Thread tid = self();
+		pthread_once(&__info_cond_once, __info_cond_init);
 		// create info for the main thread
-		if (__info.find(tid) == __info.end())
+		mutex_lock(&__info_mutex);
+		bool exists = (__info.find(tid) != __info.end());
+		mutex_unlock(&__info_mutex);
+		if (!exists)
 		{
 			Info *info;
 			__info_create(&info);
+			mutex_lock(&__info_mutex);
 			__info[tid] = info;
+			mutex_unlock(&__info_mutex);
 			set_name(tid, "main");
 			main_thread_id = tid;
 			inited = true;
@@ -48,11 +66,21 @@ namespace msa { namespace thread {
 		{
 			Thread tid = main_thread_id;
 			// delete info for the main thread
+			mutex_lock(&__info_mutex);
 			if (__info.find(tid) != __info.end())
 			{
 				__info_dispose(__info[tid]);
 				__info.erase(tid);
 			}
+			// give threads that are still on their way out (such as the one that
+			// stopped the system) a chance to finish before __info goes away
+			int waited = 0;
+			while (!__info.empty() && waited < QUIT_WAIT_MILLIS)
+			{
+				cond_timed_wait(&__info_cond, &__info_mutex, QUIT_POLL_MILLIS);
+				waited += QUIT_POLL_MILLIS;
+			}
+			mutex_unlock(&__info_mutex);
 		}
 		return 0;
 	}
@@ -92,7 +120,9 @@ namespace msa { namespace thread {
 		
 		Info *info;
 		__info_create(&info);
+		mutex_lock(&__info_mutex);
 		__info[*thread] = info;
+		mutex_unlock(&__info_mutex);
 
 		if (name != NULL)
 		{
@@ -122,14 +152,18 @@ namespace msa { namespace thread {
 		{
 			return status;
 		}
+		mutex_lock(&__info_mutex);
 		strncpy(__info[thread]->name, name, 15);
 		__info[thread]->name[15] = '\0';
+		mutex_unlock(&__info_mutex);
 		return status;
 	}
 		
 	extern int get_name(Thread thread, char *name, size_t len)
 	{
+		mutex_lock(&__info_mutex);
 		strncpy(name, __info[thread]->name, len - 1);
+		mutex_unlock(&__info_mutex);
 		name[len - 1] = '\0';
 		return 0;
 	}
@@ -138,6 +172,17 @@ namespace msa { namespace thread {
 	{
 		return pthread_self();
 	}
+
+	extern int get_cpu_time(int64_t *nanos)
+	{
+		struct timespec ts;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		{
+			return -1;
+		}
+		*nanos = ((int64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+		return 0;
+	}
 		
 	extern int attr_init(Attributes *attr)
 	{
@@ -183,9 +228,27 @@ namespace msa { namespace thread {
 		return pthread_mutex_unlock(mutex);
 	}
 
+	// every cond times its waits on the monotonic clock, so that setting the wall clock
+	// neither cuts a wait short nor stretches it out
 	extern int cond_init(Cond *cond, const CondAttributes *attr)
 	{
-		return pthread_cond_init(cond, attr);
+		CondAttributes own;
+		CondAttributes *monotonic = const_cast<CondAttributes *>(attr);
+		if (attr == NULL)
+		{
+			pthread_condattr_init(&own);
+			monotonic = &own;
+		}
+		int status = pthread_condattr_setclock(monotonic, CLOCK_MONOTONIC);
+		if (status == 0)
+		{
+			status = pthread_cond_init(cond, monotonic);
+		}
+		if (attr == NULL)
+		{
+			pthread_condattr_destroy(&own);
+		}
+		return status;
 	}
 		
 	extern int cond_destroy(Cond *cond)
@@ -198,6 +261,20 @@ namespace msa { namespace thread {
 		return pthread_cond_wait(cond, mutex);
 	}
 		
+	extern int cond_timed_wait(Cond *cond, Mutex *mutex, int millis)
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += millis / 1000;
+		deadline.tv_nsec += (long) (millis % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		return pthread_cond_timedwait(cond, mutex, &deadline);
+	}
+		
 	extern int cond_broadcast(Cond *cond)
 	{
 		return pthread_cond_broadcast(cond);
@@ -223,9 +300,12 @@ namespace msa { namespace thread {
 		
 		void *retval = start_routine(start_routine_arg);
 		
+		mutex_lock(&__info_mutex);
 		Info *info = __info[self()];
-		__info_dispose(info);
 		__info.erase(self());
+		cond_broadcast(&__info_cond);
+		mutex_unlock(&__info_mutex);
+		__info_dispose(info);
 		
 		return retval;
 	}
@@ -243,4 +323,9 @@ namespace msa { namespace thread {
 		delete[] info->name;
 		delete info;
 	}
+
+	static void __info_cond_init()
+	{
+		cond_init(&__info_cond, NULL);
+	}
 } }
@@ -9,6 +9,8 @@
 	#include "unix.hpp"
 #endif
 
+#include <cstdint>
+
 namespace msa { namespace thread {
 	
 	extern int init();
@@ -18,6 +20,8 @@ namespace msa { namespace thread {
 	extern int set_name(Thread thread, const char *name);
 	extern int get_name(Thread thread, char *name, size_t len);
 	extern Thread self();
+	// gets the CPU time that the calling thread has used so far
+	extern int get_cpu_time(int64_t *nanos);
 		
 	extern int attr_init(Attributes *attr);
 	extern int attr_set_detach(Attributes *attr, bool detach);
@@ -32,6 +36,8 @@ namespace msa { namespace thread {
 	extern int cond_init(Cond *cond, const CondAttributes *attr);
 	extern int cond_destroy(Cond *cond);
 	extern int cond_wait(Cond *cond, Mutex *mutex);
+	// like cond_wait, but gives up after the given time; returns non-zero if it timed out
+	extern int cond_timed_wait(Cond *cond, Mutex *mutex, int millis);
 	extern int cond_broadcast(Cond *cond);
 	extern int cond_signal(Cond *cond);
 
@@ -175,6 +175,20 @@ namespace msa { namespace thread {
 	{
 		return GetCurrentThreadId();
 	}
+
+	extern int get_cpu_time(int64_t *nanos)
+	{
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+		{
+			return -1;
+		}
+		// FILETIMEs count in 100ns intervals
+		uint64_t k = ((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+		uint64_t u = ((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime;
+		*nanos = (int64_t) (k + u) * 100;
+		return 0;
+	}
 		
 	extern int attr_init(Attributes *attr)
 	{
@@ -312,6 +326,52 @@ namespace msa { namespace thread {
 		return 0;
 	}
 		
+	extern int cond_timed_wait(Cond *cond, Mutex *mutex, int millis)
+	{
+		if (cond->external_mutex != NULL)
+		{
+			if (cond->external_mutex != mutex)
+			{
+				return 1;
+			}
+		}
+		cond->external_mutex = mutex;
+		Thread tid = GetCurrentThreadId();
+
+		mutex_lock(cond->internal_mutex);
+		__info[tid]->waiting_on_cond = true;
+		cond->threads.insert(tid);
+		cond->wait_queue.push(tid);
+		mutex_unlock(cond->internal_mutex);
+
+		if (!mutex_unlock(cond->mutex))
+		{
+			return 1;
+		}
+		// set up done, wait for cond or the time to run out
+		int waited = 0;
+		while (__info[tid]->waiting_on_cond && waited < millis)
+		{
+			Sleep(5);
+			waited += 5;
+		}
+		bool timed_out = false;
+		mutex_lock(cond->internal_mutex);
+		if (__info[tid]->waiting_on_cond)
+		{
+			// no longer wanted; cond_signal skips threads that are not in the set
+			__info[tid]->waiting_on_cond = false;
+			cond->threads.erase(tid);
+			timed_out = true;
+		}
+		mutex_unlock(cond->internal_mutex);
+		if (!mutex_lock(cond->external_mutex))
+		{
+			return 1;
+		}
+		return timed_out ? 1 : 0;
+	}
+		
 	extern int cond_broadcast(Cond *cond);
 	{
 		while (!cond->wait_queue.empty())
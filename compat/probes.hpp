@@ -0,0 +1,31 @@
+// DO NOT INCLUDE THIS FILE DIRECTLY
+#ifndef COMPAT_COMPAT_HPP
+	#error "do not include compatibility files directly; include compat/compat.hpp instead"
+#endif
+
+// MSA_PROBE(name) and MSA_PROBEn(name, args...) place a static tracepoint in the 'msa'
+// provider that perf, bpftrace and SystemTap can attach to. When <sys/sdt.h> is
+// available each probe is a single nop plus an ELF note, so arguments should be cheap
+// to compute; otherwise, or when built with -DMSA_NO_PROBES, they compile to nothing.
+// Arguments must be integers or pointers. See docs/probes.md for the probe list.
+
+#if !defined(MSA_NO_PROBES) && defined(__has_include)
+	#if __has_include(<sys/sdt.h>)
+		#include <sys/sdt.h>
+		#define MSA_PROBES_ENABLED
+	#endif
+#endif
+
+#ifdef MSA_PROBES_ENABLED
+	#define MSA_PROBE(name)							DTRACE_PROBE(msa, name)
+	#define MSA_PROBE1(name, a1)					DTRACE_PROBE1(msa, name, a1)
+	#define MSA_PROBE2(name, a1, a2)				DTRACE_PROBE2(msa, name, a1, a2)
+	#define MSA_PROBE3(name, a1, a2, a3)			DTRACE_PROBE3(msa, name, a1, a2, a3)
+	#define MSA_PROBE4(name, a1, a2, a3, a4)		DTRACE_PROBE4(msa, name, a1, a2, a3, a4)
+#else
+	#define MSA_PROBE(name)							do {} while (0)
+	#define MSA_PROBE1(name, a1)					do {} while (0)
+	#define MSA_PROBE2(name, a1, a2)				do {} while (0)
+	#define MSA_PROBE3(name, a1, a2, a3)			do {} while (0)
+	#define MSA_PROBE4(name, a1, a2, a3, a4)		do {} while (0)
+#endif
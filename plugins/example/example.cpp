@@ -1,6 +1,13 @@
 #include "plugin/plugin.hpp"
 #include "agent/agent.hpp"
 #include "cmd/cmd.hpp"
+#include "event/dispatch.hpp"
+
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
 
 extern "C" const msa::plugin::Info *msa_plugin_register(const msa::PluginHooks *hooks);
 
@@ -9,32 +16,69 @@ namespace dekarrin {
 	typedef struct env
 	{
 		std::vector<msa::cmd::Command> *commands;
+		int love_count;
 	} Env;
 
 	static int init(msa::Handle hdl, void **env);
 	static int quit(msa::Handle hdl, void *env);
+	static int save_state(msa::Handle hdl, void *env, std::string &state);
+	static int restore(msa::Handle hdl, void **env, const std::string &state);
 	static int add_commands(msa::Handle hdl, void *plugin_env, std::vector<msa::cmd::Command *> &new_commands);
+	static int add_subscriptions(msa::Handle hdl, void *plugin_env, std::vector<msa::plugin::Subscription> &new_subscriptions);
 	static msa::cmd::Result love_func(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+	static void plugin_event_func(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync);
 	
-	static const msa::plugin::FunctionTable function_table = {init, quit, NULL, NULL, NULL, add_commands};
+	static const msa::plugin::FunctionTable function_table = {init, quit, NULL, NULL, NULL, add_commands, save_state, restore, add_subscriptions};
 	static const msa::plugin::Info plugin_info = {"example", "Example Plugin", {"dekarrin"}, msa::plugin::Version(1, 0, 0, 0), &function_table};
 
 	static const msa::PluginHooks *msa_sys;
+	// commands are not given the plugin env, so keep it where love_func can get to it
+	static Env *current_env = NULL;
 
 	static int init(msa::Handle hdl __attribute__((unused)), void **env)
 	{
 		Env *my_env = new Env;
 		my_env->commands = new std::vector<msa::cmd::Command>;
 		my_env->commands->push_back(msa::cmd::Command("LOVE", "execute a test function", "", love_func));
+		my_env->love_count = 0;
 		*env = my_env;
+		current_env = my_env;
+		return 0;
+	}
+
+	// the state only has to be understood by later versions of this same plugin
+	static int save_state(msa::Handle hdl __attribute__((unused)), void *env, std::string &state)
+	{
+		Env *my_env = (Env *) env;
+		state = std::to_string(my_env->love_count);
 		return 0;
 	}
 
+	// the state comes from a file, so it is checked rather than trusted
+	static int restore(msa::Handle hdl, void **env, const std::string &state)
+	{
+		const char *start = state.c_str();
+		char *end = NULL;
+		errno = 0;
+		long count = strtol(start, &end, 10);
+		if (end == start || *end != '\0' || errno == ERANGE || count < 0 || count > INT_MAX)
+		{
+			return 2;
+		}
+		int status = init(hdl, env);
+		if (status == 0)
+		{
+			((Env *) *env)->love_count = (int) count;
+		}
+		return status;
+	}
+
 	static int quit(msa::Handle hdl __attribute__((unused)), void *env)
 	{
 		Env *my_env = (Env *) env;
 		delete my_env->commands;
 		delete my_env;
+		current_env = NULL;
 		return 0;
 	}
 
@@ -48,12 +92,35 @@ namespace dekarrin {
 		return 0;
 	}
 	
+	static int add_subscriptions(msa::Handle hdl __attribute__((unused)), void *env __attribute__((unused)), std::vector<msa::plugin::Subscription> &new_subscriptions)
+	{
+		new_subscriptions.push_back(msa::plugin::Subscription {msa::event::Topic::PLUGIN, plugin_event_func});
+		return 0;
+	}
+
 	static msa::cmd::Result love_func(msa::Handle hdl, const msa::cmd::ParamList &args __attribute__((unused)), msa::event::HandlerSync *const sync __attribute__((unused)))
 	{
+		current_env->love_count++;
 		msa_sys->agent->say(hdl, "$USER_TITLE, the new command works!");
+		if (current_env->love_count > 1)
+		{
+			msa_sys->agent->say(hdl, "That's " + std::to_string(current_env->love_count) + " times now!");
+		}
+		// the timer is removed for us if the plugin is disabled before it fires
+		msa_sys->event->timer.delay(hdl, std::chrono::milliseconds(1000), msa::event::Topic::PLUGIN, msa::event::wrap(std::string("example.love")));
 		return msa::cmd::Result(0);
 	}
 
+	// other plugins may use the PLUGIN topic too, so only react to our own events
+	static void plugin_event_func(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync __attribute__((unused)))
+	{
+		const msa::event::Args<std::string> *args = dynamic_cast<const msa::event::Args<std::string> *>(e->args);
+		if (args != NULL && args->get_args() == "example.love" && current_env != NULL)
+		{
+			msa_sys->agent->say(hdl, "I still feel the love, $USER_TITLE!");
+		}
+	}
+
 }
 
 extern "C" const msa::plugin::Info *msa_plugin_register(const msa::PluginHooks *hooks)
@@ -4,28 +4,31 @@
 # changes will be overwritten.                    #
 ###################################################
 
-$(ODIR)/agent/agent.o: $(SDIR)/agent/agent.cpp $(SDIR)/agent/agent.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/output/output.hpp $(SDIR)/output/hooks.hpp $(SDIR)/util/var.hpp
+$(ODIR)/agent/agent.o: $(SDIR)/agent/agent.cpp $(SDIR)/agent/agent.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/output/output.hpp $(SDIR)/output/hooks.hpp $(SDIR)/util/var.hpp
 	$(CXX) -c -o $@ $(SDIR)/agent/agent.cpp $(CXXFLAGS)
 
 $(ODIR)/util/util.o: $(SDIR)/util/util.cpp $(SDIR)/util/util.hpp
 	$(CXX) -c -o $@ $(SDIR)/util/util.cpp $(CXXFLAGS)
 
-$(ODIR)/msa.o: $(SDIR)/msa.cpp $(SDIR)/msa.hpp $(SDIR)/agent/agent.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/input/input.hpp $(SDIR)/input/hooks.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/timer.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/output/output.hpp $(SDIR)/output/hooks.hpp $(SDIR)/plugin/plugin.hpp $(SDIR)/plugin/hooks.hpp
+$(ODIR)/msa.o: $(SDIR)/msa.cpp $(SDIR)/msa.hpp $(SDIR)/agent/agent.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/input/input.hpp $(SDIR)/input/hooks.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/timer.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/output/output.hpp $(SDIR)/output/hooks.hpp $(SDIR)/plugin/plugin.hpp $(SDIR)/plugin/hooks.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/trace/trace.hpp $(SDIR)/trace/hooks.hpp
 	$(CXX) -c -o $@ $(SDIR)/msa.cpp $(CXXFLAGS)
 
-$(ODIR)/event/event.o: $(SDIR)/event/event.cpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp
+$(ODIR)/event/event.o: $(SDIR)/event/event.cpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp
 	$(CXX) -c -o $@ $(SDIR)/event/event.cpp $(CXXFLAGS)
 
-$(ODIR)/event/handler.o: $(SDIR)/event/handler.cpp $(SDIR)/event/handler.hpp $(SDIR)/msa.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp
+$(ODIR)/event/handler.o: $(SDIR)/event/handler.cpp $(SDIR)/event/handler.hpp $(SDIR)/msa.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/trace/trace.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/trace/hooks.hpp
 	$(CXX) -c -o $@ $(SDIR)/event/handler.cpp $(CXXFLAGS)
 
-$(ODIR)/event/dispatch.o: $(SDIR)/event/dispatch.cpp $(SDIR)/event/dispatch.hpp $(SDIR)/msa.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/event/timer.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp
+$(ODIR)/event/dispatch.o: $(SDIR)/event/dispatch.cpp $(SDIR)/event/dispatch.hpp $(SDIR)/msa.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/event/timer.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/event/journal.hpp $(SDIR)/util/util.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/trace/trace.hpp $(SDIR)/trace/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/event/dispatch.cpp $(CXXFLAGS)
 
-$(ODIR)/event/timer.o: $(SDIR)/event/timer.cpp $(SDIR)/event/timer.hpp $(SDIR)/msa.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp
+$(ODIR)/event/timer.o: $(SDIR)/event/timer.cpp $(SDIR)/event/timer.hpp $(SDIR)/msa.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/trace/trace.hpp $(SDIR)/trace/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/event/timer.cpp $(CXXFLAGS)
 
-$(ODIR)/input/input.o: $(SDIR)/input/input.cpp $(SDIR)/input/input.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/input/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/event/timer.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp
+$(ODIR)/event/journal.o: $(SDIR)/event/journal.cpp $(SDIR)/event/journal.hpp $(SDIR)/msa.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/timer.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
+	$(CXX) -c -o $@ $(SDIR)/event/journal.cpp $(CXXFLAGS)
+
+$(ODIR)/input/input.o: $(SDIR)/input/input.cpp $(SDIR)/input/input.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/input/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/event/timer.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/input/input.cpp $(CXXFLAGS)
 
 $(ODIR)/util/string.o: $(SDIR)/util/string.cpp $(SDIR)/util/string.hpp
@@ -34,18 +37,30 @@ $(ODIR)/util/string.o: $(SDIR)/util/string.cpp $(SDIR)/util/string.hpp
 $(ODIR)/cfg/cfg.o: $(SDIR)/cfg/cfg.cpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp
 	$(CXX) -c -o $@ $(SDIR)/cfg/cfg.cpp $(CXXFLAGS)
 
-$(ODIR)/cmd/cmd.o: $(SDIR)/cmd/cmd.cpp $(SDIR)/cmd/cmd.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/timer.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/util/util.hpp
+$(ODIR)/cmd/cmd.o: $(SDIR)/cmd/cmd.cpp $(SDIR)/cmd/cmd.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/timer.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/cmd/cmd.cpp $(CXXFLAGS)
 
-$(ODIR)/log/log.o: $(SDIR)/log/log.cpp $(SDIR)/log/log.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/log/hooks.hpp $(SDIR)/util/util.hpp
+$(ODIR)/log/log.o: $(SDIR)/log/log.cpp $(SDIR)/log/log.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/log/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/log/log.cpp $(CXXFLAGS)
 
-$(ODIR)/output/output.o: $(SDIR)/output/output.cpp $(SDIR)/output/output.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/output/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp
+$(ODIR)/output/output.o: $(SDIR)/output/output.cpp $(SDIR)/output/output.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/output/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/metrics/metrics.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/trace/trace.hpp $(SDIR)/trace/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/output/output.cpp $(CXXFLAGS)
 
 $(ODIR)/util/var.o: $(SDIR)/util/var.cpp $(SDIR)/util/var.hpp
 	$(CXX) -c -o $@ $(SDIR)/util/var.cpp $(CXXFLAGS)
 
-$(ODIR)/plugin/plugin.o: $(SDIR)/plugin/plugin.cpp $(SDIR)/plugin/plugin.hpp $(SDIR)/msa.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/plugin/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp
+$(ODIR)/plugin/plugin.o: $(SDIR)/plugin/plugin.cpp $(SDIR)/plugin/plugin.hpp $(SDIR)/msa.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/plugin/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/event/dispatch.hpp $(SDIR)/event/timer.hpp $(SDIR)/event/timer_hooks.hpp $(SDIR)/event/hooks.hpp $(SDIR)/trace/trace.hpp $(SDIR)/trace/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
 	$(CXX) -c -o $@ $(SDIR)/plugin/plugin.cpp $(CXXFLAGS)
 
+$(ODIR)/checkpoint/checkpoint.o: $(SDIR)/checkpoint/checkpoint.cpp $(SDIR)/checkpoint/checkpoint.hpp
+	$(CXX) -c -o $@ $(SDIR)/checkpoint/checkpoint.cpp $(CXXFLAGS)
+
+$(ODIR)/metrics/metrics.o: $(SDIR)/metrics/metrics.cpp $(SDIR)/metrics/metrics.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/metrics/hooks.hpp $(SDIR)/cmd/cmd.hpp $(SDIR)/event/handler.hpp $(SDIR)/event/event.hpp $(SDIR)/checkpoint/checkpoint.hpp $(SDIR)/event/topics.hpp $(SDIR)/cmd/hooks.hpp $(SDIR)/agent/agent.hpp $(SDIR)/agent/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/util/util.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
+	$(CXX) -c -o $@ $(SDIR)/metrics/metrics.cpp $(CXXFLAGS)
+
+$(ODIR)/trace/trace.o: $(SDIR)/trace/trace.cpp $(SDIR)/trace/trace.hpp $(SDIR)/msa.hpp $(SDIR)/cfg/cfg.hpp $(SDIR)/util/string.hpp $(SDIR)/trace/hooks.hpp $(SDIR)/log/log.hpp $(SDIR)/log/hooks.hpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
+	$(CXX) -c -o $@ $(SDIR)/trace/trace.cpp $(CXXFLAGS)
+
+$(ODIR)/memory/memory.o: $(SDIR)/memory/memory.cpp $(SDIR)/memory/memory.hpp $(SDIR)/memory/tags.hpp
+	$(CXX) -c -o $@ $(SDIR)/memory/memory.cpp $(CXXFLAGS)
+
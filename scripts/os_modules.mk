@@ -13,3 +13,6 @@ $(ODIR)/platform/file.o: $(OS_SDIR)/platform/file/file.cpp
 $(ODIR)/platform/lib.o: $(OS_SDIR)/platform/lib/lib.cpp $(OS_SDIR)/platform/file/file.hpp
 	$(CXX) -c -o $@ $(OS_SDIR)/platform/lib/lib.cpp $(CXXFLAGS)
 
+$(ODIR)/platform/net.o: $(OS_SDIR)/platform/net/net.cpp
+	$(CXX) -c -o $@ $(OS_SDIR)/platform/net/net.cpp $(CXXFLAGS)
+
@@ -74,6 +74,53 @@ namespace msa { namespace agent {
 		return hdl->agent->agent;
 	}
 
+	extern void checkpoint(msa::Handle hdl, msa::checkpoint::Writer &out)
+	{
+		AgentContext *ctx = hdl->agent;
+		out.put_u8(static_cast<uint8_t>(ctx->agent->state));
+		out.put_u32(ctx->agent->attitude);
+		out.put_u8(static_cast<uint8_t>(ctx->agent->mood));
+		std::vector<std::string> names;
+		msa::var::get_defined(ctx->expander, names);
+		std::vector<std::string> internal;
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			if (!msa::var::is_external(ctx->expander, names[i]))
+			{
+				internal.push_back(names[i]);
+			}
+		}
+		out.put_u32(internal.size());
+		for (size_t i = 0; i < internal.size(); i++)
+		{
+			out.put_string(internal[i]);
+			out.put_string(msa::var::get_value(ctx->expander, internal[i]));
+		}
+	}
+
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in)
+	{
+		AgentContext *ctx = hdl->agent;
+		ctx->agent->state = static_cast<State>(in.get_u8());
+		ctx->agent->attitude = in.get_u32();
+		ctx->agent->mood = static_cast<Mood>(in.get_u8());
+		uint32_t count = in.get_u32();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::string name = in.get_string();
+			std::string value = in.get_string();
+			if (msa::var::is_external(ctx->expander, name))
+			{
+				continue;
+			}
+			if (!msa::var::is_registered(ctx->expander, name))
+			{
+				msa::var::register_internal(ctx->expander, name);
+			}
+			msa::var::set_value(ctx->expander, name, value);
+		}
+	}
+
 	extern void print_prompt_char(msa::Handle hdl)
 	{
 		std::string output_text = "> ";
@@ -3,6 +3,7 @@
 
 #include "msa.hpp"
 #include "cfg/cfg.hpp"
+#include "checkpoint/checkpoint.hpp"
 
 // Start of hooks' includes
 #include <string>
@@ -59,6 +60,10 @@ namespace msa { namespace agent {
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
 	extern int quit(msa::Handle hdl);
 	extern const Agent *get_agent(msa::Handle hdl);
+	// saves the agent's state and the substitutions that were set while running. The name
+	// and user title come from the config, so they are left out.
+	extern void checkpoint(msa::Handle hdl, msa::checkpoint::Writer &out);
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in);
 	extern const PluginHooks *get_plugin_hooks();
 	
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
@@ -1,20 +1,53 @@
 #include "cfg/cfg.hpp"
 #include "util/string.hpp"
 
+#include "platform/file/file.hpp"
+#include "platform/thread/thread.hpp"
+
 #include <fstream>
+#include <atomic>
 #include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
 
 namespace msa { namespace cfg {
 
 	const char section_header_start_char = '[';
 	const char section_header_end_char = ']';
 	const char comment_char = '#';
+	const char *const include_key = "INCLUDE";
+	const size_t max_include_workers = 4;
+
+	// an included file, parsed on its own before being merged in
+	typedef struct fragment_type
+	{
+		std::string path;
+		Config config;
+		std::vector<std::string> errors;
+	} Fragment;
 
-	static void interpret(Config *config, std::string &section_name, const std::string &line);
-	static void read_section_header(Config *config, std::string &section_name, const std::string &line);
-	static void read_kv_pair(Config *config, const std::string &section_name, const std::string &line);
+	typedef struct include_job_type
+	{
+		std::vector<Fragment> *fragments;
+		std::atomic<size_t> next;
+		bool copy;
+	} IncludeJob;
+
+	static bool read_file(Config *config, const std::string &path, bool copy, std::vector<std::string> &errors);
+	static bool load_includes(Config *config, const char *path, bool copy);
+	static void *include_worker(void *args);
+	static void merge(Config *config, const Config &fragment);
+	static void print_errors(const std::string &path, const std::vector<std::string> &errors);
+	static void parse(Config *config, const char *data, size_t size, std::vector<std::string> &errors);
+	static void interpret(Config *config, Section **section, const char *first, const char *last);
+	static void read_section_header(Config *config, Section **section, const char *first, const char *last);
+	static void read_kv_pair(Section *section, const char *first, const char *split_at, const char *last);
+	static void trim(const char **first, const char **last);
 	static void check_is_identifier(const std::string &check);
-	static void remove_comments(std::string &line);
 	static void write_section(std::ostream &out, const Section &sec);
 
 	extern void dump_conf(const Config *conf)
@@ -44,6 +77,38 @@ namespace msa { namespace cfg {
 		}
 	}
 
+	extern void diff(const Section &old_sec, const Section &new_sec, std::vector<std::string> &changed)
+	{
+		typedef std::map<std::string, std::vector<std::string>> Entries;
+		const Entries &old_entries = old_sec.get_entries();
+		const Entries &new_entries = new_sec.get_entries();
+		// both are sorted by key, so walk them together
+		Entries::const_iterator old_it = old_entries.begin();
+		Entries::const_iterator new_it = new_entries.begin();
+		while (old_it != old_entries.end() || new_it != new_entries.end())
+		{
+			if (new_it == new_entries.end() || (old_it != old_entries.end() && old_it->first < new_it->first))
+			{
+				changed.push_back(old_it->first);
+				old_it++;
+			}
+			else if (old_it == old_entries.end() || new_it->first < old_it->first)
+			{
+				changed.push_back(new_it->first);
+				new_it++;
+			}
+			else
+			{
+				if (old_it->second != new_it->second)
+				{
+					changed.push_back(old_it->first);
+				}
+				old_it++;
+				new_it++;
+			}
+		}
+	}
+
 	extern int save(const char *path, const Config *config)
 	{
 		if (config == NULL)
@@ -79,62 +144,235 @@ namespace msa { namespace cfg {
 		return 0;
 	}
 
-	extern Config *load(const char *path)
+	extern Config *load(const char *path, bool copy)
 	{
-		std::ifstream config_file;
-		config_file.open(path);
-		Config *config = NULL;
-		if (!config_file.is_open())
+		Config *config = new Config;
+		std::vector<std::string> errors;
+		if (!read_file(config, path, copy, errors))
 		{
-			return config;
+			delete config;
+			return NULL;
 		}
-		std::string line;
-		std::string section_name = "";
-		config = new Config;
-		int line_num = 1;
+		bool no_errors = errors.empty();
+		if (!no_errors)
+		{
+			print_errors(path, errors);
+		}
+		// includes are read even if the main file had errors so that everything
+		// wrong with the config is shown at once
+		no_errors = load_includes(config, path, copy) && no_errors;
+		if (!no_errors)
+		{
+			printf("\ncould not parse config file '%s'\n", path);
+			delete config;
+			config = NULL;
+		}
+		return config;
+	}
+
+	// returns false only if the file could not be opened
+	static bool read_file(Config *config, const std::string &path, bool copy, std::vector<std::string> &errors)
+	{
+		msa::file::Mapping *mapping;
+		try
+		{
+			mapping = msa::file::map(path, copy);
+		}
+		catch (const std::exception &e)
+		{
+			return false;
+		}
+		parse(config, msa::file::mapping_data(mapping), msa::file::mapping_size(mapping), errors);
+		msa::file::unmap(mapping);
+		return true;
+	}
+
+	/**
+	 * Reads every file matched by the include patterns in the top of the config. The files
+	 * are parsed on worker threads, but are always merged in the order that the patterns
+	 * are given (and in sorted order for the files matched by each one), so the result
+	 * does not depend on which worker finishes first. Values from included files are
+	 * added after any that are already set.
+	 */
+	static bool load_includes(Config *config, const char *path, bool copy)
+	{
+		Config::const_iterator global = config->find("");
+		if (global == config->end() || !global->second.has(include_key))
+		{
+			return true;
+		}
+		std::string base_dir = path;
+		msa::file::dirname(base_dir);
+		std::vector<std::string> paths;
 		bool no_errors = true;
-		while (!getline(config_file, line).eof())
+		const std::vector<std::string> &patterns = global->second.get_all(include_key);
+		for (size_t i = 0; i < patterns.size(); i++)
+		{
+			std::string pattern = patterns[i];
+			if (!msa::file::is_absolute(pattern))
+			{
+				pattern = base_dir;
+				msa::file::join(pattern, patterns[i]);
+			}
+			try
+			{
+				msa::file::glob(pattern, paths);
+			}
+			catch (const std::exception &e)
+			{
+				printf("error parsing config file '%s':\n", path);
+				printf("  include %s: %s\n", patterns[i].c_str(), e.what());
+				no_errors = false;
+			}
+		}
+		if (paths.empty())
+		{
+			return no_errors;
+		}
+
+		std::vector<Fragment> fragments(paths.size());
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			fragments[i].path = paths[i];
+		}
+		IncludeJob job;
+		job.fragments = &fragments;
+		job.next = 0;
+		job.copy = copy;
+		// the calling thread takes a share of the files as well
+		size_t worker_count = std::min(fragments.size(), max_include_workers) - 1;
+		std::vector<msa::thread::Thread> workers;
+		for (size_t i = 0; i < worker_count; i++)
+		{
+			msa::thread::Thread t;
+			if (msa::thread::create(&t, NULL, include_worker, &job, "cfg-include") == 0)
+			{
+				workers.push_back(t);
+			}
+		}
+		include_worker(&job);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			msa::thread::join(workers[i], NULL);
+		}
+
+		for (size_t i = 0; i < fragments.size(); i++)
+		{
+			if (!fragments[i].errors.empty())
+			{
+				print_errors(fragments[i].path, fragments[i].errors);
+				no_errors = false;
+			}
+			merge(config, fragments[i].config);
+		}
+		return no_errors;
+	}
+
+	static void *include_worker(void *args)
+	{
+		IncludeJob *job = (IncludeJob *) args;
+		size_t idx;
+		while ((idx = job->next++) < job->fragments->size())
 		{
-			remove_comments(line);
-			msa::string::trim(line);
-			if (line != "")
+			Fragment &frag = (*job->fragments)[idx];
+			if (!read_file(&frag.config, frag.path, job->copy, frag.errors))
+			{
+				frag.errors.push_back("could not open file");
+				continue;
+			}
+			Config::const_iterator global = frag.config.find("");
+			if (global != frag.config.end() && global->second.has(include_key))
+			{
+				frag.errors.push_back("included files cannot include other files");
+			}
+		}
+		return NULL;
+	}
+
+	static void merge(Config *config, const Config &fragment)
+	{
+		typedef std::map<std::string, std::vector<std::string>> Entries;
+		for (Config::const_iterator sec = fragment.begin(); sec != fragment.end(); sec++)
+		{
+			Section &dest = config->insert(std::make_pair(sec->first, Section(sec->first))).first->second;
+			const Entries &entries = sec->second.get_entries();
+			for (Entries::const_iterator it = entries.begin(); it != entries.end(); it++)
+			{
+				dest.create_key(it->first);
+				for (size_t i = 0; i < it->second.size(); i++)
+				{
+					dest.push(it->first, it->second[i]);
+				}
+			}
+		}
+	}
+
+	static void print_errors(const std::string &path, const std::vector<std::string> &errors)
+	{
+		printf("error parsing config file '%s':\n", path.c_str());
+		for (size_t i = 0; i < errors.size(); i++)
+		{
+			printf("  %s\n", errors[i].c_str());
+		}
+	}
+
+	/**
+	 * Scans the entire config in one pass. Lines are handled as ranges of the original
+	 * data, and only the final keys and values are ever copied out of it.
+	 */
+	static void parse(Config *config, const char *data, size_t size, std::vector<std::string> &errors)
+	{
+		const char *end = data + size;
+		const char *line = data;
+		Section *section = NULL;
+		int line_num = 1;
+		while (line < end)
+		{
+			const char *eol = (const char *) memchr(line, '\n', end - line);
+			if (eol == NULL)
+			{
+				// the last line does not need to end with a newline
+				eol = end;
+			}
+			const char *last = (const char *) memchr(line, comment_char, eol - line);
+			if (last == NULL)
+			{
+				last = eol;
+			}
+			const char *first = line;
+			trim(&first, &last);
+			if (first != last)
 			{
 				// parsing is all-or-nothing, but try to parse the whole thing
 				// so all errors are shown at once
 				try
 				{
-					interpret(config, section_name, line);
+					interpret(config, &section, first, last);
 				}
 				catch (std::exception &e)
 				{
-					printf("error parsing config file:\n");
-					printf("  on line %d: %s\n", line_num, e.what());
-					no_errors = false;
+					errors.push_back("on line " + std::to_string(line_num) + ": " + e.what());
 				}
 			}
+			line = eol + 1;
 			line_num++;
 		}
-		config_file.close();
-		if (!no_errors)
-		{
-			printf("\ncould not parse config file '%s'\n", path);
-			delete config;
-			config = NULL;
-		}
-		return config;
 	}
 	
-	static void interpret(Config *config, std::string &section_name, const std::string &line)
+	static void interpret(Config *config, Section **section, const char *first, const char *last)
 	{
-		const char &start = section_header_start_char;
-		const char &end = section_header_end_char;
-		if (line.front() == start && line.back() == end)
+		const char *split_at;
+		if (*first == section_header_start_char && *(last - 1) == section_header_end_char)
 		{
-			read_section_header(config, section_name, line);
+			read_section_header(config, section, first, last);
 		}
-		else if (line.find('=') != std::string::npos)
+		else if ((split_at = (const char *) memchr(first, '=', last - first)) != NULL)
 		{
-			read_kv_pair(config, section_name, line);
+			if (*section == NULL)
+			{
+				*section = &(*config)[""];
+			}
+			read_kv_pair(*section, first, split_at, last);
 		}
 		else
 		{
@@ -142,81 +380,104 @@ namespace msa { namespace cfg {
 		}
 	}
 
-	static void read_section_header(Config *config, std::string &section_name, const std::string &line)
+	static void read_section_header(Config *config, Section **section, const char *first, const char *last)
 	{
-		section_name = line.substr(1, line.size() - 2);
+		std::string section_name(first + 1, last - first - 2);
 		msa::string::to_upper(section_name);
 		check_is_identifier(section_name);
-		(*config)[section_name] = Section(section_name);
+		Section &sec = (*config)[section_name];
+		sec = Section(section_name);
+		*section = &sec;
 	}
 
-	static void read_kv_pair(Config *config, const std::string &section_name, const std::string &line)
+	static void read_kv_pair(Section *section, const char *first, const char *split_at, const char *last)
 	{
 		// split the line at the equals sign
-		size_t split_at = line.find('=');
-		std::string key = line.substr(0, split_at);
-		std::string val = line.substr(split_at + 1);
-		msa::string::trim(key);
-		msa::string::trim(val);
+		const char *key_last = split_at;
+		const char *val_first = split_at + 1;
+		trim(&first, &key_last);
+		trim(&val_first, &last);
 		
 		// check if there is an index
 		int index = -1;
-		size_t bracket_pos = key.find('[');
-		if (bracket_pos != std::string::npos && key.back() == ']')
+		const char *bracket_pos = (const char *) memchr(first, '[', key_last - first);
+		if (bracket_pos != NULL && *(key_last - 1) == ']')
 		{
-			std::string idx_str = key.substr(bracket_pos + 1, key.size() - bracket_pos - 2);
-			msa::string::trim(idx_str);
+			const char *idx_first = bracket_pos + 1;
+			const char *idx_last = key_last - 1;
+			trim(&idx_first, &idx_last);
 			// make sure we have ONLY digits
-			if (idx_str.find_first_not_of("1234567890") != std::string::npos)
+			if (idx_first == idx_last)
 			{
 				throw std::invalid_argument("key index can only be digits");
 			}
-			index = std::stoi(idx_str);
-			key = key.substr(0, bracket_pos);
-			msa::string::trim(key);
+			index = 0;
+			for (const char *c = idx_first; c < idx_last; c++)
+			{
+				if (*c < '0' || *c > '9')
+				{
+					throw std::invalid_argument("key index can only be digits");
+				}
+				if (index > (INT_MAX - 9) / 10)
+				{
+					throw std::out_of_range("key index is too large");
+				}
+				index = (index * 10) + (*c - '0');
+			}
+			key_last = bracket_pos;
+			trim(&first, &key_last);
 		}
 
 		// sanity check on the key
-		if (key == "")
+		if (first == key_last)
 		{
 			throw std::invalid_argument("key cannot be blank");
 		}
+		std::string key(first, key_last - first);
 		msa::string::to_upper(key);
 		// confirm key format
 		check_is_identifier(key);
 		
 		// are there quotes around the value? take them out if so
-		if (val.front() == '"' && val.back() == '"')
+		if (val_first != last && *val_first == '"' && *(last - 1) == '"')
 		{
-			val = val.substr(1, val.size() - 2);
+			val_first++;
+			if (last > val_first)
+			{
+				last--;
+			}
 		}
+		std::string val(val_first, last - val_first);
 
-		Section &sec = (*config)[section_name];
-		sec.create_key(key);
+		section->create_key(key);
 
 		// did we have an explicit index set? If so, we must use it to set the
 		// the value
 		if (index != -1)
 		{
 			size_t idx = (size_t) index;
-			while (sec.get_all(key).size() < idx + 1)
+			while (section->get_all(key).size() < idx + 1)
 			{
-				sec.push(key, std::string());
+				section->push(key, std::string());
 			}
-			sec.set(key, idx, val);
+			section->set(key, idx, val);
 		}
 		else
 		{
-			sec.push(key, val);
+			section->push(key, val);
 		}
 	}
 
-	static void remove_comments(std::string &line)
+	static void trim(const char **first, const char **last)
 	{
-		size_t pos = line.find(comment_char);
-		if (pos != std::string::npos)
+		const std::string &ws = msa::string::default_ws;
+		while (*first < *last && ws.find(**first) != std::string::npos)
 		{
-			line = line.substr(0, pos);
+			(*first)++;
+		}
+		while (*last > *first && ws.find(*(*last - 1)) != std::string::npos)
+		{
+			(*last)--;
 		}
 	}
 
@@ -282,13 +543,6 @@ namespace msa { namespace cfg {
 		return get_all(key).at(0);
 	}
 
-	Section &Section::operator=(const Section &sec)
-	{
-		name = sec.name;
-		entries = sec.entries;
-		return *this;
-	}
-
 	const std::string &Section::get_name() const
 	{
 		return name;
@@ -308,19 +562,57 @@ namespace msa { namespace cfg {
 	void Section::push(const std::string &key, const std::string &val)
 	{
 		entries.at(key).push_back(val);
+		std::vector<Value> &typed = values.at(key);
+		typed.push_back(Value());
+		parse_value(val, typed.back());
 	}
 	
-	void Section::set(const std::string &key, size_t index, std::string &val)
+	void Section::set(const std::string &key, size_t index, const std::string &val)
 	{
 		entries.at(key)[index] = val;
+		parse_value(val, values.at(key)[index]);
 	}
 	
 	void Section::create_key(const std::string &key)
 	{
-		if (!has(key))
+		// insert() leaves existing keys alone, so there is no need to check first
+		entries.insert(std::make_pair(key, std::vector<std::string>()));
+		values.insert(std::make_pair(key, std::vector<Value>()));
+	}
+
+	void Section::parse_value(const std::string &str, Value &val)
+	{
+		// values that are not numbers read as 0, the same as the stream
+		// extraction that used to be done on every lookup
+		const char *c_str = str.c_str();
+		errno = 0;
+		val.integer = std::strtoll(c_str, NULL, 10);
+		val.integer_overflow = (errno == ERANGE);
+		errno = 0;
+		val.real = std::strtod(c_str, NULL);
+		val.real_overflow = (errno == ERANGE && std::fabs(val.real) == HUGE_VAL);
+		val.upper = str;
+		msa::string::to_upper(val.upper);
+	}
+
+	const std::vector<Section::Value> &Section::get_values(const std::string &key) const
+	{
+		std::map<std::string, std::vector<Value>>::const_iterator iter = values.find(key);
+		if (iter == values.end())
 		{
-			entries[key] = std::vector<std::string>();
+			throw config_error(get_name(), key, "", "key does not exist");
 		}
+		return iter->second;
+	}
+
+	const Section::Value *Section::find_value(const std::string &key) const
+	{
+		std::map<std::string, std::vector<Value>>::const_iterator iter = values.find(key);
+		if (iter == values.end() || iter->second.empty())
+		{
+			return NULL;
+		}
+		return &iter->second.front();
 	}
 
 	void Section::check_exists(const std::string &key) const
@@ -336,6 +628,12 @@ namespace msa { namespace cfg {
 		return (*this)[key];
 	}
 	
+	template<> std::string Section::get_or<std::string>(const std::string &key, const std::string &def) const
+	{
+		std::map<std::string, std::vector<std::string>>::const_iterator iter = entries.find(key);
+		return (iter != entries.end() && !iter->second.empty()) ? iter->second.front() : def;
+	}
+	
 	template<> std::vector<std::string> Section::get_all_as<std::string>(const std::string &key) const
 	{
 		return std::vector<std::string>(get_all(key));
@@ -3,10 +3,11 @@
 
 #include <map>
 #include <string>
-#include <sstream>
 #include <vector>
 #include <stdexcept>
 #include <type_traits>
+#include <limits>
+#include <cmath>
 
 #include "util/string.hpp"
 
@@ -42,14 +43,13 @@ namespace msa { namespace cfg {
 		public:
 			Section();
 			Section(const std::string &name);
-			Section &operator=(const Section &sec);
 			bool has(const std::string &key) const;
 			const std::string &operator[](const std::string &key) const;
 			const std::string &get_name() const;
 			const std::map<std::string, std::vector<std::string>> &get_entries() const;
 			const std::vector<std::string> &get_all(const std::string &key) const;
 			void push(const std::string &key, const std::string &val);
-			void set(const std::string &key, size_t index, std::string &val);
+			void set(const std::string &key, size_t index, const std::string &val);
 			void create_key(const std::string &key);
 
 			/**
@@ -78,7 +78,7 @@ namespace msa { namespace cfg {
 				}
 				if (typed > max)
 				{
-					throw config_error(get_name(), key, (*this)[key], "must be less than or equal to " + std::to_string(min));
+					throw config_error(get_name(), key, (*this)[key], "must be less than or equal to " + std::to_string(max));
 				}
 			}
 
@@ -89,17 +89,17 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> void check_range_all(const std::string &key, const T &min, const T &max) const
 			{
-				std::vector<T> items;
-				get_all_as<T>(key, items);
-				for (size_t i = 0; i < items.size(); i++)
+				const std::vector<Value> &values = get_values(key);
+				for (size_t i = 0; i < values.size(); i++)
 				{
-					if (items.at(i) < min)
+					T typed = convert<T>(key, i, values[i]);
+					if (typed < min)
 					{
-						throw config_error(get_name(), key, i, (*this)[key], "must be greater than or equal to " + std::to_string(min));
+						throw config_error(get_name(), key, i, get_all(key)[i], "must be greater than or equal to " + std::to_string(min));
 					}
-					if (items.at(i) > max)
+					if (typed > max)
 					{
-						throw config_error(get_name(), key, i, (*this)[key], "must be less than or equal to " + std::to_string(min));
+						throw config_error(get_name(), key, i, get_all(key)[i], "must be less than or equal to " + std::to_string(max));
 					}
 				}
 			}
@@ -111,11 +111,7 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> T get_as(const std::string &key) const
 			{
-				static_assert(std::is_arithmetic<T>::value, "for converting values, only arithmetic types are supported");
-				std::istringstream ss((*this)[key]);
-				T typed;
-				ss >> typed;
-				return typed;
+				return convert<T>(key, 0, get_values(key).at(0));
 			}
 
 			/**
@@ -123,16 +119,13 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> T get_as_enum(const std::string &key, const std::map<std::string, T> &enum_map, bool case_sensitive = false) const
 			{
-				std::string val = (*this)[key];
-				if (!case_sensitive)
-				{
-					msa::string::to_upper(val);
-				}
-				if (enum_map.find(val) == enum_map.end())
+				const std::string &val = case_sensitive ? (*this)[key] : get_values(key).at(0).upper;
+				typename std::map<std::string, T>::const_iterator iter = enum_map.find(val);
+				if (iter == enum_map.end())
 				{
 					throw config_error(get_name(), key, (*this)[key], "not a valid kind of " + key);
 				}
-				return enum_map.at(val);
+				return iter->second;
 			}
 
 			/**
@@ -143,7 +136,8 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> T get_or(const std::string &key, const T &def) const
 			{
-				return has(key) ? get_as<T>(key) : def;
+				const Value *val = find_value(key);
+				return val != NULL ? convert<T>(key, 0, *val) : def;
 			}
 
 			/**
@@ -165,15 +159,12 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> std::vector<T> get_all_as(const std::string &key) const
 			{
-				static_assert(std::is_arithmetic<T>::value, "for converting values, only arithmetic types are supported");
+				const std::vector<Value> &values = get_values(key);
 				std::vector<T> items;
-				const std::vector<std::string> all = get_all(key);
-				for (auto i = all.begin(); i != all.end(); i++)
+				items.reserve(values.size());
+				for (size_t i = 0; i < values.size(); i++)
 				{
-					std::istringstream ss(*i);
-					T typed;
-					ss >> typed;
-					items.push_back(typed);
+					items.push_back(convert<T>(key, i, values[i]));
 				}
 				return items;
 			}
@@ -183,36 +174,98 @@ namespace msa { namespace cfg {
 			 */
 			template<class T> std::vector<T> get_all_as_enum(const std::string &key, const std::map<std::string, T> &enum_map, bool case_sensitive = false) const
 			{
-				const std::vector<std::string> all = get_all(key);
+				const std::vector<std::string> &all = get_all(key);
+				const std::vector<Value> &values = get_values(key);
 				std::vector<T> items;
+				items.reserve(all.size());
 				for (size_t i = 0; i < all.size(); i++)
 				{
-					std::string val = all[i];
-					if (!case_sensitive)
+					const std::string &val = case_sensitive ? all[i] : values[i].upper;
+					typename std::map<std::string, T>::const_iterator iter = enum_map.find(val);
+					if (iter == enum_map.end())
 					{
-						msa::string::to_upper(val);
+						throw config_error(get_name(), key, i, all[i], "not a valid kind of " + key);
 					}
-					if (enum_map.find(val) == enum_map.end())
-					{
-						throw config_error(get_name(), key, i, (*this)[key], "not a valid kind of " + key);
-					}
-					items.push_back(enum_map.at(val));
+					items.push_back(iter->second);
 				}
 				return items;
 			}
 		
 		private:
+			/**
+			 * The typed forms of a value, parsed once when the value is set so that
+			 * lookups never need to parse it again.
+			 */
+			typedef struct value_type
+			{
+				long long integer;
+				double real;
+				// set when the number was too large for integer or real to hold
+				bool integer_overflow;
+				bool real_overflow;
+				std::string upper;
+			} Value;
+
+			/**
+			 * Converts a value of the key to the given type. Throws a config_error if the
+			 * value does not fit in the type, rather than letting it be cut down.
+			 */
+			template<class T> T convert(const std::string &key, size_t index, const Value &val) const
+			{
+				static_assert(std::is_arithmetic<T>::value, "for converting values, only arithmetic types are supported");
+				if (!fits<T>(val, std::is_floating_point<T>()))
+				{
+					std::string what = "must be from " + std::to_string(std::numeric_limits<T>::lowest()) + " to " + std::to_string(std::numeric_limits<T>::max());
+					if (index > 0)
+					{
+						throw config_error(get_name(), key, index, get_all(key)[index], what);
+					}
+					throw config_error(get_name(), key, get_all(key)[index], what);
+				}
+				return std::is_floating_point<T>::value ? (T) val.real : (T) val.integer;
+			}
+
+			template<class T> static bool fits(const Value &val, std::true_type)
+			{
+				return !val.real_overflow && !(std::fabs(val.real) > std::numeric_limits<T>::max());
+			}
+
+			template<class T> static bool fits(const Value &val, std::false_type)
+			{
+				if (val.integer_overflow)
+				{
+					return false;
+				}
+				if (val.integer < 0)
+				{
+					return std::is_signed<T>::value && val.integer >= (long long) std::numeric_limits<T>::lowest();
+				}
+				return (unsigned long long) val.integer <= (unsigned long long) std::numeric_limits<T>::max();
+			}
+
+			static void parse_value(const std::string &str, Value &val);
+			const std::vector<Value> &get_values(const std::string &key) const;
+			const Value *find_value(const std::string &key) const;
+
 			std::string name;
 			std::map<std::string, std::vector<std::string>> entries;
+			std::map<std::string, std::vector<Value>> values;
 	};
 	template<> std::string Section::get_as<std::string>(const std::string &key) const;
+	template<> std::string Section::get_or<std::string>(const std::string &key, const std::string &def) const;
 	template<> std::vector<std::string> Section::get_all_as<std::string>(const std::string &key) const;
 
 	typedef std::map<std::string, Section> Config;
 
-	extern Config *load(const char *path);
+	// files that may be changed while they are read, as when reloading, should be copied
+	// into memory rather than mapped
+	extern Config *load(const char *path, bool copy = false);
 	extern int save(const char *path, const Config *configuration);
 
+	// gets the keys whose values differ between two versions of a section, including
+	// keys that are only in one of them
+	extern void diff(const Section &old_sec, const Section &new_sec, std::vector<std::string> &changed);
+
 	extern void dump_conf(const Config *conf);
 	extern void dump_section(const Section &sect);
 
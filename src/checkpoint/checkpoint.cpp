@@ -0,0 +1,305 @@
+#include "checkpoint/checkpoint.hpp"
+
+#include <map>
+#include <cstdio>
+
+#include "platform/file/file.hpp"
+
+namespace msa { namespace checkpoint {
+
+	static const char MAGIC[8] = {'M', 'S', 'A', 'C', 'K', 'P', 'T', '\0'};
+	static const uint32_t FORMAT_VERSION = 1;
+	static const size_t TAG_SIZE = 4;
+
+	typedef struct section_type
+	{
+		uint32_t version;
+		// points into the mapping for a loaded snapshot, or into payload for a new one
+		const char *data;
+		size_t size;
+		std::string payload;
+	} Section;
+
+	struct snapshot_type
+	{
+		std::map<std::string, Section> sections;
+		// NULL unless the snapshot was loaded from a file
+		msa::file::Mapping *mapping;
+	};
+
+	static void put_le(std::string &buf, uint64_t value, size_t bytes);
+	static uint64_t get_le(const char *data, size_t bytes);
+
+	void Writer::put_u8(uint8_t value)
+	{
+		put_le(buf, value, 1);
+	}
+
+	void Writer::put_u32(uint32_t value)
+	{
+		put_le(buf, value, 4);
+	}
+
+	void Writer::put_u64(uint64_t value)
+	{
+		put_le(buf, value, 8);
+	}
+
+	void Writer::put_i64(int64_t value)
+	{
+		put_le(buf, (uint64_t) value, 8);
+	}
+
+	void Writer::put_bool(bool value)
+	{
+		put_le(buf, value ? 1 : 0, 1);
+	}
+
+	void Writer::put_string(const std::string &value)
+	{
+		put_le(buf, value.size(), 4);
+		buf += value;
+	}
+
+	void Writer::append(const Writer &other)
+	{
+		buf += other.buf;
+	}
+
+	const std::string &Writer::data() const
+	{
+		return buf;
+	}
+
+	Reader::Reader(const char *data, size_t size) : data(data), size(size), pos(0)
+	{}
+
+	uint8_t Reader::get_u8()
+	{
+		return (uint8_t) get_le(take(1), 1);
+	}
+
+	uint32_t Reader::get_u32()
+	{
+		return (uint32_t) get_le(take(4), 4);
+	}
+
+	uint64_t Reader::get_u64()
+	{
+		return get_le(take(8), 8);
+	}
+
+	int64_t Reader::get_i64()
+	{
+		return (int64_t) get_le(take(8), 8);
+	}
+
+	bool Reader::get_bool()
+	{
+		return get_le(take(1), 1) != 0;
+	}
+
+	std::string Reader::get_string()
+	{
+		size_t len = get_le(take(4), 4);
+		return std::string(take(len), len);
+	}
+
+	bool Reader::at_end() const
+	{
+		return pos >= size;
+	}
+
+	const char *Reader::get_bytes(size_t count)
+	{
+		return take(count);
+	}
+
+	const char *Reader::take(size_t count)
+	{
+		if (count > size - pos)
+		{
+			throw checkpoint_error("section ends early");
+		}
+		const char *start = data + pos;
+		pos += count;
+		return start;
+	}
+
+	extern Snapshot *create_snapshot()
+	{
+		Snapshot *snap = new Snapshot;
+		snap->mapping = NULL;
+		return snap;
+	}
+
+	extern void dispose_snapshot(Snapshot *snap)
+	{
+		if (snap->mapping != NULL)
+		{
+			msa::file::unmap(snap->mapping);
+		}
+		delete snap;
+	}
+
+	extern void add_section(Snapshot *snap, const std::string &tag, uint32_t version, const Writer &payload)
+	{
+		if (tag.size() != TAG_SIZE)
+		{
+			throw std::invalid_argument("section tag must be " + std::to_string(TAG_SIZE) + " characters: " + tag);
+		}
+		Section &sec = snap->sections[tag];
+		sec.version = version;
+		sec.payload = payload.data();
+		sec.data = sec.payload.data();
+		sec.size = sec.payload.size();
+	}
+
+	extern size_t save(const Snapshot *snap, const std::string &path)
+	{
+		std::string buf(MAGIC, sizeof(MAGIC));
+		put_le(buf, FORMAT_VERSION, 4);
+		put_le(buf, snap->sections.size(), 4);
+		std::map<std::string, Section>::const_iterator iter;
+		for (iter = snap->sections.begin(); iter != snap->sections.end(); iter++)
+		{
+			buf += iter->first;
+			put_le(buf, iter->second.version, 4);
+			put_le(buf, iter->second.size, 8);
+			buf.append(iter->second.data, iter->second.size);
+		}
+
+		// the data must be on disk before the rename, or a crash could leave an empty file
+		// in place of the old checkpoint; the directory is synced so the rename is too
+		std::string tmp_path = path + ".tmp";
+		msa::file::AppendFile *file;
+		try
+		{
+			file = msa::file::open_append(tmp_path, true);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw checkpoint_error(std::string("could not open checkpoint for writing: ") + e.what());
+		}
+		bool written = msa::file::append(file, buf.data(), buf.size()) && msa::file::sync(file);
+		msa::file::close_append(file);
+		if (!written)
+		{
+			remove(tmp_path.c_str());
+			throw checkpoint_error("could not write " + tmp_path);
+		}
+		if (rename(tmp_path.c_str(), path.c_str()) != 0)
+		{
+			remove(tmp_path.c_str());
+			throw checkpoint_error("could not replace " + path);
+		}
+		std::string dir_path = path;
+		msa::file::dirname(dir_path);
+		if (!msa::file::sync_dir(dir_path))
+		{
+			throw checkpoint_error("could not sync the directory of " + path);
+		}
+		return buf.size();
+	}
+
+	extern Snapshot *load(const std::string &path)
+	{
+		msa::file::Mapping *mapping = NULL;
+		try
+		{
+			mapping = msa::file::map(path);
+		}
+		catch (const std::logic_error &e)
+		{
+			throw checkpoint_error(e.what());
+		}
+		Snapshot *snap = create_snapshot();
+		snap->mapping = mapping;
+		try
+		{
+			Reader header(msa::file::mapping_data(mapping), msa::file::mapping_size(mapping));
+			for (size_t i = 0; i < sizeof(MAGIC); i++)
+			{
+				if ((char) header.get_u8() != MAGIC[i])
+				{
+					throw checkpoint_error(path + " is not a checkpoint file");
+				}
+			}
+			uint32_t format = header.get_u32();
+			if (format != FORMAT_VERSION)
+			{
+				throw checkpoint_error(path + " has unknown format version " + std::to_string(format));
+			}
+			uint32_t count = header.get_u32();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				std::string tag;
+				for (size_t c = 0; c < TAG_SIZE; c++)
+				{
+					tag += (char) header.get_u8();
+				}
+				Section &sec = snap->sections[tag];
+				sec.version = header.get_u32();
+				sec.size = header.get_u64();
+				// the payload is not copied; it is read from the mapping when asked for
+				sec.data = header.get_bytes(sec.size);
+			}
+		}
+		catch (const checkpoint_error &)
+		{
+			dispose_snapshot(snap);
+			throw;
+		}
+		return snap;
+	}
+
+	extern size_t size(const Snapshot *snap)
+	{
+		if (snap->mapping != NULL)
+		{
+			return msa::file::mapping_size(snap->mapping);
+		}
+		size_t total = sizeof(MAGIC) + 8;
+		std::map<std::string, Section>::const_iterator iter;
+		for (iter = snap->sections.begin(); iter != snap->sections.end(); iter++)
+		{
+			total += TAG_SIZE + 12 + iter->second.size;
+		}
+		return total;
+	}
+
+	extern bool has_section(const Snapshot *snap, const std::string &tag, uint32_t version)
+	{
+		std::map<std::string, Section>::const_iterator iter = snap->sections.find(tag);
+		return iter != snap->sections.end() && iter->second.version == version;
+	}
+
+	extern Reader read_section(const Snapshot *snap, const std::string &tag)
+	{
+		std::map<std::string, Section>::const_iterator iter = snap->sections.find(tag);
+		if (iter == snap->sections.end())
+		{
+			throw checkpoint_error("no section " + tag);
+		}
+		return Reader(iter->second.data, iter->second.size);
+	}
+
+	static void put_le(std::string &buf, uint64_t value, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; i++)
+		{
+			buf += (char) ((value >> (8 * i)) & 0xff);
+		}
+	}
+
+	static uint64_t get_le(const char *data, size_t bytes)
+	{
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; i++)
+		{
+			value |= ((uint64_t) (unsigned char) data[i]) << (8 * i);
+		}
+		return value;
+	}
+
+} }
@@ -0,0 +1,84 @@
+#ifndef MSA_CHECKPOINT_CHECKPOINT_HPP
+#define MSA_CHECKPOINT_CHECKPOINT_HPP
+
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// Snapshots of runtime state, so that a restarted instance can pick up where the
+// last one stopped. A snapshot is a set of sections, each tagged with the four
+// character name and the version of the module state in it. Every module writes
+// and reads its own sections; a section that is missing or has a different
+// version is skipped rather than guessed at.
+
+namespace msa { namespace checkpoint {
+
+	class checkpoint_error : public std::runtime_error
+	{
+		public:
+			checkpoint_error(const std::string &what) : std::runtime_error(what) {}
+	};
+
+	// builds the payload of a section. Values are stored little-endian regardless of
+	// the host.
+	class Writer
+	{
+		public:
+			void put_u8(uint8_t value);
+			void put_u32(uint32_t value);
+			void put_u64(uint64_t value);
+			void put_i64(int64_t value);
+			void put_bool(bool value);
+			void put_string(const std::string &value);
+			// adds everything another writer has
+			void append(const Writer &other);
+			const std::string &data() const;
+
+		private:
+			std::string buf;
+	};
+
+	// reads back what a Writer wrote, in the same order. Getters throw a
+	// checkpoint_error rather than read past the end.
+	class Reader
+	{
+		public:
+			Reader(const char *data, size_t size);
+			uint8_t get_u8();
+			uint32_t get_u32();
+			uint64_t get_u64();
+			int64_t get_i64();
+			bool get_bool();
+			std::string get_string();
+			// gives the next count bytes without copying them
+			const char *get_bytes(size_t count);
+			bool at_end() const;
+
+		private:
+			const char *take(size_t count);
+			const char *data;
+			size_t size;
+			size_t pos;
+	};
+
+	typedef struct snapshot_type Snapshot;
+
+	extern Snapshot *create_snapshot();
+	extern void dispose_snapshot(Snapshot *snap);
+	// tag must be four characters
+	extern void add_section(Snapshot *snap, const std::string &tag, uint32_t version, const Writer &payload);
+	// writes to a temporary file first, so a crash while saving leaves any older file whole.
+	// Returns the number of bytes written.
+	extern size_t save(const Snapshot *snap, const std::string &path);
+	// maps the file into memory; sections are read straight out of the mapping, which stays
+	// until the snapshot is disposed. Throws checkpoint_error if the file is not a snapshot.
+	extern Snapshot *load(const std::string &path);
+	extern size_t size(const Snapshot *snap);
+	// whether the snapshot has the section at exactly the given version
+	extern bool has_section(const Snapshot *snap, const std::string &tag, uint32_t version);
+	extern Reader read_section(const Snapshot *snap, const std::string &tag);
+
+} }
+
+#endif
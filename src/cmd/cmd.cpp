@@ -4,6 +4,9 @@
 #include "agent/agent.hpp"
 #include "log/log.hpp"
 #include "util/util.hpp"
+#include "metrics/metrics.hpp"
+#include "memory/memory.hpp"
+#include "platform/thread/thread.hpp"
 
 #include <cstdio>
 #include <stdexcept>
@@ -18,22 +21,65 @@ namespace msa { namespace cmd {
 		#undef MSA_MODULE_HOOK
 	};
 
+	// a single piece of a compiled alias token; either literal text or a reference
+	// to one of the positional parameters given when the alias is invoked
+	typedef struct alias_piece_type
+	{
+		std::string text;
+		// 0 for literal text, N for $N, or ALL_PARAMS for $@
+		int param;
+	} AliasPiece;
+
+	typedef std::vector<AliasPiece> AliasToken;
+
+	typedef struct alias_type
+	{
+		std::string name;
+		std::string expansion;
+		std::vector<AliasToken> tokens;
+		// whether any token refers to a parameter; if none do, the invocation
+		// arguments are appended to the expansion
+		bool has_params;
+	} Alias;
+
+	// an entry in the command table; exactly one of command and alias is set, so that
+	// resolving an alias costs the same single lookup as resolving a command
+	typedef struct invokable_type
+	{
+		const Command *command;
+		const Alias *alias;
+	} Invokable;
+
+	typedef std::map<std::string, Invokable> CommandTable;
+
 	struct command_context_type
 	{
 		int last_status;
 		bool last_threw_exception;
-		std::map<std::string, const Command *> commands;
+		CommandTable commands;
+		// guards commands, which plugins change from their own threads
+		msa::thread::Mutex mutex;
+		msa::metrics::Counter *run_metric;
+		msa::metrics::Counter *failed_metric;
 	};
 
+	static const int ALL_PARAMS = -1;
+	static const int MAX_ALIAS_DEPTH = 16;
+
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
 	static int create_command_context(CommandContext **ctx);
 	static int dispose_command_context(CommandContext *ctx);
-	static void shell_tokenize(const std::string &str, std::vector<std::string> &output);
+	static void define_alias(msa::Handle hdl, const std::string &name, const std::vector<std::string> &template_tokens);
+	static void compile_alias_token(const std::string &tok, AliasToken &compiled, bool *has_params);
+	static void expand_alias(const Alias *alias, const std::vector<std::string> &tokens, std::vector<std::string> &output);
+	static std::string escape_expansion(const std::string &text);
 
 	// handlers
 	static Result help_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const sync);
 	static Result echo_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const sync);
 	static Result kill_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const sync);
+	static Result alias_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const sync);
+	static Result unalias_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const sync);
 	static void parse_command(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync);
 
 	static void register_default_commands(msa::Handle hdl);
@@ -42,7 +88,9 @@ namespace msa { namespace cmd {
 	static const Command default_commands[] = {
 		{"KILL", "It shuts down this MSA instance", "", kill_func},
 		{"ECHO", "It outputs its arguments", "echo-args...", echo_func},
-		{"HELP", "With no args, it lists all commands. Otherwise, it displays the help", "[command]", help_func}
+		{"HELP", "With no args, it lists all commands. Otherwise, it displays the help", "[command]", help_func},
+		{"ALIAS", "It defines a new command that runs another command line; $1, $2, etc. and $@ in the command line are replaced with the alias's arguments", "[name [= command-line...]]", alias_func},
+		{"UNALIAS", "It removes an alias", "name", unalias_func}
 	};
 
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
@@ -61,6 +109,8 @@ namespace msa { namespace cmd {
 			return 1;
 		}
 		
+		hdl->cmd->run_metric = msa::metrics::get_counter(hdl, "msa_commands_total", "Command lines that named a known command");
+		hdl->cmd->failed_metric = msa::metrics::get_counter(hdl, "msa_command_failures_total", "Command lines that named no known command, had bad arguments, threw or returned non-zero");
 		register_default_commands(hdl);
 		
 		msa::event::subscribe(hdl, msa::event::Topic::TEXT_INPUT, parse_command);
@@ -97,16 +147,36 @@ namespace msa { namespace cmd {
 		return &HOOKS;
 	}
 
+	/**
+	 * Adds a command. A user's alias cannot stop a plugin from being enabled, so a command
+	 * replaces an alias of the same name; ALIAS refuses the names of existing commands.
+	 */
 	extern void register_command(msa::Handle hdl, const Command *cmd)
 	{
 		CommandContext *ctx = hdl->cmd;
 		std::string invoke = std::string(cmd->invoke);
 		msa::string::to_upper(invoke);
-		if (ctx->commands.find(invoke) != ctx->commands.end())
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::iterator iter = ctx->commands.find(invoke);
+		if (iter != ctx->commands.end() && iter->second.command != NULL)
 		{
+			msa::thread::mutex_unlock(&ctx->mutex);
 			throw std::logic_error("command already exists: " + invoke);
 		}
-		ctx->commands[invoke] = cmd;
+		const Alias *replaced = NULL;
+		if (iter != ctx->commands.end())
+		{
+			replaced = iter->second.alias;
+		}
+		Invokable &entry = ctx->commands[invoke];
+		entry.command = cmd;
+		entry.alias = NULL;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (replaced != NULL)
+		{
+			msa::log::warn(hdl, "Command " + invoke + " replaces the alias of the same name, which ran: " + replaced->expansion);
+			delete replaced;
+		}
 	}
 
 	extern void unregister_command(msa::Handle hdl, const Command *cmd)
@@ -114,25 +184,82 @@ namespace msa { namespace cmd {
 		CommandContext *ctx = hdl->cmd;
 		std::string invoke = std::string(cmd->invoke);
 		msa::string::to_upper(invoke);
-		if (ctx->commands.find(invoke) == ctx->commands.end())
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::iterator iter = ctx->commands.find(invoke);
+		if (iter == ctx->commands.end() || iter->second.command == NULL)
 		{
+			msa::thread::mutex_unlock(&ctx->mutex);
 			throw std::logic_error("command does not exist: " + invoke);
 		}
-		ctx->commands.erase(invoke);
+		ctx->commands.erase(iter);
+		msa::thread::mutex_unlock(&ctx->mutex);
 	}
 	
 	extern void get_commands(msa::Handle hdl, std::vector<const Command *> &list)
 	{
 		CommandContext *ctx = hdl->cmd;
-		std::map<std::string, const Command *>::const_iterator iter;
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::const_iterator iter;
 		for (iter = ctx->commands.begin(); iter != ctx->commands.end(); iter++)
 		{
-			list.push_back(iter->second);
+			if (iter->second.command != NULL)
+			{
+				list.push_back(iter->second.command);
+			}
 		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern void add_alias(msa::Handle hdl, const std::string &name, const std::string &expansion)
+	{
+		std::vector<std::string> template_tokens;
+		shell_tokenize(expansion, template_tokens);
+		define_alias(hdl, name, template_tokens);
+	}
+
+	extern void remove_alias(msa::Handle hdl, const std::string &name)
+	{
+		CommandContext *ctx = hdl->cmd;
+		std::string invoke = name;
+		msa::string::to_upper(invoke);
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::iterator iter = ctx->commands.find(invoke);
+		if (iter == ctx->commands.end() || iter->second.alias == NULL)
+		{
+			msa::thread::mutex_unlock(&ctx->mutex);
+			throw std::logic_error("alias does not exist: " + invoke);
+		}
+		const Alias *alias = iter->second.alias;
+		ctx->commands.erase(iter);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		delete alias;
 	}
 
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config)
 	{
+		if (config.has("ALIAS"))
+		{
+			// each entry is in the same 'name = command-line' form that the ALIAS command takes
+			const std::vector<std::string> &defs = config.get_all("ALIAS");
+			for (size_t i = 0; i < defs.size(); i++)
+			{
+				size_t split_at = defs[i].find('=');
+				if (split_at == std::string::npos)
+				{
+					throw msa::cfg::config_error(config.get_name(), "ALIAS", i, defs[i], "must be in the form 'name = command-line'");
+				}
+				std::string name = defs[i].substr(0, split_at);
+				msa::string::trim(name);
+				try
+				{
+					add_alias(hdl, name, defs[i].substr(split_at + 1));
+				}
+				catch (const std::exception &e)
+				{
+					throw msa::cfg::config_error(config.get_name(), "ALIAS", i, defs[i], e.what());
+				}
+			}
+		}
 		std::string startup_cmd = config.get_or<std::string>("STARTUP", "echo I'd like to announce my presence!");
 		msa::event::generate(hdl, msa::event::Topic::TEXT_INPUT, msa::event::wrap(startup_cmd));
 	}
@@ -142,12 +269,24 @@ namespace msa { namespace cmd {
 		CommandContext *c = new CommandContext;
 		c->last_status = 0;
 		c->last_threw_exception = false;
+		msa::thread::mutex_init(&c->mutex, NULL);
+		c->run_metric = NULL;
+		c->failed_metric = NULL;
 		*ctx = c;
 		return 0;
 	}
 
 	static int dispose_command_context(CommandContext *ctx)
 	{
+		CommandTable::iterator iter;
+		for (iter = ctx->commands.begin(); iter != ctx->commands.end(); iter++)
+		{
+			if (iter->second.alias != NULL)
+			{
+				delete iter->second.alias;
+			}
+		}
+		msa::thread::mutex_destroy(&ctx->mutex);
 		delete ctx;
 		return 0;
 	}
@@ -161,7 +300,6 @@ namespace msa { namespace cmd {
 			if (status != MSA_ERR_LOG)
 			{
 				msa::log::error(hdl, "Shutdown error: " + std::to_string(status));
-				msa::util::sleep_milli(250); // give log a chance to get the error
 			}
 			return Result(1, std::string("Shutdown error ") + std::to_string(status));
 		}
@@ -175,15 +313,34 @@ namespace msa { namespace cmd {
 		{
 			std::string cmd_name = params[0];
 			msa::string::to_upper(cmd_name);
-			if (ctx->commands.find(cmd_name) == ctx->commands.end())
+			bool found = false;
+			const Command *cmd = NULL;
+			std::string expansion;
+			msa::thread::mutex_lock(&ctx->mutex);
+			CommandTable::const_iterator entry = ctx->commands.find(cmd_name);
+			if (entry != ctx->commands.end())
+			{
+				found = true;
+				cmd = entry->second.command;
+				if (entry->second.alias != NULL)
+				{
+					expansion = entry->second.alias->expansion;
+				}
+			}
+			msa::thread::mutex_unlock(&ctx->mutex);
+			if (!found)
 			{
 				msa::agent::say(hdl, "I'm sorry, $USER_TITLE, but I don't know about the command '" + cmd_name + "'.");
 				msa::agent::say(hdl, "But if you do HELP with no args, I'll list the commands I do know!");
 				return Result(1);
 			}
+			else if (cmd == NULL)
+			{
+				msa::agent::say(hdl, "Oh, " + cmd_name + " is an alias! It runs this: " + escape_expansion(expansion));
+				return Result(0);
+			}
 			else
 			{
-				const Command *cmd = ctx->commands[cmd_name];
 				msa::agent::say(hdl, "Oh yeah, that's the " + cmd_name + " command!");
 				msa::agent::say(hdl, cmd->desc + ".");
 				std::string usage_str = "";				
@@ -233,10 +390,17 @@ namespace msa { namespace cmd {
 		else
 		{
 			msa::agent::say(hdl, "Sure! I'll list the commands I know about.");
-			std::map<std::string, const Command *>::const_iterator iter;
+			std::vector<std::string> names;
+			msa::thread::mutex_lock(&ctx->mutex);
+			CommandTable::const_iterator iter;
 			for (iter = ctx->commands.begin(); iter != ctx->commands.end(); iter++)
 			{
-				msa::agent::say(hdl, iter->first);
+				names.push_back(iter->first + (iter->second.alias != NULL ? " (alias)" : ""));
+			}
+			msa::thread::mutex_unlock(&ctx->mutex);
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				msa::agent::say(hdl, names[i]);
 			}
 			msa::agent::say(hdl, "You can do HELP followed by the name of a command to find out more.");
 			return Result(0);
@@ -258,8 +422,102 @@ namespace msa { namespace cmd {
 		return Result(0);
 	}
 	
+	static Result alias_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const UNUSED(sync))
+	{
+		CommandContext *ctx = hdl->cmd;
+		CommandTable::const_iterator iter;
+		if (params.arg_count() == 0)
+		{
+			std::vector<std::string> lines;
+			msa::thread::mutex_lock(&ctx->mutex);
+			for (iter = ctx->commands.begin(); iter != ctx->commands.end(); iter++)
+			{
+				if (iter->second.alias != NULL)
+				{
+					lines.push_back(iter->first + " = " + escape_expansion(iter->second.alias->expansion));
+				}
+			}
+			msa::thread::mutex_unlock(&ctx->mutex);
+			if (lines.empty())
+			{
+				msa::agent::say(hdl, "I don't have any aliases yet, $USER_TITLE.");
+				return Result(0);
+			}
+			msa::agent::say(hdl, "Here are the aliases I know about:");
+			for (size_t i = 0; i < lines.size(); i++)
+			{
+				msa::agent::say(hdl, lines[i]);
+			}
+			return Result(0);
+		}
+		std::string name = params[0];
+		msa::string::to_upper(name);
+		if (params.arg_count() == 1)
+		{
+			bool found = false;
+			std::string expansion;
+			msa::thread::mutex_lock(&ctx->mutex);
+			iter = ctx->commands.find(name);
+			if (iter != ctx->commands.end() && iter->second.alias != NULL)
+			{
+				found = true;
+				expansion = iter->second.alias->expansion;
+			}
+			msa::thread::mutex_unlock(&ctx->mutex);
+			if (!found)
+			{
+				msa::agent::say(hdl, "Sorry, $USER_TITLE, but there's no alias called '" + name + "'.");
+				return Result(1);
+			}
+			msa::agent::say(hdl, name + " = " + escape_expansion(expansion));
+			return Result(0);
+		}
+		if (params[1] != "=" || params.arg_count() < 3)
+		{
+			msa::agent::say(hdl, "To make an alias, tell me it like this: ALIAS name = command-line");
+			return Result(2);
+		}
+		std::vector<std::string> template_tokens;
+		for (size_t i = 2; i < params.arg_count(); i++)
+		{
+			template_tokens.push_back(params[i]);
+		}
+		try
+		{
+			define_alias(hdl, name, template_tokens);
+		}
+		catch (const std::logic_error &e)
+		{
+			msa::agent::say(hdl, "Oh no, I couldn't make that alias: " + std::string(e.what()));
+			return Result(3);
+		}
+		msa::agent::say(hdl, "Okay, $USER_TITLE! Now " + name + " will do that for you.");
+		return Result(0);
+	}
+
+	static Result unalias_func(msa::Handle hdl, const ParamList &params, msa::event::HandlerSync *const UNUSED(sync))
+	{
+		if (params.arg_count() < 1)
+		{
+			msa::agent::say(hdl, "Which alias should I get rid of, $USER_TITLE?");
+			return Result(1);
+		}
+		try
+		{
+			remove_alias(hdl, params[0]);
+		}
+		catch (const std::logic_error &e)
+		{
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, but there's no alias called '" + params[0] + "'.");
+			return Result(2);
+		}
+		msa::agent::say(hdl, "All right, I forgot about that alias.");
+		return Result(0);
+	}
+	
 	static void parse_command(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync)
 	{
+		msa::memory::Scope memory_scope(msa::memory::Tag::CMD);
 		CommandContext *ctx = hdl->cmd;
 		auto e_args = dynamic_cast<msa::event::Args<std::string>*>(e->args);
 		std::string str = e_args->get_args();
@@ -274,15 +532,68 @@ namespace msa { namespace cmd {
 		}
 		std::string cmd_name = tokens[0];
 		msa::string::to_upper(cmd_name);
-		if (ctx->commands.find(cmd_name) == ctx->commands.end())
+		const Command *cmd = NULL;
+		bool circular = false;
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::const_iterator entry = ctx->commands.find(cmd_name);
+
+		// aliases are already compiled to tokens, so they are expanded in place rather
+		// than being joined back into a line and tokenized again
+		int alias_depth = 0;
+		std::vector<std::string> expanded;
+		while (entry != ctx->commands.end() && entry->second.alias != NULL)
+		{
+			if (++alias_depth > MAX_ALIAS_DEPTH)
+			{
+				circular = true;
+				break;
+			}
+			expanded.clear();
+			expand_alias(entry->second.alias, tokens, expanded);
+			tokens.swap(expanded);
+			if (tokens.size() == 0)
+			{
+				break;
+			}
+			cmd_name = tokens[0];
+			msa::string::to_upper(cmd_name);
+			entry = ctx->commands.find(cmd_name);
+		}
+		if (!circular && tokens.size() > 0 && entry != ctx->commands.end())
+		{
+			cmd = entry->second.command;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+
+		if (circular)
 		{
+			msa::log::warn(hdl, "Alias expansion of '" + tokens[0] + "' exceeded max depth " + std::to_string(MAX_ALIAS_DEPTH));
+			msa::metrics::increment(ctx->failed_metric, 1);
+			msa::agent::say(hdl, "Hmm, $USER_TITLE, those aliases just keep going in circles, so I stopped.");
+			msa::agent::print_prompt_char(hdl);
+		}
+		else if (tokens.size() == 0)
+		{
+			// an alias that expanded to nothing has nothing to run
+			msa::agent::print_prompt_char(hdl);
+		}
+		else if (cmd == NULL)
+		{
+			msa::metrics::increment(ctx->failed_metric, 1);
 			msa::agent::say(hdl, "I'm sorry, $USER_TITLE. I don't know what you mean by '" + cmd_name + "'.");
 			msa::agent::print_prompt_char(hdl);
 		}
 		else
 		{
-			const Command *cmd = ctx->commands[cmd_name];
-			
+			msa::metrics::increment(ctx->run_metric, 1);
+
+			// an alias definition holds a command line of its own, so its options must
+			// not be parsed as though they belong to ALIAS
+			if (cmd->handler == alias_func)
+			{
+				tokens.insert(tokens.begin() + 1, "--");
+			}
+
 			// parse params
 			ParamList params;
 			try
@@ -297,6 +608,7 @@ namespace msa { namespace cmd {
 				ctx->last_threw_exception = false;
 				// ...but does count as a failure status
 				ctx->last_status = -2;
+				msa::metrics::increment(ctx->failed_metric, 1);
 				return;
 			}
 			
@@ -312,6 +624,10 @@ namespace msa { namespace cmd {
 				{
 					ctx->last_threw_exception = false;
 					ctx->last_status = result.status();
+					if (result.status() != 0)
+					{
+						msa::metrics::increment(ctx->failed_metric, 1);
+					}
 					msa::agent::print_prompt_char(hdl);
 				}
 			}
@@ -320,6 +636,7 @@ namespace msa { namespace cmd {
 				msa::log::error(hdl, "Command " + params.str() + " failed with exception: " + e.what());
 				msa::agent::say(hdl, "Oh no! I'm sorry, but I couldn't do that. Take a look at my log file.");
 				ctx->last_threw_exception = true;
+				msa::metrics::increment(ctx->failed_metric, 1);
 			}
 		}
 	}
@@ -344,7 +661,7 @@ namespace msa { namespace cmd {
 		}
 	}
 
-	static void shell_tokenize(const std::string &str, std::vector<std::string> &output)
+	extern void shell_tokenize(const std::string &str, std::vector<std::string> &output)
 	{
 		enum class Mode { NORMAL, SINGLE_QUOTED, DOUBLE_QUOTED, ESCAPED };
 		std::string cur_str;
@@ -413,6 +730,160 @@ namespace msa { namespace cmd {
 		}
 	}
 	
+	static void define_alias(msa::Handle hdl, const std::string &name, const std::vector<std::string> &template_tokens)
+	{
+		CommandContext *ctx = hdl->cmd;
+		std::string invoke = name;
+		msa::string::to_upper(invoke);
+		if (invoke.empty() || invoke.find_first_of(msa::string::default_ws) != std::string::npos)
+		{
+			throw std::logic_error("not a valid alias name: '" + name + "'");
+		}
+		if (template_tokens.empty())
+		{
+			throw std::logic_error("alias command line cannot be blank");
+		}
+		Alias *alias = new Alias;
+		alias->name = invoke;
+		alias->has_params = false;
+		for (size_t i = 0; i < template_tokens.size(); i++)
+		{
+			alias->tokens.push_back(AliasToken());
+			compile_alias_token(template_tokens[i], alias->tokens.back(), &alias->has_params);
+			alias->expansion += (i > 0 ? " " : "") + template_tokens[i];
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		CommandTable::iterator iter = ctx->commands.find(invoke);
+		if (iter != ctx->commands.end() && iter->second.command != NULL)
+		{
+			msa::thread::mutex_unlock(&ctx->mutex);
+			delete alias;
+			throw std::logic_error("command already exists: " + invoke);
+		}
+		// redefining an alias replaces the old one
+		const Alias *replaced = NULL;
+		if (iter != ctx->commands.end())
+		{
+			replaced = iter->second.alias;
+			iter->second.alias = alias;
+		}
+		else
+		{
+			Invokable &entry = ctx->commands[invoke];
+			entry.command = NULL;
+			entry.alias = alias;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		delete replaced;
+	}
+
+	static void compile_alias_token(const std::string &tok, AliasToken &compiled, bool *has_params)
+	{
+		std::string literal;
+		size_t i = 0;
+		while (i < tok.size())
+		{
+			char next = (i + 1 < tok.size()) ? tok[i + 1] : '\0';
+			if (tok[i] == '$' && (next == '@' || (next >= '1' && next <= '9')))
+			{
+				if (!literal.empty())
+				{
+					compiled.push_back(AliasPiece {literal, 0});
+					literal.clear();
+				}
+				int param = ALL_PARAMS;
+				i++;
+				if (next == '@')
+				{
+					i++;
+				}
+				else
+				{
+					param = 0;
+					while (i < tok.size() && tok[i] >= '0' && tok[i] <= '9')
+					{
+						param = (param * 10) + (tok[i] - '0');
+						i++;
+					}
+				}
+				compiled.push_back(AliasPiece {"", param});
+				*has_params = true;
+			}
+			else
+			{
+				literal += tok[i];
+				i++;
+			}
+		}
+		if (!literal.empty() || compiled.empty())
+		{
+			compiled.push_back(AliasPiece {literal, 0});
+		}
+	}
+
+	static void expand_alias(const Alias *alias, const std::vector<std::string> &tokens, std::vector<std::string> &output)
+	{
+		// tokens[0] is the name the alias was invoked by; its parameters follow it
+		size_t param_count = tokens.size() - 1;
+		for (size_t i = 0; i < alias->tokens.size(); i++)
+		{
+			const AliasToken &tok = alias->tokens[i];
+			// a token that is only $@ becomes one token per parameter
+			if (tok.size() == 1 && tok[0].param == ALL_PARAMS)
+			{
+				output.insert(output.end(), tokens.begin() + 1, tokens.end());
+				continue;
+			}
+			// a token that is only a missing $N is dropped entirely
+			if (tok.size() == 1 && tok[0].param > 0 && (size_t) tok[0].param > param_count)
+			{
+				continue;
+			}
+			std::string expanded;
+			for (size_t j = 0; j < tok.size(); j++)
+			{
+				const AliasPiece &piece = tok[j];
+				if (piece.param == 0)
+				{
+					expanded += piece.text;
+				}
+				else if (piece.param == ALL_PARAMS)
+				{
+					for (size_t k = 1; k < tokens.size(); k++)
+					{
+						expanded += (k > 1 ? " " : "") + tokens[k];
+					}
+				}
+				else if ((size_t) piece.param <= param_count)
+				{
+					expanded += tokens[piece.param];
+				}
+			}
+			output.push_back(expanded);
+		}
+		// an alias without any parameter references passes its arguments along as-is
+		if (!alias->has_params)
+		{
+			output.insert(output.end(), tokens.begin() + 1, tokens.end());
+		}
+	}
+
+	// the agent substitutes variables in everything it says, so an alias's own $1 and
+	// $@ references must be escaped before it is shown
+	static std::string escape_expansion(const std::string &text)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (text[i] == '$' || text[i] == '\\')
+			{
+				escaped += '\\';
+			}
+			escaped += text[i];
+		}
+		return escaped;
+	}
+
 	ParamList::ParamList() :
 		_command(""),
 		_args(),
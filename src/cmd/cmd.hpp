@@ -100,6 +100,12 @@ namespace msa { namespace cmd {
 	extern int quit(msa::Handle hdl);
 	extern void register_command(msa::Handle hdl, const Command *cmd);
 	extern void unregister_command(msa::Handle hdl, const Command *cmd);
+	// an alias's command line is tokenized once when it is added; $1, $2, etc. and $@ in it
+	// are replaced with the alias's arguments when it is run
+	extern void add_alias(msa::Handle hdl, const std::string &name, const std::string &expansion);
+	extern void remove_alias(msa::Handle hdl, const std::string &name);
+	// splits a command line into words, handling quotes and backslash escapes
+	extern void shell_tokenize(const std::string &str, std::vector<std::string> &output);
 	extern const PluginHooks *get_plugin_hooks();
 	
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
@@ -1,19 +1,30 @@
 #include "event/dispatch.hpp"
-#include "util/util.hpp"
+#include "event/journal.hpp"
 #include "log/log.hpp"
 #include "cmd/cmd.hpp"
 #include "agent/agent.hpp"
+#include "metrics/metrics.hpp"
+#include "trace/trace.hpp"
+#include "memory/memory.hpp"
+#include "util/string.hpp"
 
 #include <queue>
 #include <stack>
 #include <map>
 #include <string>
 #include <stdexcept>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 
 #include "platform/thread/thread.hpp"
 
 namespace msa { namespace event {
 
+	typedef std::chrono::steady_clock Clock;
+
+	static const long long DEFAULT_JOURNAL_MAX_SIZE = 64 * 1024 * 1024;
+
 	static const PluginHooks HOOKS = {
 		#define MSA_MODULE_HOOK(retspec, name, ...)		name,
 		#include "event/hooks.hpp"
@@ -25,44 +36,132 @@ namespace msa { namespace event {
 		}
 	};
 
+	// queued events are dispatched highest priority first, and in the order that they
+	// were pushed within a priority, so that a simulation replays the same way each time
+	typedef struct queued_event_type {
+		const Event *event;
+		uint64_t sequence;
+		bool journaled;
+	} QueuedEvent;
+
+	struct QueueOrder
+	{
+		bool operator()(const QueuedEvent &e1, const QueuedEvent &e2) const
+		{
+			if (get_priority(e1.event) != get_priority(e2.event))
+			{
+				return get_priority(e1.event) < get_priority(e2.event);
+			}
+			return e1.sequence > e2.sequence;
+		}
+	};
+
+	typedef std::priority_queue<QueuedEvent, std::vector<QueuedEvent>, QueueOrder> EventQueue;
+
+	static std::map<std::string, ClockMode> CLOCK_MODE_NAMES;
+
 	typedef struct handler_context_type {
+		// the event that was dispatched; used for priority checks
 		const Event *event;
-		EventHandler handler_func;
+		uint64_t sequence;
+		bool journaled;
+		// one handler per subscriber, each called with its own copy of the event,
+		// since handlers take ownership of the event args
+		std::vector<EventHandler> handler_funcs;
+		std::vector<const Event *> events;
+		// a copy of the event that the handlers cannot free, so that it can be
+		// checkpointed if they do not finish; NULL unless checkpointing is on
+		const Event *replay;
 		HandlerSync *sync;
-		bool running;
+		msa::Handle hdl;
+		// read by the EDT without the lock to see if the handler is done
+		std::atomic<bool> running;
 		msa::thread::Thread thread;
+		// running and reap_in_handler are changed under the mutex, and finished is
+		// broadcast when running is cleared
+		msa::thread::Mutex mutex;
+		msa::thread::Cond finished;
 		bool reap_in_handler;
+		// kept here rather than read from the dispatch context, which may be gone by
+		// the time an abandoned handler finishes
+		msa::metrics::Histogram *duration_metric;
+		msa::metrics::Gauge *contexts_metric;
+		Clock::time_point started;
 	} HandlerContext;
 
 	struct event_dispatch_context_type {
 		msa::thread::Thread edt;
+		// set by stop_edt(), which quit() calls too if it has not yet been
+		bool edt_stopped;
 		msa::thread::Mutex queue_mutex;
+		// signalled when an event is pushed or a stop is requested, to wake the EDT
+		msa::thread::Cond queue_cond;
 		HandlerContext *current_handler;
-		std::priority_queue<const Event *> queue;
-		std::map<Topic, EventHandler> handlers;
+		EventQueue queue;
+		// guarded by queue_mutex
+		uint64_t pushed;
+		JournalContext *journal;
+		std::string journal_path;
+		bool journal_sync;
+		size_t journal_max_size;
+		std::string replay_path;
+		double replay_speed;
+		std::map<Topic, std::vector<EventHandler>> handlers;
+		msa::thread::Mutex handlers_mutex;
 		std::stack<HandlerContext *> interrupted;
-		int sleep_time;
+		// read by the EDT on every loop, so it can be changed while the EDT runs
+		std::atomic<int> sleep_time;
+		// how long the EDT waits in total for handlers to finish when stopping
+		std::atomic<int> shutdown_timeout;
 		std::vector<msa::cmd::Command *> commands;
+		// where the EDT writes what it has left when it stops; NULL if not checkpointing
+		std::atomic<msa::checkpoint::Writer *> checkpoint;
+		msa::metrics::Counter *generated_metric;
+		msa::metrics::Gauge *queued_metric;
+		msa::metrics::Histogram *handler_metric;
+		msa::metrics::Gauge *contexts_metric;
+		// published for the status source so that it never needs the queue lock or the
+		// handler contexts, which only the EDT may touch. They are set one at a time, so
+		// a reader may see a handler's topic with the previous handler's start time.
+		std::atomic<size_t> queued;
+		// -1 when no handler is running
+		std::atomic<int> running_topic;
+		std::atomic<size_t> running_subscribers;
+		std::atomic<int64_t> running_since_millis;
+		std::atomic<size_t> interrupted_depth;
 	};
 
 	static int create_event_dispatch_context(EventDispatchContext **event);
 	static int dispose_event_dispatch_context(EventDispatchContext *event);
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static void read_journal_config(msa::Handle hdl, const msa::cfg::Section &config);
 	static void *event_start(void *args);
 	
 	static void push_event(msa::Handle msa, const Event *e);
 
 	static void *edt_start(void *args);
 	static void edt_run(msa::Handle hdl);
+	static bool edt_idle(msa::Handle hdl);
+	static bool edt_has_work(msa::Handle hdl);
 	static void edt_cleanup(msa::Handle hdl);
-	static const Event *edt_poll_event_queue(msa::Handle hdl);
+	static void edt_publish_state(msa::Handle hdl);
+	static void edt_checkpoint_queue(msa::Handle hdl, msa::checkpoint::Writer &out, uint32_t *count, int *unsaved);
+	static bool edt_poll_event_queue(msa::Handle hdl, QueuedEvent *next);
 	static void edt_interrupt_handler(msa::Handle hdl);
-	static void edt_spawn_handler(msa::Handle hdl, const Event *e);
-	static void edt_dispatch_event(msa::Handle hdl, const Event *e);
-	static void dispose_handler_context(HandlerContext *ctx, bool wait);
+	static void edt_spawn_handler(msa::Handle hdl, const QueuedEvent &next, const std::vector<EventHandler> &handler_funcs);
+	static void edt_dispatch_event(msa::Handle hdl, const QueuedEvent &next);
+	static bool dispose_handler_context(HandlerContext *ctx, bool wait, Clock::time_point deadline);
+	static void free_handler_context(HandlerContext *ctx);
+	static void dispose_handler_events(HandlerContext *ctx);
+	static std::string event_status(msa::Handle hdl);
 
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
 	{
+		if (CLOCK_MODE_NAMES.empty())
+		{
+			CLOCK_MODE_NAMES["REAL"] = ClockMode::REAL;
+			CLOCK_MODE_NAMES["SIMULATED"] = ClockMode::SIMULATED;
+		}
 		int create_status = create_event_dispatch_context(&hdl->event);
 		if (create_status != 0)
 		{
@@ -75,11 +174,24 @@ namespace msa { namespace event {
 			msa::log::error(hdl, "Could not create event timer context (error " + std::to_string(create_status) + ")");
 			return create_status;
 		}
+		create_status = create_journal_context(hdl, &hdl->event->journal);
+		if (create_status != 0)
+		{
+			msa::log::error(hdl, "Could not create event journal context (error " + std::to_string(create_status) + ")");
+			return create_status;
+		}
 		
+		hdl->event->generated_metric = msa::metrics::get_counter(hdl, "msa_events_generated_total", "Events pushed onto the event queue");
+		hdl->event->queued_metric = msa::metrics::get_gauge(hdl, "msa_event_queue_depth", "Events waiting to be dispatched");
+		hdl->event->handler_metric = msa::metrics::get_histogram(hdl, "msa_event_handler_microseconds", "How long the handlers of each dispatched event took to finish");
+		hdl->event->contexts_metric = msa::metrics::get_gauge(hdl, "msa_event_handler_contexts", "Handler contexts that have not been freed yet");
+		msa::metrics::add_status_source(hdl, "event", event_status);
+
 		// read config
 		try
 		{
 			read_config(hdl, config);
+			read_journal_config(hdl, config);
 		}
 		catch (const msa::cfg::config_error &e)
 		{
@@ -97,30 +209,55 @@ namespace msa { namespace event {
 		return 0;
 	}
 
-	extern int quit(msa::Handle msa)
+	extern void stop_edt(msa::Handle msa)
 	{
-		if (msa->status == msa::Status::CREATED && msa->event != NULL)
+		EventDispatchContext *ctx = msa->event;
+		if (ctx->edt_stopped)
 		{
-			// this shouldn't happen, but if we get here, it's because
-			// the event handle was inited but the EDT was not started.
-			// We can just destroy the mutex and delete everything immediately
-			msa::log::warn(msa, "EDT has not yet set status to RUNNING! Killing anyways");
-			msa::thread::mutex_destroy(&msa->event->queue_mutex);
-			dispose_event_dispatch_context(msa->event);
-			return 0;
+			return;
+		}
+		ctx->edt_stopped = true;
+		stop_replay(ctx->journal);
+		if (msa->status == msa::Status::CREATED)
+		{
+			// the EDT was never started
+			return;
 		}
 		// if the quit was initiated by the current event thread,
 		// we must mark it as such so that the EDT knows not to
 		// wait on it (since this thread also joins on the EDT,
 		// this would cause deadlock)
-		if (msa::thread::self() == msa->event->current_handler->thread)
+		HandlerContext *current = ctx->current_handler;
+		if (current != NULL && msa::thread::self() == current->thread)
 		{
-			set_handler_syscall_origin(msa->event->current_handler->sync);
+			set_handler_syscall_origin(current->sync);
 		}
-		msa->status = msa::Status::STOP_REQUESTED;
+		msa::set_status(msa, msa::Status::STOP_REQUESTED);
+		// wake the EDT rather than waiting for it to notice
+		msa::thread::mutex_lock(&ctx->queue_mutex);
+		msa::thread::cond_broadcast(&ctx->queue_cond);
+		msa::thread::mutex_unlock(&ctx->queue_mutex);
 		msa::log::trace(msa, "Joining on EDT");
-		msa::thread::join(msa->event->edt, NULL);
+		msa::thread::join(ctx->edt, NULL);
 		msa::log::trace(msa, "EDT joined");
+	}
+
+	extern int quit(msa::Handle msa)
+	{
+		msa::metrics::remove_status_source(msa, "event");
+		stop_edt(msa);
+		if (msa->status == msa::Status::CREATED)
+		{
+			// this shouldn't happen, but if we get here, it's because
+			// the event handle was inited but the EDT was not started.
+			// We can just destroy the mutex and delete everything immediately
+			msa::log::warn(msa, "EDT has not yet set status to RUNNING! Killing anyways");
+			msa::thread::mutex_destroy(&msa->event->queue_mutex);
+			dispose_event_dispatch_context(msa->event);
+			return 0;
+		}
+		// the EDT has written its last records, so what is left can be committed
+		close_journal(msa->event->journal);
 		dispose_event_dispatch_context(msa->event);
 		dispose_timer_context(msa->timer);
 		return 0;
@@ -146,23 +283,162 @@ namespace msa { namespace event {
 		return 0;
 	}
 
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> &changed)
+	{
+		static const char *JOURNAL_KEYS[] = {"JOURNAL", "JOURNAL_SYNC", "JOURNAL_MAX_SIZE", "REPLAY", "REPLAY_SPEED"};
+		for (size_t i = 0; i < sizeof(JOURNAL_KEYS) / sizeof(const char *); i++)
+		{
+			if (std::find(changed.begin(), changed.end(), JOURNAL_KEYS[i]) != changed.end())
+			{
+				msa::log::warn(hdl, "Event " + std::string(JOURNAL_KEYS[i]) + " changed; restart for it to take effect");
+			}
+		}
+		try
+		{
+			read_config(hdl, config);
+		}
+		catch (const msa::cfg::config_error &e)
+		{
+			msa::log::error(hdl, "Could not read event config: " + std::string(e.what()));
+			return 1;
+		}
+		return 0;
+	}
+
 	extern const PluginHooks *get_plugin_hooks()
 	{
 		return &HOOKS;
 	}
 
+	extern size_t queue_depth(msa::Handle hdl)
+	{
+		return hdl->event->queued;
+	}
+
+	extern void set_checkpoint(msa::Handle hdl, msa::checkpoint::Writer *out)
+	{
+		hdl->event->checkpoint = out;
+	}
+
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in)
+	{
+		int dropped = 0;
+		size_t queued = 0;
+		// handler events first, since they were dispatched before anything in the queue
+		for (int list = 0; list < 2; list++)
+		{
+			uint32_t count = in.get_u32();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const Event *e = restore_event(in);
+				if (e == NULL)
+				{
+					dropped++;
+					continue;
+				}
+				push_event(hdl, e);
+				queued++;
+			}
+		}
+		uint32_t timers = restore_timers(hdl, in);
+		if (dropped > 0)
+		{
+			msa::log::warn(hdl, "Dropped " + std::to_string(dropped) + " checkpointed event(s) for topics that no longer exist");
+		}
+		msa::log::info(hdl, "Restored " + std::to_string(queued) + " event(s) and " + std::to_string(timers) + " timer(s)");
+	}
+
+	/**
+	 * Events that the last instance journaled but never finished are pushed again before
+	 * anything else, and are journaled again in the new file before it replaces the old.
+	 */
+	extern void start_journal(msa::Handle hdl)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		if (ctx->journal_path != "")
+		{
+			std::vector<JournalEntry> unfinished;
+			FILE *fp = fopen(ctx->journal_path.c_str(), "rb");
+			if (fp != NULL)
+			{
+				fclose(fp);
+				try
+				{
+					size_t torn = read_journal(ctx->journal_path, true, unfinished);
+					if (torn > 0)
+					{
+						msa::log::warn(hdl, "Ignored " + std::to_string(torn) + " byte(s) at the end of the journal that were not completely written");
+					}
+				}
+				catch (const std::logic_error &e)
+				{
+					msa::log::error(hdl, "Could not read event journal: " + std::string(e.what()) + "; starting a new one");
+				}
+			}
+			try
+			{
+				open_journal(ctx->journal, ctx->journal_path, ctx->journal_sync, ctx->journal_max_size);
+			}
+			catch (const std::logic_error &e)
+			{
+				msa::log::error(hdl, "Could not open event journal: " + std::string(e.what()) + "; events will not be journaled");
+				dispose_journal_entries(unfinished);
+			}
+			if (journal_open(ctx->journal))
+			{
+				for (size_t i = 0; i < unfinished.size(); i++)
+				{
+					push_event(hdl, unfinished[i].event);
+				}
+				install_journal(ctx->journal);
+				msa::log::info(hdl, "Journaling events to " + ctx->journal_path + "; recovered " + std::to_string(unfinished.size()) + " unfinished event(s)");
+			}
+		}
+		if (ctx->replay_path != "")
+		{
+			std::vector<JournalEntry> entries;
+			try
+			{
+				read_journal(ctx->replay_path, false, entries);
+			}
+			catch (const std::logic_error &e)
+			{
+				msa::log::error(hdl, "Could not read journal to replay: " + std::string(e.what()));
+				return;
+			}
+			msa::log::info(hdl, "Replaying " + std::to_string(entries.size()) + " journaled event(s) from " + ctx->replay_path);
+			start_replay(hdl, ctx->journal, entries, ctx->replay_speed);
+		}
+	}
+
 	extern void subscribe(msa::Handle msa, Topic t, EventHandler handler)
 	{
-		msa->event->handlers[t] = handler;
+		EventDispatchContext *ctx = msa->event;
+		msa::thread::mutex_lock(&ctx->handlers_mutex);
+		std::vector<EventHandler> &list = ctx->handlers[t];
+		if (std::find(list.begin(), list.end(), handler) == list.end())
+		{
+			list.push_back(handler);
+		}
+		msa::thread::mutex_unlock(&ctx->handlers_mutex);
 	}
 
-	extern void unsubscribe(msa::Handle msa, Topic t, EventHandler UNUSED(handler))
+	extern void unsubscribe(msa::Handle msa, Topic t, EventHandler handler)
 	{
-		msa->event->handlers[t] = NULL;
+		EventDispatchContext *ctx = msa->event;
+		msa::thread::mutex_lock(&ctx->handlers_mutex);
+		std::vector<EventHandler> &list = ctx->handlers[t];
+		auto iter = std::find(list.begin(), list.end(), handler);
+		if (iter != list.end())
+		{
+			list.erase(iter);
+		}
+		msa::thread::mutex_unlock(&ctx->handlers_mutex);
 	}
 
 	extern void generate(msa::Handle msa, Topic t, const IArgs &args)
 	{
+		msa::memory::Scope memory_scope(msa::memory::Tag::EVENT);
 		const Event *e = create(t, args);
 		msa::log::debug(msa, "Pushed a " + topic_str(t) + " event");
 		push_event(msa, e);
@@ -172,15 +448,46 @@ namespace msa { namespace event {
 	{
 		EventDispatchContext *edc = new EventDispatchContext;
 		msa::thread::mutex_init(&edc->queue_mutex, NULL);
+		msa::thread::cond_init(&edc->queue_cond, NULL);
+		msa::thread::mutex_init(&edc->handlers_mutex, NULL);
+		edc->edt_stopped = false;
 		edc->current_handler = NULL;
+		edc->pushed = 0;
+		edc->journal = NULL;
+		edc->journal_sync = true;
+		edc->journal_max_size = DEFAULT_JOURNAL_MAX_SIZE;
+		edc->replay_speed = 1;
 		edc->commands = get_timer_commands();
+		edc->checkpoint = NULL;
+		edc->generated_metric = NULL;
+		edc->queued_metric = NULL;
+		edc->handler_metric = NULL;
+		edc->contexts_metric = NULL;
+		edc->queued = 0;
+		edc->running_topic = -1;
+		edc->running_subscribers = 0;
+		edc->running_since_millis = 0;
+		edc->interrupted_depth = 0;
 		*event = edc;
 		return 0;
 	}
 
 	static int dispose_event_dispatch_context(EventDispatchContext *event)
 	{
+		// pushed by handlers that were still running after the EDT stopped
+		while (!event->queue.empty())
+		{
+			const Event *e = event->queue.top().event;
+			event->queue.pop();
+			delete e;
+		}
 		msa::thread::mutex_destroy(&event->queue_mutex);
+		msa::thread::cond_destroy(&event->queue_cond);
+		msa::thread::mutex_destroy(&event->handlers_mutex);
+		if (event->journal != NULL)
+		{
+			dispose_journal_context(event->journal);
+		}
 		auto iter = event->commands.begin();
 		while (iter != event->commands.end())
 		{
@@ -198,63 +505,241 @@ namespace msa { namespace event {
 		int sleep_time = config.get_or("IDLE_SLEEP_TIME", 10);
 		config.check_range("TICK_RESOLUTION", sleep_time, 1000, false);
 		int tick_res = config.get_or("TICK_RESOLUTION", 10);
+		config.check_range("SHUTDOWN_TIMEOUT", 0, 60000, false);
+		ClockMode mode = config.has("CLOCK") ? config.get_as_enum("CLOCK", CLOCK_MODE_NAMES) : ClockMode::REAL;
 		hdl->event->sleep_time = sleep_time;
+		hdl->event->shutdown_timeout = config.get_or("SHUTDOWN_TIMEOUT", 2000);
 		set_tick_resolution(hdl->timer, tick_res);
+		set_clock_mode(hdl->timer, mode);
+	}
+
+	// only read at startup; see reconfigure()
+	static void read_journal_config(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		ctx->journal_path = config.get_or<std::string>("JOURNAL", "");
+		ctx->journal_sync = config.get_or("JOURNAL_SYNC", true);
+		long long max_size = config.get_or("JOURNAL_MAX_SIZE", DEFAULT_JOURNAL_MAX_SIZE);
+		if (max_size < 0)
+		{
+			throw msa::cfg::config_error(config.get_name(), "JOURNAL_MAX_SIZE", config["JOURNAL_MAX_SIZE"], "must be 0 or more");
+		}
+		ctx->journal_max_size = (size_t) max_size;
+		ctx->replay_path = config.get_or<std::string>("REPLAY", "");
+		ctx->replay_speed = config.get_or("REPLAY_SPEED", 1.0);
+		if (ctx->replay_speed < 0)
+		{
+			throw msa::cfg::config_error(config.get_name(), "REPLAY_SPEED", config["REPLAY_SPEED"], "must be 0 or more");
+		}
+		if (ctx->replay_path != "" && ctx->replay_path == ctx->journal_path)
+		{
+			throw msa::cfg::config_error(config.get_name(), "REPLAY", ctx->replay_path, "cannot be the journal that is being written");
+		}
 	}
 
 	static void *edt_start(void *args)
 	{
 		msa::Handle hdl = (msa::Handle) args;
-		hdl->status = msa::Status::RUNNING;
+		msa::memory::Scope memory_scope(msa::memory::Tag::EVENT);
+		msa::set_status(hdl, msa::Status::RUNNING);
+		EventDispatchContext *ctx = hdl->event;
 		while (hdl->status != msa::Status::STOP_REQUESTED)
 		{
 			edt_run(hdl);
-			msa::util::sleep_milli(hdl->event->sleep_time);
+			// a simulated clock skips straight to the next timer rather than waiting for it
+			if (clock_simulated(hdl) && edt_idle(hdl) && advance_clock(hdl))
+			{
+				continue;
+			}
+			// sleep until the next tick, or until there is something new to do
+			Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(ctx->sleep_time);
+			msa::thread::mutex_lock(&ctx->queue_mutex);
+			while (hdl->status != msa::Status::STOP_REQUESTED && !edt_has_work(hdl))
+			{
+				// rounded up, since the sleep time may be a single millisecond
+				auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - Clock::now()).count();
+				if (remaining <= 0)
+				{
+					break;
+				}
+				msa::thread::cond_timed_wait(&ctx->queue_cond, &ctx->queue_mutex, (int) ((remaining + 999) / 1000));
+			}
+			msa::thread::mutex_unlock(&ctx->queue_mutex);
 		}
 		edt_cleanup(hdl);
 		return NULL;
 	}
 
+	// nothing is queued or running, so nothing can happen until a timer fires or input arrives
+	static bool edt_idle(msa::Handle hdl)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		return ctx->queued == 0 && ctx->current_handler == NULL && ctx->interrupted.empty();
+	}
+
+	// whether edt_run() would do more than check the timers; called with the queue mutex held
+	static bool edt_has_work(msa::Handle hdl)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		HandlerContext *current = ctx->current_handler;
+		if (current != NULL && !current->running)
+		{
+			return true;
+		}
+		if (ctx->queue.empty())
+		{
+			return false;
+		}
+		return current == NULL || get_priority(ctx->queue.top().event) > get_priority(current->event);
+	}
+
 	static void edt_cleanup(msa::Handle hdl)
 	{
 		EventDispatchContext *ctx = hdl->event;
+		Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(ctx->shutdown_timeout);
+		msa::checkpoint::Writer *out = ctx->checkpoint;
+		// let every interrupted handler run to completion at the same time rather
+		// than one after another
+		std::vector<HandlerContext *> draining;
 		if (ctx->current_handler != NULL)
 		{
 			// if the syscall that caused the EDT to enter cleanup
 			// is from the current event handler, do not wait for it
 			// to complete before freeing its resources
-			bool wait = !handler_syscall_origin(ctx->current_handler->sync);
-			dispose_handler_context(ctx->current_handler, wait);
+			if (handler_syscall_origin(ctx->current_handler->sync))
+			{
+				// it asked for the stop, so it must not be recovered and run again
+				if (ctx->current_handler->journaled)
+				{
+					journal_done(ctx->journal, ctx->current_handler->sequence);
+				}
+				dispose_handler_context(ctx->current_handler, false, deadline);
+			}
+			else
+			{
+				draining.push_back(ctx->current_handler);
+			}
 		}
 		while (!ctx->interrupted.empty())
 		{
 			HandlerContext *intr_ctx = ctx->interrupted.top();
 			ctx->interrupted.pop();
-			dispose_handler_context(intr_ctx, true);
+			resume_handler(intr_ctx->sync);
+			draining.push_back(intr_ctx);
+		}
+		int abandoned = 0;
+		int unsaved = 0;
+		msa::checkpoint::Writer unfinished;
+		uint32_t unfinished_count = 0;
+		for (size_t i = 0; i < draining.size(); i++)
+		{
+			// a handler that is given up on frees its own context when it is done, so its
+			// event must be written before then
+			msa::checkpoint::Writer replay;
+			bool replayable = (out != NULL && draining[i]->replay != NULL && checkpoint_event(replay, draining[i]->replay));
+			if (!dispose_handler_context(draining[i], true, deadline))
+			{
+				abandoned++;
+				if (replayable)
+				{
+					unfinished.append(replay);
+					unfinished_count++;
+				}
+				else if (out != NULL)
+				{
+					unsaved++;
+				}
+			}
+		}
+		if (abandoned > 0)
+		{
+			msa::log::warn(hdl, std::to_string(abandoned) + " event handler(s) did not finish within the shutdown timeout; leaving them to clean up after themselves, and the rest of the shutdown to the last of them");
+		}
+		if (out != NULL)
+		{
+			out->put_u32(unfinished_count);
+			out->append(unfinished);
+			uint32_t queued = 0;
+			edt_checkpoint_queue(hdl, *out, &queued, &unsaved);
+			uint32_t timers = checkpoint_timers(hdl, *out);
+			journal_checkpointed(ctx->journal);
+			msa::log::info(hdl, "Checkpointed " + std::to_string(unfinished_count) + " unfinished and " + std::to_string(queued) + " queued event(s), and " + std::to_string(timers) + " timer(s)");
+			if (unsaved > 0)
+			{
+				msa::log::warn(hdl, std::to_string(unsaved) + " event(s) do not have text args and were not checkpointed");
+			}
 		}
 		while (!hdl->event->queue.empty())
 		{
-			const Event *e = hdl->event->queue.top();
+			const Event *e = hdl->event->queue.top().event;
 			hdl->event->queue.pop();
 			delete e;
 		}
+		ctx->queued = 0;
+		msa::metrics::set_gauge(ctx->queued_metric, 0);
 		clear_timers(hdl->timer);
+		edt_publish_state(hdl);
+	}
+
+	static void edt_publish_state(msa::Handle hdl)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		HandlerContext *current = ctx->current_handler;
+		if (current != NULL && current->running)
+		{
+			ctx->running_since_millis = std::chrono::duration_cast<std::chrono::milliseconds>(current->started.time_since_epoch()).count();
+			ctx->running_subscribers = current->handler_funcs.size();
+			ctx->running_topic = static_cast<int>(current->event->topic);
+		}
+		else
+		{
+			ctx->running_topic = -1;
+		}
+		ctx->interrupted_depth = ctx->interrupted.size();
+	}
+
+	/**
+	 * Writes the queued events in the order that they would have been dispatched.
+	 * Only the EDT takes events off the queue, so they are copied rather than popped.
+	 */
+	static void edt_checkpoint_queue(msa::Handle hdl, msa::checkpoint::Writer &out, uint32_t *count, int *unsaved)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		msa::thread::mutex_lock(&ctx->queue_mutex);
+		EventQueue queue = ctx->queue;
+		msa::thread::mutex_unlock(&ctx->queue_mutex);
+		msa::checkpoint::Writer events;
+		*count = 0;
+		while (!queue.empty())
+		{
+			if (checkpoint_event(events, queue.top().event))
+			{
+				(*count)++;
+			}
+			else
+			{
+				(*unsaved)++;
+			}
+			queue.pop();
+		}
+		out.put_u32(*count);
+		out.append(events);
 	}
 
 	static void edt_run(msa::Handle hdl) {
 		// check event_queue, decide if we want the current top
-		const Event *e = edt_poll_event_queue(hdl);
-		if (e != NULL)
+		QueuedEvent next;
+		if (edt_poll_event_queue(hdl, &next))
 		{
-			msa::log::debug(hdl, "Dispatching " + topic_str(e->topic) + " event");
-			edt_dispatch_event(hdl, e);
+			msa::log::debug(hdl, "Dispatching " + topic_str(next.event->topic) + " event");
+			edt_dispatch_event(hdl, next);
 		}
 		
 		EventDispatchContext *edc = hdl->event;
 		// check if current task has finished
 		if (edc->current_handler != NULL && !(edc->current_handler->running))
 		{
-			dispose_handler_context(edc->current_handler, false);
+			dispose_handler_context(edc->current_handler, false, Clock::now());
 			edc->current_handler = NULL;
 		}
 		// if current task is clear, load up the next one that has been interrupted
@@ -268,15 +753,17 @@ namespace msa { namespace event {
 		// TODO: Add a synthetic event for when queue has emptied and no events
 
 		check_timers(hdl);
+		edt_publish_state(hdl);
 	}
 
-	static const Event *edt_poll_event_queue(msa::Handle hdl)
+	static bool edt_poll_event_queue(msa::Handle hdl, QueuedEvent *next)
 	{
 		const Event *e = NULL;
 		msa::thread::mutex_lock(&hdl->event->queue_mutex);
 		if (!hdl->event->queue.empty())
 		{
-			e = hdl->event->queue.top();
+			*next = hdl->event->queue.top();
+			e = next->event;
 			// if we have a current event, check to see if we should replace it
 			// with the event on the queue
 			if (hdl->event->current_handler != NULL)
@@ -294,34 +781,69 @@ namespace msa { namespace event {
 		if (e != NULL)
 		{
 			hdl->event->queue.pop();
+			hdl->event->queued--;
+			msa::metrics::adjust_gauge(hdl->event->queued_metric, -1);
 		}
 		msa::thread::mutex_unlock(&hdl->event->queue_mutex);
-		return e;
+		return e != NULL;
 	}
 
 	static void edt_interrupt_handler(msa::Handle hdl)
 	{
 		HandlerContext *ctx = hdl->event->current_handler;
 		suspend_handler(ctx->sync);
-		// wait till it stops
-		while (!handler_suspended(ctx->sync)) {
-			// we just wait here until we can go
-			msa::util::sleep_milli(hdl->event->sleep_time);
+		// wait till it stops; a handler only stops at an interrupt point, so one that
+		// finishes without reaching one is reaped instead of waited on forever
+		msa::thread::mutex_lock(&ctx->mutex);
+		while (ctx->running && !handler_suspended(ctx->sync))
+		{
+			msa::thread::cond_timed_wait(&ctx->finished, &ctx->mutex, hdl->event->sleep_time);
 			// TODO: Force handler to stop if it takes too long
 		}
-		// okay now put it on the stack
-		hdl->event->interrupted.push(ctx);
+		bool finished = !ctx->running;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (finished)
+		{
+			dispose_handler_context(ctx, false, Clock::now());
+		}
+		else
+		{
+			// okay now put it on the stack
+			hdl->event->interrupted.push(ctx);
+		}
 		// and clear the current
 		hdl->event->current_handler = NULL;
 	}
 
-	static void edt_spawn_handler(msa::Handle hdl, const Event *e)
+	static void edt_spawn_handler(msa::Handle hdl, const QueuedEvent &next, const std::vector<EventHandler> &handler_funcs)
 	{
+		const Event *e = next.event;
 		HandlerContext *new_ctx = new HandlerContext;
 		new_ctx->reap_in_handler = false;
 		new_ctx->event = e;
-		new_ctx->handler_func = hdl->event->handlers[e->topic];
-		create_handler_sync(&new_ctx->sync);
+		new_ctx->sequence = next.sequence;
+		new_ctx->journaled = next.journaled;
+		new_ctx->handler_funcs = handler_funcs;
+		new_ctx->events.push_back(e);
+		for (size_t i = 1; i < handler_funcs.size(); i++)
+		{
+			new_ctx->events.push_back(create(e->topic, *e->args));
+		}
+		new_ctx->replay = NULL;
+		if (hdl->event->checkpoint != NULL)
+		{
+			Event *replay = new Event(*e);
+			replay->args = e->args->copy();
+			new_ctx->replay = replay;
+		}
+		create_handler_sync(hdl, &new_ctx->sync);
+		new_ctx->hdl = hdl;
+		new_ctx->duration_metric = hdl->event->handler_metric;
+		new_ctx->contexts_metric = hdl->event->contexts_metric;
+		msa::metrics::adjust_gauge(new_ctx->contexts_metric, 1);
+		new_ctx->started = Clock::now();
+		msa::thread::mutex_init(&new_ctx->mutex, NULL);
+		msa::thread::cond_init(&new_ctx->finished, NULL);
 		hdl->event->current_handler = new_ctx;
 		
 		msa::thread::Attributes *attr = new msa::thread::Attributes;
@@ -329,88 +851,192 @@ namespace msa { namespace event {
 		msa::thread::attr_set_detach(attr, true);
 		
 		new_ctx->running = true;
-		int status = msa::thread::create(&new_ctx->thread, attr, event_start, hdl, "handler");
+		msa::handler_started(hdl);
+		int status = msa::thread::create(&new_ctx->thread, attr, event_start, new_ctx, "handler");
 		if (status != 0)
 		{
 			msa::log::error(hdl, "Failed to start event handler thread; thread::create() returned " + std::to_string(status));
 			new_ctx->running = false;
+			msa::handler_finished(hdl);
 		}
 		
 		msa::thread::attr_destroy(attr);
 		delete attr;
 	}
 
-	static void edt_dispatch_event(msa::Handle hdl, const Event *e)
+	static void edt_dispatch_event(msa::Handle hdl, const QueuedEvent &next)
 	{
+		const Event *e = next.event;
+		msa::trace::begin(hdl, "event", "dispatch", topic_name(e->topic));
+		MSA_PROBE3(event_dispatch, (int) e->topic, e, hdl->event->current_handler != NULL);
 		if (hdl->event->current_handler != NULL)
 		{
 			edt_interrupt_handler(hdl);
 		}
+		// snapshot the subscribers so that handlers may (un)subscribe while running
+		EventDispatchContext *ctx = hdl->event;
+		msa::thread::mutex_lock(&ctx->handlers_mutex);
+		std::vector<EventHandler> handler_funcs = ctx->handlers[e->topic];
+		msa::thread::mutex_unlock(&ctx->handlers_mutex);
 		// start the thread (if we have a handler)
-		if (hdl->event->handlers[e->topic] != NULL)
+		if (!handler_funcs.empty())
 		{
-			edt_spawn_handler(hdl, e);
+			edt_spawn_handler(hdl, next, handler_funcs);
 		}
 		else
 		{
+			if (next.journaled)
+			{
+				journal_done(ctx->journal, next.sequence);
+			}
 			delete e;
 		}
+		msa::trace::end(hdl);
 	}
 
-	static void dispose_handler_context(HandlerContext *ctx, bool wait)
+	/**
+	 * Frees a handler context, first waiting until the deadline for its handler to
+	 * finish if wait is set. A handler that is still running is left to free its own
+	 * context when it is done. Returns whether the handler had finished.
+	 */
+	static bool dispose_handler_context(HandlerContext *ctx, bool wait, Clock::time_point deadline)
 	{
-		if (ctx->running)
+		if (ctx->running && handler_suspended(ctx->sync))
+		{
+			resume_handler(ctx->sync);
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		while (wait && ctx->running)
 		{
-			if (handler_suspended(ctx->sync))
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			if (remaining <= 0)
 			{
-				resume_handler(ctx->sync);
+				break;
 			}
-			if (wait)
-			{
-				// wait until current event runs through
-				while (ctx->running)
-				{
-					msa::util::sleep_milli(10);
-				}
-			}
-			else
+			msa::thread::cond_timed_wait(&ctx->finished, &ctx->mutex, (int) remaining + 1);
+		}
+		bool finished = !ctx->running;
+		ctx->reap_in_handler = !finished;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (finished)
+		{
+			// only the EDT disposes of contexts, so the journal is still there
+			if (ctx->journaled)
 			{
-				ctx->reap_in_handler = true;
+				journal_done(ctx->hdl->event->journal, ctx->sequence);
 			}
+			free_handler_context(ctx);
+		}
+		return finished;
+	}
+
+	static void free_handler_context(HandlerContext *ctx)
+	{
+		// delete events
+		dispose_handler_events(ctx);
+		if (ctx->replay != NULL)
+		{
+			delete ctx->replay->args;
+			dispose(ctx->replay);
 		}
-		if (!ctx->reap_in_handler)
+		// delete sync handler
+		dispose_handler_sync(ctx->sync);
+		msa::thread::cond_destroy(&ctx->finished);
+		msa::thread::mutex_destroy(&ctx->mutex);
+		msa::metrics::adjust_gauge(ctx->contexts_metric, -1);
+		delete ctx;
+	}
+
+	static void dispose_handler_events(HandlerContext *ctx)
+	{
+		for (size_t i = 0; i < ctx->events.size(); i++)
 		{
-			// delete event
-			dispose(ctx->event);
-			// delete sync handler
-			dispose_handler_sync(ctx->sync);
-			delete ctx;
+			dispose(ctx->events[i]);
 		}
+		ctx->events.clear();
 	}
 
 	static void *event_start(void *args)
 	{
-		msa::Handle hdl = (msa::Handle) args;
-		HandlerContext *ctx = hdl->event->current_handler;
-		ctx->handler_func(hdl, ctx->event, ctx->sync);
-		if (ctx->reap_in_handler)
+		HandlerContext *ctx = (HandlerContext *) args;
+		// the context may be freed by the EDT once running is cleared
+		msa::Handle hdl = ctx->hdl;
+		msa::memory::Scope memory_scope(msa::memory::Tag::HANDLER);
+		Clock::time_point start = Clock::now();
+		msa::trace::begin(ctx->hdl, "handler", "run", topic_name(ctx->event->topic));
+		MSA_PROBE3(handler_start, (int) ctx->event->topic, ctx->event, ctx->handler_funcs.size());
+		for (size_t i = 0; i < ctx->handler_funcs.size(); i++)
 		{
-			dispose(ctx->event);
-			dispose_handler_sync(ctx->sync);
-			delete ctx;
+			// once a handler has stopped the instance, the modules the rest use are gone
+			if (handler_syscall_origin(ctx->sync))
+			{
+				break;
+			}
+			ctx->handler_funcs[i](ctx->hdl, ctx->events[i], ctx->sync);
 		}
-		else
+		msa::trace::end(ctx->hdl);
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+		MSA_PROBE3(handler_done, (int) ctx->event->topic, ctx->event, elapsed);
+		msa::metrics::observe(ctx->duration_metric, elapsed);
+		msa::thread::mutex_lock(&ctx->mutex);
+		bool reap = ctx->reap_in_handler;
+		ctx->running = false;
+		msa::thread::cond_broadcast(&ctx->finished);
+		// wake the EDT so it can move on without waiting out its sleep. This is done under
+		// the context mutex, which keeps the EDT from freeing either context first; a
+		// handler that reaps itself has been given up on and the EDT may already be gone
+		if (!reap)
 		{
-			ctx->running = false;
+			EventDispatchContext *edc = ctx->hdl->event;
+			msa::thread::mutex_lock(&edc->queue_mutex);
+			msa::thread::cond_signal(&edc->queue_cond);
+			msa::thread::mutex_unlock(&edc->queue_mutex);
 		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (reap)
+		{
+			free_handler_context(ctx);
+		}
+		// the last thing done, since it may quit the rest of the modules
+		msa::handler_finished(hdl);
 		return NULL;
 	}
 
 	static void push_event(msa::Handle msa, const Event *e)
 	{
+		msa::trace::instant(msa, "event", "enqueue", topic_name(e->topic));
 		msa::thread::mutex_lock(&msa->event->queue_mutex);
-		msa->event->queue.push(e);
+		uint64_t sequence = msa->event->pushed++;
+		bool journaled = journal_event(msa->event->journal, sequence, e);
+		msa->event->queue.push(QueuedEvent {e, sequence, journaled});
+		msa->event->queued++;
+		MSA_PROBE3(event_enqueue, (int) e->topic, e, msa->event->queued.load());
+		msa::metrics::increment(msa->event->generated_metric, 1);
+		msa::metrics::adjust_gauge(msa->event->queued_metric, 1);
+		msa::thread::cond_signal(&msa->event->queue_cond);
 		msa::thread::mutex_unlock(&msa->event->queue_mutex);
 	}
 
+	// reads only what the EDT publishes, so it can be called from any thread
+	static std::string event_status(msa::Handle hdl)
+	{
+		EventDispatchContext *ctx = hdl->event;
+		std::string text = "{\"queue_depth\": " + std::to_string(ctx->queued);
+		int topic = ctx->running_topic;
+		if (topic < 0)
+		{
+			text += ", \"handler\": null";
+		}
+		else
+		{
+			int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+			text += ", \"handler\": {\"topic\": " + msa::string::json_quote(topic_str(static_cast<Topic>(topic)));
+			text += ", \"subscribers\": " + std::to_string(ctx->running_subscribers);
+			text += ", \"running_millis\": " + std::to_string(std::max(now - ctx->running_since_millis, (int64_t) 0)) + "}";
+		}
+		text += ", \"interrupted\": " + std::to_string(ctx->interrupted_depth);
+		text += ", \"timers\": " + std::to_string(timer_count(hdl)) + "}";
+		return text;
+	}
+
 } }
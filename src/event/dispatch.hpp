@@ -10,9 +10,26 @@ namespace msa { namespace event {
 
 	extern int init(msa::Handle msa, const msa::cfg::Section &config);
 	extern int quit(msa::Handle msa);
+	// stops the EDT, giving running handlers until the shutdown timeout to finish. The
+	// module stays usable by any that did not until quit() is called.
+	extern void stop_edt(msa::Handle msa);
 	extern int setup(msa::Handle hdl);	
 	extern int teardown(msa::Handle hdl);
+	// applies changed config values without stopping the EDT
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> &changed);
 	extern const PluginHooks *get_plugin_hooks();
+	// the number of events waiting to be dispatched
+	extern size_t queue_depth(msa::Handle hdl);
+	// turns on checkpointing. From then on the EDT keeps a copy of each event that it
+	// hands to handlers, and when it stops it writes the queued events, the events of
+	// handlers that did not finish, and the timers to out instead of dropping them.
+	extern void set_checkpoint(msa::Handle hdl, msa::checkpoint::Writer *out);
+	// queues the events and adds the timers that were written when checkpointing
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in);
+	// opens the event journal and starts replaying one if the config asks for either.
+	// Called once every module is set up, since it pushes the events that the last
+	// instance journaled but did not finish.
+	extern void start_journal(msa::Handle hdl);
 	
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
 	#include "event/hooks.hpp"
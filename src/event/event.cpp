@@ -88,4 +88,52 @@ namespace msa { namespace event {
 		#undef MSA_EVENT_TOPIC
 		return std::to_string(static_cast<int>(t));
 	}
+
+	extern const char *topic_name(Topic t)
+	{
+		#define MSA_EVENT_TOPIC(enum_name, priority)		if (t == Topic::enum_name) return #enum_name;
+		#include "event/topics.hpp"
+		#undef MSA_EVENT_TOPIC
+		return "UNKNOWN";
+	}
+
+	extern bool parse_topic(const std::string &name, Topic *t)
+	{
+		#define MSA_EVENT_TOPIC(enum_name, priority)		if (name == #enum_name) { *t = Topic::enum_name; return true; }
+		#include "event/topics.hpp"
+		#undef MSA_EVENT_TOPIC
+		return false;
+	}
+
+	extern bool checkpoint_event(msa::checkpoint::Writer &out, const Event *e)
+	{
+		const Args<std::string> *args = dynamic_cast<const Args<std::string> *>(e->args);
+		if (args == NULL)
+		{
+			return false;
+		}
+		// topics are saved by name so that adding a topic does not change old checkpoints
+		out.put_string(topic_str(e->topic));
+		out.put_i64(e->generation_time);
+		out.put_string(args->get_args());
+		return true;
+	}
+
+	extern const Event *restore_event(msa::checkpoint::Reader &in)
+	{
+		std::string topic_name = in.get_string();
+		time_t generation_time = in.get_i64();
+		std::string args = in.get_string();
+		Topic t;
+		if (!parse_topic(topic_name, &t))
+		{
+			return NULL;
+		}
+		Event *e = new Event;
+		e->generation_time = generation_time;
+		e->attributes = get_topic_attr(t);
+		e->topic = t;
+		e->args = new Args<std::string>(args);
+		return e;
+	}
 } }
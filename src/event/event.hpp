@@ -5,6 +5,8 @@
 #include <cstdint>
 #include <string>
 
+#include "checkpoint/checkpoint.hpp"
+
 namespace msa { namespace event {
 
 	enum class Topic
@@ -89,6 +91,16 @@ namespace msa { namespace event {
 	extern uint8_t get_priority(const Event *e);
 	extern int max_topic_index();
 	extern std::string topic_str(Topic t);
+	// the same name as topic_str(), as a string literal that can be kept
+	extern const char *topic_name(Topic t);
+	// the reverse of topic_str(); returns whether there is a topic with the name
+	extern bool parse_topic(const std::string &name, Topic *t);
+	// writes an event so that it can be created again after a restart. Only events with
+	// string args can be written; returns whether the event was.
+	extern bool checkpoint_event(msa::checkpoint::Writer &out, const Event *e);
+	// reads back an event written by checkpoint_event(). Returns NULL if its topic no
+	// longer exists.
+	extern const Event *restore_event(msa::checkpoint::Reader &in);
 
 } }
 
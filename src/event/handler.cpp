@@ -1,4 +1,5 @@
 #include "event/handler.hpp"
+#include "trace/trace.hpp"
 
 #include "platform/thread/thread.hpp"
 
@@ -10,11 +11,14 @@ namespace msa { namespace event {
 		bool suspend_flag;
 		bool in_wait_loop;
 		bool syscall_origin;
+		// only used for tracing
+		msa::Handle hdl;
 	};
 
-	extern void create_handler_sync(HandlerSync **sync)
+	extern void create_handler_sync(msa::Handle hdl, HandlerSync **sync)
 	{
 		handler_synchronization_type *handler_sync = new handler_synchronization_type;
+		handler_sync->hdl = hdl;
 		msa::thread::cond_init(&handler_sync->resume_cond, NULL);
 		msa::thread::mutex_init(&handler_sync->suspend_mutex, NULL);
 		handler_sync->suspend_flag = false;
@@ -32,6 +36,8 @@ namespace msa { namespace event {
 
 	extern void suspend_handler(HandlerSync *sync)
 	{
+		msa::trace::instant(sync->hdl, "handler", "suspend", NULL);
+		MSA_PROBE1(handler_suspend, sync);
 		msa::thread::mutex_lock(&sync->suspend_mutex);
 		sync->suspend_flag = true;
 		msa::thread::mutex_unlock(&sync->suspend_mutex);
@@ -39,6 +45,8 @@ namespace msa { namespace event {
 
 	extern void resume_handler(HandlerSync *sync)
 	{
+		msa::trace::instant(sync->hdl, "handler", "resume", NULL);
+		MSA_PROBE1(handler_resume, sync);
 		msa::thread::mutex_lock(&sync->suspend_mutex);
 		sync->suspend_flag = false;
 		msa::thread::cond_broadcast(&sync->resume_cond);
@@ -71,6 +79,11 @@ namespace msa { namespace event {
 	extern void HANDLER_INTERRUPT_POINT(HandlerSync *sync)
 	{
 		msa::thread::mutex_lock(&sync->suspend_mutex);
+		bool waited = sync->suspend_flag;
+		if (waited)
+		{
+			msa::trace::begin(sync->hdl, "handler", "suspended", NULL);
+		}
 		while (sync->suspend_flag)
 		{
 			sync->in_wait_loop = true;
@@ -78,6 +91,10 @@ namespace msa { namespace event {
 		}
 		sync->in_wait_loop = false;
 		msa::thread::mutex_unlock(&sync->suspend_mutex);
+		if (waited)
+		{
+			msa::trace::end(sync->hdl);
+		}
 	}
 
 } }
@@ -11,7 +11,7 @@ namespace msa { namespace event {
 	typedef void (*EventHandler)(msa::Handle hdl, const Event *const e, HandlerSync *const sync);
 
 	// creates a handler sync and initializes the variables in it
-	extern void create_handler_sync(HandlerSync **sync);
+	extern void create_handler_sync(msa::Handle hdl, HandlerSync **sync);
 
 	// destroys handler sync and frees resources associated with it
 	extern void dispose_handler_sync(HandlerSync *sync);
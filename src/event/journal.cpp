@@ -0,0 +1,578 @@
+#include "event/journal.hpp"
+
+#include "event/dispatch.hpp"
+#include "log/log.hpp"
+#include "metrics/metrics.hpp"
+#include "memory/memory.hpp"
+#include "checkpoint/checkpoint.hpp"
+#include "platform/file/file.hpp"
+
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+#include "platform/thread/thread.hpp"
+
+namespace msa { namespace event {
+
+	typedef std::chrono::steady_clock Clock;
+
+	static const char MAGIC[4] = {'M', 'S', 'A', 'J'};
+	static const uint32_t FORMAT_VERSION = 1;
+	// the length and checksum in front of each record
+	static const size_t FRAME_SIZE = 8;
+
+	// what each record is
+	static const uint8_t RECORD_EVENT = 'E';
+	static const uint8_t RECORD_DONE = 'D';
+	static const uint8_t RECORD_CHECKPOINTED = 'C';
+
+	struct journal_context_type
+	{
+		msa::Handle hdl;
+		// NULL when journaling is off
+		msa::file::AppendFile *file;
+		std::string path;
+		bool sync;
+		// how large the file may grow before it is rewritten with only the events that
+		// are not finished with, or 0 to let it grow; guarded by the mutex
+		size_t max_size;
+		// only used by the writer
+		size_t size;
+		size_t compact_at;
+		// whether the file has been moved to path yet; it is not compacted before then
+		bool installed;
+		// the framed records of the events that are not finished with, by sequence number
+		std::map<uint64_t, std::string> live;
+		msa::thread::Thread writer;
+		msa::thread::Mutex mutex;
+		// signalled when records are added or the writer is stopped
+		msa::thread::Cond pending_cond;
+		// broadcast after each commit
+		msa::thread::Cond committed_cond;
+		// records that the writer has not taken yet, and how many records have been
+		// added and committed in total
+		std::string pending;
+		uint64_t added;
+		uint64_t committed;
+		bool stopping;
+		// set once a write fails; nothing more is committed after that
+		bool failed;
+		msa::metrics::Counter *records_metric;
+		msa::metrics::Counter *bytes_metric;
+		msa::metrics::Histogram *commit_metric;
+		msa::metrics::Counter *compactions_metric;
+		// the replay thread runs until replaying is cleared; guarded by the mutex
+		msa::thread::Thread replayer;
+		bool replaying;
+		msa::thread::Cond replay_cond;
+		std::vector<JournalEntry> replay_entries;
+		double replay_speed;
+	};
+
+	static void *writer_start(void *args);
+	static void *replay_start(void *args);
+	static void add_record(JournalContext *ctx, const msa::checkpoint::Writer &record, uint8_t type, uint64_t sequence);
+	static bool compact_journal(JournalContext *ctx, const std::string &data);
+	static uint32_t checksum(const char *data, size_t size);
+	static void put_header(std::string &buf);
+
+	extern int create_journal_context(msa::Handle hdl, JournalContext **ctx)
+	{
+		JournalContext *j = new JournalContext;
+		j->hdl = hdl;
+		j->file = NULL;
+		j->sync = true;
+		j->max_size = 0;
+		j->size = 0;
+		j->compact_at = 0;
+		j->installed = false;
+		msa::thread::mutex_init(&j->mutex, NULL);
+		msa::thread::cond_init(&j->pending_cond, NULL);
+		msa::thread::cond_init(&j->committed_cond, NULL);
+		msa::thread::cond_init(&j->replay_cond, NULL);
+		j->added = 0;
+		j->committed = 0;
+		j->stopping = false;
+		j->failed = false;
+		j->replaying = false;
+		j->replay_speed = 1;
+		j->records_metric = msa::metrics::get_counter(hdl, "msa_journal_records_total", "Records added to the event journal");
+		j->bytes_metric = msa::metrics::get_counter(hdl, "msa_journal_bytes_total", "Bytes committed to the event journal");
+		j->commit_metric = msa::metrics::get_histogram(hdl, "msa_journal_commit_microseconds", "How long each group commit of the event journal took");
+		j->compactions_metric = msa::metrics::get_counter(hdl, "msa_journal_compactions_total", "Times the event journal was rewritten with only its unfinished events");
+		*ctx = j;
+		return 0;
+	}
+
+	extern void dispose_journal_context(JournalContext *ctx)
+	{
+		stop_replay(ctx);
+		close_journal(ctx);
+		msa::thread::cond_destroy(&ctx->replay_cond);
+		msa::thread::cond_destroy(&ctx->committed_cond);
+		msa::thread::cond_destroy(&ctx->pending_cond);
+		msa::thread::mutex_destroy(&ctx->mutex);
+		delete ctx;
+	}
+
+	extern void open_journal(JournalContext *ctx, const std::string &path, bool sync, size_t max_size)
+	{
+		std::string new_path = path + ".new";
+		msa::file::AppendFile *file = msa::file::open_append(new_path, true);
+		std::string header;
+		put_header(header);
+		if (!msa::file::append(file, header.data(), header.size()))
+		{
+			msa::file::close_append(file);
+			remove(new_path.c_str());
+			throw std::logic_error("could not write " + new_path);
+		}
+		ctx->file = file;
+		ctx->path = path;
+		ctx->sync = sync;
+		ctx->max_size = max_size;
+		ctx->size = header.size();
+		ctx->compact_at = max_size;
+		ctx->installed = false;
+		ctx->live.clear();
+		ctx->stopping = false;
+		ctx->failed = false;
+		int status = msa::thread::create(&ctx->writer, NULL, writer_start, ctx, "journal");
+		if (status != 0)
+		{
+			ctx->file = NULL;
+			msa::file::close_append(file);
+			remove(new_path.c_str());
+			throw std::logic_error("could not start journal thread (error " + std::to_string(status) + ")");
+		}
+	}
+
+	/**
+	 * The new file is only moved over the old one once the events recovered from the old
+	 * one are committed to it, so a crash while recovering loses nothing.
+	 */
+	extern void install_journal(JournalContext *ctx)
+	{
+		flush_journal(ctx);
+		std::string new_path = ctx->path + ".new";
+		if (rename(new_path.c_str(), ctx->path.c_str()) != 0)
+		{
+			msa::log::error(ctx->hdl, "Could not replace " + ctx->path + " with the new journal; it is being written to " + new_path);
+			return;
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->installed = true;
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern void close_journal(JournalContext *ctx)
+	{
+		if (ctx->file == NULL)
+		{
+			return;
+		}
+		// a clean stop either checkpoints or drops what is left, so there is nothing to recover
+		journal_checkpointed(ctx);
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->stopping = true;
+		msa::thread::cond_broadcast(&ctx->pending_cond);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		msa::thread::join(ctx->writer, NULL);
+		msa::file::close_append(ctx->file);
+		ctx->file = NULL;
+	}
+
+	extern bool journal_open(JournalContext *ctx)
+	{
+		return ctx->file != NULL;
+	}
+
+	extern bool journal_event(JournalContext *ctx, uint64_t sequence, const Event *e)
+	{
+		if (ctx->file == NULL)
+		{
+			return false;
+		}
+		msa::memory::Scope memory_scope(msa::memory::Tag::JOURNAL);
+		msa::checkpoint::Writer record;
+		record.put_u8(RECORD_EVENT);
+		record.put_u64(sequence);
+		record.put_i64(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		if (!checkpoint_event(record, e))
+		{
+			return false;
+		}
+		add_record(ctx, record, RECORD_EVENT, sequence);
+		return true;
+	}
+
+	extern void journal_done(JournalContext *ctx, uint64_t sequence)
+	{
+		if (ctx->file == NULL)
+		{
+			return;
+		}
+		msa::memory::Scope memory_scope(msa::memory::Tag::JOURNAL);
+		msa::checkpoint::Writer record;
+		record.put_u8(RECORD_DONE);
+		record.put_u64(sequence);
+		add_record(ctx, record, RECORD_DONE, sequence);
+	}
+
+	extern void journal_checkpointed(JournalContext *ctx)
+	{
+		if (ctx->file == NULL)
+		{
+			return;
+		}
+		msa::memory::Scope memory_scope(msa::memory::Tag::JOURNAL);
+		msa::checkpoint::Writer record;
+		record.put_u8(RECORD_CHECKPOINTED);
+		record.put_u64(0);
+		add_record(ctx, record, RECORD_CHECKPOINTED, 0);
+	}
+
+	extern void flush_journal(JournalContext *ctx)
+	{
+		if (ctx->file == NULL)
+		{
+			return;
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		uint64_t target = ctx->added;
+		while (ctx->committed < target && !ctx->failed)
+		{
+			msa::thread::cond_wait(&ctx->committed_cond, &ctx->mutex);
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern size_t read_journal(const std::string &path, bool unfinished, std::vector<JournalEntry> &entries)
+	{
+		msa::file::Mapping *mapping = msa::file::map(path);
+		const char *data = msa::file::mapping_data(mapping);
+		size_t size = msa::file::mapping_size(mapping);
+		std::string header;
+		put_header(header);
+		if (size < header.size() || header.compare(0, header.size(), data, header.size()) != 0)
+		{
+			msa::file::unmap(mapping);
+			throw std::logic_error(path + " is not an event journal of this version");
+		}
+		std::vector<JournalEntry> read;
+		// where each unfinished event is in read, by sequence number
+		std::map<uint64_t, size_t> open;
+		size_t pos = header.size();
+		while (pos + FRAME_SIZE <= size)
+		{
+			msa::checkpoint::Reader frame(data + pos, FRAME_SIZE);
+			uint32_t length = frame.get_u32();
+			uint32_t sum = frame.get_u32();
+			if (length > size - pos - FRAME_SIZE || checksum(data + pos + FRAME_SIZE, length) != sum)
+			{
+				break;
+			}
+			msa::checkpoint::Reader record(data + pos + FRAME_SIZE, length);
+			pos += FRAME_SIZE + length;
+			try
+			{
+				uint8_t type = record.get_u8();
+				uint64_t sequence = record.get_u64();
+				if (type == RECORD_EVENT)
+				{
+					int64_t millis = record.get_i64();
+					const Event *e = restore_event(record);
+					if (e != NULL)
+					{
+						open[sequence] = read.size();
+						read.push_back(JournalEntry {sequence, millis, e});
+					}
+				}
+				else if (type == RECORD_DONE && unfinished)
+				{
+					open.erase(sequence);
+				}
+				else if (type == RECORD_CHECKPOINTED && unfinished)
+				{
+					open.clear();
+				}
+			}
+			catch (const msa::checkpoint::checkpoint_error &e)
+			{
+				// whole but not readable, so it is skipped rather than guessed at
+			}
+		}
+		msa::file::unmap(mapping);
+		for (size_t i = 0; i < read.size(); i++)
+		{
+			std::map<uint64_t, size_t>::const_iterator iter = open.find(read[i].sequence);
+			if (!unfinished || (iter != open.end() && iter->second == i))
+			{
+				entries.push_back(read[i]);
+			}
+			else
+			{
+				delete read[i].event->args;
+				dispose(read[i].event);
+			}
+		}
+		return size - pos;
+	}
+
+	extern void dispose_journal_entries(std::vector<JournalEntry> &entries)
+	{
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			delete entries[i].event->args;
+			dispose(entries[i].event);
+		}
+		entries.clear();
+	}
+
+	extern int start_replay(msa::Handle hdl, JournalContext *ctx, std::vector<JournalEntry> &entries, double speed)
+	{
+		ctx->replay_entries.swap(entries);
+		ctx->replay_speed = speed;
+		ctx->replaying = true;
+		int status = msa::thread::create(&ctx->replayer, NULL, replay_start, ctx, "replay");
+		if (status != 0)
+		{
+			ctx->replaying = false;
+			dispose_journal_entries(ctx->replay_entries);
+			msa::log::error(hdl, "Could not start journal replay thread (error " + std::to_string(status) + ")");
+		}
+		return status;
+	}
+
+	extern void stop_replay(JournalContext *ctx)
+	{
+		msa::thread::mutex_lock(&ctx->mutex);
+		bool running = ctx->replaying;
+		ctx->replaying = false;
+		msa::thread::cond_broadcast(&ctx->replay_cond);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (running)
+		{
+			msa::thread::join(ctx->replayer, NULL);
+		}
+	}
+
+	// events are journaled while the queue is locked, so their records are in the order
+	// that the events were pushed
+	static void add_record(JournalContext *ctx, const msa::checkpoint::Writer &record, uint8_t type, uint64_t sequence)
+	{
+		const std::string &payload = record.data();
+		msa::checkpoint::Writer frame;
+		frame.put_u32(payload.size());
+		frame.put_u32(checksum(payload.data(), payload.size()));
+		msa::thread::mutex_lock(&ctx->mutex);
+		size_t start = ctx->pending.size();
+		ctx->pending += frame.data();
+		ctx->pending += payload;
+		if (ctx->max_size > 0)
+		{
+			if (type == RECORD_EVENT)
+			{
+				ctx->live[sequence].assign(ctx->pending, start, std::string::npos);
+			}
+			else if (type == RECORD_DONE)
+			{
+				ctx->live.erase(sequence);
+			}
+			else
+			{
+				ctx->live.clear();
+			}
+		}
+		ctx->added++;
+		msa::thread::cond_signal(&ctx->pending_cond);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		msa::metrics::increment(ctx->records_metric, 1);
+	}
+
+	/**
+	 * Takes every record added since the last commit and writes them with one sync, so
+	 * that records added while a sync is in progress share the next one.
+	 *
+	 * Once the file has grown past its limit, the records of every event that is not
+	 * finished with take the place of the batch and are written to a new file instead;
+	 * they already account for everything in the batch. The limit then doubles if what
+	 * is left is over half of it, so that a long queue is not rewritten on every commit.
+	 */
+	static void *writer_start(void *args)
+	{
+		JournalContext *ctx = (JournalContext *) args;
+		msa::memory::Scope memory_scope(msa::memory::Tag::JOURNAL);
+		std::string batch;
+		std::string held;
+		msa::thread::mutex_lock(&ctx->mutex);
+		while (true)
+		{
+			while (ctx->pending.empty() && !ctx->stopping)
+			{
+				msa::thread::cond_wait(&ctx->pending_cond, &ctx->mutex);
+			}
+			if (ctx->pending.empty())
+			{
+				break;
+			}
+			bool compact = (ctx->max_size > 0 && ctx->installed && ctx->size > ctx->compact_at && !ctx->failed);
+			if (compact)
+			{
+				put_header(batch);
+				std::map<uint64_t, std::string>::const_iterator iter;
+				for (iter = ctx->live.begin(); iter != ctx->live.end(); iter++)
+				{
+					batch += iter->second;
+				}
+				held.swap(ctx->pending);
+			}
+			else
+			{
+				batch.swap(ctx->pending);
+			}
+			uint64_t target = ctx->added;
+			bool failed = ctx->failed;
+			msa::thread::mutex_unlock(&ctx->mutex);
+
+			Clock::time_point start = Clock::now();
+			if (compact && !compact_journal(ctx, batch))
+			{
+				// the records are put back so that they go to the old file, which is
+				// left to grow from now on
+				msa::thread::mutex_lock(&ctx->mutex);
+				ctx->pending.insert(0, held);
+				ctx->max_size = 0;
+				ctx->live.clear();
+				held.clear();
+				batch.clear();
+				continue;
+			}
+			bool ok = compact || (!failed && msa::file::append(ctx->file, batch.data(), batch.size()));
+			if (ok && ctx->sync && !compact)
+			{
+				ok = msa::file::sync(ctx->file);
+			}
+			if (ok)
+			{
+				size_t before = ctx->size;
+				ctx->size = compact ? batch.size() : ctx->size + batch.size();
+				if (compact)
+				{
+					ctx->compact_at = std::max(ctx->max_size, ctx->size * 2);
+					msa::metrics::increment(ctx->compactions_metric, 1);
+					msa::log::debug(ctx->hdl, "Compacted the event journal from " + std::to_string(before) + " to " + std::to_string(ctx->size) + " bytes");
+				}
+				msa::metrics::increment(ctx->bytes_metric, batch.size());
+				msa::metrics::observe(ctx->commit_metric, std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+			}
+			else if (!failed)
+			{
+				msa::log::error(ctx->hdl, "Could not write to the event journal; no more events will be recorded");
+			}
+			batch.clear();
+			held.clear();
+
+			msa::thread::mutex_lock(&ctx->mutex);
+			ctx->failed = !ok;
+			ctx->committed = target;
+			msa::thread::cond_broadcast(&ctx->committed_cond);
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return NULL;
+	}
+
+	static void *replay_start(void *args)
+	{
+		JournalContext *ctx = (JournalContext *) args;
+		msa::memory::Scope memory_scope(msa::memory::Tag::JOURNAL);
+		std::vector<JournalEntry> &entries = ctx->replay_entries;
+		Clock::time_point start = Clock::now();
+		size_t replayed = 0;
+		for (; replayed < entries.size(); replayed++)
+		{
+			const JournalEntry &entry = entries[replayed];
+			msa::thread::mutex_lock(&ctx->mutex);
+			if (ctx->replay_speed > 0)
+			{
+				std::chrono::duration<double, std::milli> offset((entry.millis - entries[0].millis) / ctx->replay_speed);
+				Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(offset);
+				while (ctx->replaying && Clock::now() < due)
+				{
+					auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+					msa::thread::cond_timed_wait(&ctx->replay_cond, &ctx->mutex, (int) std::min(left + 1, (decltype(left)) 1000));
+				}
+			}
+			bool replaying = ctx->replaying;
+			msa::thread::mutex_unlock(&ctx->mutex);
+			if (!replaying)
+			{
+				break;
+			}
+			generate(ctx->hdl, entry.event->topic, *entry.event->args);
+		}
+		msa::log::info(ctx->hdl, "Replayed " + std::to_string(replayed) + " of " + std::to_string(entries.size()) + " journaled event(s) in " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count()) + "ms");
+		dispose_journal_entries(entries);
+		return NULL;
+	}
+
+	/**
+	 * Writes the data to a new file, syncs it and moves it over the journal, so that a
+	 * crash leaves either the old file or the whole new one. Only the writer calls this.
+	 */
+	static bool compact_journal(JournalContext *ctx, const std::string &data)
+	{
+		std::string new_path = ctx->path + ".new";
+		msa::file::AppendFile *file = NULL;
+		try
+		{
+			file = msa::file::open_append(new_path, true);
+		}
+		catch (const std::logic_error &e)
+		{
+			msa::log::error(ctx->hdl, "Could not compact the event journal: " + std::string(e.what()) + "; it will no longer be compacted");
+			return false;
+		}
+		std::string dir_path = ctx->path;
+		msa::file::dirname(dir_path);
+		bool ok = msa::file::append(file, data.data(), data.size()) && msa::file::sync(file);
+		if (!ok || rename(new_path.c_str(), ctx->path.c_str()) != 0)
+		{
+			msa::file::close_append(file);
+			remove(new_path.c_str());
+			msa::log::error(ctx->hdl, "Could not write the compacted event journal to " + ctx->path + "; it will no longer be compacted");
+			return false;
+		}
+		if (!msa::file::sync_dir(dir_path))
+		{
+			msa::log::warn(ctx->hdl, "Could not sync the directory of " + ctx->path + " after compacting the event journal");
+		}
+		msa::file::close_append(ctx->file);
+		ctx->file = file;
+		return true;
+	}
+
+	// FNV-1a, which is enough to find a record that was only partly written
+	static uint32_t checksum(const char *data, size_t size)
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= (uint8_t) data[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	static void put_header(std::string &buf)
+	{
+		msa::checkpoint::Writer header;
+		header.put_u32(FORMAT_VERSION);
+		buf.assign(MAGIC, sizeof(MAGIC));
+		buf += header.data();
+	}
+
+} }
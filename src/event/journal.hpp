@@ -0,0 +1,66 @@
+#ifndef MSA_EVENT_JOURNAL_HPP
+#define MSA_EVENT_JOURNAL_HPP
+
+#include "msa.hpp"
+#include "event/event.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// An append-only record of the events pushed onto the queue, and of which of them
+// were finished with, so that events that were never handled can be pushed again
+// after a crash or replayed into another instance. Records are written by a
+// background thread that commits everything added since its last write with a
+// single sync, and which compacts the file once it grows past a limit. Like
+// checkpoints, only events with string args can be recorded.
+
+namespace msa { namespace event {
+
+	typedef struct journal_context_type JournalContext;
+
+	typedef struct journal_entry_type
+	{
+		uint64_t sequence;
+		// wall clock time that the event was pushed, in milliseconds
+		int64_t millis;
+		// owned by whoever read the entry
+		const Event *event;
+	} JournalEntry;
+
+	extern int create_journal_context(msa::Handle hdl, JournalContext **ctx);
+	extern void dispose_journal_context(JournalContext *ctx);
+	// starts committing records to a new file next to path, which replaces the file at
+	// path once install_journal() is called. Once the file passes max_size bytes, it is
+	// rewritten with only the events that are not finished with; 0 lets it grow. Throws
+	// std::logic_error if it cannot be opened.
+	extern void open_journal(JournalContext *ctx, const std::string &path, bool sync, size_t max_size);
+	extern void install_journal(JournalContext *ctx);
+	// marks every event as finished with, commits what is left and closes the file
+	extern void close_journal(JournalContext *ctx);
+	extern bool journal_open(JournalContext *ctx);
+	// adds an event that was pushed with the given sequence number; returns whether it
+	// could be recorded
+	extern bool journal_event(JournalContext *ctx, uint64_t sequence, const Event *e);
+	extern void journal_done(JournalContext *ctx, uint64_t sequence);
+	// records that every event that is not done has been written to a checkpoint or
+	// dropped on purpose
+	extern void journal_checkpointed(JournalContext *ctx);
+	// blocks until every record added so far has been committed
+	extern void flush_journal(JournalContext *ctx);
+	// reads the events of a journal in the order they were pushed, giving only the ones
+	// that were never done or checkpointed if unfinished is set. Reading stops at the
+	// first record that was cut short or damaged, as the last one is after a crash.
+	// Returns how many bytes were left unread that way. Throws std::logic_error if the
+	// file cannot be read or is not a journal.
+	extern size_t read_journal(const std::string &path, bool unfinished, std::vector<JournalEntry> &entries);
+	extern void dispose_journal_entries(std::vector<JournalEntry> &entries);
+	// generates the events again in a thread of their own, spaced out as they were first
+	// pushed and sped up by speed; a speed of 0 generates them as fast as possible. Takes
+	// the events from entries.
+	extern int start_replay(msa::Handle hdl, JournalContext *ctx, std::vector<JournalEntry> &entries, double speed);
+	extern void stop_replay(JournalContext *ctx);
+
+} }
+
+#endif
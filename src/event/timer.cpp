@@ -4,38 +4,46 @@
 #include "event/dispatch.hpp"
 #include "log/log.hpp"
 #include "agent/agent.hpp"
+#include "trace/trace.hpp"
+#include "memory/memory.hpp"
 
 #include <map>
+#include <atomic>
+#include <algorithm>
 
 #include "platform/thread/thread.hpp"
 
 
 namespace msa { namespace event {
 	
-	typedef std::chrono::high_resolution_clock chrono_clock;
+	typedef std::chrono::steady_clock chrono_clock;
 	typedef chrono_clock::time_point chrono_time;
 	
 	class Timer
 	{
 		public:
-			Timer(int16_t id, std::chrono::milliseconds period, Topic topic, const IArgs &args, bool recurring, bool system) :
+			Timer(int16_t id, uint64_t seq, std::chrono::milliseconds period, Topic topic, const IArgs &args, bool recurring, bool system, chrono_time now, const std::string &owner = "") :
 				_id(id),
+				_seq(seq),
 				_period(period),
-				_last_fired(chrono_clock::now()),
+				_last_fired(now),
 				_recurring(recurring),
 				_event_args(args.copy()),
 				_event_topic(topic),
-				_system(system)
+				_system(system),
+				_owner(owner)
 			{}
 			
 			Timer(const Timer &other) :
 				_id(other._id),
+				_seq(other._seq),
 				_period(other._period),
 				_last_fired(other._last_fired),
 				_recurring(other._recurring),
 				_event_args(other._event_args->copy()),
 				_event_topic(other._event_topic),
-				_system(other._system)
+				_system(other._system),
+				_owner(other._owner)
 			{}
 			
 			~Timer()
@@ -48,10 +56,12 @@ namespace msa { namespace event {
 				delete _event_args;
 				_event_args = other._event_args->copy();
 				_id = other._id;
+				_seq = other._seq;
 				_period = other._period;
 				_last_fired = other._last_fired;
 				_event_topic = other._event_topic;
 				_system = other._system;
+				_owner = other._owner;
 				return *this;
 			}
 			
@@ -74,6 +84,7 @@ namespace msa { namespace event {
 			 */
 			void fire(msa::Handle hdl, chrono_time now)
 			{
+				msa::trace::instant(hdl, "timer", "fire", topic_name(_event_topic));
 				generate(hdl, _event_topic, *_event_args);
 				msa::log::debug(hdl, "Fired timer " + std::to_string(id()));
 				_last_fired = now;
@@ -88,6 +99,11 @@ namespace msa { namespace event {
 			{
 				return _id;
 			}
+
+			uint64_t seq() const
+			{
+				return _seq;
+			}
 			
 			Topic topic() const
 			{
@@ -99,77 +115,190 @@ namespace msa { namespace event {
 				return _system;
 			}
 
+			const std::string &owner() const
+			{
+				return _owner;
+			}
+
+			std::chrono::milliseconds period() const
+			{
+				return _period;
+			}
+
+			const IArgs &args() const
+			{
+				return *_event_args;
+			}
+
+			std::chrono::milliseconds remaining(chrono_time now) const
+			{
+				auto left = std::chrono::duration_cast<std::chrono::milliseconds>(_last_fired + _period - now);
+				return std::max(left, std::chrono::milliseconds::zero());
+			}
+
+			/**
+			 * Moves the last fire time so that the timer next fires after
+			 * the given time from now.
+			 */
+			void set_remaining(std::chrono::milliseconds remaining, chrono_time now)
+			{
+				_last_fired = now - (_period - remaining);
+			}
+
+			chrono_time deadline() const
+			{
+				return _last_fired + _period;
+			}
+
 		private:
 			int16_t _id;
+			// when the timer was added relative to the others; unlike the ID, it never wraps
+			uint64_t _seq;
 			std::chrono::milliseconds _period;
-			std::chrono::high_resolution_clock::time_point _last_fired;
+			chrono_time _last_fired;
 			bool _recurring;
 			IArgs *_event_args;
 			Topic _event_topic;
 			bool _system;
+			// the plugin that created the timer, or empty for none
+			std::string _owner;
 	};
 	
 	struct TimerContext
 	{
-		std::chrono::milliseconds tick_resolution;
+		// in milliseconds; can be changed while the EDT is checking timers
+		std::atomic<int> tick_resolution;
 		chrono_time last_tick_time;
+		std::atomic<ClockMode> mode;
+		// where a simulated clock is; only moved by the EDT, and guarded by the mutex
+		chrono_time virtual_now;
+		// the wall clock time that virtual_now started from, for schedule()
+		time_t virtual_epoch;
+		chrono_time virtual_start;
+		// how far SIMULATE asked for the clock to be run, and when it was asked in real time
+		chrono_time run_until;
+		bool run_active;
+		chrono_clock::time_point run_started;
 		std::map<int16_t, Timer*> list;
+		int16_t next_id;
+		uint64_t next_seq;
+		// the timers found due by fire_timers(), kept so that checking does not allocate
+		std::vector<Timer*> due;
+		// the size of the list, kept for readers that should not wait on the mutex
+		std::atomic<size_t> count;
 		msa::thread::Mutex mutex;
 	};
 	
 	static void fire_timers(msa::Handle hdl, chrono_time now);
+	static chrono_time clock_now(TimerContext *ctx);
+	static int16_t next_timer_id(TimerContext *ctx);
+	static bool fires_before(const Timer *a, const Timer *b);
+	static int16_t insert_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args, bool recurring, bool system, const std::string &owner);
 	static msa::cmd::Result cmd_timer(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const sync);
 	static msa::cmd::Result cmd_deltimer(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const sync);
+	static msa::cmd::Result cmd_simulate(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const sync);
 
 	extern std::vector<msa::cmd::Command *> get_timer_commands()
 	{
 		std::vector<msa::cmd::Command *> cmds;
 		cmds.push_back(new msa::cmd::Command("TIMER", "It schedules a command to execute in the future", "time-ms command", "r", cmd_timer));
 		cmds.push_back(new msa::cmd::Command("DELTIMER", "It deletes a timer", "timer-id", cmd_deltimer));
+		cmds.push_back(new msa::cmd::Command("SIMULATE", "It runs the simulated clock forward, then executes a command", "time-ms [command]", cmd_simulate));
 		return cmds;
 	}
 
 	extern int16_t schedule(msa::Handle msa, time_t timestamp, const Topic topic, const IArgs &args)
 	{
-		time_t ref_time = time(NULL);
+		return owned_schedule(msa, "", timestamp, topic, args);
+	}
+
+	extern int16_t delay(msa::Handle msa, std::chrono::milliseconds delay, const Topic topic, const IArgs &args)
+	{
+		return owned_delay(msa, "", delay, topic, args);
+	}
+
+	extern int16_t add_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args)
+	{
+		return owned_add_timer(msa, "", period, topic, args);
+	}
+
+	extern int16_t owned_schedule(msa::Handle msa, const std::string &owner, time_t timestamp, const Topic topic, const IArgs &args)
+	{
+		time_t ref_time = clock_time(msa);
 		if (ref_time >= timestamp)
 		{
 			return -1;
 		}
-		return delay(msa, std::chrono::seconds(timestamp), topic, args);
+		return owned_delay(msa, owner, std::chrono::seconds(timestamp - ref_time), topic, args);
 	}
 
-	extern int16_t delay(msa::Handle msa, std::chrono::milliseconds delay, const Topic topic, const IArgs &args)
+	extern int16_t owned_delay(msa::Handle msa, const std::string &owner, std::chrono::milliseconds delay, const Topic topic, const IArgs &args)
 	{
-		msa::thread::mutex_lock(&msa->timer->mutex);
-		int16_t id = msa->timer->list.size();
-		Timer *t = new Timer(id, delay, topic, args, false, true);
-		msa->timer->list[t->id()] = t;
-		msa::thread::mutex_unlock(&msa->timer->mutex);
-		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " event to fire in " + std::to_string(delay.count()) + "ms (id = " + std::to_string(t->id()) + ")");
-		return t->id();
+		int16_t id = insert_timer(msa, delay, topic, args, false, false, owner);
+		if (id == -1)
+		{
+			msa::log::warn(msa, "Could not schedule a " + topic_str(topic) + " event; every timer ID is in use");
+			return -1;
+		}
+		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " event to fire in " + std::to_string(delay.count()) + "ms (id = " + std::to_string(id) + ")");
+		return id;
 	}
 	
-	extern int16_t add_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args)
+	extern int16_t owned_add_timer(msa::Handle msa, const std::string &owner, std::chrono::milliseconds period, const Topic topic, const IArgs &args)
 	{
-		msa::thread::mutex_lock(&msa->timer->mutex);
-		int16_t id = msa->timer->list.size();
-		Timer *t = new Timer(id, period, topic, args, true, true);
-		msa->timer->list[t->id()] = t;
-		msa::thread::mutex_unlock(&msa->timer->mutex);
-		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " event to fire every " + std::to_string(period.count()) + "ms (id = " + std::to_string(t->id()) + ")");
-		return t->id();
+		int16_t id = insert_timer(msa, period, topic, args, true, false, owner);
+		if (id == -1)
+		{
+			msa::log::warn(msa, "Could not schedule a " + topic_str(topic) + " event; every timer ID is in use");
+			return -1;
+		}
+		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " event to fire every " + std::to_string(period.count()) + "ms (id = " + std::to_string(id) + ")");
+		return id;
 	}
 	
 	extern int16_t sys_add_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args)
 	{
-		msa::thread::mutex_lock(&msa->timer->mutex);
-		int16_t id = msa->timer->list.size();
-		Timer *t = new Timer(id, period, topic, args, true, false);
-		msa->timer->list[t->id()] = t;
-		msa::thread::mutex_unlock(&msa->timer->mutex);
-		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " system event to fire every " + std::to_string(period.count()) + "ms (id = " + std::to_string(t->id()) + ")");
-		return t->id();
+		int16_t id = insert_timer(msa, period, topic, args, true, true, "");
+		if (id == -1)
+		{
+			msa::log::warn(msa, "Could not schedule a " + topic_str(topic) + " system event; every timer ID is in use");
+			return -1;
+		}
+		msa::log::debug(msa, "Scheduled a " + topic_str(topic) + " system event to fire every " + std::to_string(period.count()) + "ms (id = " + std::to_string(id) + ")");
+		return id;
+	}
+
+	static int16_t insert_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args, bool recurring, bool system, const std::string &owner)
+	{
+		TimerContext *ctx = msa->timer;
+		msa::memory::Scope memory_scope(msa::memory::Tag::TIMER);
+		msa::thread::mutex_lock(&ctx->mutex);
+		int16_t id = next_timer_id(ctx);
+		if (id != -1)
+		{
+			ctx->list[id] = new Timer(id, ctx->next_seq++, period, topic, args, recurring, system, clock_now(ctx), owner);
+			ctx->count = ctx->list.size();
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return id;
+	}
+
+	// IDs are handed out in order and are not reused until they wrap, so that an old ID
+	// does not name a newer timer; returns -1 if every ID is taken. Must be called with
+	// the mutex held
+	static int16_t next_timer_id(TimerContext *ctx)
+	{
+		if (ctx->list.size() > INT16_MAX)
+		{
+			return -1;
+		}
+		while (ctx->list.find(ctx->next_id) != ctx->list.end())
+		{
+			ctx->next_id = (ctx->next_id == INT16_MAX) ? 0 : ctx->next_id + 1;
+		}
+		int16_t id = ctx->next_id;
+		ctx->next_id = (id == INT16_MAX) ? 0 : id + 1;
+		return id;
 	}
 
 	extern void remove_timer(msa::Handle msa, int16_t id)
@@ -197,11 +326,132 @@ namespace msa { namespace event {
 		TimerContext *ctx = msa->timer;
 		Timer *t = ctx->list[id];
 		ctx->list.erase(id);
+		ctx->count = ctx->list.size();
 		delete t;
 		msa::log::debug(msa, "Removed timer ID " + std::to_string(id));
 		return;
 	}
 
+	// the owner is checked under the lock, so that a timer whose ID has been handed on
+	// since the owner's timer fired is left alone
+	extern bool remove_owned_timer(msa::Handle msa, const std::string &owner, int16_t id)
+	{
+		TimerContext *ctx = msa->timer;
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::map<int16_t, Timer*>::const_iterator iter = ctx->list.find(id);
+		bool owned = (iter != ctx->list.end() && iter->second->owner() == owner);
+		if (owned)
+		{
+			sys_remove_timer(msa, id);
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return owned;
+	}
+
+	extern size_t remove_owned_timers(msa::Handle msa, const std::string &owner)
+	{
+		TimerContext *ctx = msa->timer;
+		std::vector<int16_t> ids;
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::map<int16_t, Timer*>::const_iterator iter;
+		for (iter = ctx->list.begin(); iter != ctx->list.end(); iter++)
+		{
+			if (iter->second->owner() == owner)
+			{
+				ids.push_back(iter->first);
+			}
+		}
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			sys_remove_timer(msa, ids[i]);
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return ids.size();
+	}
+
+	extern uint32_t checkpoint_timers(msa::Handle hdl, msa::checkpoint::Writer &out)
+	{
+		TimerContext *ctx = hdl->timer;
+		msa::checkpoint::Writer timers;
+		uint32_t count = 0;
+		msa::thread::mutex_lock(&ctx->mutex);
+		chrono_time now = clock_now(ctx);
+		// written in the order they were added, so that they are restored in that order
+		std::vector<const Timer*> ordered;
+		std::map<int16_t, Timer*>::const_iterator iter;
+		for (iter = ctx->list.begin(); iter != ctx->list.end(); iter++)
+		{
+			ordered.push_back(iter->second);
+		}
+		std::sort(ordered.begin(), ordered.end(), [](const Timer *a, const Timer *b) { return a->seq() < b->seq(); });
+		for (size_t i = 0; i < ordered.size(); i++)
+		{
+			const Timer *t = ordered[i];
+			const Args<std::string> *args = dynamic_cast<const Args<std::string> *>(&t->args());
+			if (args == NULL)
+			{
+				msa::log::warn(hdl, "Timer " + std::to_string(t->id()) + " does not have text args, so it cannot be checkpointed");
+				continue;
+			}
+			timers.put_u32((uint16_t) t->id());
+			timers.put_string(topic_str(t->topic()));
+			timers.put_string(args->get_args());
+			timers.put_u64(t->period().count());
+			timers.put_u64(t->remaining(now).count());
+			timers.put_bool(t->recurring());
+			timers.put_bool(t->is_system());
+			count++;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		out.put_u32(count);
+		out.append(timers);
+		return count;
+	}
+
+	extern uint32_t restore_timers(msa::Handle hdl, msa::checkpoint::Reader &in)
+	{
+		TimerContext *ctx = hdl->timer;
+		msa::memory::Scope memory_scope(msa::memory::Tag::TIMER);
+		uint32_t count = in.get_u32();
+		uint32_t added = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			int16_t id = (int16_t) (uint16_t) in.get_u32();
+			std::string topic_name = in.get_string();
+			std::string args = in.get_string();
+			std::chrono::milliseconds period(in.get_u64());
+			std::chrono::milliseconds remaining(in.get_u64());
+			bool recurring = in.get_bool();
+			bool system = in.get_bool();
+			Topic topic;
+			if (!parse_topic(topic_name, &topic))
+			{
+				msa::log::warn(hdl, "Dropping checkpointed timer " + std::to_string(id) + " for unknown topic " + topic_name);
+				continue;
+			}
+			msa::thread::mutex_lock(&ctx->mutex);
+			if (id < 0 || ctx->list.find(id) != ctx->list.end())
+			{
+				id = next_timer_id(ctx);
+			}
+			if (id == -1)
+			{
+				msa::thread::mutex_unlock(&ctx->mutex);
+				msa::log::warn(hdl, "Dropping a checkpointed " + topic_name + " timer; every timer ID is in use");
+				continue;
+			}
+			chrono_time now = clock_now(ctx);
+			Timer *t = new Timer(id, ctx->next_seq++, period, topic, wrap(args), recurring, system, now);
+			t->set_remaining(std::min(remaining, period), now);
+			ctx->list[id] = t;
+			ctx->count = ctx->list.size();
+			msa::thread::mutex_unlock(&ctx->mutex);
+			msa::log::debug(hdl, "Restored timer " + std::to_string(id) + " with " + std::to_string(remaining.count()) + "ms left");
+			added++;
+		}
+		return added;
+	}
+
 	extern void get_timers(msa::Handle msa, std::vector<int16_t> &list)
 	{
 		TimerContext *ctx = msa->timer;
@@ -219,7 +469,16 @@ namespace msa { namespace event {
 		TimerContext *t = new TimerContext;
 		t->last_tick_time = chrono_time::min();
 		msa::thread::mutex_init(&t->mutex, NULL);
-		t->tick_resolution = std::chrono::milliseconds(1);
+		t->tick_resolution = 1;
+		t->mode = ClockMode::REAL;
+		t->virtual_now = chrono_clock::now();
+		t->virtual_start = t->virtual_now;
+		t->virtual_epoch = time(NULL);
+		t->run_until = t->virtual_now;
+		t->run_active = false;
+		t->next_id = 0;
+		t->next_seq = 0;
+		t->count = 0;
 		*ctx = t;
 		return 0;
 	}
@@ -232,9 +491,98 @@ namespace msa { namespace event {
 	
 	extern void set_tick_resolution(TimerContext *ctx, int res)
 	{
-		ctx->tick_resolution = std::chrono::milliseconds(res);
+		ctx->tick_resolution = res;
 	}
 	
+	/**
+	 * Changes which clock the timers run on. Every timer keeps the time it had left,
+	 * so a simulated clock starts from the real time and a real clock takes over
+	 * from wherever the simulation got to.
+	 */
+	extern void set_clock_mode(TimerContext *ctx, ClockMode mode)
+	{
+		msa::thread::mutex_lock(&ctx->mutex);
+		if (ctx->mode != mode)
+		{
+			chrono_time old_now = clock_now(ctx);
+			chrono_time real_now = chrono_clock::now();
+			if (mode == ClockMode::SIMULATED)
+			{
+				ctx->virtual_now = real_now;
+				ctx->virtual_start = real_now;
+				ctx->virtual_epoch = time(NULL);
+			}
+			ctx->run_active = false;
+			std::map<int16_t, Timer*>::iterator iter;
+			for (iter = ctx->list.begin(); iter != ctx->list.end(); iter++)
+			{
+				iter->second->set_remaining(iter->second->remaining(old_now), real_now);
+			}
+			ctx->mode = mode;
+			ctx->last_tick_time = chrono_time::min();
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern bool clock_simulated(msa::Handle hdl)
+	{
+		return hdl->timer->mode == ClockMode::SIMULATED;
+	}
+
+	extern time_t clock_time(msa::Handle hdl)
+	{
+		TimerContext *ctx = hdl->timer;
+		if (ctx->mode != ClockMode::SIMULATED)
+		{
+			return time(NULL);
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(ctx->virtual_now - ctx->virtual_start);
+		time_t t = ctx->virtual_epoch + (time_t) elapsed.count();
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return t;
+	}
+
+	extern bool advance_clock(msa::Handle hdl)
+	{
+		TimerContext *ctx = hdl->timer;
+		msa::thread::mutex_lock(&ctx->mutex);
+		if (ctx->mode != ClockMode::SIMULATED || !ctx->run_active)
+		{
+			msa::thread::mutex_unlock(&ctx->mutex);
+			return false;
+		}
+		chrono_time next = ctx->run_until;
+		std::map<int16_t, Timer*>::const_iterator iter;
+		for (iter = ctx->list.begin(); iter != ctx->list.end(); iter++)
+		{
+			next = std::min(next, iter->second->deadline());
+		}
+		if (next > ctx->virtual_now)
+		{
+			ctx->virtual_now = next;
+		}
+		chrono_time now = ctx->virtual_now;
+		bool finished = (now >= ctx->run_until);
+		auto run_length = std::chrono::duration_cast<std::chrono::milliseconds>(ctx->run_until - ctx->virtual_start);
+		chrono_time run_started = ctx->run_started;
+		ctx->run_active = !finished;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		fire_timers(hdl, now);
+		if (finished)
+		{
+			auto took = std::chrono::duration_cast<std::chrono::milliseconds>(chrono_clock::now() - run_started);
+			msa::log::info(hdl, "Simulated clock reached " + std::to_string(run_length.count()) + "ms after " + std::to_string(took.count()) + "ms of real time");
+		}
+		return true;
+	}
+
+	// the mutex must be held if the clock is simulated
+	static chrono_time clock_now(TimerContext *ctx)
+	{
+		return (ctx->mode == ClockMode::SIMULATED) ? ctx->virtual_now : chrono_clock::now();
+	}
+
 	extern void clear_timers(TimerContext *ctx)
 	{
 		auto timer_iter = ctx->list.begin();
@@ -244,15 +592,30 @@ namespace msa { namespace event {
 			timer_iter = ctx->list.erase(timer_iter);
 			delete t;
 		}
+		ctx->count = 0;
+	}
+
+	extern size_t timer_count(msa::Handle hdl)
+	{
+		return hdl->timer->count;
 	}
 	
 	extern void check_timers(msa::Handle hdl)
 	{
 		TimerContext *ctx = hdl->timer;
 		
+		// a simulated clock only moves when the EDT advances it, so there are no ticks to wait for
+		if (ctx->mode == ClockMode::SIMULATED)
+		{
+			msa::thread::mutex_lock(&ctx->mutex);
+			chrono_time now = ctx->virtual_now;
+			msa::thread::mutex_unlock(&ctx->mutex);
+			fire_timers(hdl, now);
+			return;
+		}
 		// check if we need to do timing tasks
 		chrono_time now = chrono_clock::now();
-		if (ctx->last_tick_time + ctx->tick_resolution <= now)
+		if (ctx->last_tick_time + std::chrono::milliseconds(ctx->tick_resolution) <= now)
 		{
 			ctx->last_tick_time = now;
 			fire_timers(hdl, now);
@@ -263,25 +626,43 @@ namespace msa { namespace event {
 	{
 		TimerContext *ctx = hdl->timer;
 		msa::thread::mutex_lock(&ctx->mutex);
-		std::map<int16_t, Timer*>::iterator iter = ctx->list.begin();
-		while (iter != ctx->list.end())
+		MSA_PROBE1(timers_check, ctx->list.size());
+		std::map<int16_t, Timer*>::const_iterator iter;
+		for (iter = ctx->list.begin(); iter != ctx->list.end(); iter++)
 		{
-			Timer *t = iter->second;
-			if (t->ready(now))
+			if (iter->second->ready(now))
 			{
-				t->fire(hdl, now);
-				if (!t->recurring())
-				{
-					iter = ctx->list.erase(iter);
-					delete t;
-					msa::log::debug(hdl, "Completed and removed timer " + std::to_string(iter->first));
-					continue;
-				}
+				ctx->due.push_back(iter->second);
 			}
-			iter++;
 		}
+		std::sort(ctx->due.begin(), ctx->due.end(), fires_before);
+		for (size_t i = 0; i < ctx->due.size(); i++)
+		{
+			Timer *t = ctx->due[i];
+			MSA_PROBE3(timer_fire, t->id(), (int) t->topic(), t->recurring());
+			t->fire(hdl, now);
+			if (!t->recurring())
+			{
+				int16_t id = t->id();
+				ctx->list.erase(id);
+				ctx->count = ctx->list.size();
+				delete t;
+				msa::log::debug(hdl, "Completed and removed timer " + std::to_string(id));
+			}
+		}
+		ctx->due.clear();
 		msa::thread::mutex_unlock(&ctx->mutex);
 	}
+
+	// timers that are due together fire in the order they were added
+	static bool fires_before(const Timer *a, const Timer *b)
+	{
+		if (a->deadline() != b->deadline())
+		{
+			return a->deadline() < b->deadline();
+		}
+		return a->seq() < b->seq();
+	}
 	
 	static msa::cmd::Result cmd_timer(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const UNUSED(sync))
 	{
@@ -341,6 +722,59 @@ namespace msa { namespace event {
 		}
 	}	
 
+	static msa::cmd::Result cmd_simulate(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const UNUSED(sync))
+	{
+		TimerContext *ctx = hdl->timer;
+		if (ctx->mode != ClockMode::SIMULATED)
+		{
+			msa::agent::say(hdl, "My clock is a real one, $USER_TITLE. Set my event clock to 'simulated' first.");
+			return msa::cmd::Result(1);
+		}
+		if (params.arg_count() < 1)
+		{
+			msa::agent::say(hdl, "You gotta tell me how far ahead to go, $USER_TITLE.");
+			return msa::cmd::Result(2);
+		}
+		int length = 0;
+		try
+		{
+			length = std::stoi(params[0]);
+		}
+		catch (std::exception &e)
+		{
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, but '" + params[0] + "' isn't a number of milliseconds.");
+			return msa::cmd::Result(3);
+		}
+		if (length < 0)
+		{
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, I can only make time go forwards.");
+			return msa::cmd::Result(4);
+		}
+		auto ms = std::chrono::milliseconds(length);
+		std::string cmd_str = "";
+		for (size_t i = 1; i < params.arg_count(); i++)
+		{
+			cmd_str += params[i];
+			if (i + 1 < params.arg_count())
+			{
+				cmd_str += " ";
+			}
+		}
+		// it is the newest timer, so it fires after any other timer that is due at the same time
+		if (!cmd_str.empty() && delay(hdl, ms, Topic::TEXT_INPUT, wrap(cmd_str)) == -1)
+		{
+			msa::agent::say(hdl, "Oh no! I'm sorry, $USER_TITLE, I couldn't set up that command!");
+			return msa::cmd::Result(5);
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->run_until = ctx->virtual_now + ms;
+		ctx->run_active = true;
+		ctx->run_started = chrono_clock::now();
+		msa::thread::mutex_unlock(&ctx->mutex);
+		msa::agent::say(hdl, "Okay, $USER_TITLE, I will go through the next " + std::to_string(ms.count()) + " milliseconds as fast as I can!");
+		return msa::cmd::Result(0);
+	}
+
 	static msa::cmd::Result cmd_deltimer(msa::Handle hdl, const msa::cmd::ParamList &params, HandlerSync *const UNUSED(sync))
 	{
 		if (params.arg_count() < 1)
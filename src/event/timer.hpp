@@ -4,20 +4,49 @@
 #include "msa.hpp"
 #include "cmd/cmd.hpp"
 #include "event/event.hpp"
+#include "checkpoint/checkpoint.hpp"
 
 #include <chrono>
 #include <vector>
 
 namespace msa { namespace event {
 
+	// REAL timers run on the steady clock. SIMULATED timers run on a virtual clock that
+	// stands still until the SIMULATE command runs it forward, which the EDT then does
+	// by calling advance_clock() whenever it is idle.
+	enum class ClockMode { REAL, SIMULATED };
+
 	extern std::vector<msa::cmd::Command *> get_timer_commands();
 	extern void check_timers(msa::Handle hdl);
 	extern int create_timer_context(TimerContext **ctx);
 	extern void dispose_timer_context(TimerContext *ctx);
 	extern void set_tick_resolution(TimerContext *ctx, int res);
+	extern void set_clock_mode(TimerContext *ctx, ClockMode mode);
+	extern bool clock_simulated(msa::Handle hdl);
+	// moves a simulated clock to the earliest timer deadline, or to the end of the run
+	// if that is sooner, and fires the timers that are due; returns false if no run is
+	// in progress
+	extern bool advance_clock(msa::Handle hdl);
 	extern void clear_timers(TimerContext *ctx);
+	// does not take the timer lock, so it may be a change behind
+	extern size_t timer_count(msa::Handle hdl);
 	extern void sys_remove_timer(msa::Handle msa, int16_t id);
+	// writes the timers with string args along with how long each has left, and returns
+	// how many were written
+	extern uint32_t checkpoint_timers(msa::Handle hdl, msa::checkpoint::Writer &out);
+	// adds the timers from a checkpoint, keeping their IDs where they are free, and
+	// returns how many were added
+	extern uint32_t restore_timers(msa::Handle hdl, msa::checkpoint::Reader &in);
 	extern int16_t sys_add_timer(msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args);
+	// like schedule(), delay() and add_timer(), but the timer is marked as the given
+	// plugin's so that it can be removed with the plugin even after its ID has been reused
+	extern int16_t owned_schedule(msa::Handle msa, const std::string &owner, time_t timestamp, const Topic topic, const IArgs &args);
+	extern int16_t owned_delay(msa::Handle msa, const std::string &owner, std::chrono::milliseconds delay, const Topic topic, const IArgs &args);
+	extern int16_t owned_add_timer(msa::Handle msa, const std::string &owner, std::chrono::milliseconds period, const Topic topic, const IArgs &args);
+	// removes the timer only if it belongs to the owner; returns whether it did
+	extern bool remove_owned_timer(msa::Handle msa, const std::string &owner, int16_t id);
+	// returns how many timers were removed
+	extern size_t remove_owned_timers(msa::Handle msa, const std::string &owner);
 
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
 	#include "event/timer_hooks.hpp"
@@ -9,8 +9,11 @@
 	#error "cannot include timer event hooks before MSA_MODULE_HOOK macro is defined"
 #endif
 
+// the functions that add a timer return its ID, or -1 if it could not be added because
+// the time has passed or every ID is in use
 MSA_MODULE_HOOK(int16_t, schedule, msa::Handle msa, time_t timestamp, const Topic topic, const IArgs &args)
 MSA_MODULE_HOOK(int16_t, delay, msa::Handle msa, std::chrono::milliseconds delay, const Topic topic, const IArgs &args)
 MSA_MODULE_HOOK(int16_t, add_timer, msa::Handle msa, std::chrono::milliseconds period, const Topic topic, const IArgs &args)
 MSA_MODULE_HOOK(void, remove_timer, msa::Handle msa, int16_t id)
 MSA_MODULE_HOOK(void, get_timers, msa::Handle msa, std::vector<int16_t> &list)
+MSA_MODULE_HOOK(time_t, clock_time, msa::Handle hdl)
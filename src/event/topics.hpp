@@ -7,4 +7,5 @@
 MSA_EVENT_TOPIC(EVENT_STACK_CLEARED, 0)
 MSA_EVENT_TOPIC(EVENT_HANDLED, 0)
 MSA_EVENT_TOPIC(EVENT_INTERRUPTED, 0)
+MSA_EVENT_TOPIC(PLUGIN, 5)
 MSA_EVENT_TOPIC(TEXT_INPUT, 10)
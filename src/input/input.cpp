@@ -2,12 +2,17 @@
 #include "event/dispatch.hpp"
 #include "util/util.hpp"
 #include "log/log.hpp"
+#include "metrics/metrics.hpp"
+#include "memory/memory.hpp"
+#include "util/string.hpp"
 
 #include <map>
 #include <string>
 #include <stdexcept>
 #include <algorithm>
 #include <iostream>
+#include <atomic>
+#include <chrono>
 
 #include "platform/thread/thread.hpp"
 
@@ -19,9 +24,6 @@ namespace msa { namespace input {
 		#undef MSA_MODULE_HOOK
 	};
 
-	typedef Chunk *(*GetInputFunc)(msa::Handle, Device *);
-	typedef bool (*CheckReadyFunc)(msa::Handle, Device *);
-
 	typedef struct input_handler
 	{
 		GetInputFunc get_input;
@@ -32,12 +34,22 @@ namespace msa { namespace input {
 	static std::map<InputType, std::string> INPUT_TYPE_STRS;
 	static std::map<std::string, InputHandler *> INPUT_HANDLER_NAMES;
 
+	// handlers added with register_handler(); unlike the names above, these are kept when
+	// an instance quits
+	static std::map<std::string, InputHandler> REGISTERED_HANDLERS;
+
+	// how long quit() waits for device threads to notice they have been stopped
+	static const int QUIT_WAIT_MILLIS = 1000;
+
 	struct device_type
 	{
 		std::string id;
 		InputType type;
 		msa::thread::Thread thread;
-		bool running;
+		// cleared from other threads to stop the device's thread
+		std::atomic<bool> running;
+		// set until the device's thread is done with it; guarded by the context mutex
+		bool has_thread;
 		bool reap_in_runner;
 		union
 		{
@@ -48,24 +60,58 @@ namespace msa { namespace input {
 
 	struct input_context_type
 	{
+		// guards devices, active and handlers, which the config reload thread, plugins,
+		// and device threads all use
+		msa::thread::Mutex mutex;
 		std::map<std::string, Device *> devices;
 		std::vector<std::string> active;
 		std::map<InputType, InputHandler *> handlers;
+		// device threads that have not yet returned; they use the handle until they do.
+		// Guarded by mutex, and threads_done is broadcast when it reaches 0.
+		size_t thread_count;
+		msa::thread::Cond threads_done;
+		// set when quit() stops waiting for the device threads; the last one to return
+		// frees the context
+		bool abandoned;
+		msa::metrics::Counter *chunks_metric;
+		// the devices as the status source gives them; rebuilt whenever they change so
+		// that the status source does not read the device map from another thread
+		msa::thread::Mutex status_mutex;
+		std::string status;
 	};
 
 	typedef struct it_args_type
 	{
 		msa::Handle hdl;
+		InputContext *ctx;
 		Device *dev;
 	} InputThreadArgs;
 
+	typedef struct device_config_type
+	{
+		InputType type;
+		std::string id;
+		InputHandler *handler;
+	} DeviceConfig;
+
 	static int init_static_resources();
 	static int destroy_static_resources();
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static void read_device_configs(const msa::cfg::Section &config, std::vector<DeviceConfig> &devices);
+	static void start_device(msa::Handle hdl, const DeviceConfig &dev_config);
 	static void create_device(Device **dev, InputType type, const void *device_id);
 	static void dispose_device(Device *device);
 	static int create_input_context(InputContext **ctx);
 	static int dispose_input_context(InputContext *ctx);
+	static void free_input_context(InputContext *ctx);
+	static size_t stop_devices(InputContext *ctx);
+	static void publish_status(msa::Handle hdl);
+	static std::string input_status(msa::Handle hdl);
+	// these and publish_status must be called with the context mutex held
+	static void insert_device(msa::Handle hdl, InputType type, void *device_id);
+	static void erase_device(msa::Handle hdl, const std::string &id);
+	static void start_device_thread(msa::Handle hdl, const std::string &id);
+	static void stop_device_thread(msa::Handle hdl, const std::string &id);
 
 	static Chunk *get_tty_input(msa::Handle hdl, Device *dev);
 	static bool tty_ready(msa::Handle hdl, Device *dev);
@@ -73,8 +119,8 @@ namespace msa { namespace input {
 	// input thread funcs
 	static void *it_start(void *hdl);
 	static InputHandler *it_get_handler(msa::Handle hdl, Device *dev);
-	static void it_read_input(msa::Handle hdl, Device *dev, InputHandler *input_handler);
-	static void it_cleanup(msa::Handle hdl, Device *dev);
+	static void it_read_input(msa::Handle hdl, InputContext *ctx, Device *dev, InputHandler *input_handler);
+	static void it_cleanup(msa::Handle hdl, InputContext *ctx, Device *dev);
 
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
 	{
@@ -85,6 +131,8 @@ namespace msa { namespace input {
 			msa::log::error(hdl, "Could not create input context (error " + std::to_string(stat) + ")");
 			return 1;
 		}
+		hdl->input->chunks_metric = msa::metrics::get_counter(hdl, "msa_input_chunks_total", "Chunks read from input devices");
+		msa::metrics::add_status_source(hdl, "input", input_status);
 		try
 		{
 			read_config(hdl, config);
@@ -99,6 +147,13 @@ namespace msa { namespace input {
 
 	extern int quit(msa::Handle hdl)
 	{
+		msa::metrics::remove_status_source(hdl, "input");
+		size_t left = stop_devices(hdl->input);
+		if (left > 0)
+		{
+			// most likely blocked reading a device; they exit on their own once the read returns
+			msa::log::warn(hdl, std::to_string(left) + " input device thread(s) did not stop within " + std::to_string(QUIT_WAIT_MILLIS) + " ms; leaving them running");
+		}
 		int status = dispose_input_context(hdl->input);
 		if (status == 0)
 		{
@@ -112,12 +167,155 @@ namespace msa { namespace input {
 		return status;
 	}
 
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> & UNUSED(changed))
+	{
+		std::vector<DeviceConfig> configured;
+		try
+		{
+			read_device_configs(config, configured);
+		}
+		catch (const msa::cfg::config_error &e)
+		{
+			msa::log::error(hdl, "Could not read input module config: " + std::string(e.what()));
+			return 1;
+		}
+		std::map<std::string, const DeviceConfig *> wanted;
+		for (size_t i = 0; i < configured.size(); i++)
+		{
+			wanted[INPUT_TYPE_STRS[configured[i].type] + ":" + configured[i].id] = &configured[i];
+		}
+		InputContext *ctx = hdl->input;
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::vector<std::string> existing;
+		std::map<std::string, Device *>::const_iterator dev_iter;
+		for (dev_iter = ctx->devices.begin(); dev_iter != ctx->devices.end(); dev_iter++)
+		{
+			existing.push_back(dev_iter->first);
+		}
+		for (size_t i = 0; i < existing.size(); i++)
+		{
+			if (wanted.find(existing[i]) == wanted.end())
+			{
+				erase_device(hdl, existing[i]);
+				msa::log::info(hdl, "Removed input device " + existing[i]);
+			}
+			else
+			{
+				wanted.erase(existing[i]);
+			}
+		}
+		int status = 0;
+		std::map<std::string, const DeviceConfig *>::const_iterator iter;
+		for (iter = wanted.begin(); iter != wanted.end(); iter++)
+		{
+			// caught here so that the mutex is not left locked
+			try
+			{
+				start_device(hdl, *iter->second);
+			}
+			catch (const std::exception &e)
+			{
+				msa::log::error(hdl, "Could not add input device " + iter->first + ": " + e.what());
+				status = 1;
+			}
+		}
+		// handlers are only looked up when a device starts, so running devices are not affected
+		for (size_t i = 0; i < configured.size(); i++)
+		{
+			ctx->handlers[configured[i].type] = configured[i].handler;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return status;
+	}
+
 	extern const PluginHooks *get_plugin_hooks()
 	{
 		return &HOOKS;
 	}
 	
 	extern void add_device(msa::Handle hdl, InputType type, void *device_id)
+	{
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		try
+		{
+			insert_device(hdl, type, device_id);
+		}
+		catch (...)
+		{
+			msa::thread::mutex_unlock(&hdl->input->mutex);
+			throw;
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	extern void remove_device(msa::Handle hdl, const std::string &id)
+	{
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		try
+		{
+			erase_device(hdl, id);
+		}
+		catch (...)
+		{
+			msa::thread::mutex_unlock(&hdl->input->mutex);
+			throw;
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	extern void register_handler(const std::string &name, GetInputFunc get_input, CheckReadyFunc is_ready)
+	{
+		if (name == "get_tty_input")
+		{
+			throw std::logic_error("input handler already exists: " + name);
+		}
+		REGISTERED_HANDLERS[name] = InputHandler {get_input, is_ready};
+	}
+
+	extern void get_devices(msa::Handle hdl, std::vector<std::string> *list)
+	{
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		std::map<std::string, Device *> *devs = &hdl->input->devices;
+		typedef std::map<std::string, Device *>::iterator it_type;
+		for (it_type iter = devs->begin(); iter != devs->end(); iter++)
+		{
+			std::string id = iter->second->id;
+			list->push_back(id);
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	extern void enable_device(msa::Handle hdl, const std::string &id)
+	{
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		try
+		{
+			start_device_thread(hdl, id);
+		}
+		catch (...)
+		{
+			msa::thread::mutex_unlock(&hdl->input->mutex);
+			throw;
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	extern void disable_device(msa::Handle hdl, const std::string &id)
+	{
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		try
+		{
+			stop_device_thread(hdl, id);
+		}
+		catch (...)
+		{
+			msa::thread::mutex_unlock(&hdl->input->mutex);
+			throw;
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	static void insert_device(msa::Handle hdl, InputType type, void *device_id)
 	{
 		Device *dev;
 		create_device(&dev, type, device_id);
@@ -128,20 +326,21 @@ namespace msa { namespace input {
 			throw std::logic_error("input device already exists: " + id);
 		}
 		hdl->input->devices[id] = dev;
+		publish_status(hdl);
 	}
 
-	extern void remove_device(msa::Handle hdl, const std::string &id)
+	static void erase_device(msa::Handle hdl, const std::string &id)
 	{
 		if (hdl->input->devices.find(id) == hdl->input->devices.end())
 		{
 			throw std::logic_error("input device does not exist: " + id);
 		}
 		Device *dev = hdl->input->devices[id];
-		if (dev->running)
+		if (dev->has_thread)
 		{
 			// mark it as collectable by the calling thread
 			dev->reap_in_runner = true;
-			disable_device(hdl, id);
+			stop_device_thread(hdl, id);
 		}
 		else
 		{
@@ -149,20 +348,10 @@ namespace msa { namespace input {
 			dispose_device(dev);
 		}
 		hdl->input->devices.erase(id);
+		publish_status(hdl);
 	}
 
-	extern void get_devices(msa::Handle hdl, std::vector<std::string> *list)
-	{
-		std::map<std::string, Device *> *devs = &hdl->input->devices;
-		typedef std::map<std::string, Device *>::iterator it_type;
-		for (it_type iter = devs->begin(); iter != devs->end(); iter++)
-		{
-			std::string id = iter->second->id;
-			list->push_back(id);
-		}
-	}
-
-	extern void enable_device(msa::Handle hdl, const std::string &id)
+	static void start_device_thread(msa::Handle hdl, const std::string &id)
 	{
 		std::vector<std::string> &act = hdl->input->active;
 		if (std::find(act.begin(), act.end(), id) != act.end())
@@ -180,25 +369,35 @@ namespace msa { namespace input {
 		InputThreadArgs *ita = new InputThreadArgs;
 		ita->dev = dev;
 		ita->hdl = hdl;
+		ita->ctx = hdl->input;
 
 		msa::thread::Attributes attr;
 		msa::thread::attr_init(&attr);
 		msa::thread::attr_set_detach(&attr, true);
+		hdl->input->thread_count++;
+		// set before the thread starts, so that it is not missed if the device is stopped first
+		dev->running = true;
+		dev->has_thread = true;
 		bool started = (msa::thread::create(&dev->thread, &attr, it_start, ita, "input") == 0);
 		msa::thread::attr_destroy(&attr);
 		
 		if (started)
 		{
 			hdl->input->active.push_back(dev->id);
+			publish_status(hdl);
 			msa::log::info(hdl, "Enabled input device " + dev->id);
 		}
 		else
 		{
+			dev->running = false;
+			dev->has_thread = false;
+			delete ita;
+			hdl->input->thread_count--;
 			msa::log::warn(hdl, "Could not enable input device " + dev->id);
 		}
 	}
 
-	extern void disable_device(msa::Handle hdl, const std::string &id)
+	static void stop_device_thread(msa::Handle hdl, const std::string &id)
 	{
 		std::vector<std::string> &act = hdl->input->active;
 		if (std::find(act.begin(), act.end(), id) == act.end())
@@ -213,6 +412,7 @@ namespace msa { namespace input {
 		}
 		hdl->input->devices[id]->running = false;
 		act.erase(std::find(act.begin(), act.end(), id));
+		publish_status(hdl);
 		msa::log::info(hdl, "Disabled input device " + id);
 	}
 
@@ -233,6 +433,10 @@ namespace msa { namespace input {
 		if (INPUT_HANDLER_NAMES.empty())
 		{
 			INPUT_HANDLER_NAMES["get_tty_input"] = new InputHandler {get_tty_input, tty_ready};
+			for (auto it = REGISTERED_HANDLERS.begin(); it != REGISTERED_HANDLERS.end(); it++)
+			{
+				INPUT_HANDLER_NAMES[it->first] = new InputHandler(it->second);
+			}
 		}
 		return 0;
 	}
@@ -248,6 +452,26 @@ namespace msa { namespace input {
 	}
 
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		std::vector<DeviceConfig> configured;
+		read_device_configs(config, configured);
+		msa::thread::mutex_lock(&hdl->input->mutex);
+		try
+		{
+			for (size_t i = 0; i < configured.size(); i++)
+			{
+				start_device(hdl, configured[i]);
+			}
+		}
+		catch (...)
+		{
+			msa::thread::mutex_unlock(&hdl->input->mutex);
+			throw;
+		}
+		msa::thread::mutex_unlock(&hdl->input->mutex);
+	}
+
+	static void read_device_configs(const msa::cfg::Section &config, std::vector<DeviceConfig> &devices)
 	{
 		if (config.has("TYPE") && config.has("ID") && config.has("HANDLER"))
 		{
@@ -257,20 +481,24 @@ namespace msa { namespace input {
 			const std::vector<InputHandler*> handlers = config.get_all_as_enum("HANDLER", INPUT_HANDLER_NAMES, true);
 			for (size_t i = 0; i < types.size() && i < ids.size() && i < handlers.size(); i++)
 			{
-				std::string id = ids[i];
-				InputType type = types[i];
-				InputHandler *handler = handlers[i];
-				hdl->input->handlers[type] = handler;
-				add_device(hdl, type, &id);
-				enable_device(hdl, INPUT_TYPE_STRS[type] + ":" + id);
+				devices.push_back(DeviceConfig {types[i], ids[i], handlers[i]});
 			}
 		}
 	}
 
+	static void start_device(msa::Handle hdl, const DeviceConfig &dev_config)
+	{
+		std::string id = dev_config.id;
+		hdl->input->handlers[dev_config.type] = dev_config.handler;
+		insert_device(hdl, dev_config.type, &id);
+		start_device_thread(hdl, INPUT_TYPE_STRS[dev_config.type] + ":" + id);
+	}
+
 	static void create_device(Device **dev_ptr, InputType type, const void *id)
 	{
 		Device *dev = new Device;
 		dev->running = false;
+		dev->has_thread = false;
 		dev->reap_in_runner = false;
 		dev->type = type;
 		switch (dev->type)
@@ -314,24 +542,30 @@ namespace msa { namespace input {
 	static int create_input_context(InputContext **ctx)
 	{
 		InputContext *io_ctx = new InputContext;
+		msa::thread::mutex_init(&io_ctx->mutex, NULL);
+		io_ctx->thread_count = 0;
+		msa::thread::cond_init(&io_ctx->threads_done, NULL);
+		io_ctx->abandoned = false;
+		io_ctx->chunks_metric = NULL;
+		msa::thread::mutex_init(&io_ctx->status_mutex, NULL);
+		io_ctx->status = "{\"devices\": []}";
 		*ctx = io_ctx;
 		return 0;
 	}
 
-	static int dispose_input_context(InputContext *ctx)
+	static size_t stop_devices(InputContext *ctx)
 	{
+		msa::thread::mutex_lock(&ctx->mutex);
 		typedef std::map<std::string, Device *>::iterator it_type;
 		it_type iter = ctx->devices.begin();
 		while (iter != ctx->devices.end())
 		{
 			Device *dev = iter->second;
-			if (dev->running)
+			if (dev->has_thread)
 			{
 				// let input_thread take care of deleting it
 				dev->reap_in_runner = true;
 				dev->running = false;
-				std::vector<std::string> &act = ctx->active;
-				act.erase(std::find(act.begin(), act.end(), dev->id));
 			}
 			else
 			{
@@ -339,63 +573,169 @@ namespace msa { namespace input {
 			}
 			iter = ctx->devices.erase(iter);
 		}
-		delete ctx;
+		ctx->active.clear();
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(QUIT_WAIT_MILLIS);
+		while (ctx->thread_count > 0)
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0)
+			{
+				break;
+			}
+			msa::thread::cond_timed_wait(&ctx->threads_done, &ctx->mutex, (int) remaining + 1);
+		}
+		size_t left = ctx->thread_count;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return left;
+	}
+
+	static int dispose_input_context(InputContext *ctx)
+	{
+		msa::thread::mutex_lock(&ctx->mutex);
+		if (ctx->thread_count > 0)
+		{
+			// the device threads still use it; the last one to return frees it
+			ctx->abandoned = true;
+			msa::thread::mutex_unlock(&ctx->mutex);
+			return 0;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		free_input_context(ctx);
 		return 0;
 	}
 
+	static void free_input_context(InputContext *ctx)
+	{
+		msa::thread::cond_destroy(&ctx->threads_done);
+		msa::thread::mutex_destroy(&ctx->status_mutex);
+		msa::thread::mutex_destroy(&ctx->mutex);
+		delete ctx;
+	}
+
+	static void publish_status(msa::Handle hdl)
+	{
+		InputContext *ctx = hdl->input;
+		std::string text = "{\"devices\": [";
+		std::map<std::string, Device *>::const_iterator iter;
+		for (iter = ctx->devices.begin(); iter != ctx->devices.end(); iter++)
+		{
+			const std::string &id = iter->second->id;
+			bool enabled = std::find(ctx->active.begin(), ctx->active.end(), id) != ctx->active.end();
+			text += (iter != ctx->devices.begin()) ? ", " : "";
+			text += "{\"id\": " + msa::string::json_quote(id);
+			text += ", \"type\": " + msa::string::json_quote(INPUT_TYPE_STRS[iter->second->type]);
+			text += ", \"enabled\": " + std::string(enabled ? "true" : "false") + "}";
+		}
+		text += "]}";
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		ctx->status.swap(text);
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+	}
+
+	static std::string input_status(msa::Handle hdl)
+	{
+		InputContext *ctx = hdl->input;
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		std::string text = ctx->status;
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+		return text;
+	}
+
 	static void *it_start(void *args)
 	{
 		InputThreadArgs *ita = static_cast<InputThreadArgs *>(args);
+		msa::memory::Scope memory_scope(msa::memory::Tag::INPUT);
 		msa::Handle hdl = ita->hdl;
+		InputContext *ctx = ita->ctx;
 		Device *dev = ita->dev;
 		delete ita;
 
-		dev->running = true;
-		
 		InputHandler *input_handler = it_get_handler(hdl, dev);
 
 		msa::log::info(hdl, "Started reading from input device " + dev->id);
-		it_read_input(hdl, dev, input_handler);
-		msa::log::info(hdl, "Stopped reading from input device " + dev->id);
+		it_read_input(hdl, ctx, dev, input_handler);
 
-		it_cleanup(hdl, dev);
+		it_cleanup(hdl, ctx, dev);
 		
 		return NULL;
 	}
 
 	static InputHandler *it_get_handler(msa::Handle hdl, Device *dev)
 	{
-		if (hdl->input->handlers.find(dev->type) == hdl->input->handlers.end())
+		InputContext *ctx = hdl->input;
+		msa::thread::mutex_lock(&ctx->mutex);
+		if (ctx->handlers.find(dev->type) == ctx->handlers.end())
 		{
 			dev->running = false;
-			disable_device(hdl, dev->id);
+			stop_device_thread(hdl, dev->id);
+			msa::thread::mutex_unlock(&ctx->mutex);
 			throw std::logic_error("no handler for input device type " + std::to_string(static_cast<int>(dev->type)));
 		}
-		return hdl->input->handlers[dev->type];
+		InputHandler *handler = ctx->handlers[dev->type];
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return handler;
 	}
 
-	static void it_read_input(msa::Handle hdl, Device *dev, InputHandler *input_handler)
+	static void it_read_input(msa::Handle hdl, InputContext *ctx, Device *dev, InputHandler *input_handler)
 	{
 		while (dev->running)
 		{
 			if (input_handler->is_ready(hdl, dev))
 			{
 				Chunk *chunk = input_handler->get_input(hdl, dev);
-				msa::log::trace(hdl, "Got input; notifying event system");
-				msa::event::generate(hdl, msa::event::Topic::TEXT_INPUT, msa::event::wrap(chunk->text));
-				msa::log::trace(hdl, "Input event has been pushed to the queue");
+				// input read by a device that was stopped meanwhile is still passed on,
+				// unless the module has quit and the modules it would go to may be gone
+				msa::thread::mutex_lock(&ctx->mutex);
+				bool abandoned = ctx->abandoned;
+				if (!abandoned)
+				{
+					msa::metrics::increment(ctx->chunks_metric, 1);
+					msa::log::trace(hdl, "Got input; notifying event system");
+					msa::event::generate(hdl, msa::event::Topic::TEXT_INPUT, msa::event::wrap(chunk->text));
+					msa::log::trace(hdl, "Input event has been pushed to the queue");
+				}
+				msa::thread::mutex_unlock(&ctx->mutex);
 				delete chunk;
+				if (abandoned)
+				{
+					break;
+				}
 			}
 		}
 	}
 
-	static void it_cleanup(msa::Handle hdl, Device *dev)
+	static void it_cleanup(msa::Handle hdl, InputContext *ctx, Device *dev)
 	{
+		// locked so that the device is not freed out from under the check
+		msa::thread::mutex_lock(&ctx->mutex);
+		// once abandoned, the rest of the modules may already have quit
+		if (!ctx->abandoned)
+		{
+			msa::log::info(hdl, "Stopped reading from input device " + dev->id);
+		}
 		if (dev->reap_in_runner)
 		{
-			msa::log::info(hdl, "Freeing input device " + dev->id);
+			if (!ctx->abandoned)
+			{
+				msa::log::info(hdl, "Freeing input device " + dev->id);
+			}
 			dispose_device(dev);
 		}
+		else
+		{
+			dev->has_thread = false;
+		}
+		ctx->thread_count--;
+		if (ctx->thread_count == 0)
+		{
+			msa::thread::cond_broadcast(&ctx->threads_done);
+		}
+		bool last = ctx->abandoned && ctx->thread_count == 0;
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (last)
+		{
+			free_input_context(ctx);
+		}
 	}
 
 	static Chunk *get_tty_input(msa::Handle UNUSED(hdl), Device *UNUSED(dev))
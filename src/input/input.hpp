@@ -23,11 +23,22 @@ namespace msa { namespace input {
 
 	typedef struct device_type Device;
 
+	// is_ready is polled in a loop by the device's thread, so it should block for a short
+	// while when there is no input rather than return false straight away
+	typedef Chunk *(*GetInputFunc)(msa::Handle hdl, Device *dev);
+	typedef bool (*CheckReadyFunc)(msa::Handle hdl, Device *dev);
+
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
 	extern int quit(msa::Handle hdl);
+	// adds and removes devices to match the config; devices that did not change are left running
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> &changed);
 	extern void add_device(msa::Handle hdl, InputType type, void *device_id);
-	extern void get_devices(msa::Handle hdl, std::vector<const std::string> *list);
+	extern void get_devices(msa::Handle hdl, std::vector<std::string> *list);
 	extern void remove_device(msa::Handle hdl, const std::string &id);
+	// makes an input handler available to the HANDLER key of the input config. The names
+	// are shared by all instances and only read when one starts, so register handlers
+	// before calling msa::start().
+	extern void register_handler(const std::string &name, GetInputFunc get_input, CheckReadyFunc is_ready);
 	extern const PluginHooks *get_plugin_hooks();
 	
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
@@ -1,6 +1,7 @@
 #include "log/log.hpp"
 #include "util/string.hpp"
 #include "util/util.hpp"
+#include "memory/memory.hpp"
 
 #include <fstream>
 #include <vector>
@@ -8,6 +9,8 @@
 #include <string>
 #include <stdexcept>
 #include <queue>
+#include <atomic>
+#include <algorithm>
 
 #include <ctime>
 #include <cstdio>
@@ -45,7 +48,7 @@ namespace msa { namespace log {
 		std::string output_format_string;
 		StreamType type;
 		CloseHandler close_handler;
-		Level level;
+		std::atomic<Level> level;
 		Format format;
 		OpenMode open_mode;
 	} LogStream;
@@ -53,15 +56,20 @@ namespace msa { namespace log {
 	struct log_context_type
 	{
 		std::vector<LogStream *> streams;
-		Level level;
+		// levels are checked on every message, so they are atomic to allow
+		// changing them without stopping anything
+		std::atomic<Level> level;
 		msa::thread::Thread writer_thread;
 		msa::thread::Mutex queue_mutex;
+		// signalled when a message is pushed or the log is stopped
+		msa::thread::Cond queue_cond;
 		std::queue<Message *> messages;
-		bool running;
+		std::atomic<bool> running;
 	};
 
 	static int init_static_resources();
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static void read_levels(msa::Handle hdl, const msa::cfg::Section &config);
 	static int create_log_context(LogContext **ctx);
 	static int dispose_log_context(LogContext *ctx);
 	static int create_log_stream(LogStream **stream);
@@ -69,6 +77,16 @@ namespace msa { namespace log {
 	static int create_message(Message **msg, const std::string &msg_text, Level level);
 	static int dispose_message(Message *msg);
 	static int close_ofstream(std::ostream *raw_stream);
+	static void read_levels(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		set_level(hdl, config.get_as_enum_or("GLOBAL_LEVEL", Level::INFO, LEVEL_NAMES));
+		const std::vector<Level> levs = config.has("LEVEL") ? config.get_all_as_enum("LEVEL", LEVEL_NAMES) : std::vector<Level>();
+		for (size_t i = 0; i < hdl->log->streams.size(); i++)
+		{
+			set_stream_level(hdl, i, levs.size() > i ? levs[i] : Level::INFO);
+		}
+	}
+
 	static void check_and_push(msa::Handle hdl, const std::string &msg_text, Level level);
 	static void push_msg(msa::Handle hdl, Message *msg);
 	static const char *level_to_str(Level lev);
@@ -101,12 +119,37 @@ namespace msa { namespace log {
 
 	extern int quit(msa::Handle hdl)
 	{
+		msa::thread::mutex_lock(&hdl->log->queue_mutex);
 		hdl->log->running = false;
+		msa::thread::cond_broadcast(&hdl->log->queue_cond);
+		msa::thread::mutex_unlock(&hdl->log->queue_mutex);
 		msa::thread::join(hdl->log->writer_thread, NULL);
 		dispose_log_context(hdl->log);
 		return 0;
 	}
 	
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> &changed)
+	{
+		static const char *STREAM_KEYS[] = {"TYPE", "LOCATION", "FORMAT", "OUTPUT", "OPEN_MODE"};
+		for (size_t i = 0; i < sizeof(STREAM_KEYS) / sizeof(const char *); i++)
+		{
+			if (std::find(changed.begin(), changed.end(), STREAM_KEYS[i]) != changed.end())
+			{
+				warn(hdl, "Log stream " + std::string(STREAM_KEYS[i]) + " changed; restart for it to take effect");
+			}
+		}
+		try
+		{
+			read_levels(hdl, config);
+		}
+		catch (const msa::cfg::config_error &e)
+		{
+			error(hdl, "Could not read log levels: " + std::string(e.what()));
+			return 1;
+		}
+		return 0;
+	}
+
 	extern const PluginHooks *get_plugin_hooks()
 	{
 		return &HOOKS;
@@ -311,6 +354,8 @@ namespace msa { namespace log {
 	static void check_and_push(msa::Handle hdl, const std::string &msg_text, Level level)
 	{
 		LogContext *ctx = hdl->log;
+		msa::memory::Scope memory_scope(msa::memory::Tag::LOG);
+		MSA_PROBE3(log_message, (int) level, msg_text.c_str(), level >= ctx->level);
 		// check if we should ignore the message from the global level
 		if (level < ctx->level) {
 			return;
@@ -365,6 +410,7 @@ namespace msa { namespace log {
 		LogContext *log = new LogContext;
 		log->running = false;
 		msa::thread::mutex_init(&log->queue_mutex, NULL);
+		msa::thread::cond_init(&log->queue_cond, NULL);
 		*ctx = log;
 		return 0;
 	}
@@ -372,6 +418,7 @@ namespace msa { namespace log {
 	static int dispose_log_context(LogContext *ctx)
 	{
 		msa::thread::mutex_destroy(&ctx->queue_mutex);
+		msa::thread::cond_destroy(&ctx->queue_cond);
 		while (!ctx->streams.empty())
 		{
 			LogStream *stream = *(ctx->streams.begin());
@@ -465,43 +512,33 @@ namespace msa { namespace log {
 		}
 		msa::thread::mutex_lock(&hdl->log->queue_mutex);
 		hdl->log->messages.push(msg);
+		msa::thread::cond_signal(&hdl->log->queue_cond);
 		msa::thread::mutex_unlock(&hdl->log->queue_mutex);
 	}
 
 	static void *writer_start(void *args)
 	{
 		msa::Handle hdl = (msa::Handle) args;
-		// run util shutdown, and then keep running until the message queue is empty
-		while (hdl->log->running)
-		{
-			Message *msg = writer_poll_msg(hdl);
-			if (msg != NULL)
-			{
-				writer_write_to_streams(hdl, msg);
-				dispose_message(msg);
-			}
-			else
-			{
-				msa::util::sleep_milli(5);
-			}
-		}
-		msa::thread::mutex_lock(&hdl->log->queue_mutex);
-		// empty everything remaining
-		while (!hdl->log->messages.empty())
+		msa::memory::Scope memory_scope(msa::memory::Tag::LOG);
+		// run until shutdown, and then keep running until the message queue is empty
+		Message *msg;
+		while ((msg = writer_poll_msg(hdl)) != NULL)
 		{
-			Message *rem_msg = hdl->log->messages.front();
-			hdl->log->messages.pop();
-			writer_write_to_streams(hdl, rem_msg);
-			dispose_message(rem_msg);
+			writer_write_to_streams(hdl, msg);
+			dispose_message(msg);
 		}
-		msa::thread::mutex_unlock(&hdl->log->queue_mutex);
 		return NULL;
 	}
 
+	// waits for the next message; gives NULL once the log is stopped and has no more
 	static Message *writer_poll_msg(msa::Handle hdl)
 	{
 		Message *msg = NULL;
 		msa::thread::mutex_lock(&hdl->log->queue_mutex);
+		while (hdl->log->running && hdl->log->messages.empty())
+		{
+			msa::thread::cond_wait(&hdl->log->queue_cond, &hdl->log->queue_mutex);
+		}
 		if (!hdl->log->messages.empty())
 		{
 			msg = hdl->log->messages.front();
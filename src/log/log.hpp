@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace msa { namespace log {
 
@@ -48,6 +49,8 @@ namespace msa { namespace log {
 
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
 	extern int quit(msa::Handle hdl);
+	// applies changed level settings; other stream settings need a restart
+	extern int reconfigure(msa::Handle hdl, const msa::cfg::Section &config, const std::vector<std::string> &changed);
 
 	// creates a new log stream and returns the ID of the stream
 	extern stream_id create_stream(msa::Handle hdl, StreamType type, const std::string &location, Format fmt, const std::string &output_format_string, OpenMode open_mode);
@@ -1,7 +1,6 @@
 /* Main source code file. */
 
 #include "msa.hpp"
-#include "util/util.hpp"
 
 #include <cstdlib>
 #include <cstdio>
@@ -61,20 +60,11 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 	DEBUG_PRINTF("(Waiting for EDT to start)\n");
-	while (hdl->status == msa::Status::CREATED)
-	{
-		msa::util::sleep_milli(50);
-	}
+	msa::wait_for_status(hdl, msa::Status::RUNNING, -1);
 	DEBUG_PRINTF("(System is ready)\n");
-	while (hdl->status == msa::Status::RUNNING)
-	{
-		msa::util::sleep_milli(50);
-	}
+	msa::wait_for_status(hdl, msa::Status::STOP_REQUESTED, -1);
 	DEBUG_PRINTF("(Waiting for MSA to exit)\n");
-	while (hdl->status != msa::Status::STOPPED)
-	{
-		msa::util::sleep_milli(50);
-	}
+	msa::wait_for_status(hdl, msa::Status::STOPPED, -1);
 	if (hdl->status == msa::Status::STOPPED)
 	{
 		DEBUG_PRINTF("(MSA system has exited)\n");
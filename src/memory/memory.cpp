@@ -0,0 +1,211 @@
+#include "memory/memory.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace msa { namespace memory {
+
+	// threads are given slots in turn; past this many, threads share slots, which is
+	// still correct but makes them contend
+	static const size_t SLOT_COUNT = 8;
+	static const size_t TAG_COUNT = 0
+		#define MSA_MEMORY_TAG(enum_name, name)		+ 1
+		#include "memory/tags.hpp"
+		#undef MSA_MEMORY_TAG
+	;
+
+	// put in front of each block so that freeing it knows what to charge
+	typedef struct header_type
+	{
+		size_t size;
+		Tag tag;
+	} Header;
+
+	// rounded up so that the block after the header is still aligned for any type
+	static const size_t HEADER_SIZE = (sizeof(Header) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+	typedef struct counts_type
+	{
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> frees;
+		std::atomic<uint64_t> allocated_bytes;
+		std::atomic<uint64_t> freed_bytes;
+	} Counts;
+
+	// aligned so that the slots of different threads are not on the same cache line
+	typedef struct slot_type
+	{
+		alignas(64) Counts tags[TAG_COUNT];
+	} Slot;
+
+	// all of these are zeroed before any constructor runs, so allocations made during
+	// static initialization are counted too
+	static Slot slots[SLOT_COUNT];
+	static std::atomic<size_t> next_slot(0);
+	static thread_local size_t current_slot = SLOT_COUNT;
+	static thread_local Tag current_tag = Tag::OTHER;
+
+	static Counts &counts_of(Tag tag);
+	static void *allocate(size_t size);
+	static void release(void *ptr);
+
+	Scope::Scope(Tag tag) : previous(current_tag)
+	{
+		current_tag = tag;
+	}
+
+	Scope::~Scope()
+	{
+		current_tag = previous;
+	}
+
+	extern const char *tag_name(Tag tag)
+	{
+		switch (tag)
+		{
+			#define MSA_MEMORY_TAG(enum_name, name)		case Tag::enum_name: return name;
+			#include "memory/tags.hpp"
+			#undef MSA_MEMORY_TAG
+		}
+		return "unknown";
+	}
+
+	extern Stats get_stats(Tag tag)
+	{
+		// frees are read first so that a block freed while this runs is not counted as
+		// freed but never allocated
+		Stats stats = {0, 0, 0, 0};
+		for (size_t s = 0; s < SLOT_COUNT; s++)
+		{
+			const Counts &counts = slots[s].tags[(size_t) tag];
+			stats.frees += counts.frees.load(std::memory_order_relaxed);
+			stats.freed_bytes += counts.freed_bytes.load(std::memory_order_relaxed);
+		}
+		for (size_t s = 0; s < SLOT_COUNT; s++)
+		{
+			const Counts &counts = slots[s].tags[(size_t) tag];
+			stats.allocations += counts.allocations.load(std::memory_order_relaxed);
+			stats.allocated_bytes += counts.allocated_bytes.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+
+	static Counts &counts_of(Tag tag)
+	{
+		if (current_slot == SLOT_COUNT)
+		{
+			current_slot = next_slot.fetch_add(1, std::memory_order_relaxed) % SLOT_COUNT;
+		}
+		return slots[current_slot].tags[(size_t) tag];
+	}
+
+	static void *allocate(size_t size)
+	{
+		if (size > SIZE_MAX - HEADER_SIZE)
+		{
+			throw std::bad_alloc();
+		}
+		void *block;
+		while ((block = std::malloc(size + HEADER_SIZE)) == NULL)
+		{
+			std::new_handler handler = std::get_new_handler();
+			if (handler == NULL)
+			{
+				throw std::bad_alloc();
+			}
+			handler();
+		}
+		Header *header = (Header *) block;
+		header->size = size;
+		header->tag = current_tag;
+		Counts &counts = counts_of(header->tag);
+		counts.allocations.fetch_add(1, std::memory_order_relaxed);
+		counts.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+		return (char *) block + HEADER_SIZE;
+	}
+
+	static void release(void *ptr)
+	{
+		if (ptr == NULL)
+		{
+			return;
+		}
+		Header *header = (Header *) ((char *) ptr - HEADER_SIZE);
+		Counts &counts = counts_of(header->tag);
+		counts.frees.fetch_add(1, std::memory_order_relaxed);
+		counts.freed_bytes.fetch_add(header->size, std::memory_order_relaxed);
+		std::free(header);
+	}
+
+} }
+
+// replacing these in the executable also replaces them for the libraries and plugins
+// that it loads, so every block that operator delete sees has a header
+
+void *operator new(std::size_t size)
+{
+	return msa::memory::allocate(size);
+}
+
+void *operator new[](std::size_t size)
+{
+	return msa::memory::allocate(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return msa::memory::allocate(size);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	try
+	{
+		return msa::memory::allocate(size);
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+void operator delete(void *ptr) noexcept
+{
+	msa::memory::release(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+	msa::memory::release(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+	msa::memory::release(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+	msa::memory::release(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	msa::memory::release(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	msa::memory::release(ptr);
+}
+#endif
@@ -0,0 +1,50 @@
+#ifndef MSA_MEMORY_MEMORY_HPP
+#define MSA_MEMORY_MEMORY_HPP
+
+#include <cstdint>
+
+// Accounts for what each part of MSA has allocated. Every block from operator new is
+// tagged with the allocating thread's current tag, and freeing it is charged back to
+// that tag no matter which thread does it. Modules set the tag with a Scope around
+// code that allocates on their behalf; the innermost scope wins, and anything outside
+// of one is counted as OTHER.
+//
+// The counts are kept for the whole process, so instances that share one are counted
+// together. Only operator new is tracked, not malloc().
+
+namespace msa { namespace memory {
+
+	enum class Tag
+	{
+		#define MSA_MEMORY_TAG(enum_name, name)		enum_name,
+		#include "memory/tags.hpp"
+		#undef MSA_MEMORY_TAG
+	};
+
+	typedef struct stats_type
+	{
+		uint64_t allocations;
+		uint64_t frees;
+		uint64_t allocated_bytes;
+		uint64_t freed_bytes;
+	} Stats;
+
+	class Scope
+	{
+		public:
+			explicit Scope(Tag tag);
+			~Scope();
+			Scope(const Scope &other) = delete;
+			Scope &operator=(const Scope &other) = delete;
+
+		private:
+			Tag previous;
+	};
+
+	extern const char *tag_name(Tag tag);
+	// the totals since the process started; live bytes are allocated_bytes - freed_bytes
+	extern Stats get_stats(Tag tag);
+
+} }
+
+#endif
@@ -0,0 +1,17 @@
+// List for using with X-Macro style of maintaining memory tags
+
+// Syntax is MSA_MEMORY_TAG(name, display-name)
+// OTHER must stay first; it is the tag of threads that have not set one.
+
+MSA_MEMORY_TAG(OTHER, "other")
+MSA_MEMORY_TAG(EVENT, "event")
+MSA_MEMORY_TAG(HANDLER, "handler")
+MSA_MEMORY_TAG(TIMER, "timer")
+MSA_MEMORY_TAG(LOG, "log")
+MSA_MEMORY_TAG(OUTPUT, "output")
+MSA_MEMORY_TAG(INPUT, "input")
+MSA_MEMORY_TAG(CMD, "cmd")
+MSA_MEMORY_TAG(PLUGIN, "plugin")
+MSA_MEMORY_TAG(METRICS, "metrics")
+MSA_MEMORY_TAG(TRACE, "trace")
+MSA_MEMORY_TAG(JOURNAL, "journal")
@@ -0,0 +1,23 @@
+// Functions in the metrics module that dynamically-loaded modules (plugins) are allowed to call.
+
+// Define the MSA_MODULE_HOOK macro to arrange the hooks as needed, and then include this file.
+// MSA_MODULE_HOOK will declare hooks with the following arguments:
+// MSA_MODULE_HOOK(return-spec, func-name, ...) where ... is the arguments of the hook
+// This file should only be included from metrics module code.
+
+#ifndef MSA_MODULE_HOOK
+	#error "cannot include metrics hooks before MSA_MODULE_HOOK macro is defined"
+#endif
+
+MSA_MODULE_HOOK(Counter *, get_counter, msa::Handle hdl, const std::string &name, const std::string &help)
+MSA_MODULE_HOOK(Gauge *, get_gauge, msa::Handle hdl, const std::string &name, const std::string &help)
+MSA_MODULE_HOOK(Histogram *, get_histogram, msa::Handle hdl, const std::string &name, const std::string &help)
+MSA_MODULE_HOOK(void, increment, Counter *counter, uint64_t amount)
+MSA_MODULE_HOOK(void, set_gauge, Gauge *gauge, int64_t value)
+MSA_MODULE_HOOK(void, adjust_gauge, Gauge *gauge, int64_t delta)
+MSA_MODULE_HOOK(void, observe, Histogram *histogram, uint64_t value)
+MSA_MODULE_HOOK(uint64_t, get_count, const Counter *counter)
+MSA_MODULE_HOOK(int64_t, get_value, const Gauge *gauge)
+MSA_MODULE_HOOK(uint64_t, get_percentile, const Histogram *histogram, double percent)
+MSA_MODULE_HOOK(void, add_status_source, msa::Handle hdl, const std::string &name, StatusFunc func)
+MSA_MODULE_HOOK(void, remove_status_source, msa::Handle hdl, const std::string &name)
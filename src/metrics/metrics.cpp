@@ -0,0 +1,923 @@
+#include "metrics/metrics.hpp"
+#include "cmd/cmd.hpp"
+#include "agent/agent.hpp"
+#include "log/log.hpp"
+#include "util/string.hpp"
+#include "memory/memory.hpp"
+
+#include <map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+#include "platform/thread/thread.hpp"
+#include "platform/net/net.hpp"
+
+namespace msa { namespace metrics {
+
+	static const PluginHooks HOOKS = {
+		#define MSA_MODULE_HOOK(retspec, name, ...)		name,
+		#include "metrics/hooks.hpp"
+		#undef MSA_MODULE_HOOK
+	};
+
+	// threads are given slots in turn; past this many, threads share slots, which is
+	// still correct but makes them contend
+	static const size_t SLOT_COUNT = 8;
+	// each power of two is split into this many buckets, so a bucket is never more than
+	// 1/8 as wide as the values in it
+	static const int SUB_BUCKET_BITS = 3;
+	static const uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+	// how long a client gets to send its request before it is answered anyway
+	static const int REQUEST_TIMEOUT_MILLIS = 100;
+
+	typedef std::chrono::steady_clock Clock;
+
+	enum class Kind
+	{
+		COUNTER,
+		GAUGE,
+		HISTOGRAM
+	};
+
+	// padded so that the slots of different threads are not on the same cache line
+	typedef struct counter_slot_type
+	{
+		std::atomic<uint64_t> value;
+		char padding[64 - sizeof(std::atomic<uint64_t>)];
+	} CounterSlot;
+
+	struct counter_type
+	{
+		CounterSlot slots[SLOT_COUNT];
+	};
+
+	struct gauge_type
+	{
+		std::atomic<int64_t> value;
+	};
+
+	typedef struct histogram_slot_type
+	{
+		std::atomic<uint64_t> buckets[BUCKET_COUNT];
+		std::atomic<uint64_t> sum;
+	} HistogramSlot;
+
+	struct histogram_type
+	{
+		HistogramSlot slots[SLOT_COUNT];
+	};
+
+	typedef struct metric_type
+	{
+		Kind kind;
+		std::string help;
+		union
+		{
+			Counter *counter;
+			Gauge *gauge;
+			Histogram *histogram;
+		};
+	} Metric;
+
+	// the slots of a histogram added together
+	typedef struct histogram_totals_type
+	{
+		std::vector<uint64_t> buckets;
+		uint64_t count;
+		uint64_t sum;
+	} HistogramTotals;
+
+	struct metrics_context_type
+	{
+		// guards the map only; metrics are updated without it
+		msa::thread::Mutex mutex;
+		// sorted by name, which is the order they are exported in
+		std::map<std::string, Metric> metrics;
+		std::vector<msa::cmd::Command *> commands;
+		// when MEMORY was last used and the allocation counts it saw, for giving rates;
+		// guarded by mutex
+		Clock::time_point memory_checked;
+		std::vector<uint64_t> memory_allocations;
+		// held while a source is called, so that removing one waits for it to return
+		msa::thread::Mutex status_mutex;
+		std::map<std::string, StatusFunc> status_sources;
+		std::string socket_path;
+		int port;
+		std::string dump_path;
+		int dump_interval;
+		std::vector<msa::net::Socket *> listeners;
+		// woken to stop the exporter
+		msa::net::Waker *export_waker;
+		msa::thread::Thread export_thread;
+		std::atomic<bool> exporting;
+	};
+
+	static std::atomic<size_t> next_slot(0);
+	static thread_local size_t current_slot = SLOT_COUNT;
+
+	static int create_metrics_context(MetricsContext **ctx);
+	static int dispose_metrics_context(MetricsContext *ctx);
+	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static Metric *find_or_add(msa::Handle hdl, const std::string &name, const std::string &help, Kind kind);
+	static void check_name(const std::string &name);
+	static size_t get_slot();
+	static size_t bucket_of(uint64_t value);
+	static uint64_t bucket_upper_bound(size_t bucket);
+	static void total_histogram(const Histogram *histogram, HistogramTotals &totals);
+	static uint64_t percentile_of(const HistogramTotals &totals, double percent);
+	static std::string escape_help(const std::string &help);
+	static std::string render_memory();
+	static std::string format_bytes(uint64_t bytes);
+	static std::string status_name(msa::Status status)
+	{
+		switch (status)
+		{
+			case msa::Status::CREATED:
+				return "CREATED";
+
+			case msa::Status::RUNNING:
+				return "RUNNING";
+
+			case msa::Status::STOP_REQUESTED:
+				return "STOP_REQUESTED";
+
+			case msa::Status::STOPPED:
+				return "STOPPED";
+		}
+		return "UNKNOWN";
+	}
+
+	static void start_exporter(msa::Handle hdl);
+	static void stop_exporter(msa::Handle hdl);
+	static void *export_start(void *args);
+	static void serve_client(msa::Handle hdl, msa::net::Socket *client);
+	static void dump(msa::Handle hdl);
+
+	static msa::cmd::Result cmd_metrics(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+	static msa::cmd::Result cmd_memory(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+
+	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		if (create_metrics_context(&hdl->metrics) != 0)
+		{
+			msa::log::error(hdl, "Could not create metrics context");
+			return 1;
+		}
+		try
+		{
+			read_config(hdl, config);
+		}
+		catch (const msa::cfg::config_error &e)
+		{
+			msa::log::error(hdl, "Could not read metrics config: " + std::string(e.what()));
+			return 2;
+		}
+		return 0;
+	}
+
+	extern int quit(msa::Handle hdl)
+	{
+		// teardown is skipped when stopping because of an error
+		stop_exporter(hdl);
+		if (dispose_metrics_context(hdl->metrics) != 0)
+		{
+			msa::log::error(hdl, "Could not dispose metrics context");
+			return 1;
+		}
+		hdl->metrics = NULL;
+		return 0;
+	}
+
+	extern int setup(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		for (size_t i = 0; i < ctx->commands.size(); i++)
+		{
+			msa::cmd::register_command(hdl, ctx->commands[i]);
+		}
+		start_exporter(hdl);
+		return 0;
+	}
+
+	extern int teardown(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		for (size_t i = 0; i < ctx->commands.size(); i++)
+		{
+			msa::cmd::unregister_command(hdl, ctx->commands[i]);
+		}
+		stop_exporter(hdl);
+		return 0;
+	}
+
+	extern const PluginHooks *get_plugin_hooks()
+	{
+		return &HOOKS;
+	}
+
+	extern std::string render(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		std::string text;
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::map<std::string, Metric>::const_iterator iter;
+		for (iter = ctx->metrics.begin(); iter != ctx->metrics.end(); iter++)
+		{
+			const std::string &name = iter->first;
+			const Metric &m = iter->second;
+			text += "# HELP " + name + " " + escape_help(m.help) + "\n";
+			switch (m.kind)
+			{
+				case Kind::COUNTER:
+					text += "# TYPE " + name + " counter\n";
+					text += name + " " + std::to_string(get_count(m.counter)) + "\n";
+					break;
+
+				case Kind::GAUGE:
+					text += "# TYPE " + name + " gauge\n";
+					text += name + " " + std::to_string(get_value(m.gauge)) + "\n";
+					break;
+
+				case Kind::HISTOGRAM:
+				{
+					text += "# TYPE " + name + " histogram\n";
+					HistogramTotals totals;
+					total_histogram(m.histogram, totals);
+					// only the buckets that have something in them are listed; the rest would
+					// repeat the count of the one below
+					uint64_t cumulative = 0;
+					for (size_t b = 0; b < BUCKET_COUNT; b++)
+					{
+						if (totals.buckets[b] > 0)
+						{
+							cumulative += totals.buckets[b];
+							text += name + "_bucket{le=\"" + std::to_string(bucket_upper_bound(b)) + "\"} " + std::to_string(cumulative) + "\n";
+						}
+					}
+					text += name + "_bucket{le=\"+Inf\"} " + std::to_string(totals.count) + "\n";
+					text += name + "_sum " + std::to_string(totals.sum) + "\n";
+					text += name + "_count " + std::to_string(totals.count) + "\n";
+					break;
+				}
+			}
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		text += render_memory();
+		return text;
+	}
+
+	extern std::string render_status(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		std::string text = "{\"status\": " + msa::string::json_quote(status_name(hdl->status));
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		std::map<std::string, StatusFunc>::const_iterator iter;
+		for (iter = ctx->status_sources.begin(); iter != ctx->status_sources.end(); iter++)
+		{
+			text += ", " + msa::string::json_quote(iter->first) + ": " + iter->second(hdl);
+		}
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+		text += "}\n";
+		return text;
+	}
+
+	extern Counter *get_counter(msa::Handle hdl, const std::string &name, const std::string &help)
+	{
+		Metric *m = find_or_add(hdl, name, help, Kind::COUNTER);
+		return (m != NULL) ? m->counter : NULL;
+	}
+
+	extern Gauge *get_gauge(msa::Handle hdl, const std::string &name, const std::string &help)
+	{
+		Metric *m = find_or_add(hdl, name, help, Kind::GAUGE);
+		return (m != NULL) ? m->gauge : NULL;
+	}
+
+	extern Histogram *get_histogram(msa::Handle hdl, const std::string &name, const std::string &help)
+	{
+		Metric *m = find_or_add(hdl, name, help, Kind::HISTOGRAM);
+		return (m != NULL) ? m->histogram : NULL;
+	}
+
+	extern void increment(Counter *counter, uint64_t amount)
+	{
+		if (counter != NULL)
+		{
+			counter->slots[get_slot()].value.fetch_add(amount, std::memory_order_relaxed);
+		}
+	}
+
+	extern void set_gauge(Gauge *gauge, int64_t value)
+	{
+		if (gauge != NULL)
+		{
+			gauge->value.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	extern void adjust_gauge(Gauge *gauge, int64_t delta)
+	{
+		if (gauge != NULL)
+		{
+			gauge->value.fetch_add(delta, std::memory_order_relaxed);
+		}
+	}
+
+	extern void observe(Histogram *histogram, uint64_t value)
+	{
+		if (histogram != NULL)
+		{
+			HistogramSlot &slot = histogram->slots[get_slot()];
+			slot.buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+			slot.sum.fetch_add(value, std::memory_order_relaxed);
+		}
+	}
+
+	extern uint64_t get_count(const Counter *counter)
+	{
+		if (counter == NULL)
+		{
+			return 0;
+		}
+		uint64_t total = 0;
+		for (size_t s = 0; s < SLOT_COUNT; s++)
+		{
+			total += counter->slots[s].value.load(std::memory_order_relaxed);
+		}
+		return total;
+	}
+
+	extern int64_t get_value(const Gauge *gauge)
+	{
+		return (gauge != NULL) ? gauge->value.load(std::memory_order_relaxed) : 0;
+	}
+
+	extern uint64_t get_percentile(const Histogram *histogram, double percent)
+	{
+		if (histogram == NULL)
+		{
+			return 0;
+		}
+		HistogramTotals totals;
+		total_histogram(histogram, totals);
+		return percentile_of(totals, percent);
+	}
+
+	extern void add_status_source(msa::Handle hdl, const std::string &name, StatusFunc func)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		if (ctx == NULL)
+		{
+			return;
+		}
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		ctx->status_sources[name] = func;
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+	}
+
+	extern void remove_status_source(msa::Handle hdl, const std::string &name)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		if (ctx == NULL)
+		{
+			return;
+		}
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		ctx->status_sources.erase(name);
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+	}
+
+	static int create_metrics_context(MetricsContext **ctx_ptr)
+	{
+		MetricsContext *ctx = new MetricsContext;
+		if (msa::thread::mutex_init(&ctx->mutex, NULL) != 0)
+		{
+			delete ctx;
+			return 1;
+		}
+		if (msa::thread::mutex_init(&ctx->status_mutex, NULL) != 0)
+		{
+			msa::thread::mutex_destroy(&ctx->mutex);
+			delete ctx;
+			return 1;
+		}
+		ctx->port = 0;
+		ctx->dump_interval = 0;
+		ctx->exporting = false;
+		ctx->export_waker = NULL;
+		ctx->memory_checked = Clock::now();
+		ctx->commands.push_back(new msa::cmd::Command("METRICS", "It shows what has been counted and timed so far, optionally only the metrics with names that contain the filter", "[filter]", cmd_metrics));
+		ctx->commands.push_back(new msa::cmd::Command("MEMORY", "It shows how much memory each part of me is holding on to and how fast it is allocating", "", cmd_memory));
+		*ctx_ptr = ctx;
+		return 0;
+	}
+
+	static int dispose_metrics_context(MetricsContext *ctx)
+	{
+		std::map<std::string, Metric>::iterator iter;
+		for (iter = ctx->metrics.begin(); iter != ctx->metrics.end(); iter++)
+		{
+			switch (iter->second.kind)
+			{
+				case Kind::COUNTER:
+					delete iter->second.counter;
+					break;
+
+				case Kind::GAUGE:
+					delete iter->second.gauge;
+					break;
+
+				case Kind::HISTOGRAM:
+					delete iter->second.histogram;
+					break;
+			}
+		}
+		for (size_t i = 0; i < ctx->commands.size(); i++)
+		{
+			delete ctx->commands[i];
+		}
+		msa::thread::mutex_destroy(&ctx->mutex);
+		msa::thread::mutex_destroy(&ctx->status_mutex);
+		delete ctx;
+		return 0;
+	}
+
+	static void read_config(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		ctx->socket_path = config.get_or<std::string>("SOCKET", "");
+		config.check_range("PORT", 0, 65535, false);
+		ctx->port = config.get_or("PORT", 0);
+		ctx->dump_path = config.get_or<std::string>("DUMP_FILE", "");
+		config.check_range("DUMP_INTERVAL", 1, 86400, false);
+		ctx->dump_interval = config.get_or("DUMP_INTERVAL", 60);
+	}
+
+	static Metric *find_or_add(msa::Handle hdl, const std::string &name, const std::string &help, Kind kind)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		if (ctx == NULL)
+		{
+			return NULL;
+		}
+		check_name(name);
+		msa::memory::Scope memory_scope(msa::memory::Tag::METRICS);
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::map<std::string, Metric>::iterator iter = ctx->metrics.find(name);
+		if (iter != ctx->metrics.end())
+		{
+			Metric *existing = &iter->second;
+			msa::thread::mutex_unlock(&ctx->mutex);
+			if (existing->kind != kind)
+			{
+				throw std::logic_error("metric already exists as another kind: " + name);
+			}
+			return existing;
+		}
+		Metric &m = ctx->metrics[name];
+		m.kind = kind;
+		m.help = help;
+		switch (kind)
+		{
+			case Kind::COUNTER:
+				m.counter = new Counter;
+				for (size_t s = 0; s < SLOT_COUNT; s++)
+				{
+					m.counter->slots[s].value = 0;
+				}
+				break;
+
+			case Kind::GAUGE:
+				m.gauge = new Gauge;
+				m.gauge->value = 0;
+				break;
+
+			case Kind::HISTOGRAM:
+				m.histogram = new Histogram;
+				for (size_t s = 0; s < SLOT_COUNT; s++)
+				{
+					for (size_t b = 0; b < BUCKET_COUNT; b++)
+					{
+						m.histogram->slots[s].buckets[b] = 0;
+					}
+					m.histogram->slots[s].sum = 0;
+				}
+				break;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return &m;
+	}
+
+	// names must match [a-zA-Z_:][a-zA-Z0-9_:]* to be exported
+	static void check_name(const std::string &name)
+	{
+		bool valid = !name.empty();
+		for (size_t i = 0; i < name.size() && valid; i++)
+		{
+			char c = name[i];
+			bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':';
+			valid = letter || (i > 0 && c >= '0' && c <= '9');
+		}
+		if (!valid)
+		{
+			throw std::invalid_argument("bad metric name: '" + name + "'");
+		}
+	}
+
+	static size_t get_slot()
+	{
+		if (current_slot == SLOT_COUNT)
+		{
+			current_slot = next_slot.fetch_add(1, std::memory_order_relaxed) % SLOT_COUNT;
+		}
+		return current_slot;
+	}
+
+	/**
+	 * Values below SUB_BUCKETS get a bucket each. Above that, the bucket is picked by the
+	 * position of the highest set bit and then by the SUB_BUCKET_BITS bits after it.
+	 */
+	static size_t bucket_of(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return (size_t) value;
+		}
+		int exponent = 0;
+		uint64_t rest = value;
+		for (int shift = 32; shift > 0; shift >>= 1)
+		{
+			if ((rest >> shift) != 0)
+			{
+				rest >>= shift;
+				exponent += shift;
+			}
+		}
+		uint64_t sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+		return (size_t) ((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub);
+	}
+
+	// the largest value that goes in the bucket
+	static uint64_t bucket_upper_bound(size_t bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+		{
+			return bucket;
+		}
+		int exponent = (int) (bucket / SUB_BUCKETS) - 1 + SUB_BUCKET_BITS;
+		uint64_t sub = bucket % SUB_BUCKETS;
+		uint64_t width = UINT64_C(1) << (exponent - SUB_BUCKET_BITS);
+		uint64_t lower = (SUB_BUCKETS + sub) * width;
+		return lower + (width - 1);
+	}
+
+	static void total_histogram(const Histogram *histogram, HistogramTotals &totals)
+	{
+		totals.buckets.assign(BUCKET_COUNT, 0);
+		totals.count = 0;
+		totals.sum = 0;
+		for (size_t s = 0; s < SLOT_COUNT; s++)
+		{
+			const HistogramSlot &slot = histogram->slots[s];
+			for (size_t b = 0; b < BUCKET_COUNT; b++)
+			{
+				uint64_t n = slot.buckets[b].load(std::memory_order_relaxed);
+				totals.buckets[b] += n;
+				totals.count += n;
+			}
+			totals.sum += slot.sum.load(std::memory_order_relaxed);
+		}
+	}
+
+	// gives the upper bound of the bucket that the value at the percentile is in
+	static uint64_t percentile_of(const HistogramTotals &totals, double percent)
+	{
+		if (totals.count == 0)
+		{
+			return 0;
+		}
+		uint64_t rank = (uint64_t) (percent / 100.0 * totals.count + 0.5);
+		rank = (rank < 1) ? 1 : ((rank > totals.count) ? totals.count : rank);
+		uint64_t seen = 0;
+		for (size_t b = 0; b < BUCKET_COUNT; b++)
+		{
+			seen += totals.buckets[b];
+			if (seen >= rank)
+			{
+				return bucket_upper_bound(b);
+			}
+		}
+		return bucket_upper_bound(BUCKET_COUNT - 1);
+	}
+
+	static std::string escape_help(const std::string &help)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < help.size(); i++)
+		{
+			if (help[i] == '\\')
+			{
+				escaped += "\\\\";
+			}
+			else if (help[i] == '\n')
+			{
+				escaped += "\\n";
+			}
+			else
+			{
+				escaped += help[i];
+			}
+		}
+		return escaped;
+	}
+
+	// the allocation counts of every memory tag, as labelled series
+	static std::string render_memory()
+	{
+		std::string live = "# HELP msa_memory_live_bytes Bytes allocated with operator new and not yet freed\n# TYPE msa_memory_live_bytes gauge\n";
+		std::string allocated = "# HELP msa_memory_allocated_bytes_total Bytes allocated with operator new\n# TYPE msa_memory_allocated_bytes_total counter\n";
+		std::string allocations = "# HELP msa_memory_allocations_total Blocks allocated with operator new\n# TYPE msa_memory_allocations_total counter\n";
+		#define MSA_MEMORY_TAG(enum_name, name) \
+		{ \
+			msa::memory::Stats stats = msa::memory::get_stats(msa::memory::Tag::enum_name); \
+			uint64_t live_bytes = (stats.allocated_bytes > stats.freed_bytes) ? stats.allocated_bytes - stats.freed_bytes : 0; \
+			live += "msa_memory_live_bytes{tag=\"" name "\"} " + std::to_string(live_bytes) + "\n"; \
+			allocated += "msa_memory_allocated_bytes_total{tag=\"" name "\"} " + std::to_string(stats.allocated_bytes) + "\n"; \
+			allocations += "msa_memory_allocations_total{tag=\"" name "\"} " + std::to_string(stats.allocations) + "\n"; \
+		}
+		#include "memory/tags.hpp"
+		#undef MSA_MEMORY_TAG
+		return live + allocated + allocations;
+	}
+
+	static std::string format_bytes(uint64_t bytes)
+	{
+		char buf[32];
+		if (bytes < 1024)
+		{
+			snprintf(buf, sizeof(buf), "%llu B", (unsigned long long) bytes);
+		}
+		else if (bytes < 1024 * 1024)
+		{
+			snprintf(buf, sizeof(buf), "%.1f KiB", bytes / 1024.0);
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "%.1f MiB", bytes / (1024.0 * 1024.0));
+		}
+		return std::string(buf);
+	}
+
+	static void start_exporter(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		try
+		{
+			if (ctx->socket_path != "")
+			{
+				ctx->listeners.push_back(msa::net::listen_local(ctx->socket_path));
+				msa::log::info(hdl, "Serving metrics on " + ctx->socket_path);
+			}
+			if (ctx->port != 0)
+			{
+				ctx->listeners.push_back(msa::net::listen_loopback((uint16_t) ctx->port));
+				msa::log::info(hdl, "Serving metrics on port " + std::to_string(ctx->port));
+			}
+		}
+		catch (const std::logic_error &e)
+		{
+			msa::log::warn(hdl, "Could not serve metrics: " + std::string(e.what()));
+		}
+		if (ctx->listeners.empty() && ctx->dump_path == "")
+		{
+			return;
+		}
+		try
+		{
+			ctx->export_waker = msa::net::create_waker();
+		}
+		catch (const std::logic_error &e)
+		{
+			msa::log::warn(hdl, "Could not start metrics exporter: " + std::string(e.what()));
+			return;
+		}
+		ctx->exporting = true;
+		if (msa::thread::create(&ctx->export_thread, NULL, export_start, hdl, "metrics") != 0)
+		{
+			ctx->exporting = false;
+			msa::net::dispose_waker(ctx->export_waker);
+			ctx->export_waker = NULL;
+			msa::log::warn(hdl, "Could not start metrics exporter");
+		}
+	}
+
+	static void stop_exporter(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		if (ctx->exporting)
+		{
+			ctx->exporting = false;
+			msa::net::wake(ctx->export_waker);
+			msa::thread::join(ctx->export_thread, NULL);
+			msa::net::dispose_waker(ctx->export_waker);
+			ctx->export_waker = NULL;
+			// so that the file has the final values
+			if (ctx->dump_path != "")
+			{
+				dump(hdl);
+			}
+		}
+		for (size_t i = 0; i < ctx->listeners.size(); i++)
+		{
+			msa::net::close(ctx->listeners[i]);
+		}
+		ctx->listeners.clear();
+	}
+
+	static void *export_start(void *args)
+	{
+		msa::Handle hdl = (msa::Handle) args;
+		msa::memory::Scope memory_scope(msa::memory::Tag::METRICS);
+		MetricsContext *ctx = hdl->metrics;
+		Clock::time_point next_dump = Clock::now() + std::chrono::seconds(ctx->dump_interval);
+		while (ctx->exporting)
+		{
+			// without a dump to make, the wait lasts until a client comes or the exporter is stopped
+			int wait = -1;
+			if (ctx->dump_path != "")
+			{
+				if (Clock::now() >= next_dump)
+				{
+					dump(hdl);
+					next_dump += std::chrono::seconds(ctx->dump_interval);
+				}
+				auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next_dump - Clock::now()).count();
+				wait = (remaining > 0) ? (int) remaining + 1 : 0;
+			}
+			msa::net::Socket *client = msa::net::accept(ctx->listeners, ctx->export_waker, wait);
+			if (client != NULL)
+			{
+				serve_client(hdl, client);
+			}
+		}
+		return NULL;
+	}
+
+	/**
+	 * Answers HTTP GET requests with a response that Prometheus can scrape, or with the
+	 * status if /status is asked for. Clients that send anything else just get the text,
+	 * which is the status if they sent "status" and the metrics otherwise.
+	 */
+	static void serve_client(msa::Handle hdl, msa::net::Socket *client)
+	{
+		char buf[512];
+		size_t got = msa::net::receive(client, buf, sizeof(buf), REQUEST_TIMEOUT_MILLIS);
+		std::string request(buf, got);
+		bool http = msa::string::starts_with(request, "GET ");
+		bool status = http ? msa::string::starts_with(request, "GET /status") : msa::string::starts_with(request, "status");
+		std::string text = status ? render_status(hdl) : render(hdl);
+		std::string response;
+		if (http)
+		{
+			response = "HTTP/1.0 200 OK\r\n";
+			response += status ? "Content-Type: application/json\r\n" : "Content-Type: text/plain; version=0.0.4\r\n";
+			response += "Content-Length: " + std::to_string(text.size()) + "\r\n\r\n";
+		}
+		response += text;
+		if (!msa::net::send(client, response))
+		{
+			msa::log::debug(hdl, "Metrics client went away before it got a response");
+		}
+		msa::net::close(client);
+	}
+
+	// writes to a temporary file first so that readers never see half a dump
+	static void dump(msa::Handle hdl)
+	{
+		MetricsContext *ctx = hdl->metrics;
+		std::string text = render(hdl);
+		std::string tmp_path = ctx->dump_path + ".tmp";
+		FILE *fp = fopen(tmp_path.c_str(), "wb");
+		if (fp == NULL)
+		{
+			msa::log::warn(hdl, "Could not open " + tmp_path + " to dump metrics");
+			return;
+		}
+		bool written = (fwrite(text.data(), 1, text.size(), fp) == text.size());
+		written = (fclose(fp) == 0) && written;
+		if (!written || rename(tmp_path.c_str(), ctx->dump_path.c_str()) != 0)
+		{
+			remove(tmp_path.c_str());
+			msa::log::warn(hdl, "Could not dump metrics to " + ctx->dump_path);
+		}
+	}
+
+	static msa::cmd::Result cmd_metrics(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const UNUSED(sync))
+	{
+		MetricsContext *ctx = hdl->metrics;
+		std::string filter = (params.arg_count() > 0) ? params[0] : "";
+		std::vector<std::string> lines;
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::map<std::string, Metric>::const_iterator iter;
+		for (iter = ctx->metrics.begin(); iter != ctx->metrics.end(); iter++)
+		{
+			const std::string &name = iter->first;
+			const Metric &m = iter->second;
+			if (name.find(filter) == std::string::npos)
+			{
+				continue;
+			}
+			switch (m.kind)
+			{
+				case Kind::COUNTER:
+					lines.push_back(name + " = " + std::to_string(get_count(m.counter)));
+					break;
+
+				case Kind::GAUGE:
+					lines.push_back(name + " = " + std::to_string(get_value(m.gauge)));
+					break;
+
+				case Kind::HISTOGRAM:
+				{
+					HistogramTotals totals;
+					total_histogram(m.histogram, totals);
+					std::string line = name + ": " + std::to_string(totals.count) + " samples";
+					if (totals.count > 0)
+					{
+						line += ", p50 " + std::to_string(percentile_of(totals, 50));
+						line += ", p90 " + std::to_string(percentile_of(totals, 90));
+						line += ", p99 " + std::to_string(percentile_of(totals, 99));
+						line += ", max " + std::to_string(percentile_of(totals, 100));
+					}
+					lines.push_back(line);
+					break;
+				}
+			}
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (lines.empty())
+		{
+			msa::agent::say(hdl, "Hmm, I haven't been keeping track of anything like that.");
+			return msa::cmd::Result(0);
+		}
+		msa::agent::say(hdl, "Okay, $USER_TITLE. Here's what I've been keeping track of:");
+		for (size_t i = 0; i < lines.size(); i++)
+		{
+			msa::agent::say(hdl, lines[i]);
+		}
+		return msa::cmd::Result(0);
+	}
+
+	static msa::cmd::Result cmd_memory(msa::Handle hdl, const msa::cmd::ParamList & UNUSED(params), msa::event::HandlerSync *const UNUSED(sync))
+	{
+		MetricsContext *ctx = hdl->metrics;
+		std::vector<msa::memory::Tag> tags = {
+			#define MSA_MEMORY_TAG(enum_name, name)		msa::memory::Tag::enum_name,
+			#include "memory/tags.hpp"
+			#undef MSA_MEMORY_TAG
+		};
+		std::vector<msa::memory::Stats> stats;
+		for (size_t i = 0; i < tags.size(); i++)
+		{
+			stats.push_back(msa::memory::get_stats(tags[i]));
+		}
+		Clock::time_point now = Clock::now();
+		msa::thread::mutex_lock(&ctx->mutex);
+		double seconds = std::chrono::duration<double>(now - ctx->memory_checked).count();
+		std::vector<uint64_t> previous = ctx->memory_allocations;
+		ctx->memory_checked = now;
+		ctx->memory_allocations.clear();
+		for (size_t i = 0; i < stats.size(); i++)
+		{
+			ctx->memory_allocations.push_back(stats[i].allocations);
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		previous.resize(tags.size(), 0);
+
+		msa::agent::say(hdl, "Okay, $USER_TITLE. Here's the memory I'm holding on to, and how fast I've been asking for more since you last checked:");
+		uint64_t total_live = 0;
+		uint64_t total_blocks = 0;
+		for (size_t i = 0; i < tags.size(); i++)
+		{
+			const msa::memory::Stats &s = stats[i];
+			uint64_t live = (s.allocated_bytes > s.freed_bytes) ? s.allocated_bytes - s.freed_bytes : 0;
+			uint64_t blocks = (s.allocations > s.frees) ? s.allocations - s.frees : 0;
+			total_live += live;
+			total_blocks += blocks;
+			if (s.allocations == 0)
+			{
+				continue;
+			}
+			char rate[32];
+			snprintf(rate, sizeof(rate), "%.1f", (seconds > 0) ? (s.allocations - previous[i]) / seconds : 0.0);
+			msa::agent::say(hdl, std::string(msa::memory::tag_name(tags[i])) + ": " + format_bytes(live) + " in " + std::to_string(blocks) + " blocks, " + rate + " allocations/s");
+		}
+		msa::agent::say(hdl, "That's " + format_bytes(total_live) + " in " + std::to_string(total_blocks) + " blocks altogether.");
+		return msa::cmd::Result(0);
+	}
+
+} }
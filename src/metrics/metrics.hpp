@@ -0,0 +1,55 @@
+#ifndef MSA_METRICS_METRICS_HPP
+#define MSA_METRICS_METRICS_HPP
+
+#include "msa.hpp"
+#include "cfg/cfg.hpp"
+
+#include <string>
+#include <cstdint>
+
+// Counters, gauges and histograms that any module or plugin can keep. Updates are
+// lock-free and go to a slot owned by the calling thread, so hot paths can update
+// them freely; the slots are only added up when the metrics are read.
+//
+// A metric is created the first time its name is asked for and lives until the
+// instance stops, so callers should look it up once and keep the pointer. Names
+// follow the Prometheus rules. All functions accept a NULL metric and do nothing
+// with it, which is what the getters give when the metrics module is not running.
+//
+// Modules can also add a status source, which the exporter calls to describe what the
+// module is doing right now. It runs on the exporter thread, so it should read state
+// that the module publishes for it rather than take the module's own locks.
+
+namespace msa { namespace metrics {
+
+	typedef struct counter_type Counter;
+	typedef struct gauge_type Gauge;
+	typedef struct histogram_type Histogram;
+
+	// gives a JSON object describing the module
+	typedef std::string (*StatusFunc)(msa::Handle hdl);
+
+	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
+	extern int quit(msa::Handle hdl);
+	extern int setup(msa::Handle hdl);
+	extern int teardown(msa::Handle hdl);
+	// renders every metric in the Prometheus text exposition format
+	extern std::string render(msa::Handle hdl);
+	// renders the instance status and every status source as one JSON object
+	extern std::string render_status(msa::Handle hdl);
+	extern const PluginHooks *get_plugin_hooks();
+
+	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
+	#include "metrics/hooks.hpp"
+	#undef MSA_MODULE_HOOK
+
+	struct plugin_hooks_type
+	{
+		#define MSA_MODULE_HOOK(retspec, name, ...)		retspec (*name)(__VA_ARGS__);
+		#include "metrics/hooks.hpp"
+		#undef MSA_MODULE_HOOK
+	};
+
+} }
+
+#endif
@@ -8,10 +8,18 @@
 #include "output/output.hpp"
 #include "util/string.hpp"
 #include "plugin/plugin.hpp"
+#include "checkpoint/checkpoint.hpp"
+#include "metrics/metrics.hpp"
+#include "trace/trace.hpp"
 
 #include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
 
 #include "platform/thread/thread.hpp"
+#include "platform/file/file.hpp"
 
 namespace msa {
 
@@ -21,15 +29,132 @@ namespace msa {
 
 	typedef int (*ModFunc)(Handle);
 	typedef int (*ModInitFunc)(Handle, const msa::cfg::Section&);
+	typedef int (*ModReconfigureFunc)(Handle, const msa::cfg::Section&, const std::vector<std::string>&);
+
+	typedef struct reconfigurable_module_type
+	{
+		const char *section;
+		ModReconfigureFunc reconfigure;
+	} ReconfigurableModule;
+
+	// modules that can apply config changes while running; changes to the
+	// sections of any other module need a restart
+	static const ReconfigurableModule RECONFIGURABLE_MODULES[] = {
+		{"LOG", msa::log::reconfigure},
+		{"EVENT", msa::event::reconfigure},
+		{"INPUT", msa::input::reconfigure}
+	};
+
+	typedef void (*ModCheckpointFunc)(Handle, msa::checkpoint::Writer&);
+	typedef void (*ModRestoreFunc)(Handle, msa::checkpoint::Reader&);
+
+	typedef struct checkpointed_module_type
+	{
+		const char *name;
+		const char *tag;
+		// bump when the layout of the module's section changes; sections with another
+		// version are skipped
+		uint32_t version;
+		// NULL if the module writes its section itself as it quits
+		ModCheckpointFunc checkpoint;
+		ModRestoreFunc restore;
+	} CheckpointedModule;
+
+	// modules with state that is saved on a normal stop and restored on the next start,
+	// in restore order. Plugins go first so that their handlers are subscribed before
+	// the events are queued.
+	static const CheckpointedModule CHECKPOINTED_MODULES[] = {
+		{"Plugin", "PLUG", 1, msa::plugin::checkpoint, msa::plugin::restore},
+		{"Agent", "AGNT", 1, msa::agent::checkpoint, msa::agent::restore},
+		{"Event", "EVNT", 1, NULL, msa::event::restore}
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	typedef struct module_init_type
+	{
+		const char *name;
+		ModInitFunc init;
+		int error;
+		// modules that must finish init first
+		std::vector<std::string> after;
+	} ModuleInit;
+
+	// modules with no path between them in this graph are inited at the same time.
+	// Everything needs the log, and modules that keep metrics or record traces need the
+	// metrics and trace modules; plugin autoload only opens and registers libraries, so
+	// it does not wait on the modules that plugins use once they are enabled.
+	static const ModuleInit MODULE_INITS[] = {
+		{"Log", msa::log::init, MSA_ERR_LOG, {}},
+		{"Metrics", msa::metrics::init, MSA_ERR_METRICS, {"Log"}},
+		{"Trace", msa::trace::init, MSA_ERR_TRACE, {"Log"}},
+		{"Output", msa::output::init, MSA_ERR_OUTPUT, {"Log", "Metrics", "Trace"}},
+		{"Event", msa::event::init, MSA_ERR_EVENT, {"Log", "Metrics", "Trace"}},
+		{"Plugin", msa::plugin::init, MSA_ERR_PLUGIN, {"Log", "Trace"}},
+		{"Input", msa::input::init, MSA_ERR_INPUT, {"Event"}},
+		{"Agent", msa::agent::init, MSA_ERR_AGENT, {"Output"}},
+		{"Command", msa::cmd::init, MSA_ERR_CMD, {"Event"}}
+	};
+
+	typedef struct init_job_type
+	{
+		Handle hdl;
+		msa::cfg::Config *conf;
+		const ModuleInit *module;
+		int ret;
+		Clock::duration time;
+	} InitJob;
+
+	typedef std::vector<std::pair<std::string, Clock::duration>> StartupProfile;
+
+	struct reload_context_type
+	{
+		std::string path;
+		msa::cfg::Config *config;
+		msa::file::Watch *watch;
+		msa::thread::Thread thread;
+		// cleared by stop_reload(), which then wakes the watch
+		std::atomic<bool> running;
+	};
+
+	struct lifecycle_context_type
+	{
+		msa::thread::Mutex mutex;
+		msa::thread::Cond changed;
+		// empty if checkpointing is off
+		std::string checkpoint_path;
+		// the section that the EDT writes as it stops
+		msa::checkpoint::Writer *event_checkpoint;
+		// the checkpoint being written while stopping
+		msa::checkpoint::Snapshot *checkpoint;
+		// event handler threads that have not yet returned, and whether the last of them
+		// is to finish stopping the instance; both guarded by mutex
+		int live_handlers;
+		bool finish_in_handler;
+	};
 
 	static const msa::cfg::Section &get_module_section(msa::cfg::Config *conf, const std::string &name);
+	static int init_modules(Handle hdl, msa::cfg::Config *conf, StartupProfile &profile);
+	static void *init_worker(void *args);
 	static int init_module(Handle hdl, msa::cfg::Config *conf, ModInitFunc init_func, const std::string &name);
-	static int setup_module(Handle hdl, ModFunc setup_func, const std::string &name);
+	static int setup_module(Handle hdl, ModFunc setup_func, const std::string &name, StartupProfile &profile);
+	static std::string format_millis(Clock::duration dur);
 	static int quit_module(Handle msa, void **mod, ModFunc quit_func, const std::string &log_name);
 	static int teardown_module(Handle hdl, void **mod, ModFunc teardown_func, const std::string &name);
 	static int stop(Handle hdl, int retcode);
+	static int finish_stop(Handle hdl);
+	static void begin_checkpoint(Handle hdl);
+	static void finish_checkpoint(Handle hdl);
+	static void restore_checkpoint(Handle hdl, StartupProfile &profile);
+	static int start_reload(Handle hdl, const char *config_path, msa::cfg::Config *conf);
+	static void stop_reload(Handle hdl);
+	static void *reload_start(void *args);
+	static void reload_config(Handle hdl);
 
 	static const msa::cfg::Section blank_section("");
+
+	// how long the config file must go unchanged before it is reloaded
+	static const int RELOAD_SETTLE_MILLIS = 50;
 	
 	extern void init()
 	{
@@ -41,6 +166,8 @@ namespace msa {
 		PLUGIN_HOOKS->cmd = msa::cmd::get_plugin_hooks();
 		PLUGIN_HOOKS->log = msa::log::get_plugin_hooks();
 		PLUGIN_HOOKS->plugin = msa::plugin::get_plugin_hooks();
+		PLUGIN_HOOKS->metrics = msa::metrics::get_plugin_hooks();
+		PLUGIN_HOOKS->trace = msa::trace::get_plugin_hooks();
 		msa::thread::init();
 	}
 	
@@ -66,6 +193,14 @@ namespace msa {
 
 		environment_type *hdl = new environment_type;
 		hdl->status = Status::CREATED;
+		hdl->lifecycle = new LifecycleContext;
+		msa::thread::mutex_init(&hdl->lifecycle->mutex, NULL);
+		msa::thread::cond_init(&hdl->lifecycle->changed, NULL);
+		hdl->lifecycle->checkpoint_path = get_module_section(conf, "CHECKPOINT").get_or<std::string>("PATH", "");
+		hdl->lifecycle->event_checkpoint = NULL;
+		hdl->lifecycle->checkpoint = NULL;
+		hdl->lifecycle->live_handlers = 0;
+		hdl->lifecycle->finish_in_handler = false;
 		hdl->event = NULL;
 		hdl->input = NULL;
 		hdl->output = NULL;
@@ -73,22 +208,42 @@ namespace msa {
 		hdl->cmd = NULL;
 		hdl->log = NULL;
 		hdl->plugin = NULL;
+		hdl->metrics = NULL;
+		hdl->trace = NULL;
+		hdl->reload = NULL;
 
-		// init system modules; changing order could break everything
-		if (init_module(hdl, conf, msa::log::init, "Log") != 0) return MSA_ERR_LOG;
-		if (init_module(hdl, conf, msa::output::init, "Output") != 0) return MSA_ERR_OUTPUT;
-		if (init_module(hdl, conf, msa::event::init, "Event") != 0) return MSA_ERR_EVENT;
-		if (init_module(hdl, conf, msa::input::init, "Input") != 0) return MSA_ERR_INPUT;
-		if (init_module(hdl, conf, msa::agent::init, "Agent") != 0) return MSA_ERR_AGENT;
-		if (init_module(hdl, conf, msa::cmd::init, "Command") != 0) return MSA_ERR_CMD;
-		if (init_module(hdl, conf, msa::plugin::init, "Plugin") != 0) return MSA_ERR_PLUGIN;
+		// init system modules in dependency order; see MODULE_INITS
+		Clock::time_point start_time = Clock::now();
+		StartupProfile profile;
+		int init_status = init_modules(hdl, conf, profile);
+		if (init_status != MSA_SUCCESS) return init_status;
+		if (hdl->lifecycle->checkpoint_path != "")
+		{
+			hdl->lifecycle->event_checkpoint = new msa::checkpoint::Writer;
+			msa::event::set_checkpoint(hdl, hdl->lifecycle->event_checkpoint);
+		}
 		
 		// system is inited, do setup now (order does not matter)
-		if (setup_module(hdl, msa::plugin::setup, "Plugin") != 0) return MSA_ERR_PLUGIN;
-		if (setup_module(hdl, msa::event::setup, "Event") != 0) return MSA_ERR_EVENT;
+		if (setup_module(hdl, msa::plugin::setup, "Plugin", profile) != 0) return MSA_ERR_PLUGIN;
+		if (setup_module(hdl, msa::event::setup, "Event", profile) != 0) return MSA_ERR_EVENT;
+		if (setup_module(hdl, msa::metrics::setup, "Metrics", profile) != 0) return MSA_ERR_METRICS;
+		// journal first so that the events restored from the checkpoint are journaled too
+		msa::event::start_journal(hdl);
+		restore_checkpoint(hdl, profile);
+
+		for (size_t i = 0; i < profile.size(); i++)
+		{
+			msa::log::debug(hdl, "Startup profile: " + profile[i].first + " took " + format_millis(profile[i].second));
+		}
+		msa::log::info(hdl, "Started all modules in " + format_millis(Clock::now() - start_time));
 
 		*msa = hdl;
-		delete conf;
+
+		// the config is kept so that changes to it can be found when it is reloaded
+		if (start_reload(hdl, config_path, conf) != 0)
+		{
+			delete conf;
+		}
 		
 		msa::log::info(hdl, "Finished initializing Moe Serifu Agent");
 		return MSA_SUCCESS;
@@ -136,7 +291,26 @@ namespace msa {
 		{
 			return MSA_ERR_PLUGIN;
 		}
-		
+
+		if (msa->metrics != NULL)
+		{
+			return MSA_ERR_METRICS;
+		}
+
+		if (msa->trace != NULL)
+		{
+			return MSA_ERR_TRACE;
+		}
+
+		if (msa->reload != NULL)
+		{
+			return MSA_ERR_CONFIG;
+		}
+
+		delete msa->lifecycle->event_checkpoint;
+		msa::thread::cond_destroy(&msa->lifecycle->changed);
+		msa::thread::mutex_destroy(&msa->lifecycle->mutex);
+		delete msa->lifecycle;
 		delete msa;
 		return MSA_SUCCESS;
 	}
@@ -144,12 +318,18 @@ namespace msa {
 	static int stop(Handle msa, int retcode)
 	{
 		msa::log::info(msa, "Moe Serifu Agent is now shutting down...");
+		stop_reload(msa);
 		
 		// teardown; order does not matter here. Skip if non-normal shutdown
 		if (retcode == 0)
 		{
+			if (msa->lifecycle->event_checkpoint != NULL)
+			{
+				begin_checkpoint(msa);
+			}
 			if (teardown_module(msa, (void **) &msa->plugin, msa::plugin::teardown, "Plugin") != 0) return MSA_ERR_PLUGIN;
 			if (teardown_module(msa, (void **) &msa->event, msa::event::teardown, "Event") != 0) return MSA_ERR_EVENT;
+			if (teardown_module(msa, (void **) &msa->metrics, msa::metrics::teardown, "Metrics") != 0) return MSA_ERR_METRICS;
 		}
 		
 		// modules are torn down, now quit them; order matters
@@ -157,18 +337,221 @@ namespace msa {
 		if (quit_module(msa, (void **) &msa->input, msa::input::quit, "Input") != 0) return MSA_ERR_INPUT;
 		if (quit_module(msa, (void **) &msa->agent, msa::agent::quit, "Agent") != 0) return MSA_ERR_AGENT;
 		if (quit_module(msa, (void **) &msa->cmd, msa::cmd::quit, "Command") != 0) return MSA_ERR_CMD;
+		if (msa->event != NULL)
+		{
+			msa::event::stop_edt(msa);
+		}
+
+		// a handler that did not finish in time, or that asked for this stop, may still be
+		// using the modules that are left, so the last of them quits them once it is done
+		LifecycleContext *ctx = msa->lifecycle;
+		msa::thread::mutex_lock(&ctx->mutex);
+		if (ctx->live_handlers > 0)
+		{
+			ctx->finish_in_handler = true;
+			msa::log::debug(msa, "Leaving the rest of the shutdown to " + std::to_string(ctx->live_handlers) + " running event handler(s)");
+			msa::thread::mutex_unlock(&ctx->mutex);
+			return MSA_SUCCESS;
+		}
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return finish_stop(msa);
+	}
+
+	/**
+	 * Quits the modules that event handlers may still be using once no handler is left
+	 * running. Stopped is the last status set, after which the handle may be disposed.
+	 */
+	static int finish_stop(Handle msa)
+	{
 		if (quit_module(msa, (void **) &msa->event, msa::event::quit, "Event") != 0) return MSA_ERR_EVENT;
 		if (quit_module(msa, (void **) &msa->output, msa::output::quit, "Output") != 0) return MSA_ERR_OUTPUT;
+		// after every module that may still be updating a metric
+		if (quit_module(msa, (void **) &msa->metrics, msa::metrics::quit, "Metrics") != 0) return MSA_ERR_METRICS;
+		// after every module that may still be recording
+		if (quit_module(msa, (void **) &msa->trace, msa::trace::quit, "Trace") != 0) return MSA_ERR_TRACE;
+		if (msa->lifecycle->checkpoint != NULL)
+		{
+			finish_checkpoint(msa);
+		}
 		
 		msa::log::info(msa, "Moe Serifu Agent primary modules shutdown cleanly");
 		
 		// shutdown log module last
 		if (quit_module(msa, (void **) &msa->log, msa::log::quit, "") != 0) return MSA_ERR_LOG;
 		
-		msa->status = msa::Status::STOPPED;
+		set_status(msa, msa::Status::STOPPED);
 		return MSA_SUCCESS;
 	}
 
+	/**
+	 * Saves the module state that is gone once the modules are torn down. The EDT adds
+	 * its own section as it stops, and the file is written by finish_checkpoint().
+	 */
+	static void begin_checkpoint(Handle hdl)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		ctx->checkpoint = msa::checkpoint::create_snapshot();
+		size_t count = sizeof(CHECKPOINTED_MODULES) / sizeof(CheckpointedModule);
+		for (size_t i = 0; i < count; i++)
+		{
+			const CheckpointedModule &mod = CHECKPOINTED_MODULES[i];
+			if (mod.checkpoint == NULL)
+			{
+				continue;
+			}
+			try
+			{
+				msa::checkpoint::Writer out;
+				mod.checkpoint(hdl, out);
+				msa::checkpoint::add_section(ctx->checkpoint, mod.tag, mod.version, out);
+			}
+			catch (const std::exception &e)
+			{
+				msa::log::error(hdl, "Could not checkpoint " + std::string(mod.name) + " module: " + e.what());
+			}
+		}
+	}
+
+	static void finish_checkpoint(Handle hdl)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		Clock::time_point start = Clock::now();
+		// the event module is the only one that writes its own section
+		size_t count = sizeof(CHECKPOINTED_MODULES) / sizeof(CheckpointedModule);
+		for (size_t i = 0; i < count; i++)
+		{
+			const CheckpointedModule &mod = CHECKPOINTED_MODULES[i];
+			if (mod.checkpoint == NULL && !ctx->event_checkpoint->data().empty())
+			{
+				msa::checkpoint::add_section(ctx->checkpoint, mod.tag, mod.version, *ctx->event_checkpoint);
+			}
+		}
+		try
+		{
+			size_t bytes = msa::checkpoint::save(ctx->checkpoint, ctx->checkpoint_path);
+			msa::log::info(hdl, "Checkpointed runtime state to " + ctx->checkpoint_path + " (" + std::to_string(bytes) + " bytes) in " + format_millis(Clock::now() - start));
+		}
+		catch (const msa::checkpoint::checkpoint_error &e)
+		{
+			msa::log::error(hdl, "Could not write checkpoint: " + std::string(e.what()));
+		}
+		msa::checkpoint::dispose_snapshot(ctx->checkpoint);
+		ctx->checkpoint = NULL;
+	}
+
+	/**
+	 * Restores each module from the checkpoint left by the last stop, if there is one.
+	 * The file is removed afterwards so that its events are not replayed a second time
+	 * if this instance does not stop cleanly.
+	 */
+	static void restore_checkpoint(Handle hdl, StartupProfile &profile)
+	{
+		const std::string &path = hdl->lifecycle->checkpoint_path;
+		if (path == "")
+		{
+			return;
+		}
+		FILE *fp = fopen(path.c_str(), "rb");
+		if (fp == NULL)
+		{
+			msa::log::debug(hdl, "No checkpoint at " + path + "; starting fresh");
+			return;
+		}
+		fclose(fp);
+
+		Clock::time_point start = Clock::now();
+		msa::checkpoint::Snapshot *snap = NULL;
+		try
+		{
+			snap = msa::checkpoint::load(path);
+		}
+		catch (const msa::checkpoint::checkpoint_error &e)
+		{
+			msa::log::error(hdl, "Could not load checkpoint: " + std::string(e.what()) + "; starting fresh");
+			remove(path.c_str());
+			return;
+		}
+		size_t count = sizeof(CHECKPOINTED_MODULES) / sizeof(CheckpointedModule);
+		for (size_t i = 0; i < count; i++)
+		{
+			const CheckpointedModule &mod = CHECKPOINTED_MODULES[i];
+			if (!msa::checkpoint::has_section(snap, mod.tag, mod.version))
+			{
+				msa::log::warn(hdl, "Checkpoint has no usable state for the " + std::string(mod.name) + " module");
+				continue;
+			}
+			try
+			{
+				msa::checkpoint::Reader in = msa::checkpoint::read_section(snap, mod.tag);
+				mod.restore(hdl, in);
+			}
+			catch (const std::exception &e)
+			{
+				msa::log::error(hdl, "Could not restore " + std::string(mod.name) + " module from checkpoint: " + e.what());
+			}
+		}
+		size_t bytes = msa::checkpoint::size(snap);
+		msa::checkpoint::dispose_snapshot(snap);
+		remove(path.c_str());
+		Clock::duration took = Clock::now() - start;
+		profile.push_back(std::make_pair("checkpoint restore", took));
+		msa::log::info(hdl, "Restored runtime state from " + path + " (" + std::to_string(bytes) + " bytes) in " + format_millis(took));
+	}
+
+	extern void set_status(Handle hdl, Status status)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		msa::thread::mutex_lock(&ctx->mutex);
+		hdl->status = status;
+		msa::thread::cond_broadcast(&ctx->changed);
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern bool wait_for_status(Handle hdl, Status status, int timeout)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		msa::thread::mutex_lock(&ctx->mutex);
+		while (hdl->status < status)
+		{
+			if (timeout < 0)
+			{
+				msa::thread::cond_wait(&ctx->changed, &ctx->mutex);
+				continue;
+			}
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0)
+			{
+				break;
+			}
+			msa::thread::cond_timed_wait(&ctx->changed, &ctx->mutex, (int) remaining + 1);
+		}
+		bool reached = (hdl->status >= status);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return reached;
+	}
+
+	extern void handler_started(Handle hdl)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->live_handlers++;
+		msa::thread::mutex_unlock(&ctx->mutex);
+	}
+
+	extern void handler_finished(Handle hdl)
+	{
+		LifecycleContext *ctx = hdl->lifecycle;
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->live_handlers--;
+		bool finish = (ctx->finish_in_handler && ctx->live_handlers == 0);
+		msa::thread::mutex_unlock(&ctx->mutex);
+		if (finish)
+		{
+			finish_stop(hdl);
+		}
+	}
+
 	static const msa::cfg::Section &get_module_section(msa::cfg::Config *conf, const std::string &name)
 	{
 		if (conf->find(name) != conf->end())
@@ -181,12 +564,14 @@ namespace msa {
 		}
 	}
 	
-	static int setup_module(Handle hdl, ModFunc setup_func, const std::string &name)
+	static int setup_module(Handle hdl, ModFunc setup_func, const std::string &name, StartupProfile &profile)
 	{
 		std::string lower_name = name;
 		msa::string::to_lower(lower_name);
 		
+		Clock::time_point start = Clock::now();
 		int ret = setup_func(hdl);
+		profile.push_back(std::make_pair(lower_name + " setup", Clock::now() - start));
 		if (ret != 0)
 		{
 			msa::log::error(hdl, "Failed to setup " + lower_name + " module");
@@ -231,7 +616,7 @@ namespace msa {
 		msa::string::to_upper(upper_name);
 		bool enable_failure_log = (upper_name != "LOG"); // cant log messages before log is started
 		
-		msa::cfg::Section section = get_module_section(conf, upper_name);
+		const msa::cfg::Section &section = get_module_section(conf, upper_name);
 		int ret = init_func(hdl, section);
 		if (ret != 0)
 		{
@@ -240,13 +625,117 @@ namespace msa {
 				msa::log::error(hdl, "Failed to start " + lower_name + " module");
 				msa::log::debug(hdl, name + " module's init() returned " + std::to_string(ret));
 			}
-			stop(hdl, ret);
-			dispose(hdl);
 			return ret;
 		}
 		msa::log::trace(hdl, "Started " + lower_name + " module");
 		return ret;
 	}
+
+	/**
+	 * Inits the modules in waves. Each wave is every module whose dependencies are done,
+	 * and the modules in a wave are inited on threads of their own. If any module fails,
+	 * whatever was started is stopped once its wave is over.
+	 */
+	static int init_modules(Handle hdl, msa::cfg::Config *conf, StartupProfile &profile)
+	{
+		size_t count = sizeof(MODULE_INITS) / sizeof(ModuleInit);
+		std::vector<bool> done(count, false);
+		size_t done_count = 0;
+		int wave_num = 0;
+		while (done_count < count)
+		{
+			std::vector<InitJob> wave;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (done[i])
+				{
+					continue;
+				}
+				bool ready = true;
+				const std::vector<std::string> &after = MODULE_INITS[i].after;
+				for (size_t j = 0; j < count && ready; j++)
+				{
+					bool needed = std::find(after.begin(), after.end(), MODULE_INITS[j].name) != after.end();
+					ready = !needed || done[j];
+				}
+				if (ready)
+				{
+					wave.push_back(InitJob {hdl, conf, &MODULE_INITS[i], 0, Clock::duration::zero()});
+				}
+			}
+			if (wave.empty())
+			{
+				// only possible if MODULE_INITS has a cycle or names an unknown module
+				msa::log::error(hdl, "Module init order cannot be satisfied");
+				stop(hdl, -1);
+				dispose(hdl);
+				return MSA_ERR_CONFIG;
+			}
+			wave_num++;
+
+			// the first job runs here; the rest get threads
+			std::vector<msa::thread::Thread> threads(wave.size());
+			std::vector<bool> started(wave.size(), false);
+			for (size_t i = 1; i < wave.size(); i++)
+			{
+				std::string thread_name = "init-" + std::string(wave[i].module->name);
+				msa::string::to_lower(thread_name);
+				started[i] = (msa::thread::create(&threads[i], NULL, init_worker, &wave[i], thread_name.c_str()) == 0);
+				if (!started[i])
+				{
+					init_worker(&wave[i]);
+				}
+			}
+			init_worker(&wave[0]);
+			for (size_t i = 1; i < wave.size(); i++)
+			{
+				if (started[i])
+				{
+					msa::thread::join(threads[i], NULL);
+				}
+			}
+
+			int error = MSA_SUCCESS;
+			int failed_ret = 0;
+			for (size_t i = 0; i < wave.size(); i++)
+			{
+				std::string lower_name = wave[i].module->name;
+				msa::string::to_lower(lower_name);
+				profile.push_back(std::make_pair(lower_name + " init (wave " + std::to_string(wave_num) + ")", wave[i].time));
+				done[wave[i].module - MODULE_INITS] = true;
+				done_count++;
+				if (wave[i].ret != 0 && error == MSA_SUCCESS)
+				{
+					error = wave[i].module->error;
+					failed_ret = wave[i].ret;
+				}
+			}
+			if (error != MSA_SUCCESS)
+			{
+				stop(hdl, failed_ret);
+				dispose(hdl);
+				return error;
+			}
+		}
+		return MSA_SUCCESS;
+	}
+
+	static void *init_worker(void *args)
+	{
+		InitJob *job = (InitJob *) args;
+		Clock::time_point start = Clock::now();
+		job->ret = init_module(job->hdl, job->conf, job->module->init, job->module->name);
+		job->time = Clock::now() - start;
+		return NULL;
+	}
+
+	static std::string format_millis(Clock::duration dur)
+	{
+		double millis = std::chrono::duration<double, std::milli>(dur).count();
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.3f ms", millis);
+		return std::string(buf);
+	}
 	
 	static int quit_module(Handle msa, void **mod, ModFunc quit_func, const std::string &log_name)
 	{
@@ -278,4 +767,150 @@ namespace msa {
 		return status;
 	}
 
+	static int start_reload(Handle hdl, const char *config_path, msa::cfg::Config *conf)
+	{
+		const msa::cfg::Section &config = get_module_section(conf, "RELOAD");
+		if (config.get_or("WATCH", 0) == 0)
+		{
+			return 1;
+		}
+		ReloadContext *ctx = new ReloadContext;
+		ctx->path = config_path;
+		ctx->config = conf;
+		try
+		{
+			ctx->watch = msa::file::watch(ctx->path);
+		}
+		catch (const std::exception &e)
+		{
+			msa::log::warn(hdl, "Could not watch config file for changes: " + std::string(e.what()));
+			delete ctx;
+			return 2;
+		}
+		ctx->running = true;
+		hdl->reload = ctx;
+		int status = msa::thread::create(&ctx->thread, NULL, reload_start, hdl, "cfg-reload");
+		if (status != 0)
+		{
+			msa::log::warn(hdl, "Could not create config reload thread (error " + std::to_string(status) + ")");
+			msa::file::unwatch(ctx->watch);
+			delete ctx;
+			hdl->reload = NULL;
+			return 3;
+		}
+		msa::log::info(hdl, "Watching config file " + ctx->path + " for changes");
+		return 0;
+	}
+
+	static void stop_reload(Handle hdl)
+	{
+		ReloadContext *ctx = hdl->reload;
+		if (ctx == NULL)
+		{
+			return;
+		}
+		ctx->running = false;
+		msa::file::wake(ctx->watch);
+		msa::thread::join(ctx->thread, NULL);
+		msa::file::unwatch(ctx->watch);
+		delete ctx->config;
+		delete ctx;
+		hdl->reload = NULL;
+	}
+
+	static void *reload_start(void *args)
+	{
+		Handle hdl = (Handle) args;
+		ReloadContext *ctx = hdl->reload;
+		while (ctx->running)
+		{
+			if (msa::file::wait_for_change(ctx->watch, -1))
+			{
+				// editors may save a file in more than one write, so wait for them to finish
+				while (ctx->running && msa::file::wait_for_change(ctx->watch, RELOAD_SETTLE_MILLIS));
+				reload_config(hdl);
+			}
+		}
+		return NULL;
+	}
+
+	static void reload_config(Handle hdl)
+	{
+		ReloadContext *ctx = hdl->reload;
+		msa::log::info(hdl, "Config file " + ctx->path + " changed; reloading it");
+		// an editor may truncate the file while it is read, which a mapping cannot survive
+		msa::cfg::Config *conf = msa::cfg::load(ctx->path.c_str(), true);
+		if (conf == NULL)
+		{
+			msa::log::error(hdl, "Could not load changed config file; keeping the current config");
+			return;
+		}
+		
+		std::vector<std::string> names;
+		msa::cfg::Config::const_iterator iter;
+		for (iter = ctx->config->begin(); iter != ctx->config->end(); iter++)
+		{
+			names.push_back(iter->first);
+		}
+		for (iter = conf->begin(); iter != conf->end(); iter++)
+		{
+			if (ctx->config->find(iter->first) == ctx->config->end())
+			{
+				names.push_back(iter->first);
+			}
+		}
+
+		size_t num_reconfigurable = sizeof(RECONFIGURABLE_MODULES) / sizeof(ReconfigurableModule);
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			const std::string &name = names[i];
+			std::vector<std::string> changed;
+			msa::cfg::diff(get_module_section(ctx->config, name), get_module_section(conf, name), changed);
+			if (changed.empty())
+			{
+				continue;
+			}
+			std::string keys = changed[0];
+			for (size_t k = 1; k < changed.size(); k++)
+			{
+				keys += ", " + changed[k];
+			}
+
+			ModReconfigureFunc reconfigure = NULL;
+			for (size_t m = 0; m < num_reconfigurable; m++)
+			{
+				if (name == RECONFIGURABLE_MODULES[m].section)
+				{
+					reconfigure = RECONFIGURABLE_MODULES[m].reconfigure;
+				}
+			}
+			if (reconfigure == NULL)
+			{
+				msa::log::warn(hdl, "Changes to [" + name + "] (" + keys + ") need a restart to take effect");
+				continue;
+			}
+			int ret = reconfigure(hdl, get_module_section(conf, name), changed);
+			if (ret != 0)
+			{
+				msa::log::error(hdl, "Could not apply changes to [" + name + "]; it keeps its current config");
+				msa::log::debug(hdl, name + " module's reconfigure() returned " + std::to_string(ret));
+				// keep the old section so that the failed changes are found again next time
+				if (ctx->config->find(name) != ctx->config->end())
+				{
+					(*conf)[name] = (*ctx->config)[name];
+				}
+				else
+				{
+					conf->erase(name);
+				}
+			}
+			else
+			{
+				msa::log::info(hdl, "Applied changes to [" + name + "]: " + keys);
+			}
+		}
+		delete ctx->config;
+		ctx->config = conf;
+	}
+
 }
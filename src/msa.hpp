@@ -3,6 +3,8 @@
 
 #include "debug_macros.hpp"
 
+#include <atomic>
+
 // DO NOT INCLUDE ANY MSA HEADER FILES HERE!
 // If you find you have to, re-think your design.
 // It will break here.
@@ -16,6 +18,8 @@
 #define MSA_ERR_LOG 6
 #define MSA_ERR_OUTPUT 7
 #define MSA_ERR_PLUGIN 8
+#define MSA_ERR_METRICS 9
+#define MSA_ERR_TRACE 10
 
 namespace msa {
 
@@ -69,6 +73,24 @@ namespace msa {
 		
 	}
 
+	namespace metrics {
+
+		typedef struct metrics_context_type MetricsContext;
+		typedef struct plugin_hooks_type PluginHooks;
+
+	}
+
+	namespace trace {
+
+		typedef struct trace_context_type TraceContext;
+		typedef struct plugin_hooks_type PluginHooks;
+
+	}
+
+	typedef struct reload_context_type ReloadContext;
+	typedef struct lifecycle_context_type LifecycleContext;
+
+	// a handle's status only ever moves forward through these, in order
 	enum class Status
 	{
 		CREATED,
@@ -79,7 +101,9 @@ namespace msa {
 
 	struct environment_type
 	{
-		Status status;
+		// only change with set_status() so that waiters are woken
+		std::atomic<Status> status;
+		LifecycleContext *lifecycle;
 		msa::event::EventDispatchContext *event;
 		// timer is not actually a separate module from event, but we give it special status
 		// because it must be able to get its context without relying on the event dispatch
@@ -91,6 +115,10 @@ namespace msa {
 		msa::cmd::CommandContext *cmd;
 		msa::log::LogContext *log;
 		msa::plugin::PluginContext *plugin;
+		msa::metrics::MetricsContext *metrics;
+		msa::trace::TraceContext *trace;
+		// watches the config file; NULL if reloading is turned off
+		ReloadContext *reload;
 	};
 
 	typedef struct environment_type* Handle;
@@ -104,6 +132,8 @@ namespace msa {
 		const msa::cmd::PluginHooks *cmd;
 		const msa::log::PluginHooks *log;
 		const msa::plugin::PluginHooks *plugin;
+		const msa::metrics::PluginHooks *metrics;
+		const msa::trace::PluginHooks *trace;
 	} PluginHooks;
 
 	// global library initializer. Must call before creating handles with start()
@@ -125,6 +155,20 @@ namespace msa {
 	// that handle first.
 	extern int dispose(Handle hdl);
 
+	// changes the status of an instance and wakes everything waiting on it
+	extern void set_status(Handle hdl, Status status);
+
+	// waits until the status of an instance has reached the given one, or gone past it.
+	// timeout is in milliseconds; a negative timeout waits forever. Returns whether the
+	// status was reached.
+	extern bool wait_for_status(Handle hdl, Status status, int timeout);
+
+	// called by the event module around each handler thread. A stop leaves the modules
+	// that handlers may use to the last handler still running, which quits them as it
+	// finishes.
+	extern void handler_started(Handle hdl);
+	extern void handler_finished(Handle hdl);
+
 	// gets the global plugin hooks table
 	extern const PluginHooks *get_plugin_hooks();
 
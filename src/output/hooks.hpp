@@ -19,4 +19,4 @@ MSA_MODULE_HOOK(void, dispose_chunk, Chunk *chunk)
 MSA_MODULE_HOOK(void, create_handler, OutputHandler **handler, const std::string &name, OutputHandlerFunc func)
 MSA_MODULE_HOOK(void, dispose_handler, OutputHandler *handler)
 MSA_MODULE_HOOK(const std::string&, get_handler_name, const OutputHandler *handler)
-
+MSA_MODULE_HOOK(const std::string&, get_chunk_text, const Chunk *chunk)
@@ -1,6 +1,9 @@
 #include "output/output.hpp"
 #include "log/log.hpp"
 #include "util/string.hpp"
+#include "metrics/metrics.hpp"
+#include "trace/trace.hpp"
+#include "memory/memory.hpp"
 
 #include <map>
 #include <stdexcept>
@@ -44,6 +47,12 @@ namespace msa { namespace output {
 		std::string active;
 		bool running;
 		HandlerMap handlers;
+		msa::metrics::Counter *chunks_metric;
+		msa::metrics::Counter *bytes_metric;
+		// the devices as the status source gives them; rebuilt under state_mutex whenever
+		// they change so that the status source only needs the short-held status_mutex
+		msa::thread::Mutex status_mutex;
+		std::string status;
 	};
 
 	struct output_handler_type
@@ -66,6 +75,8 @@ namespace msa { namespace output {
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
 	static void switch_to_next_device(msa::Handle hdl, const std::vector<std::string> &bad_ids);
 	static void switch_device_internal(msa::Handle hdl, const std::string &id);
+	static void publish_status(msa::Handle hdl);
+	static std::string output_status(msa::Handle hdl);
 	static void create_default_handlers(msa::Handle hdl);
 	static void dispose_default_handlers(msa::Handle hdl);
 	static int init_static_resources();
@@ -78,6 +89,9 @@ namespace msa { namespace output {
 			msa::log::error(hdl, "Could not create output context");
 			return -1;
 		}
+		hdl->output->chunks_metric = msa::metrics::get_counter(hdl, "msa_output_chunks_total", "Chunks written to the active output device");
+		hdl->output->bytes_metric = msa::metrics::get_counter(hdl, "msa_output_bytes_total", "Bytes of text written to the active output device");
+		msa::metrics::add_status_source(hdl, "output", output_status);
 		create_default_handlers(hdl);
 		try
 		{
@@ -99,6 +113,7 @@ namespace msa { namespace output {
 
 	extern int quit(msa::Handle hdl)
 	{
+		msa::metrics::remove_status_source(hdl, "output");
 		hdl->output->active = "";
 		dispose_default_handlers(hdl);
 		int status = dispose_output_context(hdl->output);
@@ -120,8 +135,13 @@ namespace msa { namespace output {
 		OutputContext *ctx = hdl->output;
 		if (hdl->status == msa::Status::RUNNING && ctx != NULL && ctx->running)
 		{
+			msa::memory::Scope memory_scope(msa::memory::Tag::OUTPUT);
+			msa::trace::begin(hdl, "output", "write", NULL);
+			MSA_PROBE2(output_write, chunk->text->c_str(), chunk->text->size());
 			msa::thread::mutex_lock(ctx->state_mutex);
 			Device *dev = ctx->devices[ctx->active];
+			msa::metrics::increment(ctx->chunks_metric, 1);
+			msa::metrics::increment(ctx->bytes_metric, chunk->text->size());
 			try
 			{
 				dev->handler->func(hdl, chunk, dev);
@@ -129,14 +149,18 @@ namespace msa { namespace output {
 			catch (...)
 			{
 				msa::thread::mutex_unlock(ctx->state_mutex);
+				msa::trace::end(hdl);
 				throw;
 			}
 			msa::thread::mutex_unlock(ctx->state_mutex);
+			MSA_PROBE1(output_write_done, chunk->text->size());
+			msa::trace::end(hdl);
 		}
 	}
 
 	extern void write_text(msa::Handle hdl, const std::string &text)
 	{
+		msa::memory::Scope memory_scope(msa::memory::Tag::OUTPUT);
 		Chunk *ch;
 		create_chunk(&ch, text);
 		write(hdl, ch);
@@ -166,6 +190,7 @@ namespace msa { namespace output {
 		{
 			switch_device_internal(hdl, id);
 		}
+		publish_status(hdl);
 		msa::thread::mutex_unlock(ctx->state_mutex);
 		msa::log::info(hdl, "Added output device " + id);
 	}
@@ -208,6 +233,7 @@ namespace msa { namespace output {
 		}
 		dispose_device(ctx->devices[id]);
 		ctx->devices.erase(id);
+		publish_status(hdl);
 		msa::thread::mutex_unlock(ctx->state_mutex);
 		msa::log::info(hdl, "Removed output device " + id);
 	}
@@ -250,6 +276,11 @@ namespace msa { namespace output {
 		delete chunk;
 	}
 
+	extern const std::string &get_chunk_text(const Chunk *chunk)
+	{
+		return *chunk->text;
+	}
+
 	extern void create_handler(OutputHandler **handler_ptr, const std::string &name, OutputHandlerFunc func)
 	{
 		OutputHandler *handler = new OutputHandler;
@@ -357,8 +388,12 @@ namespace msa { namespace output {
 		OutputContext *output = new OutputContext;
 		output->running = true;
 		output->active = "";
+		output->chunks_metric = NULL;
+		output->bytes_metric = NULL;
 		output->state_mutex = new msa::thread::Mutex;
 		msa::thread::mutex_init(output->state_mutex, NULL);
+		msa::thread::mutex_init(&output->status_mutex, NULL);
+		output->status = "{\"active\": null, \"devices\": []}";
 		*ctx = output;
 		return 0;
 	}
@@ -377,6 +412,7 @@ namespace msa { namespace output {
 		}
 		msa::thread::mutex_destroy(ctx->state_mutex);
 		delete ctx->state_mutex;
+		msa::thread::mutex_destroy(&ctx->status_mutex);
 		delete ctx;
 		return 0;
 	}
@@ -468,6 +504,37 @@ namespace msa { namespace output {
 		}
 		ctx->active = id;
 		ctx->devices[id]->active = true;
+		publish_status(hdl);
+	}
+
+	// must be called with the state mutex held
+	static void publish_status(msa::Handle hdl)
+	{
+		OutputContext *ctx = hdl->output;
+		std::string text = "{\"active\": " + ((ctx->active != "") ? msa::string::json_quote(ctx->active) : "null") + ", \"devices\": [";
+		std::map<std::string, Device *>::const_iterator iter;
+		for (iter = ctx->devices.begin(); iter != ctx->devices.end(); iter++)
+		{
+			const Device *dev = iter->second;
+			text += (iter != ctx->devices.begin()) ? ", " : "";
+			text += "{\"id\": " + msa::string::json_quote(dev->id);
+			text += ", \"type\": " + msa::string::json_quote(OUTPUT_TYPE_STRS[dev->type]);
+			text += ", \"handler\": " + msa::string::json_quote(dev->handler->name);
+			text += ", \"active\": " + std::string(dev->active ? "true" : "false") + "}";
+		}
+		text += "]}";
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		ctx->status.swap(text);
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+	}
+
+	static std::string output_status(msa::Handle hdl)
+	{
+		OutputContext *ctx = hdl->output;
+		msa::thread::mutex_lock(&ctx->status_mutex);
+		std::string text = ctx->status;
+		msa::thread::mutex_unlock(&ctx->status_mutex);
+		return text;
 	}
 
 	static void print_to_stdout(msa::Handle UNUSED(hdl), const Chunk *ch, Device *dev)
@@ -492,6 +559,8 @@ namespace msa { namespace output {
 	{
 		unregister_handler(hdl, OutputType::TTY, default_stdout_handler);
 		dispose_handler(default_stdout_handler); // TODO: need to move to quit() in init/start/stop/quit model
+		// so that an instance started later in the same process creates it again
+		default_stdout_handler = NULL;
 	}
 
 	static int init_static_resources()
@@ -27,8 +27,9 @@ namespace msa { namespace output {
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
 	extern int quit(msa::Handle hdl);
 	
-	
-	extern void add_device(msa::Handle hdl, OutputType type, void *device_id);
+	// handler_id is the name of a handler registered for the type. The first device added
+	// becomes the active one.
+	extern void add_device(msa::Handle hdl, OutputType type, const std::string &handler_id, void *device_id);
 	extern void remove_device(msa::Handle hdl, const std::string &id);
 	
 	extern void register_handler(msa::Handle hdl, OutputType type, const OutputHandler *handler);
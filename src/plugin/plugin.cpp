@@ -3,12 +3,26 @@
 #include "log/log.hpp"
 #include "agent/agent.hpp"
 #include "util/string.hpp"
+#include "event/dispatch.hpp"
+#include "event/timer.hpp"
+#include "trace/trace.hpp"
+#include "memory/memory.hpp"
 
 #include "platform/file/file.hpp"
 #include "platform/lib/lib.hpp"
+#include "platform/thread/thread.hpp"
 
 #include <map>
 #include <exception>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+// plugins that were compiled into the binary; see STATIC_PLUGINS in the Makefile
+#define MSA_STATIC_PLUGIN(name)		extern "C" const msa::plugin::Info *msa_plugin_register_##name(const msa::PluginHooks *hooks);
+#include "plugin/static_plugins.hpp"
+#undef MSA_STATIC_PLUGIN
 
 namespace msa { namespace plugin {
 
@@ -20,34 +34,196 @@ namespace msa { namespace plugin {
 
 	static const std::string BAD_PLUGIN_ID = "";
 
+	typedef struct static_plugin_type
+	{
+		const char *name;
+		RegisterFunc register_func;
+	} StaticPlugin;
+
+	static const StaticPlugin STATIC_PLUGINS[] = {
+		#define MSA_STATIC_PLUGIN(name)		{#name, msa_plugin_register_##name},
+		#include "plugin/static_plugins.hpp"
+		#undef MSA_STATIC_PLUGIN
+		{NULL, NULL}
+	};
+
+	// how long to wait for running commands to finish before a plugin is closed
+	static const int QUIESCE_TIMEOUT_MILLIS = 2000;
+
+	typedef std::chrono::steady_clock Clock;
+
+	// a library that is being loaded. Opening it and finding its register function can be
+	// done on any thread, but registering it must be done on the thread that owns hdl.
+	typedef struct pending_load_type
+	{
+		std::string path;
+		msa::lib::Library *lib;
+		RegisterFunc register_func;
+		std::string error;
+		Clock::duration open_time;
+		Clock::duration resolve_time;
+	} PendingLoad;
+
+	typedef struct load_job_type
+	{
+		std::vector<PendingLoad> *pending;
+		std::atomic<size_t> next;
+	} LoadJob;
+
+	// what a plugin has used. It is kept by ID so that it carries over reloads.
+	typedef struct usage_type
+	{
+		uint64_t command_calls;
+		uint64_t events_handled;
+		int64_t cpu_nanos;
+		int64_t wall_nanos;
+		uint64_t events_generated;
+		uint64_t timers_created;
+	} Usage;
+
+	// a plugin whose manifest has been read but whose library will not be loaded until one
+	// of its commands is used or an event on one of its topics is dispatched
+	typedef struct deferred_plugin_type
+	{
+		std::string id;
+		std::string path;
+		std::string version;
+		std::vector<msa::cmd::Command *> stubs;
+		std::vector<msa::event::Topic> topics;
+	} DeferredPlugin;
+
 	typedef struct plugin_entry_type
 	{
 		const Info *info;
 		void *local_env;
 		std::string *id;
+		std::string path;
 		msa::lib::Library *lib;
 		std::vector<msa::cmd::Command *> commands;
+
+		// the commands that are actually registered. Each one counts the calls running in
+		// the plugin's code so that the library is never closed out from under them.
+		std::vector<msa::cmd::Command *> proxies;
+		int active_calls;
+		bool quiescing;
+
+		std::vector<Subscription> subscriptions;
+		// the ID as the tracer keeps it, so that calls are not interned each time
+		const char *trace_name;
 	} PluginEntry;
 
 	struct plugin_context_type
 	{
 		std::map<std::string, PluginEntry *> loaded;
 		std::map<std::string, PluginEntry *> enabled;
+		std::map<std::string, DeferredPlugin *> deferred;
+		std::map<std::string, DeferredPlugin *> stub_owners;
+		std::map<std::string, PluginEntry *> command_owners;
+		// plugin handlers for each topic that plugin_topic_handler is subscribed to
+		std::map<msa::event::Topic, std::vector<std::pair<PluginEntry *, msa::event::EventHandler>>> topic_subscribers;
+		// guards command_owners, topic_subscribers, the call counts of entries, and usage
+		msa::thread::Mutex calls_mutex;
+		std::map<std::string, Usage> usage;
+		// for hook calls made when no plugin is known to be running
+		Usage unattributed;
+		// plugins are given these instead of the regular hooks so that their events
+		// and timers can be counted
+		msa::PluginHooks accounted_hooks;
+		msa::event::PluginHooks accounted_event_hooks;
+		int stats_interval;
+		msa::thread::Thread stats_thread;
+		std::atomic<bool> stats_running;
+		// used with calls_mutex to wake the stats thread when it is stopped
+		msa::thread::Cond stats_cond;
+		// used with calls_mutex; broadcast when a plugin's last running call returns
+		msa::thread::Cond calls_done;
 		std::string autoload_dir;
+		int load_threads;
+		bool lazy;
 		std::vector<msa::cmd::Command *> commands;
 	};
 	
+	// the usage and ID of the plugin whose code the current thread is running; timers
+	// that it creates are marked with the ID
+	static thread_local Usage *current_usage = NULL;
+	static thread_local const std::string *current_owner = NULL;
+
+	// charges hook calls made by the current thread to a plugin while in scope
+	class PluginScope
+	{
+		public:
+			PluginScope(msa::Handle hdl, const std::string &id) : hdl(hdl), previous(current_usage), previous_owner(current_owner), memory_scope(msa::memory::Tag::PLUGIN)
+			{
+				PluginContext *ctx = hdl->plugin;
+				const char *trace_name = NULL;
+				msa::thread::mutex_lock(&ctx->calls_mutex);
+				current_usage = &ctx->usage[id];
+				std::map<std::string, PluginEntry *>::const_iterator entry = ctx->loaded.find(id);
+				current_owner = (entry != ctx->loaded.end()) ? entry->second->id : NULL;
+				trace_name = (entry != ctx->loaded.end()) ? entry->second->trace_name : NULL;
+				msa::thread::mutex_unlock(&ctx->calls_mutex);
+				if (msa::trace::is_enabled(hdl))
+				{
+					msa::trace::begin(hdl, "plugin", (trace_name != NULL) ? trace_name : msa::trace::intern(hdl, id), NULL);
+				}
+			}
+
+			~PluginScope()
+			{
+				msa::trace::end(hdl);
+				current_usage = previous;
+				current_owner = previous_owner;
+			}
+
+		private:
+			msa::Handle hdl;
+			Usage *previous;
+			const std::string *previous_owner;
+			msa::memory::Scope memory_scope;
+	};
+
 	static int create_plugin_context(PluginContext **ctx_ptr);
 	static int dispose_plugin_context(PluginContext *ctx);
 	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static void load_static(msa::Handle hdl);
 	static void load_all(msa::Handle hdl, const std::string &dir_path);
+	static void *load_worker(void *args);
+	static void open_library(PendingLoad *pl);
+	static const std::string &register_library(msa::Handle hdl, PendingLoad *pl);
+	static std::string format_millis(Clock::duration dur);
+	static void create_accounted_hooks(PluginContext *ctx);
+	static void charge_hook_call(msa::Handle hdl, bool is_timer);
+	static void accounted_generate(msa::Handle hdl, const msa::event::Topic topic, const msa::event::IArgs &args);
+	static int16_t accounted_schedule(msa::Handle hdl, time_t timestamp, const msa::event::Topic topic, const msa::event::IArgs &args);
+	static int16_t accounted_delay(msa::Handle hdl, std::chrono::milliseconds delay, const msa::event::Topic topic, const msa::event::IArgs &args);
+	static int16_t accounted_add_timer(msa::Handle hdl, std::chrono::milliseconds period, const msa::event::Topic topic, const msa::event::IArgs &args);
+	static void accounted_remove_timer(msa::Handle hdl, int16_t id);
+	static const std::string &timer_owner();
+	static void end_call(msa::Handle hdl, PluginEntry *entry, int64_t cpu_start, Clock::time_point wall_start, bool is_command);
+	static std::string describe_usage(const Usage &usage);
+	static void *stats_start(void *args);
+	static void close_library(msa::lib::Library *lib);
+	static bool read_manifest(msa::Handle hdl, const std::string &manifest_path, const std::string &lib_path);
+	static const std::string &activate_deferred(msa::Handle hdl, const std::string &id, const std::string *state);
+	static void remove_stubs(msa::Handle hdl, DeferredPlugin *dp);
+	static std::vector<std::string> deferred_for_topic(msa::Handle hdl, msa::event::Topic topic);
+	static void enable_entry(msa::Handle hdl, const std::string &id, const std::string *state);
+	static bool quiesce(msa::Handle hdl, PluginEntry *entry);
+	static void end_quiesce(msa::Handle hdl, PluginEntry *entry);
 	static bool call_plugin_add_commands(msa::Handle hdl, PluginEntry *entry);
 	static bool call_plugin_func(msa::Handle hdl, const std::string &id, const std::string &func_name, Func func, void *local_env);
 	static void remove_plugin_commands(msa::Handle hdl, PluginEntry *entry);
+	static bool call_plugin_add_subscriptions(msa::Handle hdl, PluginEntry *entry);
+	static void remove_plugin_subscriptions(msa::Handle hdl, PluginEntry *entry);
+	static void remove_plugin_timers(msa::Handle hdl, PluginEntry *entry);
+	static void plugin_topic_handler(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync);
 	static msa::cmd::Result cmd_enable(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
 	static msa::cmd::Result cmd_disable(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
 	static msa::cmd::Result cmd_list(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
 	static msa::cmd::Result cmd_info(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+	static msa::cmd::Result cmd_deferred(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+	static msa::cmd::Result cmd_proxy(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
+	static msa::cmd::Result cmd_reload(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync);
 
 	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
 	{
@@ -65,6 +241,8 @@ namespace msa { namespace plugin {
 			msa::log::error(hdl, "Could not read config: " + std::string(e.what()));
 			return -1;
 		}
+		// built-in plugins go first so that they win any ID conflicts
+		load_static(hdl);
 		// do autoloading now
 		if (hdl->plugin->autoload_dir != "")
 		{
@@ -80,6 +258,47 @@ namespace msa { namespace plugin {
 		{
 			msa::cmd::register_command(hdl, ctx->commands[i]);
 		}
+		if (ctx->stats_interval > 0)
+		{
+			ctx->stats_running = true;
+			if (msa::thread::create(&ctx->stats_thread, NULL, stats_start, hdl, "plugin-stats") != 0)
+			{
+				ctx->stats_running = false;
+				msa::log::warn(hdl, "Could not start plugin usage dumper");
+			}
+		}
+		std::map<std::string, DeferredPlugin *>::iterator iter = ctx->stub_owners.begin();
+		while (iter != ctx->stub_owners.end())
+		{
+			std::vector<msa::cmd::Command *> &stubs = iter->second->stubs;
+			std::vector<msa::cmd::Command *>::iterator stub = stubs.begin();
+			while ((*stub)->invoke != iter->first)
+			{
+				stub++;
+			}
+			try
+			{
+				msa::cmd::register_command(hdl, *stub);
+				iter++;
+			}
+			catch (const std::exception &e)
+			{
+				msa::log::error(hdl, "Plugin '" + iter->second->id + "' could not add command '" + iter->first + "': " + e.what());
+				delete *stub;
+				stubs.erase(stub);
+				iter = ctx->stub_owners.erase(iter);
+			}
+		}
+		// plugin_topic_handler loads the deferred plugins that listed a topic before it
+		// hands them the event
+		std::map<std::string, DeferredPlugin *>::const_iterator dp;
+		for (dp = ctx->deferred.begin(); dp != ctx->deferred.end(); dp++)
+		{
+			for (size_t i = 0; i < dp->second->topics.size(); i++)
+			{
+				msa::event::subscribe(hdl, dp->second->topics[i], plugin_topic_handler);
+			}
+		}
 		return 0;
 	}
 	
@@ -90,6 +309,29 @@ namespace msa { namespace plugin {
 		{
 			msa::cmd::unregister_command(hdl, ctx->commands[i]);
 		}
+		if (ctx->stats_running)
+		{
+			msa::thread::mutex_lock(&ctx->calls_mutex);
+			ctx->stats_running = false;
+			msa::thread::cond_broadcast(&ctx->stats_cond);
+			msa::thread::mutex_unlock(&ctx->calls_mutex);
+			msa::thread::join(ctx->stats_thread, NULL);
+		}
+		std::map<std::string, DeferredPlugin *>::iterator iter;
+		for (iter = ctx->deferred.begin(); iter != ctx->deferred.end(); iter++)
+		{
+			remove_stubs(hdl, iter->second);
+			for (size_t i = 0; i < iter->second->topics.size(); i++)
+			{
+				msa::thread::mutex_lock(&ctx->calls_mutex);
+				bool subscribed = (ctx->topic_subscribers.find(iter->second->topics[i]) != ctx->topic_subscribers.end());
+				msa::thread::mutex_unlock(&ctx->calls_mutex);
+				if (!subscribed)
+				{
+					msa::event::unsubscribe(hdl, iter->second->topics[i], plugin_topic_handler);
+				}
+			}
+		}
 		return 0;
 	}
 	
@@ -117,58 +359,10 @@ namespace msa { namespace plugin {
 	extern const std::string &load(msa::Handle hdl, const std::string &path)
 	{
 		msa::log::info(hdl, "Loading plugin library " + path);
-		PluginContext *ctx = hdl->plugin;
-		msa::lib::Library *lib = msa::lib::open(path);
-		RegisterFunc register_func = NULL;
-		// check that plugin has a getinfo()
-		try
-		{
-			register_func = msa::lib::get_symbol<RegisterFunc>(lib, "msa_plugin_register");
-		}
-		catch (const msa::lib::library_error &e)
-		{
-			msa::lib::close(lib);
-			msa::log::error(hdl, "Loading library failed - could not find msa_plugin_register symbol");
-			return BAD_PLUGIN_ID;
-		}
-		const msa::plugin::Info *info = NULL;
-		const msa::PluginHooks *hooks = msa::get_plugin_hooks();
-		// check if plugin's register() throws
-		try
-		{
-			info = register_func(hooks);
-		}
-		catch (...)
-		{
-			msa::log::error(hdl, "Plugin's msa_plugin_register() function threw an error");
-			msa::lib::close(lib);
-			return BAD_PLUGIN_ID;
-		}
-		// check that plugin's getinfo() returns a real pointer
-		if (info == NULL)
-		{
-			msa::log::error(hdl, "Plugin's msa_plugin_register() function returned NULL");
-			msa::lib::close(lib);
-			return BAD_PLUGIN_ID;
-		}
-		std::string *plugin_id = new std::string(info->id);
-		// check that we have not already loaded this plugin
-		if (is_loaded(hdl, *plugin_id))
-		{
-			msa::log::warn(hdl, "Plugin ID is already loaded: " + *plugin_id);
-			msa::lib::close(lib);
-			delete plugin_id;
-			return BAD_PLUGIN_ID;
-		}
-		// okay, we finally have a valid info table extracted from plugin. now add an entry
-		PluginEntry *entry = new PluginEntry;
-		entry->info = info;
-		entry->local_env = NULL;
-		entry->id = plugin_id;
-		entry->lib = lib;
-		ctx->loaded[*plugin_id] = entry;
-		msa::log::info(hdl, "Loaded plugin with ID: " + *plugin_id);
-		return *plugin_id;
+		PendingLoad pl;
+		pl.path = path;
+		open_library(&pl);
+		return register_library(hdl, &pl);
 	}
 	
 	extern void unload(msa::Handle hdl, const std::string &id)
@@ -180,14 +374,19 @@ namespace msa { namespace plugin {
 			msa::log::warn(hdl, "No plugin with ID; not unloading: " + id);
 			return;
 		}
+		PluginEntry *entry = ctx->loaded[id];
+		if (!quiesce(hdl, entry))
+		{
+			msa::log::error(hdl, "Plugin '" + id + "' still has commands running; not unloading");
+			return;
+		}
 		if (is_enabled(hdl, id))
 		{
 			disable(hdl, id);
 		}
-		PluginEntry *entry = ctx->loaded[id];
 		try
 		{
-			msa::lib::close(entry->lib);
+			close_library(entry->lib);
 		}
 		catch (const msa::lib::library_error &e)
 		{
@@ -216,8 +415,159 @@ namespace msa { namespace plugin {
 	}
 	
 	extern void enable(msa::Handle hdl, const std::string &id)
+	{
+		enable_entry(hdl, id, NULL);
+	}
+
+	extern void reload(msa::Handle hdl, const std::string &id)
+	{
+		msa::log::info(hdl, "Reloading plugin '" + id + "'");
+		PluginContext *ctx = hdl->plugin;
+		if (!is_loaded(hdl, id))
+		{
+			throw std::logic_error("Plugin not loaded: " + id);
+		}
+		PluginEntry *entry = ctx->loaded[id];
+		if (entry->lib == NULL)
+		{
+			throw std::logic_error("plugin '" + id + "' is built in and cannot be reloaded");
+		}
+		if (!quiesce(hdl, entry))
+		{
+			throw std::runtime_error("plugin '" + id + "' still has commands running");
+		}
+		bool was_enabled = is_enabled(hdl, id);
+		std::string state;
+		bool has_state = false;
+		SaveStateFunc save_func = entry->info->functions->save_state_func;
+		if (was_enabled && save_func != NULL)
+		{
+			int status = 0;
+			try
+			{
+				PluginScope scope(hdl, id);
+				status = save_func(hdl, entry->local_env, state);
+			}
+			catch (...)
+			{
+				status = -1;
+			}
+			if (status != 0)
+			{
+				end_quiesce(hdl, entry);
+				msa::log::error(hdl, "Plugin '" + id + "': save_state_func failed; not reloading");
+				throw std::runtime_error("save_state() failed with code " + std::to_string(status));
+			}
+			has_state = true;
+			msa::log::debug(hdl, "Plugin '" + id + "' saved " + std::to_string(state.size()) + " bytes of state");
+		}
+		// the old library has to be completely closed first, or opening the same path
+		// would only give back the old one
+		std::string path = entry->path;
+		unload(hdl, id);
+		if (is_loaded(hdl, id))
+		{
+			throw std::runtime_error("could not unload old version of plugin '" + id + "'");
+		}
+		PendingLoad pl;
+		pl.path = path;
+		open_library(&pl);
+		const std::string &new_id = register_library(hdl, &pl);
+		if (new_id == BAD_PLUGIN_ID)
+		{
+			throw std::runtime_error("could not load new version of plugin '" + id + "' from " + path);
+		}
+		if (new_id != id)
+		{
+			msa::log::warn(hdl, "Plugin '" + id + "' was reloaded with a new ID '" + new_id + "'");
+		}
+		if (was_enabled)
+		{
+			enable_entry(hdl, new_id, has_state ? &state : NULL);
+		}
+		msa::log::info(hdl, "Reloaded plugin '" + new_id + "'");
+	}
+
+	extern void checkpoint(msa::Handle hdl, msa::checkpoint::Writer &out)
+	{
+		PluginContext *ctx = hdl->plugin;
+		out.put_u32(ctx->enabled.size());
+		std::map<std::string, PluginEntry *>::const_iterator iter;
+		for (iter = ctx->enabled.begin(); iter != ctx->enabled.end(); iter++)
+		{
+			const std::string &id = iter->first;
+			SaveStateFunc save_func = iter->second->info->functions->save_state_func;
+			std::string state;
+			bool has_state = false;
+			if (save_func != NULL)
+			{
+				int status = 0;
+				try
+				{
+					PluginScope scope(hdl, id);
+					status = save_func(hdl, iter->second->local_env, state);
+				}
+				catch (...)
+				{
+					status = -1;
+				}
+				has_state = (status == 0);
+				if (!has_state)
+				{
+					msa::log::warn(hdl, "Plugin '" + id + "': save_state_func failed; it will start fresh after a restart");
+					state.clear();
+				}
+			}
+			out.put_string(id);
+			out.put_bool(has_state);
+			out.put_string(state);
+		}
+	}
+
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in)
+	{
+		PluginContext *ctx = hdl->plugin;
+		uint32_t count = in.get_u32();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::string id = in.get_string();
+			bool has_state = in.get_bool();
+			std::string state = in.get_string();
+			const std::string *state_ptr = has_state ? &state : NULL;
+			if (is_enabled(hdl, id))
+			{
+				continue;
+			}
+			try
+			{
+				if (ctx->deferred.find(id) != ctx->deferred.end())
+				{
+					if (activate_deferred(hdl, id, state_ptr) == BAD_PLUGIN_ID)
+					{
+						msa::log::error(hdl, "Could not load deferred plugin '" + id + "' to restore it");
+					}
+				}
+				else if (is_loaded(hdl, id))
+				{
+					enable_entry(hdl, id, state_ptr);
+				}
+				else
+				{
+					msa::log::warn(hdl, "Plugin '" + id + "' was enabled before the restart but is no longer loaded");
+				}
+			}
+			catch (const std::exception &e)
+			{
+				msa::log::error(hdl, "Could not restore plugin '" + id + "': " + e.what());
+			}
+		}
+	}
+
+	static void enable_entry(msa::Handle hdl, const std::string &id, const std::string *state)
 	{
 		msa::log::info(hdl, "Enabling plugin '" + id + "'");
+		MSA_PROBE2(plugin_enable, id.c_str(), state != NULL);
+		msa::memory::Scope memory_scope(msa::memory::Tag::PLUGIN);
 		PluginContext *ctx = hdl->plugin;
 		if (!is_loaded(hdl, id))
 		{
@@ -229,12 +579,25 @@ namespace msa { namespace plugin {
 		}
 		PluginEntry *entry = ctx->loaded[id];
 		entry->local_env = NULL;
-		if (entry->info->functions->init_func != NULL)
+		if (state != NULL && entry->info->functions->restore_func == NULL)
+		{
+			msa::log::warn(hdl, "Plugin '" + id + "' does not define a restore_func; its saved state is dropped");
+			state = NULL;
+		}
+		if (state != NULL || entry->info->functions->init_func != NULL)
 		{
 			int status = 0;
 			try
 			{
-				status = entry->info->functions->init_func(hdl, &entry->local_env);
+				PluginScope scope(hdl, id);
+				if (state != NULL)
+				{
+					status = entry->info->functions->restore_func(hdl, &entry->local_env, *state);
+				}
+				else
+				{
+					status = entry->info->functions->init_func(hdl, &entry->local_env);
+				}
 			}
 			catch (...)
 			{
@@ -272,6 +635,11 @@ namespace msa { namespace plugin {
 		{
 			throw std::runtime_error("add_commands() failed");
 		}
+		if (!call_plugin_add_subscriptions(hdl, entry))
+		{
+			throw std::runtime_error("add_subscriptions() failed");
+		}
+		MSA_PROBE1(plugin_enabled, id.c_str());
 	}
 	
 	extern void disable(msa::Handle hdl, const std::string &id)
@@ -283,13 +651,20 @@ namespace msa { namespace plugin {
 			return;
 		}
 		PluginEntry *entry = ctx->enabled[id];
+		// nothing of the plugin's may still be running once quit_func frees its env
+		if (!quiesce(hdl, entry))
+		{
+			throw std::runtime_error("plugin '" + id + "' still has commands running");
+		}
 		remove_plugin_commands(hdl, entry);
+		remove_plugin_subscriptions(hdl, entry);
 		ctx->enabled.erase(id);
 		if (entry->info->functions->quit_func != NULL)
 		{
 			int status = 0;
 			try
 			{
+				PluginScope scope(hdl, id);
 				status = entry->info->functions->quit_func(hdl, entry->local_env);
 			}
 			catch (...)
@@ -311,6 +686,8 @@ namespace msa { namespace plugin {
 		{
 			msa::log::info(hdl, "Plugin '" + id + "' does not define a quit_func; skipping calling quit_func");
 		}
+		remove_plugin_timers(hdl, entry);
+		end_quiesce(hdl, entry);
 	}
 	
 	extern bool is_enabled(msa::Handle hdl, const std::string &id)
@@ -336,6 +713,16 @@ namespace msa { namespace plugin {
 			return msa::cmd::Result(1);
 		}
 		std::string plugin_id = params[0];
+		if (hdl->plugin->deferred.find(plugin_id) != hdl->plugin->deferred.end())
+		{
+			if (activate_deferred(hdl, plugin_id, NULL) == BAD_PLUGIN_ID)
+			{
+				msa::agent::say(hdl, "Sorry, $USER_TITLE, but I couldn't load the plugin called '" + plugin_id + "'.");
+				return msa::cmd::Result(4);
+			}
+			msa::agent::say(hdl, "All right, $USER_TITLE! I've now enabled the plugin called '" + plugin_id + "'.");
+			return msa::cmd::Result(0);
+		}
 		if (!is_loaded(hdl, plugin_id))
 		{
 			msa::agent::say(hdl, "Sorry, $USER_TITLE, but I never loaded a plugin called '" + plugin_id + "'.");
@@ -369,16 +756,26 @@ namespace msa { namespace plugin {
 			msa::agent::say(hdl, "Ooh! That plugin is already disabled, $USER_TITLE.");
 			return msa::cmd::Result(3);
 		}
-		disable(hdl, plugin_id);
+		try
+		{
+			disable(hdl, plugin_id);
+		}
+		catch (const std::exception &e)
+		{
+			msa::log::error(hdl, "Could not disable plugin '" + plugin_id + "': " + e.what());
+			msa::agent::say(hdl, "Oh no! I couldn't disable '" + plugin_id + "', $USER_TITLE: " + std::string(e.what()));
+			return msa::cmd::Result(4);
+		}
 		msa::agent::say(hdl, "All right, $USER_TITLE! I've now disabled the plugin called '" + plugin_id + "'.");
 		return msa::cmd::Result(0);
 	}
 	
 	static msa::cmd::Result cmd_list(msa::Handle hdl, const msa::cmd::ParamList & UNUSED(params), msa::event::HandlerSync *const UNUSED(sync))
 	{
+		const std::map<std::string, DeferredPlugin *> &deferred = hdl->plugin->deferred;
 		std::vector<std::string> ids;
 		get_loaded(hdl, ids);
-		if (ids.empty())
+		if (ids.empty() && deferred.empty())
 		{
 			msa::agent::say(hdl, "Hmm, I actually haven't loaded any plugins at all.");
 			return msa::cmd::Result(0);
@@ -389,8 +786,14 @@ namespace msa { namespace plugin {
 			std::string enable_string = is_enabled(hdl, ids[i]) ? "(enabled)" : "(disabled)";
 			msa::agent::say(hdl, "'" + ids[i] + "' " + enable_string);
 		}
-		std::string plural = ids.size() > 1 ? "s" : "";
-		msa::agent::say(hdl, "That's " + std::to_string(ids.size()) + " plugin" + plural + " in total.");
+		std::map<std::string, DeferredPlugin *>::const_iterator iter;
+		for (iter = deferred.begin(); iter != deferred.end(); iter++)
+		{
+			msa::agent::say(hdl, "'" + iter->first + "' (loads when first used)");
+		}
+		size_t total = ids.size() + deferred.size();
+		std::string plural = total > 1 ? "s" : "";
+		msa::agent::say(hdl, "That's " + std::to_string(total) + " plugin" + plural + " in total.");
 		return msa::cmd::Result(0);
 	}
 
@@ -402,6 +805,24 @@ namespace msa { namespace plugin {
 			return msa::cmd::Result(1);
 		}
 		std::string plugin_id = params[0];
+		std::map<std::string, DeferredPlugin *>::const_iterator deferred = hdl->plugin->deferred.find(plugin_id);
+		if (deferred != hdl->plugin->deferred.end())
+		{
+			const DeferredPlugin *dp = deferred->second;
+			std::string invokes;
+			for (size_t i = 0; i < dp->stubs.size(); i++)
+			{
+				invokes += (i > 0 ? ", " : "") + dp->stubs[i]->invoke;
+			}
+			for (size_t i = 0; i < dp->topics.size(); i++)
+			{
+				invokes += (invokes != "" ? ", " : "") + msa::event::topic_str(dp->topics[i]) + " events";
+			}
+			msa::agent::say(hdl, "Ok! Here's what I know about '" + plugin_id + "':");
+			msa::agent::say(hdl, "Version " + dp->version + " from " + dp->path);
+			msa::agent::say(hdl, "I haven't loaded it yet. I will the first time one of these is used: " + invokes);
+			return msa::cmd::Result(0);
+		}
 		if (!is_loaded(hdl, plugin_id))
 		{
 			msa::agent::say(hdl, "Sorry, $USER_TITLE, but I never loaded a plugin called '" + plugin_id + "'.");
@@ -434,82 +855,267 @@ namespace msa { namespace plugin {
 		msa::agent::say(hdl, "add_output_devices():" + std::string((f->add_output_devices_func == NULL) ? " not" : "") + " defined");
 		msa::agent::say(hdl, "add_agent_props():" + std::string((f->add_agent_props_func == NULL) ? " not" : "") + " defined");
 		msa::agent::say(hdl, "add_commands():" + std::string((f->add_commands_func == NULL) ? " not" : "") + " defined");
+		msa::agent::say(hdl, "add_subscriptions():" + std::string((f->add_subscriptions_func == NULL) ? " not" : "") + " defined");
+		msa::agent::say(hdl, "");
+		msa::thread::mutex_lock(&hdl->plugin->calls_mutex);
+		Usage usage = hdl->plugin->usage[plugin_id];
+		msa::thread::mutex_unlock(&hdl->plugin->calls_mutex);
+		msa::agent::say(hdl, "USAGE:");
+		msa::agent::say(hdl, describe_usage(usage));
 		msa::agent::say(hdl, "");
 		msa::agent::say(hdl, "Loaded with ID '" + info->id + "'.");
 		msa::agent::say(hdl, "Plugin is currently " + std::string(is_enabled(hdl, plugin_id) ? "ENABLED" : "DISABLED") + ".");
 		return msa::cmd::Result(0);
 	}
 	
-	static bool call_plugin_func(msa::Handle hdl, const std::string &id, const std::string &func_name, Func func, void *local_env)
+	static msa::cmd::Result cmd_deferred(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync)
 	{
-		if (func != NULL)
+		PluginContext *ctx = hdl->plugin;
+		std::string invoke = params.command();
+		msa::string::to_upper(invoke);
+		std::map<std::string, DeferredPlugin *>::const_iterator owner = ctx->stub_owners.find(invoke);
+		if (owner == ctx->stub_owners.end())
 		{
-			int status = 0;
-			try
-			{
-				status = func(hdl, local_env);
-			}
-			catch (...)
-			{
-				msa::log::error(hdl, "Plugin '" + id + "' " + func_name + " threw an exception; plugin will be unloaded");
-				unload(hdl, id);
-				throw std::runtime_error("plugin unloaded; " + func_name + "() threw an exception");
-				return false;
-			}
-			if (status != 0)
-			{
-				msa::log::error(hdl, "Plugin '" + id + "': " + func_name + " failed");
-				msa::log::debug(hdl, "Plugin '" + id + "': " + func_name + " return code is " + std::to_string(status));
-				return false;
-			}
+			throw std::logic_error("no deferred plugin provides command: " + invoke);
 		}
-		else
+		// the deferred entry is gone once it is activated, so its ID must be copied
+		std::string deferred_id = owner->second->id;
+		const std::string &id = activate_deferred(hdl, deferred_id, NULL);
+		if (id == BAD_PLUGIN_ID)
 		{
-			msa::log::warn(hdl, "Plugin '" + id + "' does not define " + func_name + "; skipping execution");
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, but I couldn't load the plugin for that command.");
+			return msa::cmd::Result(1);
 		}
-		return true;
+		// now hand off to the real command, which has the same options as the stub did
+		if (ctx->command_owners.find(invoke) != ctx->command_owners.end())
+		{
+			return cmd_proxy(hdl, params, sync);
+		}
+		msa::log::warn(hdl, "Plugin '" + id + "' was loaded for command '" + invoke + "', but does not provide it");
+		msa::agent::say(hdl, "Huh, the plugin '" + id + "' doesn't actually have that command, $USER_TITLE.");
+		return msa::cmd::Result(2);
 	}
-	
-	static bool call_plugin_add_commands(msa::Handle hdl, PluginEntry *entry)
+
+	static msa::cmd::Result cmd_proxy(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const sync)
 	{
-		std::vector<msa::cmd::Command *> new_commands;
-		if (entry->info->functions->add_commands_func != NULL)
+		PluginContext *ctx = hdl->plugin;
+		std::string invoke = params.command();
+		msa::string::to_upper(invoke);
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		std::map<std::string, PluginEntry *>::const_iterator owner = ctx->command_owners.find(invoke);
+		if (owner == ctx->command_owners.end() || owner->second->quiescing)
 		{
-			int status = 0;
-			try
-			{
-				status = entry->info->functions->add_commands_func(hdl, entry->local_env, entry->commands);
-			}
-			catch (...)
-			{
-				msa::log::error(hdl, "Plugin '" + *entry->id + "' add_commands_func threw an exception; plugin will be unloaded");
-				unload(hdl, *entry->id);
-				throw std::runtime_error("plugin unloaded; add_commands() threw an exception");
-				return false;
-			}
-			if (status != 0)
+			msa::thread::mutex_unlock(&ctx->calls_mutex);
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, that plugin is being reloaded right now. Try again in a moment!");
+			return msa::cmd::Result(1);
+		}
+		PluginEntry *entry = owner->second;
+		const msa::cmd::Command *target = NULL;
+		for (size_t i = 0; i < entry->commands.size(); i++)
+		{
+			std::string target_invoke = entry->commands[i]->invoke;
+			msa::string::to_upper(target_invoke);
+			if (target_invoke == invoke)
 			{
-				msa::log::error(hdl, "Plugin '" + *entry->id + "': add_commands_func failed");
-				msa::log::debug(hdl, "Plugin '" + *entry->id + "': add_commands_func return code is " + std::to_string(status));
-				return false;
+				target = entry->commands[i];
+				break;
 			}
 		}
+		entry->active_calls++;
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+
+		PluginScope scope(hdl, *entry->id);
+		int64_t cpu_start = 0;
+		msa::thread::get_cpu_time(&cpu_start);
+		Clock::time_point wall_start = Clock::now();
+		msa::cmd::Result result(-1);
+		try
+		{
+			result = target->handler(hdl, params, sync);
+		}
+		catch (...)
+		{
+			end_call(hdl, entry, cpu_start, wall_start, true);
+			throw;
+		}
+		end_call(hdl, entry, cpu_start, wall_start, true);
+		return result;
+	}
+
+	// cpu time is only that of the calling thread, so it does not include any time
+	// that the command spent suspended while other handlers ran
+	static void end_call(msa::Handle hdl, PluginEntry *entry, int64_t cpu_start, Clock::time_point wall_start, bool is_command)
+	{
+		PluginContext *ctx = hdl->plugin;
+		int64_t cpu_end = cpu_start;
+		msa::thread::get_cpu_time(&cpu_end);
+		int64_t wall_nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wall_start).count();
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		Usage &usage = ctx->usage[*entry->id];
+		if (is_command)
+		{
+			usage.command_calls++;
+		}
 		else
 		{
-			msa::log::info(hdl, "Plugin '" + *entry->id + "' does not define add_commands_func; skipping execution");
+			usage.events_handled++;
 		}
-		std::vector<msa::cmd::Command *>::iterator iter = entry->commands.begin();
-		while (iter != entry->commands.end())
+		usage.cpu_nanos += cpu_end - cpu_start;
+		usage.wall_nanos += wall_nanos;
+		entry->active_calls--;
+		if (entry->active_calls == 0)
 		{
+			msa::thread::cond_broadcast(&ctx->calls_done);
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+	}
+
+	static msa::cmd::Result cmd_reload(msa::Handle hdl, const msa::cmd::ParamList &params, msa::event::HandlerSync *const UNUSED(sync))
+	{
+		if (params.arg_count() < 1)
+		{
+			msa::agent::say(hdl, "Well sure, but you gotta tell me which plugin you want.");
+			return msa::cmd::Result(1);
+		}
+		std::string plugin_id = params[0];
+		if (!is_loaded(hdl, plugin_id))
+		{
+			msa::agent::say(hdl, "Sorry, $USER_TITLE, but I never loaded a plugin called '" + plugin_id + "'.");
+			return msa::cmd::Result(2);
+		}
+		try
+		{
+			reload(hdl, plugin_id);
+		}
+		catch (const std::exception &e)
+		{
+			msa::log::error(hdl, "Could not reload plugin '" + plugin_id + "': " + e.what());
+			msa::agent::say(hdl, "Oh no! I couldn't reload '" + plugin_id + "', $USER_TITLE: " + std::string(e.what()));
+			return msa::cmd::Result(3);
+		}
+		msa::agent::say(hdl, "All right, $USER_TITLE! I've reloaded the plugin called '" + plugin_id + "' for you.");
+		return msa::cmd::Result(0);
+	}
+
+	/**
+	 * Stops new calls into a plugin's commands and waits for the ones already running to
+	 * finish. The wait is bounded because a running command may be suspended behind the
+	 * very handler that is waiting on it.
+	 */
+	static bool quiesce(msa::Handle hdl, PluginEntry *entry)
+	{
+		PluginContext *ctx = hdl->plugin;
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		entry->quiescing = true;
+		Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(QUIESCE_TIMEOUT_MILLIS);
+		while (entry->active_calls > 0)
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+			if (remaining <= 0)
+			{
+				break;
+			}
+			msa::thread::cond_timed_wait(&ctx->calls_done, &ctx->calls_mutex, (int) remaining + 1);
+		}
+		bool idle = (entry->active_calls == 0);
+		if (!idle)
+		{
+			entry->quiescing = false;
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+		return idle;
+	}
+
+	static void end_quiesce(msa::Handle hdl, PluginEntry *entry)
+	{
+		PluginContext *ctx = hdl->plugin;
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		entry->quiescing = false;
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+	}
+
+	static bool call_plugin_func(msa::Handle hdl, const std::string &id, const std::string &func_name, Func func, void *local_env)
+	{
+		if (func != NULL)
+		{
+			int status = 0;
+			try
+			{
+				PluginScope scope(hdl, id);
+				status = func(hdl, local_env);
+			}
+			catch (...)
+			{
+				msa::log::error(hdl, "Plugin '" + id + "' " + func_name + " threw an exception; plugin will be unloaded");
+				unload(hdl, id);
+				throw std::runtime_error("plugin unloaded; " + func_name + "() threw an exception");
+				return false;
+			}
+			if (status != 0)
+			{
+				msa::log::error(hdl, "Plugin '" + id + "': " + func_name + " failed");
+				msa::log::debug(hdl, "Plugin '" + id + "': " + func_name + " return code is " + std::to_string(status));
+				return false;
+			}
+		}
+		else
+		{
+			msa::log::warn(hdl, "Plugin '" + id + "' does not define " + func_name + "; skipping execution");
+		}
+		return true;
+	}
+	
+	static bool call_plugin_add_commands(msa::Handle hdl, PluginEntry *entry)
+	{
+		std::vector<msa::cmd::Command *> new_commands;
+		if (entry->info->functions->add_commands_func != NULL)
+		{
+			int status = 0;
+			try
+			{
+				PluginScope scope(hdl, *entry->id);
+				status = entry->info->functions->add_commands_func(hdl, entry->local_env, entry->commands);
+			}
+			catch (...)
+			{
+				msa::log::error(hdl, "Plugin '" + *entry->id + "' add_commands_func threw an exception; plugin will be unloaded");
+				unload(hdl, *entry->id);
+				throw std::runtime_error("plugin unloaded; add_commands() threw an exception");
+				return false;
+			}
+			if (status != 0)
+			{
+				msa::log::error(hdl, "Plugin '" + *entry->id + "': add_commands_func failed");
+				msa::log::debug(hdl, "Plugin '" + *entry->id + "': add_commands_func return code is " + std::to_string(status));
+				return false;
+			}
+		}
+		else
+		{
+			msa::log::info(hdl, "Plugin '" + *entry->id + "' does not define add_commands_func; skipping execution");
+		}
+		PluginContext *ctx = hdl->plugin;
+		std::vector<msa::cmd::Command *>::iterator iter = entry->commands.begin();
+		while (iter != entry->commands.end())
+		{
+			const msa::cmd::Command *target = *iter;
+			msa::cmd::Command *proxy = new msa::cmd::Command(target->invoke, target->desc, target->usage, target->options, cmd_proxy);
 			try
 			{
-				msa::cmd::register_command(hdl, *iter);
+				msa::cmd::register_command(hdl, proxy);
+				std::string invoke = target->invoke;
+				msa::string::to_upper(invoke);
+				msa::thread::mutex_lock(&ctx->calls_mutex);
+				ctx->command_owners[invoke] = entry;
+				msa::thread::mutex_unlock(&ctx->calls_mutex);
+				entry->proxies.push_back(proxy);
 				iter++;
 			}
 			catch (const std::exception &e)
 			{
 				std::string err = std::string(e.what());
 				msa::log::error(hdl, "Plugin '" + *entry->id + "' could not add command '" + (*iter)->invoke + "': " + err);
+				delete proxy;
 				iter = entry->commands.erase(iter);
 			}
 		}
@@ -518,30 +1124,212 @@ namespace msa { namespace plugin {
 
 	static void remove_plugin_commands(msa::Handle hdl, PluginEntry *entry)
 	{
-		for (size_t i = 0; i < entry->commands.size(); i++)
+		PluginContext *ctx = hdl->plugin;
+		for (size_t i = 0; i < entry->proxies.size(); i++)
+		{
+			msa::cmd::unregister_command(hdl, entry->proxies[i]);
+			std::string invoke = entry->proxies[i]->invoke;
+			msa::string::to_upper(invoke);
+			msa::thread::mutex_lock(&ctx->calls_mutex);
+			ctx->command_owners.erase(invoke);
+			msa::thread::mutex_unlock(&ctx->calls_mutex);
+			delete entry->proxies[i];
+		}
+		entry->proxies.clear();
+		entry->commands.clear();
+	}
+
+	static bool call_plugin_add_subscriptions(msa::Handle hdl, PluginEntry *entry)
+	{
+		if (entry->info->functions->add_subscriptions_func == NULL)
+		{
+			msa::log::info(hdl, "Plugin '" + *entry->id + "' does not define add_subscriptions_func; skipping execution");
+			return true;
+		}
+		int status = 0;
+		try
+		{
+			PluginScope scope(hdl, *entry->id);
+			status = entry->info->functions->add_subscriptions_func(hdl, entry->local_env, entry->subscriptions);
+		}
+		catch (...)
+		{
+			msa::log::error(hdl, "Plugin '" + *entry->id + "' add_subscriptions_func threw an exception; plugin will be unloaded");
+			unload(hdl, *entry->id);
+			throw std::runtime_error("plugin unloaded; add_subscriptions() threw an exception");
+		}
+		if (status != 0)
+		{
+			msa::log::error(hdl, "Plugin '" + *entry->id + "': add_subscriptions_func failed");
+			msa::log::debug(hdl, "Plugin '" + *entry->id + "': add_subscriptions_func return code is " + std::to_string(status));
+			return false;
+		}
+		PluginContext *ctx = hdl->plugin;
+		for (size_t i = 0; i < entry->subscriptions.size(); i++)
 		{
-			msa::cmd::unregister_command(hdl, entry->commands[i]);
+			const Subscription &sub = entry->subscriptions[i];
+			if (sub.handler == NULL)
+			{
+				continue;
+			}
+			msa::thread::mutex_lock(&ctx->calls_mutex);
+			std::vector<std::pair<PluginEntry *, msa::event::EventHandler>> &subs = ctx->topic_subscribers[sub.topic];
+			bool first = subs.empty();
+			subs.push_back(std::make_pair(entry, sub.handler));
+			msa::thread::mutex_unlock(&ctx->calls_mutex);
+			if (first)
+			{
+				msa::event::subscribe(hdl, sub.topic, plugin_topic_handler);
+			}
+			msa::log::debug(hdl, "Plugin '" + *entry->id + "' subscribed to " + msa::event::topic_str(sub.topic) + " events");
 		}
+		return true;
+	}
+
+	static void remove_plugin_subscriptions(msa::Handle hdl, PluginEntry *entry)
+	{
+		PluginContext *ctx = hdl->plugin;
+		std::vector<msa::event::Topic> emptied;
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		auto topic_iter = ctx->topic_subscribers.begin();
+		while (topic_iter != ctx->topic_subscribers.end())
+		{
+			std::vector<std::pair<PluginEntry *, msa::event::EventHandler>> &subs = topic_iter->second;
+			auto iter = subs.begin();
+			while (iter != subs.end())
+			{
+				iter = (iter->first == entry) ? subs.erase(iter) : iter + 1;
+			}
+			if (subs.empty())
+			{
+				emptied.push_back(topic_iter->first);
+				topic_iter = ctx->topic_subscribers.erase(topic_iter);
+			}
+			else
+			{
+				topic_iter++;
+			}
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+		for (size_t i = 0; i < emptied.size(); i++)
+		{
+			// still needed to load the deferred plugins that listed the topic
+			if (deferred_for_topic(hdl, emptied[i]).empty())
+			{
+				msa::event::unsubscribe(hdl, emptied[i], plugin_topic_handler);
+			}
+		}
+		entry->subscriptions.clear();
+	}
+
+	// timers are found by their owner rather than by ID, since the ID of a one-shot
+	// timer that already fired may have been handed on to some other timer
+	static void remove_plugin_timers(msa::Handle hdl, PluginEntry *entry)
+	{
+		size_t removed = msa::event::remove_owned_timers(hdl, *entry->id);
+		if (removed > 0)
+		{
+			msa::log::debug(hdl, "Removed " + std::to_string(removed) + " timer(s) owned by plugin '" + *entry->id + "'");
+		}
+	}
+
+	/**
+	 * Subscribed to every topic that some plugin wants, and calls each of their handlers
+	 * in turn. The calls are counted like command calls so that a plugin is never closed
+	 * while one of its handlers is running.
+	 */
+	static void plugin_topic_handler(msa::Handle hdl, const msa::event::Event *const e, msa::event::HandlerSync *const sync)
+	{
+		PluginContext *ctx = hdl->plugin;
+		std::vector<std::string> waiting = deferred_for_topic(hdl, e->topic);
+		for (size_t i = 0; i < waiting.size(); i++)
+		{
+			if (activate_deferred(hdl, waiting[i], NULL) == BAD_PLUGIN_ID)
+			{
+				msa::log::error(hdl, "Could not load deferred plugin '" + waiting[i] + "' for a " + msa::event::topic_str(e->topic) + " event");
+			}
+		}
+		std::vector<std::pair<PluginEntry *, msa::event::EventHandler>> subs;
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		auto topic_iter = ctx->topic_subscribers.find(e->topic);
+		if (topic_iter != ctx->topic_subscribers.end())
+		{
+			for (size_t i = 0; i < topic_iter->second.size(); i++)
+			{
+				PluginEntry *entry = topic_iter->second[i].first;
+				if (!entry->quiescing)
+				{
+					entry->active_calls++;
+					subs.push_back(topic_iter->second[i]);
+				}
+			}
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+
+		for (size_t i = 0; i < subs.size(); i++)
+		{
+			PluginEntry *entry = subs[i].first;
+			PluginScope scope(hdl, *entry->id);
+			int64_t cpu_start = 0;
+			msa::thread::get_cpu_time(&cpu_start);
+			Clock::time_point wall_start = Clock::now();
+			try
+			{
+				subs[i].second(hdl, e, sync);
+			}
+			catch (const std::exception &ex)
+			{
+				msa::log::error(hdl, "Plugin '" + *entry->id + "' " + msa::event::topic_str(e->topic) + " handler threw an exception: " + ex.what());
+			}
+			catch (...)
+			{
+				msa::log::error(hdl, "Plugin '" + *entry->id + "' " + msa::event::topic_str(e->topic) + " handler threw an exception");
+			}
+			end_call(hdl, entry, cpu_start, wall_start, false);
+		}
+		delete e->args;
 	}
 	
 	static int create_plugin_context(PluginContext **ctx_ptr)
 	{
 		PluginContext *ctx = new PluginContext;
 		ctx->autoload_dir = "";
+		ctx->load_threads = 1;
+		ctx->lazy = false;
+		ctx->unattributed = Usage();
+		ctx->stats_interval = 0;
+		ctx->stats_running = false;
+		create_accounted_hooks(ctx);
 		ctx->commands.push_back(new msa::cmd::Command("PLUGINENABLE", "It turns on a plugin", "plugin-id", cmd_enable));
 		ctx->commands.push_back(new msa::cmd::Command("PLUGINDISABLE", "It turns off a plugin", "plugin-id", cmd_disable));
 		ctx->commands.push_back(new msa::cmd::Command("PLUGINLIST", "It lists all of the plugins", "", cmd_list));
 		ctx->commands.push_back(new msa::cmd::Command("PLUGININFO", "It gives information on a plugin", "plugin-id", cmd_info));
+		ctx->commands.push_back(new msa::cmd::Command("PLUGINRELOAD", "It loads a new copy of a plugin and passes its state along", "plugin-id", cmd_reload));
+		msa::thread::mutex_init(&ctx->calls_mutex, NULL);
+		msa::thread::cond_init(&ctx->stats_cond, NULL);
+		msa::thread::cond_init(&ctx->calls_done, NULL);
 		*ctx_ptr = ctx;
 		return 0;
 	}
 	
 	static int dispose_plugin_context(PluginContext *ctx)
 	{
+		msa::thread::mutex_destroy(&ctx->calls_mutex);
+		msa::thread::cond_destroy(&ctx->stats_cond);
+		msa::thread::cond_destroy(&ctx->calls_done);
 		for (size_t i = 0; i < ctx->commands.size(); i++)
 		{
 			delete ctx->commands[i];
 		}
+		std::map<std::string, DeferredPlugin *>::iterator iter;
+		for (iter = ctx->deferred.begin(); iter != ctx->deferred.end(); iter++)
+		{
+			for (size_t i = 0; i < iter->second->stubs.size(); i++)
+			{
+				delete iter->second->stubs[i];
+			}
+			delete iter->second;
+		}
 		delete ctx;
 		return 0;
 	}
@@ -556,22 +1344,489 @@ namespace msa { namespace plugin {
 		{
 			hdl->plugin->autoload_dir = config["DIR"];
 		}
+		config.check_range("LOAD_THREADS", 1, 64, false);
+		hdl->plugin->load_threads = config.get_or("LOAD_THREADS", 4);
+		hdl->plugin->lazy = config.get_or("LAZY", false);
+		config.check_range("STATS_INTERVAL", 0, 86400, false);
+		hdl->plugin->stats_interval = config.get_or("STATS_INTERVAL", 0);
 	}
 
+	static void load_static(msa::Handle hdl)
+	{
+		for (const StaticPlugin *sp = STATIC_PLUGINS; sp->name != NULL; sp++)
+		{
+			msa::log::info(hdl, "Registering built-in plugin " + std::string(sp->name));
+			PendingLoad pl;
+			pl.path = "";
+			pl.lib = NULL;
+			pl.register_func = sp->register_func;
+			pl.open_time = Clock::duration::zero();
+			pl.resolve_time = Clock::duration::zero();
+			register_library(hdl, &pl);
+		}
+	}
+
+	/**
+	 * Opens all of the libraries in parallel, as that is where most of the time goes, and
+	 * then registers them one at a time in order of their filenames so that which plugin
+	 * wins an ID conflict is always the same.
+	 */
 	static void load_all(msa::Handle hdl, const std::string &dir_path)
 	{
+		Clock::time_point start = Clock::now();
 		std::vector<std::string> filenames;
 		msa::file::list(dir_path, filenames);
+		std::sort(filenames.begin(), filenames.end());
+		std::vector<PendingLoad> pending;
 		for (size_t i = 0; i < filenames.size(); i++)
 		{
 			std::string fname = filenames[i];
 			if (msa::string::ends_with(fname, ".so") || msa::string::ends_with(fname, ".dll"))
 			{
-				std::string full_path = dir_path;
-				msa::file::join(full_path, fname);
-				load(hdl, full_path);
+				PendingLoad pl;
+				pl.path = dir_path;
+				msa::file::join(pl.path, fname);
+				if (hdl->plugin->lazy)
+				{
+					std::string manifest = fname.substr(0, fname.rfind('.')) + ".manifest";
+					std::string manifest_path = dir_path;
+					msa::file::join(manifest_path, manifest);
+					if (std::binary_search(filenames.begin(), filenames.end(), manifest) && read_manifest(hdl, manifest_path, pl.path))
+					{
+						continue;
+					}
+				}
+				pending.push_back(pl);
 			}
 		}
+		if (pending.empty())
+		{
+			return;
+		}
+
+		LoadJob job;
+		job.pending = &pending;
+		job.next = 0;
+		// the calling thread takes a share of the libraries as well
+		size_t worker_count = std::min(pending.size(), (size_t) hdl->plugin->load_threads) - 1;
+		std::vector<msa::thread::Thread> workers;
+		for (size_t i = 0; i < worker_count; i++)
+		{
+			msa::thread::Thread t;
+			if (msa::thread::create(&t, NULL, load_worker, &job, "plugin-load") == 0)
+			{
+				workers.push_back(t);
+			}
+		}
+		load_worker(&job);
+		for (size_t i = 0; i < workers.size(); i++)
+		{
+			msa::thread::join(workers[i], NULL);
+		}
+
+		size_t loaded_count = 0;
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			msa::log::info(hdl, "Loading plugin library " + pending[i].path);
+			if (register_library(hdl, &pending[i]) != BAD_PLUGIN_ID)
+			{
+				loaded_count++;
+			}
+		}
+		std::string total = format_millis(Clock::now() - start);
+		msa::log::info(hdl, "Loaded " + std::to_string(loaded_count) + " of " + std::to_string(pending.size()) + " plugin libraries in " + total + " using " + std::to_string(workers.size() + 1) + " thread(s)");
+	}
+
+	static void *load_worker(void *args)
+	{
+		LoadJob *job = (LoadJob *) args;
+		size_t idx;
+		while ((idx = job->next++) < job->pending->size())
+		{
+			open_library(&(*job->pending)[idx]);
+		}
+		return NULL;
+	}
+
+	// does not log, as it may be run on a worker; problems are put in pl->error
+	static void open_library(PendingLoad *pl)
+	{
+		pl->lib = NULL;
+		pl->register_func = NULL;
+		pl->open_time = Clock::duration::zero();
+		pl->resolve_time = Clock::duration::zero();
+		Clock::time_point start = Clock::now();
+		try
+		{
+			pl->lib = msa::lib::open(pl->path);
+		}
+		catch (const msa::lib::library_error &e)
+		{
+			pl->error = "Loading library failed - could not open " + e.name();
+			return;
+		}
+		Clock::time_point opened = Clock::now();
+		pl->open_time = opened - start;
+		try
+		{
+			pl->register_func = msa::lib::get_symbol<RegisterFunc>(pl->lib, "msa_plugin_register");
+		}
+		catch (const msa::lib::library_error &e)
+		{
+			msa::lib::close(pl->lib);
+			pl->lib = NULL;
+			pl->error = "Loading library failed - could not find msa_plugin_register symbol";
+		}
+		pl->resolve_time = Clock::now() - opened;
+	}
+
+	static const std::string &register_library(msa::Handle hdl, PendingLoad *pl)
+	{
+		if (pl->register_func == NULL)
+		{
+			msa::log::error(hdl, pl->error);
+			return BAD_PLUGIN_ID;
+		}
+		PluginContext *ctx = hdl->plugin;
+		msa::lib::Library *lib = pl->lib;
+		Clock::time_point start = Clock::now();
+		const msa::plugin::Info *info = NULL;
+		const msa::PluginHooks *hooks = &ctx->accounted_hooks;
+		// check if plugin's register() throws
+		try
+		{
+			info = pl->register_func(hooks);
+		}
+		catch (...)
+		{
+			msa::log::error(hdl, "Plugin's msa_plugin_register() function threw an error");
+			close_library(lib);
+			return BAD_PLUGIN_ID;
+		}
+		// check that plugin's getinfo() returns a real pointer
+		if (info == NULL)
+		{
+			msa::log::error(hdl, "Plugin's msa_plugin_register() function returned NULL");
+			close_library(lib);
+			return BAD_PLUGIN_ID;
+		}
+		// the rest of its info cannot be trusted unless it was built against the same tables
+		if (info->abi_version != msa::plugin::ABI_VERSION)
+		{
+			msa::log::error(hdl, "Plugin library " + pl->path + " was built for plugin ABI version " + std::to_string(info->abi_version) + ", but this is version " + std::to_string(msa::plugin::ABI_VERSION) + "; rebuild it against these headers");
+			close_library(lib);
+			return BAD_PLUGIN_ID;
+		}
+		std::string *plugin_id = new std::string(info->id);
+		// check that we have not already loaded this plugin
+		if (is_loaded(hdl, *plugin_id))
+		{
+			msa::log::warn(hdl, "Plugin ID is already loaded: " + *plugin_id);
+			close_library(lib);
+			delete plugin_id;
+			return BAD_PLUGIN_ID;
+		}
+		// okay, we finally have a valid info table extracted from plugin. now add an entry
+		PluginEntry *entry = new PluginEntry;
+		entry->info = info;
+		entry->local_env = NULL;
+		entry->id = plugin_id;
+		entry->path = pl->path;
+		entry->lib = lib;
+		entry->active_calls = 0;
+		entry->quiescing = false;
+		entry->trace_name = msa::trace::intern(hdl, *plugin_id);
+		ctx->loaded[*plugin_id] = entry;
+		std::string timing = "open " + format_millis(pl->open_time);
+		timing += ", resolve " + format_millis(pl->resolve_time);
+		timing += ", register " + format_millis(Clock::now() - start);
+		msa::log::info(hdl, "Loaded plugin with ID: " + *plugin_id + " (" + timing + ")");
+		return *plugin_id;
+	}
+
+	/**
+	 * Reads the manifest of a library and defers loading it. The manifest is a config file
+	 * with the plugin's ID and version, one command key for each command that the plugin
+	 * adds, with the command's options after its name if it has any, and one topic key for
+	 * each topic that the plugin subscribes to:
+	 *
+	 *   id = example
+	 *   version = v1.0.0
+	 *   command = LOVE
+	 *   command = "HATE ab:"
+	 *   topic = PLUGIN
+	 *
+	 * Returns false if the library should be loaded right away instead.
+	 */
+	static bool read_manifest(msa::Handle hdl, const std::string &manifest_path, const std::string &lib_path)
+	{
+		PluginContext *ctx = hdl->plugin;
+		msa::cfg::Config *manifest = msa::cfg::load(manifest_path.c_str());
+		if (manifest == NULL || manifest->find("") == manifest->end())
+		{
+			msa::log::warn(hdl, "Could not read plugin manifest " + manifest_path + "; loading library now");
+			delete manifest;
+			return false;
+		}
+		const msa::cfg::Section &sec = (*manifest)[""];
+		if (!sec.has("ID") || (!sec.has("COMMAND") && !sec.has("TOPIC")))
+		{
+			msa::log::warn(hdl, "Plugin manifest " + manifest_path + " needs an id and at least one command or topic; loading library now");
+			delete manifest;
+			return false;
+		}
+		DeferredPlugin *dp = new DeferredPlugin;
+		dp->id = sec["ID"];
+		dp->path = lib_path;
+		dp->version = sec.get_or<std::string>("VERSION", "(unknown)");
+		if (ctx->deferred.find(dp->id) != ctx->deferred.end())
+		{
+			msa::log::warn(hdl, "Plugin ID is already deferred: " + dp->id);
+			delete manifest;
+			delete dp;
+			return true;
+		}
+		// a topic that cannot be read would never load the plugin for its events
+		std::vector<std::string> topics;
+		if (sec.has("TOPIC"))
+		{
+			topics = sec.get_all("TOPIC");
+		}
+		for (size_t i = 0; i < topics.size(); i++)
+		{
+			std::string name = topics[i];
+			msa::string::to_upper(name);
+			msa::event::Topic topic;
+			if (!msa::event::parse_topic(name, &topic))
+			{
+				msa::log::warn(hdl, "Plugin manifest " + manifest_path + " lists unknown topic '" + topics[i] + "'; loading library now");
+				delete manifest;
+				delete dp;
+				return false;
+			}
+			dp->topics.push_back(topic);
+		}
+		std::vector<std::string> commands;
+		if (sec.has("COMMAND"))
+		{
+			commands = sec.get_all("COMMAND");
+		}
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			std::vector<std::string> parts;
+			msa::string::tokenize(commands[i], ' ', parts);
+			if (parts.empty())
+			{
+				continue;
+			}
+			std::string invoke = parts[0];
+			msa::string::to_upper(invoke);
+			std::string options = parts.size() > 1 ? parts[1] : "";
+			if (ctx->stub_owners.find(invoke) != ctx->stub_owners.end())
+			{
+				msa::log::warn(hdl, "Plugin '" + dp->id + "' lists command '" + invoke + "' that another plugin already has");
+				continue;
+			}
+			msa::cmd::Command *stub = new msa::cmd::Command(invoke, "It is from plugin '" + dp->id + "', which is loaded when first used", "", options, cmd_deferred);
+			dp->stubs.push_back(stub);
+			ctx->stub_owners[invoke] = dp;
+		}
+		delete manifest;
+		ctx->deferred[dp->id] = dp;
+		msa::log::info(hdl, "Deferred loading plugin '" + dp->id + "' " + dp->version + " until first use");
+		return true;
+	}
+
+	// loads and enables a deferred plugin; returns the ID it was actually loaded with
+	static const std::string &activate_deferred(msa::Handle hdl, const std::string &id, const std::string *state)
+	{
+		PluginContext *ctx = hdl->plugin;
+		DeferredPlugin *dp = ctx->deferred[id];
+		ctx->deferred.erase(id);
+		// the stubs have to go before the real commands can be added
+		remove_stubs(hdl, dp);
+		for (size_t i = 0; i < dp->stubs.size(); i++)
+		{
+			delete dp->stubs[i];
+		}
+		msa::log::info(hdl, "Activating deferred plugin '" + dp->id + "' on first use");
+		PendingLoad pl;
+		pl.path = dp->path;
+		std::string expected_id = dp->id;
+		delete dp;
+		open_library(&pl);
+		const std::string &loaded_id = register_library(hdl, &pl);
+		if (loaded_id == BAD_PLUGIN_ID)
+		{
+			return BAD_PLUGIN_ID;
+		}
+		if (loaded_id != expected_id)
+		{
+			msa::log::warn(hdl, "Plugin manifest said ID '" + expected_id + "', but the library registered '" + loaded_id + "'");
+		}
+		enable_entry(hdl, loaded_id, state);
+		return loaded_id;
+	}
+
+	static std::vector<std::string> deferred_for_topic(msa::Handle hdl, msa::event::Topic topic)
+	{
+		std::vector<std::string> ids;
+		std::map<std::string, DeferredPlugin *>::const_iterator iter;
+		for (iter = hdl->plugin->deferred.begin(); iter != hdl->plugin->deferred.end(); iter++)
+		{
+			const std::vector<msa::event::Topic> &topics = iter->second->topics;
+			if (std::find(topics.begin(), topics.end(), topic) != topics.end())
+			{
+				ids.push_back(iter->first);
+			}
+		}
+		return ids;
+	}
+
+	static void remove_stubs(msa::Handle hdl, DeferredPlugin *dp)
+	{
+		PluginContext *ctx = hdl->plugin;
+		for (size_t i = 0; i < dp->stubs.size(); i++)
+		{
+			std::map<std::string, DeferredPlugin *>::iterator owner = ctx->stub_owners.find(dp->stubs[i]->invoke);
+			if (owner == ctx->stub_owners.end() || owner->second != dp)
+			{
+				continue;
+			}
+			ctx->stub_owners.erase(owner);
+			msa::cmd::unregister_command(hdl, dp->stubs[i]);
+		}
+	}
+
+	static void create_accounted_hooks(PluginContext *ctx)
+	{
+		ctx->accounted_event_hooks = *msa::event::get_plugin_hooks();
+		ctx->accounted_event_hooks.generate = accounted_generate;
+		ctx->accounted_event_hooks.timer.schedule = accounted_schedule;
+		ctx->accounted_event_hooks.timer.delay = accounted_delay;
+		ctx->accounted_event_hooks.timer.add_timer = accounted_add_timer;
+		ctx->accounted_event_hooks.timer.remove_timer = accounted_remove_timer;
+		ctx->accounted_hooks = *msa::get_plugin_hooks();
+		ctx->accounted_hooks.event = &ctx->accounted_event_hooks;
+	}
+
+	static void charge_hook_call(msa::Handle hdl, bool is_timer)
+	{
+		PluginContext *ctx = hdl->plugin;
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		Usage *usage = (current_usage != NULL) ? current_usage : &ctx->unattributed;
+		if (is_timer)
+		{
+			usage->timers_created++;
+		}
+		else
+		{
+			usage->events_generated++;
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+	}
+
+	static void accounted_generate(msa::Handle hdl, const msa::event::Topic topic, const msa::event::IArgs &args)
+	{
+		charge_hook_call(hdl, false);
+		msa::event::generate(hdl, topic, args);
+	}
+
+	static int16_t accounted_schedule(msa::Handle hdl, time_t timestamp, const msa::event::Topic topic, const msa::event::IArgs &args)
+	{
+		charge_hook_call(hdl, true);
+		return msa::event::owned_schedule(hdl, timer_owner(), timestamp, topic, args);
+	}
+
+	static int16_t accounted_delay(msa::Handle hdl, std::chrono::milliseconds delay, const msa::event::Topic topic, const msa::event::IArgs &args)
+	{
+		charge_hook_call(hdl, true);
+		return msa::event::owned_delay(hdl, timer_owner(), delay, topic, args);
+	}
+
+	static int16_t accounted_add_timer(msa::Handle hdl, std::chrono::milliseconds period, const msa::event::Topic topic, const msa::event::IArgs &args)
+	{
+		charge_hook_call(hdl, true);
+		return msa::event::owned_add_timer(hdl, timer_owner(), period, topic, args);
+	}
+
+	// a plugin's own timers are removed directly, so that one which already fired is not
+	// an error
+	static void accounted_remove_timer(msa::Handle hdl, int16_t id)
+	{
+		if (current_owner == NULL || !msa::event::remove_owned_timer(hdl, *current_owner, id))
+		{
+			msa::event::remove_timer(hdl, id);
+		}
+	}
+
+	// the ID of the plugin that is running, if any, to mark the timers it creates with
+	static const std::string &timer_owner()
+	{
+		static const std::string none = "";
+		return (current_owner != NULL) ? *current_owner : none;
+	}
+
+	static std::string describe_usage(const Usage &usage)
+	{
+		std::string desc = std::to_string(usage.command_calls) + " command calls";
+		desc += ", " + std::to_string(usage.events_handled) + " events handled";
+		desc += ", " + format_millis(std::chrono::nanoseconds(usage.cpu_nanos)) + " CPU";
+		desc += ", " + format_millis(std::chrono::nanoseconds(usage.wall_nanos)) + " wall";
+		desc += ", " + std::to_string(usage.events_generated) + " events";
+		desc += ", " + std::to_string(usage.timers_created) + " timers";
+		return desc;
+	}
+
+	static void *stats_start(void *args)
+	{
+		msa::Handle hdl = (msa::Handle) args;
+		PluginContext *ctx = hdl->plugin;
+		Clock::time_point next_report = Clock::now() + std::chrono::seconds(ctx->stats_interval);
+		msa::thread::mutex_lock(&ctx->calls_mutex);
+		while (ctx->stats_running)
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(next_report - Clock::now()).count();
+			if (remaining > 0)
+			{
+				// woken early by teardown
+				msa::thread::cond_timed_wait(&ctx->stats_cond, &ctx->calls_mutex, (int) remaining + 1);
+				continue;
+			}
+			next_report += std::chrono::seconds(ctx->stats_interval);
+			std::map<std::string, Usage> usage = ctx->usage;
+			Usage unattributed = ctx->unattributed;
+			msa::thread::mutex_unlock(&ctx->calls_mutex);
+			std::map<std::string, Usage>::const_iterator iter;
+			for (iter = usage.begin(); iter != usage.end(); iter++)
+			{
+				msa::log::info(hdl, "Plugin '" + iter->first + "' usage: " + describe_usage(iter->second));
+			}
+			if (unattributed.events_generated > 0 || unattributed.timers_created > 0)
+			{
+				msa::log::info(hdl, "Unattributed plugin usage: " + describe_usage(unattributed));
+			}
+			msa::thread::mutex_lock(&ctx->calls_mutex);
+		}
+		msa::thread::mutex_unlock(&ctx->calls_mutex);
+		return NULL;
+	}
+
+	// built-in plugins have no library to close
+	static void close_library(msa::lib::Library *lib)
+	{
+		if (lib != NULL)
+		{
+			msa::lib::close(lib);
+		}
+	}
+
+	static std::string format_millis(Clock::duration dur)
+	{
+		double millis = std::chrono::duration<double, std::milli>(dur).count();
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.3f ms", millis);
+		return std::string(buf);
 	}
 
 } }
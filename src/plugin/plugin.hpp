@@ -4,6 +4,7 @@
 #include "msa.hpp"
 #include "cmd/cmd.hpp"
 #include "cfg/cfg.hpp"
+#include "checkpoint/checkpoint.hpp"
 
 #include <string>
 #include <cstdint>
@@ -26,10 +27,26 @@ namespace msa { namespace plugin {
 
 	typedef struct info_type Info;
 
+	// the version of Info, FunctionTable, and the hook tables that a plugin was built
+	// against. Raise it whenever any of them change; plugins built against any other
+	// version are not loaded.
+	static const uint32_t ABI_VERSION = 2;
+
+	// a handler that a plugin wants called for every event of a topic. Unlike the handlers
+	// given to event::subscribe(), the event and its args stay owned by the plugin module.
+	typedef struct subscription_type
+	{
+		msa::event::Topic topic;
+		msa::event::EventHandler handler;
+	} Subscription;
+
 	typedef const Info *(*RegisterFunc)(const msa::PluginHooks *hooks);
 	typedef int (*Func)(msa::Handle hdl, void *plugin_env);
 	typedef int (*AddCommandsFunc)(msa::Handle hdl, void *plugin_env, std::vector<msa::cmd::Command *> &new_commands);
 	typedef int (*InitFunc)(msa::Handle hdl, void **plugin_env);
+	typedef int (*SaveStateFunc)(msa::Handle hdl, void *plugin_env, std::string &state);
+	typedef int (*RestoreFunc)(msa::Handle hdl, void **plugin_env, const std::string &state);
+	typedef int (*AddSubscriptionsFunc)(msa::Handle hdl, void *plugin_env, std::vector<Subscription> &new_subscriptions);
 	
 	typedef struct version_type
 	{
@@ -93,16 +110,30 @@ namespace msa { namespace plugin {
 		Func add_output_devices_func;
 		Func add_agent_props_func;
 		AddCommandsFunc add_commands_func;
+
+		// these are only used when a plugin is reloaded. save_state_func is called on the
+		// old version just before its quit_func, and whatever it saves is given to the
+		// restore_func of the new version, which is then called instead of init_func.
+		SaveStateFunc save_state_func;
+		RestoreFunc restore_func;
+
+		// subscriptions are removed on disable, along with any timers that the plugin
+		// created through its hooks and that have not yet been removed
+		AddSubscriptionsFunc add_subscriptions_func;
 	} FunctionTable;
 
 	struct info_type
 	{
+		// set from the headers the plugin was built with. It is first so that it can be
+		// read no matter what the rest of the struct looked like then.
+		uint32_t abi_version;
 		std::string id;
 		std::string name;
 		std::vector<std::string> authors;
 		Version version;
 		const FunctionTable *functions;
 		info_type(const std::string &id) :
+			abi_version(ABI_VERSION),
 			id(id),
 			name(""),
 			authors(),
@@ -114,6 +145,7 @@ namespace msa { namespace plugin {
 					const std::vector<std::string> &authors,
 					const Version version,
 					const FunctionTable *funcs) :
+			abi_version(ABI_VERSION),
 			id(id),
 			name(name),
 			authors(authors),
@@ -132,6 +164,12 @@ namespace msa { namespace plugin {
 	extern void unload(msa::Handle hdl, const std::string &id);
 	extern void enable(msa::Handle hdl, const std::string &id);
 	extern void disable(msa::Handle hdl, const std::string &id);
+	// replaces a plugin with a fresh load of its library, passing along its state
+	extern void reload(msa::Handle hdl, const std::string &id);
+	// saves which plugins are enabled, along with whatever their save_state_func gives.
+	// Restoring enables them again, calling restore_func in place of init_func.
+	extern void checkpoint(msa::Handle hdl, msa::checkpoint::Writer &out);
+	extern void restore(msa::Handle hdl, msa::checkpoint::Reader &in);
 	extern const PluginHooks *get_plugin_hooks();
 	
 	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
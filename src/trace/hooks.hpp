@@ -0,0 +1,16 @@
+// Functions in the trace module that dynamically-loaded modules (plugins) are allowed to call.
+
+// Define the MSA_MODULE_HOOK macro to arrange the hooks as needed, and then include this file.
+// MSA_MODULE_HOOK will declare hooks with the following arguments:
+// MSA_MODULE_HOOK(return-spec, func-name, ...) where ... is the arguments of the hook
+// This file should only be included from trace module code.
+
+#ifndef MSA_MODULE_HOOK
+	#error "cannot include trace hooks before MSA_MODULE_HOOK macro is defined"
+#endif
+
+MSA_MODULE_HOOK(bool, is_enabled, msa::Handle hdl)
+MSA_MODULE_HOOK(void, begin, msa::Handle hdl, const char *category, const char *name, const char *detail)
+MSA_MODULE_HOOK(void, end, msa::Handle hdl)
+MSA_MODULE_HOOK(void, instant, msa::Handle hdl, const char *category, const char *name, const char *detail)
+MSA_MODULE_HOOK(const char *, intern, msa::Handle hdl, const std::string &text)
@@ -0,0 +1,391 @@
+#include "trace/trace.hpp"
+#include "log/log.hpp"
+#include "util/string.hpp"
+#include "memory/memory.hpp"
+
+#include <set>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#include "platform/thread/thread.hpp"
+
+namespace msa { namespace trace {
+
+	static void plugin_begin(msa::Handle hdl, const char *category, const char *name, const char *detail);
+	static void plugin_instant(msa::Handle hdl, const char *category, const char *name, const char *detail);
+
+	// a plugin's strings go away when it is unloaded, but records are only read when the
+	// trace is written, so the plugin-facing begin and instant intern what they are given;
+	// keep these in the order of trace/hooks.hpp
+	static const PluginHooks HOOKS = {
+		is_enabled,
+		plugin_begin,
+		end,
+		plugin_instant,
+		intern
+	};
+
+	// a thread's first chunk is small, since most handler threads only record a few events;
+	// each chunk after it is twice as big up to the largest size
+	static const size_t FIRST_CHUNK_RECORDS = 64;
+	static const size_t MAX_CHUNK_RECORDS = 8192;
+	static const size_t MAX_CHUNKS = 256;
+	static const size_t THREAD_NAME_LEN = 32;
+
+	typedef std::chrono::steady_clock Clock;
+
+	// the phase is kept in the top byte of the time so that a record fits in 32 bytes
+	static const int PHASE_SHIFT = 56;
+	static const uint64_t NANOS_MASK = (UINT64_C(1) << PHASE_SHIFT) - 1;
+
+	typedef struct record_type
+	{
+		uint64_t nanos_and_phase;
+		const char *category;
+		const char *name;
+		const char *detail;
+	} Record;
+
+	typedef struct thread_buffer_type
+	{
+		int tid;
+		std::string thread_name;
+		Record *chunks[MAX_CHUNKS];
+		// only the owning thread adds records; these tell the writer how many there are
+		std::atomic<size_t> chunk_count;
+		std::atomic<size_t> used;
+		size_t capacity;
+		std::atomic<uint64_t> dropped;
+	} ThreadBuffer;
+
+	struct trace_context_type
+	{
+		// differs from every earlier context, so that a thread does not keep using the
+		// buffer it had in one that is gone
+		uint64_t id;
+		std::atomic<bool> enabled;
+		std::string path;
+		Clock::time_point start;
+		// how many more records may be allocated; it is taken a chunk at a time
+		std::atomic<int64_t> budget;
+		// guards buffers and names
+		msa::thread::Mutex mutex;
+		std::vector<ThreadBuffer *> buffers;
+		std::set<std::string> names;
+	};
+
+	static std::atomic<uint64_t> next_context_id(1);
+	static thread_local uint64_t local_context_id = 0;
+	static thread_local ThreadBuffer *local_buffer = NULL;
+
+	static int create_trace_context(TraceContext **ctx);
+	static void dispose_trace_context(TraceContext *ctx);
+	static void read_config(msa::Handle hdl, const msa::cfg::Section &config);
+	static void record(msa::Handle hdl, char phase, const char *category, const char *name, const char *detail);
+	static const char *intern_or_null(msa::Handle hdl, const char *text);
+	static ThreadBuffer *add_buffer(TraceContext *ctx);
+	static bool add_chunk(TraceContext *ctx, ThreadBuffer *buf);
+	static size_t chunk_size(size_t index);
+	static void write_trace(msa::Handle hdl);
+	static std::string format_record(const Record &r, int tid);
+
+	extern int init(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		if (create_trace_context(&hdl->trace) != 0)
+		{
+			msa::log::error(hdl, "Could not create trace context");
+			return 1;
+		}
+		try
+		{
+			read_config(hdl, config);
+		}
+		catch (const msa::cfg::config_error &e)
+		{
+			msa::log::error(hdl, "Could not read trace config: " + std::string(e.what()));
+			return 2;
+		}
+		if (hdl->trace->path != "")
+		{
+			msa::log::info(hdl, "Tracing to " + hdl->trace->path);
+			hdl->trace->enabled = true;
+		}
+		return 0;
+	}
+
+	extern int quit(msa::Handle hdl)
+	{
+		TraceContext *ctx = hdl->trace;
+		if (ctx->enabled)
+		{
+			ctx->enabled = false;
+			write_trace(hdl);
+		}
+		dispose_trace_context(ctx);
+		hdl->trace = NULL;
+		return 0;
+	}
+
+	extern const PluginHooks *get_plugin_hooks()
+	{
+		return &HOOKS;
+	}
+
+	extern bool is_enabled(msa::Handle hdl)
+	{
+		return hdl->trace != NULL && hdl->trace->enabled.load(std::memory_order_relaxed);
+	}
+
+	extern void begin(msa::Handle hdl, const char *category, const char *name, const char *detail)
+	{
+		record(hdl, 'B', category, name, detail);
+	}
+
+	extern void end(msa::Handle hdl)
+	{
+		record(hdl, 'E', NULL, NULL, NULL);
+	}
+
+	extern void instant(msa::Handle hdl, const char *category, const char *name, const char *detail)
+	{
+		record(hdl, 'i', category, name, detail);
+	}
+
+	extern const char *intern(msa::Handle hdl, const std::string &text)
+	{
+		TraceContext *ctx = hdl->trace;
+		if (ctx == NULL)
+		{
+			return "";
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		const char *interned = ctx->names.insert(text).first->c_str();
+		msa::thread::mutex_unlock(&ctx->mutex);
+		return interned;
+	}
+
+	static void plugin_begin(msa::Handle hdl, const char *category, const char *name, const char *detail)
+	{
+		if (is_enabled(hdl))
+		{
+			record(hdl, 'B', intern_or_null(hdl, category), intern_or_null(hdl, name), intern_or_null(hdl, detail));
+		}
+	}
+
+	static void plugin_instant(msa::Handle hdl, const char *category, const char *name, const char *detail)
+	{
+		if (is_enabled(hdl))
+		{
+			record(hdl, 'i', intern_or_null(hdl, category), intern_or_null(hdl, name), intern_or_null(hdl, detail));
+		}
+	}
+
+	static const char *intern_or_null(msa::Handle hdl, const char *text)
+	{
+		return (text != NULL) ? intern(hdl, text) : NULL;
+	}
+
+	static int create_trace_context(TraceContext **ctx_ptr)
+	{
+		TraceContext *ctx = new TraceContext;
+		if (msa::thread::mutex_init(&ctx->mutex, NULL) != 0)
+		{
+			delete ctx;
+			return 1;
+		}
+		ctx->id = next_context_id++;
+		ctx->enabled = false;
+		ctx->start = Clock::now();
+		ctx->budget = 0;
+		*ctx_ptr = ctx;
+		return 0;
+	}
+
+	static void dispose_trace_context(TraceContext *ctx)
+	{
+		for (size_t i = 0; i < ctx->buffers.size(); i++)
+		{
+			ThreadBuffer *buf = ctx->buffers[i];
+			for (size_t c = 0; c < buf->chunk_count; c++)
+			{
+				delete[] buf->chunks[c];
+			}
+			delete buf;
+		}
+		msa::thread::mutex_destroy(&ctx->mutex);
+		delete ctx;
+	}
+
+	static void read_config(msa::Handle hdl, const msa::cfg::Section &config)
+	{
+		TraceContext *ctx = hdl->trace;
+		ctx->path = config.get_or<std::string>("FILE", "");
+		config.check_range("MAX_EVENTS", 1000, 100000000, false);
+		ctx->budget = config.get_or("MAX_EVENTS", 1000000);
+	}
+
+	static void record(msa::Handle hdl, char phase, const char *category, const char *name, const char *detail)
+	{
+		TraceContext *ctx = hdl->trace;
+		if (ctx == NULL || !ctx->enabled.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		ThreadBuffer *buf = (local_context_id == ctx->id) ? local_buffer : add_buffer(ctx);
+		size_t used = buf->used.load(std::memory_order_relaxed);
+		if (used == buf->capacity)
+		{
+			if (!add_chunk(ctx, buf))
+			{
+				buf->dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			used = 0;
+		}
+		Record &r = buf->chunks[buf->chunk_count.load(std::memory_order_relaxed) - 1][used];
+		uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - ctx->start).count();
+		r.nanos_and_phase = (nanos & NANOS_MASK) | ((uint64_t) (unsigned char) phase << PHASE_SHIFT);
+		r.category = category;
+		r.name = name;
+		r.detail = detail;
+		buf->used.store(used + 1, std::memory_order_release);
+	}
+
+	// called the first time a thread records into the context
+	static ThreadBuffer *add_buffer(TraceContext *ctx)
+	{
+		msa::memory::Scope memory_scope(msa::memory::Tag::TRACE);
+		ThreadBuffer *buf = new ThreadBuffer;
+		char name[THREAD_NAME_LEN];
+		buf->thread_name = (msa::thread::get_name(msa::thread::self(), name, sizeof(name)) == 0) ? name : "thread";
+		buf->chunk_count = 0;
+		buf->used = 0;
+		buf->capacity = 0;
+		buf->dropped = 0;
+		msa::thread::mutex_lock(&ctx->mutex);
+		ctx->buffers.push_back(buf);
+		buf->tid = (int) ctx->buffers.size();
+		msa::thread::mutex_unlock(&ctx->mutex);
+		local_context_id = ctx->id;
+		local_buffer = buf;
+		return buf;
+	}
+
+	static bool add_chunk(TraceContext *ctx, ThreadBuffer *buf)
+	{
+		size_t index = buf->chunk_count.load(std::memory_order_relaxed);
+		if (index == MAX_CHUNKS)
+		{
+			return false;
+		}
+		int64_t size = (int64_t) chunk_size(index);
+		if (ctx->budget.fetch_sub(size, std::memory_order_relaxed) < size)
+		{
+			ctx->budget.fetch_add(size, std::memory_order_relaxed);
+			return false;
+		}
+		msa::memory::Scope memory_scope(msa::memory::Tag::TRACE);
+		buf->chunks[index] = new Record[size];
+		buf->capacity = (size_t) size;
+		buf->used.store(0, std::memory_order_relaxed);
+		buf->chunk_count.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	static size_t chunk_size(size_t index)
+	{
+		size_t size = FIRST_CHUNK_RECORDS;
+		for (size_t i = 0; i < index && size < MAX_CHUNK_RECORDS; i++)
+		{
+			size *= 2;
+		}
+		return size;
+	}
+
+	// writes to a temporary file first so that a trace that is being opened is never half written
+	static void write_trace(msa::Handle hdl)
+	{
+		TraceContext *ctx = hdl->trace;
+		std::string tmp_path = ctx->path + ".tmp";
+		FILE *fp = fopen(tmp_path.c_str(), "wb");
+		if (fp == NULL)
+		{
+			msa::log::warn(hdl, "Could not open " + tmp_path + " to write the trace");
+			return;
+		}
+		msa::thread::mutex_lock(&ctx->mutex);
+		std::vector<ThreadBuffer *> buffers = ctx->buffers;
+		msa::thread::mutex_unlock(&ctx->mutex);
+
+		uint64_t written = 0;
+		uint64_t dropped = 0;
+		fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n", fp);
+		fputs("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"moe-serifu\"}}", fp);
+		for (size_t i = 0; i < buffers.size(); i++)
+		{
+			const ThreadBuffer *buf = buffers[i];
+			std::string meta = ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " + std::to_string(buf->tid);
+			meta += ", \"args\": {\"name\": " + msa::string::json_quote(buf->thread_name) + "}}";
+			fputs(meta.c_str(), fp);
+			size_t chunks = buf->chunk_count.load(std::memory_order_acquire);
+			size_t last_used = buf->used.load(std::memory_order_acquire);
+			for (size_t c = 0; c < chunks; c++)
+			{
+				size_t count = (c + 1 < chunks) ? chunk_size(c) : last_used;
+				for (size_t r = 0; r < count; r++)
+				{
+					std::string line = ",\n" + format_record(buf->chunks[c][r], buf->tid);
+					fputs(line.c_str(), fp);
+					written++;
+				}
+			}
+			dropped += buf->dropped.load(std::memory_order_relaxed);
+		}
+		fputs("\n], \"otherData\": {\"dropped\": ", fp);
+		fputs(std::to_string(dropped).c_str(), fp);
+		fputs("}}\n", fp);
+
+		bool ok = (ferror(fp) == 0);
+		ok = (fclose(fp) == 0) && ok;
+		if (!ok || rename(tmp_path.c_str(), ctx->path.c_str()) != 0)
+		{
+			remove(tmp_path.c_str());
+			msa::log::warn(hdl, "Could not write the trace to " + ctx->path);
+			return;
+		}
+		msa::log::info(hdl, "Wrote " + std::to_string(written) + " trace events to " + ctx->path);
+		if (dropped > 0)
+		{
+			msa::log::warn(hdl, std::to_string(dropped) + " trace events were dropped after max_events was reached");
+		}
+	}
+
+	static std::string format_record(const Record &r, int tid)
+	{
+		char phase = (char) (r.nanos_and_phase >> PHASE_SHIFT);
+		uint64_t nanos = r.nanos_and_phase & NANOS_MASK;
+		// Chrome traces are in microseconds
+		std::string micros = std::to_string(nanos / 1000);
+		std::string frac = std::to_string(nanos % 1000);
+		std::string text = "{\"ph\": \"" + std::string(1, phase) + "\", \"ts\": " + micros + "." + std::string(3 - frac.size(), '0') + frac;
+		text += ", \"pid\": 1, \"tid\": " + std::to_string(tid);
+		if (phase != 'E')
+		{
+			text += ", \"cat\": " + msa::string::json_quote(r.category != NULL ? r.category : "");
+			text += ", \"name\": " + msa::string::json_quote(r.name != NULL ? r.name : "");
+		}
+		if (phase == 'i')
+		{
+			text += ", \"s\": \"t\"";
+		}
+		if (r.detail != NULL)
+		{
+			text += ", \"args\": {\"detail\": " + msa::string::json_quote(r.detail) + "}";
+		}
+		text += "}";
+		return text;
+	}
+
+} }
@@ -0,0 +1,38 @@
+#ifndef MSA_TRACE_TRACE_HPP
+#define MSA_TRACE_TRACE_HPP
+
+#include "msa.hpp"
+#include "cfg/cfg.hpp"
+
+#include <string>
+
+// An opt-in tracer that records spans and instant events from every thread, and writes
+// them as a Chrome trace (which Perfetto also opens) when the instance quits. Each thread
+// records into its own buffer, so recording takes no lock. When no trace file is
+// configured, every function returns at once.
+//
+// Names, categories and details are kept as pointers until the trace is written, so
+// they must be string literals or come from intern(); plugins' strings are interned for
+// them, since they would not outlive the plugin. A span is ended by the next end()
+// on the same thread, so spans must nest within each thread.
+
+namespace msa { namespace trace {
+
+	extern int init(msa::Handle hdl, const msa::cfg::Section &config);
+	extern int quit(msa::Handle hdl);
+	extern const PluginHooks *get_plugin_hooks();
+
+	#define MSA_MODULE_HOOK(retspec, name, ...)	extern retspec name(__VA_ARGS__);
+	#include "trace/hooks.hpp"
+	#undef MSA_MODULE_HOOK
+
+	struct plugin_hooks_type
+	{
+		#define MSA_MODULE_HOOK(retspec, name, ...)		retspec (*name)(__VA_ARGS__);
+		#include "trace/hooks.hpp"
+		#undef MSA_MODULE_HOOK
+	};
+
+} }
+
+#endif
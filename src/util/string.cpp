@@ -107,6 +107,33 @@ namespace msa { namespace string {
 		return (str.compare(0, prefix.size(), prefix) == 0);
 	}
 
+	extern String json_quote(const String &str)
+	{
+		static const char HEX[] = "0123456789abcdef";
+		String quoted = "\"";
+		for (size_t i = 0; i < str.size(); i++)
+		{
+			unsigned char c = (unsigned char) str[i];
+			if (c == '"' || c == '\\')
+			{
+				quoted += '\\';
+				quoted += (char) c;
+			}
+			else if (c < 0x20)
+			{
+				quoted += "\\u00";
+				quoted += HEX[c >> 4];
+				quoted += HEX[c & 0xf];
+			}
+			else
+			{
+				quoted += (char) c;
+			}
+		}
+		quoted += '"';
+		return quoted;
+	}
+
 #ifdef DEBUG
 	extern const char *dump(const String &str)
 	{
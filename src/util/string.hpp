@@ -18,6 +18,8 @@ namespace msa { namespace string {
 	extern void tokenize(const String &str, char separator, std::vector<String> &output);
 	extern bool ends_with(const String &str, const String &suffix);
 	extern bool starts_with(const String &str, const String &prefix);
+	// gives the string as a quoted JSON string
+	extern String json_quote(const String &str);
 
 #ifdef DEBUG
 	// only included for use with gdb in an environment where it doesn't have std::string's
@@ -74,6 +74,11 @@ namespace msa { namespace var {
 	{
 		return ex->substitutions.find(var) != ex->substitutions.end();
 	}
+
+	extern bool is_external(const Expander *ex, const std::string &var)
+	{
+		return is_registered(ex, var) && ex->substitutions.at(var).external;
+	}
 	
 	extern void set_value(Expander *ex, const std::string &var, const std::string &value)
 	{
@@ -220,6 +225,11 @@ namespace msa { namespace var {
 					(*pos)++;
 				}
 			}
+			else
+			{
+				// identifiers cannot start with a digit, so this is not a variable
+				(*pos)++;
+			}
 		}
 		return found;
 	}
@@ -13,6 +13,7 @@ namespace msa { namespace var {
 	extern void register_internal(Expander *ex, const std::string &var);
 	extern void unregister_internal(Expander *ex, const std::string &var);
 	extern bool is_registered(const Expander *ex, const std::string &var);
+	extern bool is_external(const Expander *ex, const std::string &var);
 	extern void set_value(Expander *ex, const std::string &var, const std::string &value);
 	extern const std::string &get_value(const Expander *ex, const std::string &var);
 	extern void register_external(Expander *ex, const std::string &var, std::string *value_ptr);